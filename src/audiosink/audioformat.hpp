@@ -6,9 +6,11 @@
 #include <QtCore>
 #include <utility>
 #include "portaudio.h"
+#include "dsp/pcmkernels.hpp"
 
 INCLUDE_FFMPEG_BEGIN
 #include "libavutil/samplefmt.h"
+#include "libavutil/channel_layout.h"
 INCLUDE_FFMPEG_END
 
 
@@ -21,13 +23,13 @@ struct AudioDataInfo {
 
 struct PonySampleFormat {
 private:
-    using TransformFunc = std::function<void(std::byte *, qreal, unsigned long)>;
+    using TransformFunc = void (*)(std::byte *, qreal, unsigned long);
 
     int m_index;
     PaSampleFormat m_paSampleFormat;
     AVSampleFormat m_ffmpegSampleFormat;
     int m_bytesPerSample;
-    std::function<void(std::byte *, qreal, unsigned long)> m_transform;
+    TransformFunc m_transform;
 
 
     PonySampleFormat(
@@ -40,7 +42,7 @@ private:
         m_paSampleFormat(paSampleFormat),
         m_ffmpegSampleFormat(ffmpegSampleFormat),
         m_bytesPerSample(bytesPerSample),
-        m_transform(std::move(transformFunc)) {}
+        m_transform(transformFunc) {}
 
 public:
     template<class T>
@@ -56,9 +58,7 @@ public:
         } else {
             transform = [](std::byte *src_, qreal factor, unsigned long samples) {
                 T *src = static_cast<T *>(static_cast<void *>(src_));
-                for (size_t sampleOffset = 0; sampleOffset < samples; sampleOffset++) {
-                    src[sampleOffset] = static_cast<T>(src[sampleOffset] * factor);
-                }
+                PcmKernels::gain<T>(src, samples, static_cast<float>(factor));
             };
             size = sizeof(T);
         }
@@ -99,14 +99,17 @@ private:
     PonySampleFormat m_sampleFormat;
     int m_sampleRate;
     int m_channelCount;
+    uint64_t m_channelLayout; // 0 表示声道数对应的默认布局
 
 public:
 
     PonyAudioFormat(
             PonySampleFormat sampleFormat,
             int sampleRate,
-            int channelCount
-    ) noexcept: m_sampleFormat(std::move(sampleFormat)), m_sampleRate(sampleRate), m_channelCount(channelCount) {}
+            int channelCount,
+            uint64_t channelLayout = 0
+    ) noexcept: m_sampleFormat(std::move(sampleFormat)), m_sampleRate(sampleRate), m_channelCount(channelCount),
+                m_channelLayout(channelLayout) {}
 
 
     [[nodiscard]] const PonySampleFormat &getSampleFormat() const { return m_sampleFormat; }
@@ -143,6 +146,13 @@ public:
         return m_channelCount;
     }
 
+    /**
+     * 声道布局, 位定义与 AV_CH_* 相同. 没有指定时返回声道数对应的默认布局
+     */
+    [[nodiscard]] uint64_t getChannelLayout() const {
+        return m_channelLayout ? m_channelLayout : static_cast<uint64_t>(av_get_default_channel_layout(m_channelCount));
+    }
+
     [[nodiscard]] int64_t suggestedRingBuffer(qreal speedFactor) const {
         return qBound<int64_t>(
                 static_cast<int64_t>(2 * 1024 * m_channelCount * m_sampleFormat.getBytesPerSample()),
@@ -159,10 +169,18 @@ namespace AnytMusic {
     const PonySampleFormat UInt8 = PonySampleFormat::of<uint8_t>(paUInt8, AV_SAMPLE_FMT_U8);
     const PonySampleFormat Int16 = PonySampleFormat::of<int16_t>(paInt16, AV_SAMPLE_FMT_S16);
     const PonySampleFormat Int32 = PonySampleFormat::of<int32_t>(paInt32, AV_SAMPLE_FMT_S32);
-    const PonySampleFormat Float = PonySampleFormat::of<float_t>(paFloat32, AV_SAMPLE_FMT_FLT);
+    const PonySampleFormat Float = PonySampleFormat::of<float>(paFloat32, AV_SAMPLE_FMT_FLT);
 #pragma GCC diagnostic pop
     const PonyAudioFormat DEFAULT_AUDIO_FORMAT = {Int16, 44100, 2};
 
+    /**
+     * 解码器报告的声道布局可能为 0 或者与声道数不符, 这时使用声道数对应的默认布局
+     */
+    static uint64_t channelLayoutOf(uint64_t layout, int channels) {
+        if (layout && av_get_channel_layout_nb_channels(layout) == channels) { return layout; }
+        return static_cast<uint64_t>(av_get_default_channel_layout(channels));
+    }
+
     static PonySampleFormat valueOf(AVSampleFormat ffmpegFormat) {
         switch (ffmpegFormat) {
             case AV_SAMPLE_FMT_U8:
@@ -5,16 +5,30 @@
 #include <utility>
 #include <vector>
 #include <QBuffer>
+#include <QCoreApplication>
 #include <QDebug>
+#include <QFile>
+#include <QSettings>
+#include <QTimer>
 #include "pa_ringbuffer.h"
 #include "pa_util.h"
 #include "readerwriterqueue.h"
-#include "sonic.h"
 #include "audioformat.hpp"
-#include "private/hotplug.hpp"
+#include "private/devicecatalogue.hpp"
+#include "private/audiobackend.hpp"
+#include "private/audioclock.hpp"
+#include "private/telemetry.hpp"
+#include "private/latencyprofile.hpp"
+#include "dsp/timestretch.hpp"
+#include "dsp/effectchain.hpp"
+#include "dsp/equalizer.hpp"
+#include "dsp/convolver.hpp"
+#include "dsp/replaygain.hpp"
+#include "dsp/channelmixer.hpp"
 #include "ponyplayer.h"
 #include <mutex>
 #include <shared_mutex>
+#include <thread>
 
 enum class PlaybackState {
     PLAYING, ///< 正在播放
@@ -39,32 +53,104 @@ class PonyAudioSink : public QObject {
     Q_OBJECT
 private:
 
+    /**
+     * 每个 PortAudio 流对应一个上下文. 切换设备时新旧两个流会同时存在, 只有 generation 与 m_activeGeneration
+     * 相同的流可以读取 DataBuffer, 其余的流输出静音.
+     */
+    struct StreamContext {
+        PonyAudioSink *sink;
+        uint32_t generation;
+        PaStream *stream = nullptr;
+    };
+
+    std::unique_ptr<IAudioBackend> m_backend;
     PaStream *m_stream{};
-    PaStreamParameters *param{};
+    StreamContext *m_streamContext = nullptr;
+    uint32_t m_nextGeneration = 1;
+    std::atomic<uint32_t> m_activeGeneration = 0; // 0 表示没有流可以读取 DataBuffer
+    std::atomic<uint32_t> m_ringReader = 0;       // 正在读取 DataBuffer 的流, 0 表示没有
     qreal m_volume, m_pitch;
     PlaybackState m_state;
     std::atomic<bool> m_pauseRequested = false; // 当播放完缓存的音频后停止
-    HotPlugDetector *hotPlugDetector;
-    QList<QString> devicesList;
     QString selectedOutputDevice;
-    inline static std::mutex paStreamLock;
-    inline static std::atomic_bool paInitialized = false;
+    int m_resetListenerId = -1;
 
-    PonyAudioFormat m_format;
-    PonyAudioFormat m_deviceFormat;
+    PonyAudioFormat m_format;       // 处理链和流的格式
+    PonyAudioFormat m_sourceFormat; // write 收到的数据的格式, 声道布局可能与 m_format 不同
+    PonyAudioFormat m_deviceFormat; // 解码器应该输出的格式: 流的采样率, 源的声道布局
     size_t m_bufferMaxBytes;
-    size_t m_sonicBufferMaxBytes;
-    qreal m_speedFactor;
+    size_t m_stretchBufferMaxBytes;
+    std::atomic<qreal> m_speedFactor;
     PaUtilRingBuffer m_ringBuffer{};
-    std::byte *m_ringBufferData;
+    std::byte *m_ringBufferData = nullptr;
     moodycamel::ReaderWriterQueue<AudioDataInfo> dataInfoQueue;
 
-    sonicStream sonStream;
-    std::byte *sonicBuffer = nullptr;
+    std::unique_ptr<ITimeStretcher> m_stretcher;
+    std::atomic<TimeStretch::Engine> m_stretchEngine = TimeStretch::Engine::Sonic;
+    std::atomic<TimeStretch::Quality> m_stretchQuality = TimeStretch::Quality::Balanced;
+    std::byte *m_stretchBuffer = nullptr;
+
+    /**
+     * 最近写入的 1x 原始数据, 坐标与 m_dataWritten 相同. 改变速度时从这里重新处理还没有播放的部分.
+     */
+    std::vector<std::byte> m_sourceHistory;
+    std::vector<std::byte> m_feedBuffer;
+    int64_t m_sourceWritten = 0; // 收到的 1x 数据
+    int64_t m_sourceFed = 0;     // 已经送入变速引擎的 1x 数据
+    int64_t m_fadeInFrames = 0;  // 重新处理后还需要淡入的帧数
+
+    /**
+     * 源的声道布局与输出不同时的缩混矩阵, 行优先, 为空时直接输出. 由 m_pipelineMutex 保护.
+     */
+    ChannelMixSettings m_channelMix;
+    std::vector<float> m_channelMatrix;
+    std::vector<float> m_remixIn;
+    std::vector<float> m_remixOut;
+    std::vector<int16_t> m_remixed;
+
+    AudioEffectChain m_effects;
+    std::shared_ptr<ReplayGainEffect> m_replayGain;
+    std::shared_ptr<ParametricEqualizer> m_equalizer;
+    std::shared_ptr<ConvolutionEffect> m_convolver;
+
+    /**
+     * 保护 m_sourceHistory, 变速引擎, 效果器链和 DataBuffer 的写入端. 写入数据, 清空缓冲区以及修改速度, 音调,
+     * 音量时持有. 需要同时持有 backendLock 时先获取这个锁.
+     */
+    mutable std::mutex m_pipelineMutex;
 
     PaTime m_startPoint = 0.0;
     std::atomic<int64_t> m_dataWritten = 0;
-    std::atomic<int64_t> m_dataLastWrote = 0;
+
+    /**
+     * 交叉淡化时切换时间基准: 播放到 m_rebaseBytes 之后, 时间从 m_rebasePoint 开始计算. 坐标与 m_dataWritten 相同,
+     * 为 NO_REBASE 时没有切换.
+     */
+    constexpr static int64_t NO_REBASE = std::numeric_limits<int64_t>::max();
+    std::atomic<int64_t> m_rebaseBytes = NO_REBASE;
+    std::atomic<PaTime> m_rebasePoint = 0.0;
+    std::atomic<int64_t> m_rebaseReported = NO_REBASE;
+
+    AudioClock m_clock;
+    PaTime m_streamLatency = 0.0;
+    double m_streamSampleRate = 0.0;
+    std::atomic<qreal> m_latencyOffset = 0.0;
+    double m_stretchCarry = 0.0;
+
+    AudioTelemetry m_telemetry;
+    AudioTelemetrySnapshot m_lastReported;
+    QTimer *m_telemetryTimer;
+
+    AudioLatencyConfig m_latencyConfig;
+    std::atomic<AudioLatencyProfile> m_latencyProfile = AudioLatencyProfile::Balanced;
+    RingBufferSizer m_ringSizer;
+    std::atomic<double> m_ringSecs = 0.0; // m_ringSizer.secs(), 供 DSP 线程读取
+    AudioTelemetrySnapshot m_lastAdapted;
+    QTimer *m_adaptTimer;
+
+    std::atomic<bool> m_gated = false; // 暂停时流仍在运行, 回调只输出静音, 不读取 DataBuffer
+    int m_keepAliveMs = 0;             // 暂停后保持流运行的时间, 0 表示暂停时立即停止流
+    QTimer *m_idleTimer;
 
 
     std::atomic<bool> m_blockingState = false;
@@ -82,19 +168,54 @@ private:
 
     }
 
-    int m_paCallback(const void *inputBuffer, void *outputBuffer, unsigned long framesPerBuffer,
-                     const PaStreamCallbackTimeInfo *timeInfo) {
+    /**
+     * PortAudio 回调, 运行在实时线程上. 这里不能加锁, 不能分配内存, 也不能输出日志, 异常情况只记录到 m_telemetry 中,
+     * 由 reportTelemetry 在 Playback 线程上输出.
+     */
+    int m_paCallback(const StreamContext *ctx, void *outputBuffer, unsigned long framesPerBuffer,
+                     const PaStreamCallbackTimeInfo *timeInfo, PaStreamCallbackFlags statusFlags) {
+        // DataBuffer 只允许一个读者, 抢占 m_ringReader 后需要再次检查, 避免与 activateStream 交错
+        uint32_t idle = 0;
+        if (ctx->generation == m_activeGeneration.load(std::memory_order_acquire)
+            && m_ringReader.compare_exchange_strong(idle, ctx->generation, std::memory_order_acquire)) {
+            int result = paContinue;
+            if (ctx->generation == m_activeGeneration.load(std::memory_order_acquire)) {
+                result = m_fillOutputBuffer(ctx->stream, outputBuffer, framesPerBuffer, timeInfo, statusFlags);
+            } else {
+                memset(outputBuffer, 0, framesPerBuffer * static_cast<unsigned long>(m_format.getBytesPerSampleChannels()));
+            }
+            m_ringReader.store(0, std::memory_order_release);
+            return result;
+        }
+        memset(outputBuffer, 0, framesPerBuffer * static_cast<unsigned long>(m_format.getBytesPerSampleChannels()));
+        return paContinue;
+    }
+
+    int m_fillOutputBuffer(PaStream *stream, void *outputBuffer, unsigned long framesPerBuffer,
+                           const PaStreamCallbackTimeInfo *timeInfo, PaStreamCallbackFlags statusFlags) {
+        auto callbackBegin = AudioTelemetry::Clock::now();
         ring_buffer_size_t bytesAvailCount = PaUtil_GetRingBufferReadAvailable(&m_ringBuffer);
+        m_telemetry.recordFill(bytesAvailCount, static_cast<int64_t>(m_bufferMaxBytes));
+        m_telemetry.recordLevel(m_format.durationOfBytes(bytesAvailCount));
+        if (statusFlags & paOutputUnderflow) { m_telemetry.recordDeviceUnderflow(); }
         auto bytesNeeded = static_cast<ring_buffer_size_t>(framesPerBuffer *
                                                            static_cast<unsigned long>(m_format.getBytesPerSampleChannels()));
-        if (m_blockingState) {
+        PaTime streamTime = timeInfo->currentTime > 0 ? timeInfo->currentTime : m_backend->streamTime(stream);
+        m_clock.syncStreamTime(streamTime);
+        // 这次回调的第一个样本从扬声器输出的时刻, 部分 Host API 不提供 DAC 时间, 使用当前时间加上输出延迟估计
+        PaTime dacTime = timeInfo->outputBufferDacTime;
+        if (dacTime <= 0) { dacTime = streamTime + m_streamLatency; }
+        if (m_blockingState || m_gated) {
             memset(outputBuffer, 0, static_cast<size_t>(bytesNeeded));
+            m_telemetry.recordSilent();
         } else if (bytesAvailCount == 0) {
             memset(outputBuffer, 0, static_cast<size_t>(bytesNeeded));
+            m_clock.publish(dacTime, m_dataWritten, 0, 0.0);
             if (m_pauseRequested) {
+                m_telemetry.recordCallback(callbackBegin);
                 return paComplete;
             } else {
-                qWarning() << "paAbort bytesAvailCount == 0";
+                m_telemetry.recordUnderrun();
             }
         } else {
             ring_buffer_size_t timeAlignedByteWritten = 0; // 透明化加速的影响，表示在1x速度下，理应有多少个Byte被写入
@@ -118,88 +239,200 @@ private:
                 }
             }
             if (bytesNeeded > bytesAvailCount) {
-                qWarning() << "paAbort bytesAvailCount < bytesNeeded";
+                if (!m_pauseRequested) { m_telemetry.recordPartialFill(); }
                 PaUtil_ReadRingBuffer(&m_ringBuffer, outputBuffer, bytesAvailCount);
                 memset(static_cast<std::byte *>(outputBuffer) + byteToBeWritten, 0,
                        static_cast<size_t>(bytesNeeded - byteToBeWritten));
             } else {
                 PaUtil_ReadRingBuffer(&m_ringBuffer, outputBuffer, byteToBeWritten);
             }
+            auto framesWritten = static_cast<double>(byteToBeWritten / m_format.getBytesPerSampleChannels());
+            m_clock.publish(dacTime, m_dataWritten, timeAlignedByteWritten, framesWritten / m_streamSampleRate);
             m_dataWritten += timeAlignedByteWritten;
-            m_dataLastWrote = timeAlignedByteWritten;
         }
+        m_telemetry.recordCallback(callbackBegin);
         return paContinue;
     }
 
     PaError startStreamSafe() {
-        PaError err = Pa_StopStream(m_stream);
+        // 还没有可用的流时只记录状态, 流打开后由 onDevicesChanged 启动
+        if (!m_stream) { return paNoError; }
+        PaError err = m_backend->stopStream(m_stream);
         if (err != paStreamIsStopped && err != paNoError) {
             return err;
         }
-        return Pa_StartStream(m_stream);
+        return m_backend->startStream(m_stream);
+    }
+
+
+    /**
+     * 让回调只输出静音, 并等待正在读取 DataBuffer 的回调退出. 之后回调不再读取 DataBuffer, 也不再发布时钟锚点,
+     * 播放位置停在已经输出的位置. 需要持有 backendLock.
+     */
+    void gate() {
+        m_gated = true;
+        while (m_ringReader.load(std::memory_order_acquire) != 0) { std::this_thread::yield(); }
+    }
+
+    /**
+     * 暂停后流保持运行的时间到期, 停止流以释放设备. 之后的 start 重新启动流.
+     */
+    void onIdleTimeout() {
+        std::lock_guard lock(AudioDeviceCatalogue::backendLock());
+        if (!m_gated || m_state != PlaybackState::PAUSED) { return; }
+        if (m_stream) { m_backend->stopStream(m_stream); }
+        m_gated = false;
+        qDebug() << "Audio stream idle for" << m_keepAliveMs << "ms, stopped.";
     }
 
+    static int loadKeepAliveMs() {
+        QSettings settings(AnytMusic::getConfigFile(), QSettings::IniFormat);
+        double secs = settings.value("Audio/keepAliveSecs", DEFAULT_KEEP_ALIVE_SECS).toDouble();
+        return static_cast<int>(std::clamp(secs, 0.0, 3600.0) * 1000);
+    }
 
     static void printError(PaError error) {
         qDebug() << "Error" << Pa_GetErrorText(error);
     }
 
-    PaDeviceIndex getCurrentOutputDeviceIndex() {
-        int deviceCount = Pa_GetDeviceCount();
-        for (auto index = 0; index < deviceCount; index++) {
-            auto *device = Pa_GetDeviceInfo(index);
-            if (strcmp(device->name, selectedOutputDevice.toStdString().data()) == 0 && device->maxOutputChannels > 0) {
-                return index;
-            }
+    /**
+     * 在指定设备上打开一个新的流, 不影响当前的流. 需要持有 backendLock.
+     * @param device 设备, 必须来自持有 backendLock 时读取的快照
+     * @return 新的流的上下文, 失败时返回 nullptr
+     */
+    StreamContext *openStream(const AudioDeviceInfo &device) {
+        PaStreamParameters param;
+        param.device = device.index;
+        param.channelCount = m_format.getChannelCount();
+        param.sampleFormat = m_format.getSampleFormatForPA();
+        if (m_latencyConfig.suggestedLatency > 0) {
+            param.suggestedLatency = m_latencyConfig.suggestedLatency;
+        } else {
+            param.suggestedLatency = m_latencyConfig.preferHighLatency ? device.defaultHighOutputLatency
+                                                                       : device.defaultLowOutputLatency;
         }
-        return Pa_GetDefaultOutputDevice();
-    }
-
-    // this should be guarded by paStreamLock
-    void initializeStream() {
-        if (!paInitialized) {
-            Pa_Initialize();
-            paInitialized = true;
-            qDebug() << "Initialize PonyAudioSink backend.";
-        }
-        param = new PaStreamParameters;
-        if (selectedOutputDevice.isNull()) {
-            _getDeviceList();
-            selectedOutputDevice = Pa_GetDeviceInfo(Pa_GetDefaultOutputDevice())->name;
-        }
-        param->device = getCurrentOutputDeviceIndex();
-        selectedOutputDevice = Pa_GetDeviceInfo(param->device)->name;
-        param->channelCount = m_format.getChannelCount();
-        if (param->device == paNoDevice)
-            ILLEGAL_STATE("no audio device!");
-        param->channelCount = m_format.getChannelCount();
-        param->sampleFormat = m_format.getSampleFormatForPA();
-        param->suggestedLatency = Pa_GetDeviceInfo(param->device)->defaultLowOutputLatency;
-        param->hostApiSpecificStreamInfo = nullptr;
-        ASSERT_PA_OK(
-                Pa_OpenStream(&m_stream, nullptr, param, m_format.getSampleRate(), paFramesPerBufferUnspecified,
-                              paClipOff,
-                              [](
-                                      const void *inputBuffer,
-                                      void *outputBuffer,
-                                      unsigned long framesPerBuffer,
-                                      const PaStreamCallbackTimeInfo *timeInfo,
-                                      PaStreamCallbackFlags statusFlags,
-                                      void *userData
-                              ) {
-                                  return static_cast<PonyAudioSink *>(userData)->m_paCallback(inputBuffer, outputBuffer,
-                                                                                              framesPerBuffer,
-                                                                                              timeInfo);
-                              }, this),
-                "Can not open audio stream!"
-        )
-        const PaStreamInfo *info = Pa_GetStreamInfo(m_stream);
+        param.hostApiSpecificStreamInfo = nullptr;
+        unsigned long framesPerBuffer = m_latencyConfig.framesPerBuffer > 0 ? m_latencyConfig.framesPerBuffer
+                                                                            : paFramesPerBufferUnspecified;
+        auto *ctx = new StreamContext{this, m_nextGeneration++};
+        PaError err = m_backend->openStream(&ctx->stream, param, m_format.getSampleRate(), framesPerBuffer,
+                                            [](
+                                                    const void *inputBuffer,
+                                                    void *outputBuffer,
+                                                    unsigned long framesPerBuffer,
+                                                    const PaStreamCallbackTimeInfo *timeInfo,
+                                                    PaStreamCallbackFlags statusFlags,
+                                                    void *userData
+                                            ) {
+                                                auto *context = static_cast<StreamContext *>(userData);
+                                                return context->sink->m_paCallback(context, outputBuffer,
+                                                                                   framesPerBuffer, timeInfo,
+                                                                                   statusFlags);
+                                            }, ctx);
+        if (err == paNoError) {
+            err = m_backend->setStreamFinishedCallback(ctx->stream, [](void *userData) {
+                auto *context = static_cast<StreamContext *>(userData);
+                // 被替换的流停止时不影响播放状态
+                if (context->generation == context->sink->m_activeGeneration) {
+                    context->sink->m_paStreamFinishedCallback();
+                }
+            });
+        }
+        if (err != paNoError) {
+            qWarning() << "Can not open audio stream on" << device.name << Pa_GetErrorText(err);
+            if (ctx->stream) { m_backend->closeStream(ctx->stream); }
+            delete ctx;
+            return nullptr;
+        }
+        return ctx;
+    }
+
+    /**
+     * 让 ctx 对应的流成为 DataBuffer 的读者, 之后其他流只输出静音, 由调用者负责关闭. 需要持有 backendLock.
+     * @param ctx 新的流
+     */
+    void activateStream(StreamContext *ctx) {
+        // 先禁止所有流读取 DataBuffer 并等待正在读取的回调退出, 之后才能安全地修改回调使用的参数
+        m_activeGeneration.store(0, std::memory_order_release);
+        while (m_ringReader.load(std::memory_order_acquire) != 0) { std::this_thread::yield(); }
+        m_stream = ctx->stream;
+        m_streamContext = ctx;
+        m_gated = false;
+        const PaStreamInfo *info = m_backend->streamInfo(m_stream);
         m_deviceFormat = PonyAudioFormat(AnytMusic::Int16, static_cast<int>(info->sampleRate),
-                                         param->channelCount);
-        ASSERT_PA_OK(Pa_SetStreamFinishedCallback(m_stream, [](void *userData) {
-            static_cast<PonyAudioSink *>(userData)->m_paStreamFinishedCallback();
-        }), "Can not set stream callback!")
+                                         m_sourceFormat.getChannelCount(), m_sourceFormat.getChannelLayout());
+        // 新的流有独立的流时间, 旧的锚点不再有效
+        m_clock.reset();
+        m_streamLatency = info->outputLatency;
+        m_streamSampleRate = info->sampleRate;
+        m_latencyOffset = loadLatencyOffset(selectedOutputDevice);
+        qDebug() << "Stream output latency" << m_streamLatency << "s, device offset" << m_latencyOffset.load() << "s,"
+                 << AudioLatencyConfig::nameOf(m_latencyConfig.profile) << "profile with"
+                 << m_latencyConfig.framesPerBuffer << "frames per buffer";
+        m_activeGeneration.store(ctx->generation, std::memory_order_release);
+    }
+
+    /**
+     * 停止并关闭流, 释放上下文. 需要持有 backendLock.
+     * @param ctx 流的上下文, 可以为 nullptr. PortAudio 重新初始化后 ctx->stream 为 nullptr, 只释放上下文
+     */
+    void releaseStream(StreamContext *ctx) {
+        if (!ctx) { return; }
+        if (ctx->stream) {
+            m_backend->abortStream(ctx->stream);
+            PaError err = m_backend->closeStream(ctx->stream);
+            if (err != paNoError) { qWarning() << "Error at closing stream:" << Pa_GetErrorText(err); }
+        }
+        delete ctx;
+    }
+
+    /**
+     * 关闭当前的流, 不改变播放状态. 需要持有 backendLock.
+     */
+    void closeStream() {
+        m_activeGeneration = 0;
+        m_gated = false;
+        releaseStream(m_streamContext);
+        m_streamContext = nullptr;
+        m_stream = nullptr;
+    }
+
+    /**
+     * 在选择的设备上打开流, 设备不存在时使用默认设备. 当前的流需要已经由调用者关闭. 需要持有 backendLock.
+     * @return 是否成功打开, 失败时没有可用的流, 直到设备列表下一次改变
+     */
+    bool initializeStream() {
+        auto snapshot = m_backend->snapshot();
+        if (!snapshot) {
+            qWarning() << "Audio backend is not available.";
+            return false;
+        }
+        const AudioDeviceInfo *device = selectedDevice(snapshot.get());
+        if (!device) {
+            qWarning() << "No audio device!";
+            return false;
+        }
+        selectedOutputDevice = device->name;
+        StreamContext *ctx = openStream(*device);
+        if (!ctx) { return false; }
+        activateStream(ctx);
+        return true;
+    }
+
+    /**
+     * PortAudio 即将重新初始化, 放弃当前的流. 运行在设备目录线程上, 调用时持有 backendLock.
+     */
+    void onBackendReset() {
+        m_activeGeneration.store(0, std::memory_order_release);
+        while (m_ringReader.load(std::memory_order_acquire) != 0) { std::this_thread::yield(); }
+        // Pa_Terminate 会关闭所有的流, 这里只需要丢弃句柄, 上下文留给 closeStream 释放
+        if (m_streamContext) { m_streamContext->stream = nullptr; }
+        m_stream = nullptr;
+    }
 
+    static bool isSameFormat(const PonyAudioFormat &a, const PonyAudioFormat &b) {
+        return a.getSampleFormat() == b.getSampleFormat() && a.getSampleRate() == b.getSampleRate()
+               && a.getChannelCount() == b.getChannelCount() && a.getChannelLayout() == b.getChannelLayout();
     }
 
     QString stateToStr() {
@@ -214,6 +447,328 @@ private:
         return "UNKNOWN";
     }
 
+    static QString latencyOffsetKey(const QString &device) {
+        QString key = device;
+        key.replace('/', '_').replace('\\', '_');
+        return "AudioLatencyOffset/" + key;
+    }
+
+    static qreal loadLatencyOffset(const QString &device) {
+        QSettings settings(AnytMusic::getConfigFile(), QSettings::IniFormat);
+        return settings.value(latencyOffsetKey(device), 0.0).toDouble();
+    }
+
+    /**
+     * 从扬声器输出的数据量, 按 1x 速度折算
+     * @return 单位: byte
+     */
+    [[nodiscard]] double playedBytes() const {
+        double bytes;
+        // 效果器(如卷积)的延迟使内容比 DataBuffer 晚输出
+        if (m_clock.bytesAt(m_clock.streamNow() - m_latencyOffset - m_effects.latencySecs(), bytes)) {
+            return bytes;
+        }
+        return static_cast<double>(m_dataWritten);
+    }
+
+    /**
+     * 输出上一次报告以来的回调统计, 只有出现异常时才输出警告
+     */
+    void reportTelemetry() {
+        AudioTelemetrySnapshot current = m_telemetry.snapshot();
+        AudioTelemetrySnapshot delta = current.since(m_lastReported);
+        m_lastReported = current;
+        if (delta.underruns == 0 && delta.partialFills == 0 && delta.deviceUnderflows == 0) { return; }
+        qWarning().nospace() << "Audio callback: " << delta.callbacks << " callbacks, "
+                             << delta.underruns << " underruns, "
+                             << delta.partialFills << " partial fills, "
+                             << delta.deviceUnderflows << " device underflows, p99 duration "
+                             << delta.durationQuantileMicros(0.99) << "us, max duration "
+                             << static_cast<double>(current.maxCallbackNanos) / 1000 << "us";
+    }
+
+    /**
+     * 根据上一次调整以来的欠载情况调整 DataBuffer 的可用长度. 暂停和禁用音频时的欠载不计入.
+     */
+    void adaptRingBuffer() {
+        AudioTelemetrySnapshot current = m_telemetry.snapshot();
+        AudioTelemetrySnapshot delta = current.since(m_lastAdapted);
+        m_lastAdapted = current;
+        if (m_state != PlaybackState::PLAYING || m_blockingState) { return; }
+        if (m_ringSizer.update(delta.underruns + delta.partialFills, RING_ADAPT_INTERVAL_MS / 1000.0)) {
+            m_ringSecs = m_ringSizer.secs();
+            qDebug() << "Audio ring buffer resized to" << m_ringSizer.secs() << "s ("
+                     << ringTargetBytes() << "of" << m_bufferMaxBytes << "bytes)";
+        }
+    }
+
+    /**
+     * DataBuffer 当前允许写入的总长度. 倍速播放时按速度放大, 使 DataBuffer 覆盖的媒体时长不随速度缩短.
+     * @return 单位: byte
+     */
+    [[nodiscard]] int64_t ringTargetBytes() const {
+        auto target = m_format.bytesOfDuration(m_ringSecs * std::max<qreal>(1.0, m_speedFactor));
+        return std::min(target, static_cast<int64_t>(m_bufferMaxBytes));
+    }
+
+    /**
+     * 丢弃变速引擎内部缓存的数据
+     */
+    void discardStretcher() {
+        m_stretcher->clear();
+        m_effects.reset();
+        m_stretchCarry = 0.0;
+    }
+
+    /**
+     * 丢弃 DataBuffer 中的数据. 调用时回调不能读取 DataBuffer.
+     */
+    void discardRingBuffer() {
+        PaUtil_FlushRingBuffer(&m_ringBuffer);
+        while (dataInfoQueue.pop());
+    }
+
+    /**
+     * 从 m_sourceHistory 中读取 1x 数据
+     * @param offset 起始位置, 坐标与 m_dataWritten 相同
+     * @param dst 目标
+     * @param len 长度(单位: byte)
+     */
+    void readHistory(int64_t offset, std::byte *dst, size_t len) const {
+        size_t size = m_sourceHistory.size();
+        auto begin = static_cast<size_t>(offset) % size;
+        size_t first = std::min(len, size - begin);
+        memcpy(dst, m_sourceHistory.data() + begin, first);
+        memcpy(dst + first, m_sourceHistory.data(), len - first);
+    }
+
+    void writeHistory(int64_t offset, const std::byte *src, size_t len) {
+        size_t size = m_sourceHistory.size();
+        auto begin = static_cast<size_t>(offset) % size;
+        size_t first = std::min(len, size - begin);
+        memcpy(m_sourceHistory.data() + begin, src, first);
+        memcpy(m_sourceHistory.data(), src + first, len - first);
+    }
+
+    /**
+     * 按 m_channelMatrix 把源的声道混合为输出的声道, 结果保存在 m_remixed. 需要持有 m_pipelineMutex.
+     * @param src 源格式的交错数据
+     * @param frames 帧数
+     */
+    void remixChannels(const int16_t *src, size_t frames) {
+        const int in = m_sourceFormat.getChannelCount();
+        const int out = m_format.getChannelCount();
+        m_remixed.resize(frames * static_cast<size_t>(out));
+        for (size_t f = 0; f < frames; f += REMIX_BLOCK_FRAMES) {
+            size_t n = std::min(REMIX_BLOCK_FRAMES, frames - f);
+            PcmKernels::toFloat(src + f * static_cast<size_t>(in), m_remixIn.data(), n * static_cast<size_t>(in));
+            PcmKernels::downmix(m_remixIn.data(), in, m_remixOut.data(), out, m_channelMatrix.data(), n);
+            PcmKernels::fromFloat(m_remixOut.data(), m_remixed.data() + f * static_cast<size_t>(out),
+                                  n * static_cast<size_t>(out));
+        }
+    }
+
+    /**
+     * 选择的设备, 不存在时使用默认设备
+     * @return 还没有枚举设备或者没有设备时返回 nullptr
+     */
+    const AudioDeviceInfo *selectedDevice(const AudioDeviceSnapshot *snapshot) const {
+        if (!snapshot) { return nullptr; }
+        const AudioDeviceInfo *device = snapshot->find(selectedOutputDevice);
+        return device ? device : snapshot->find(snapshot->defaultDevice);
+    }
+
+    /**
+     * 按设备支持的声道数和设置协商输出的声道布局
+     * @param device 输出设备, 为 nullptr 时只考虑设置
+     */
+    uint64_t negotiateLayout(const AudioDeviceInfo *device, const ChannelMixSettings &settings) const {
+        return ChannelMixer::negotiate(m_sourceFormat.getChannelLayout(), [device](int channels) {
+            return !device || device->supportsChannelCount(channels);
+        }, settings.maxChannels);
+    }
+
+    /**
+     * 把输出布局设置为 layout, 重新计算缩混矩阵. 需要持有 m_pipelineMutex, 输出的声道数改变时还需要重新初始化
+     * 变速引擎和效果器链.
+     */
+    void applyLayout(uint64_t layout) {
+        m_format = {AnytMusic::Int16, m_sourceFormat.getSampleRate(), ChannelLayout::channels(layout), layout};
+        m_channelMatrix = ChannelMixer::matrix(m_sourceFormat.getChannelLayout(), layout, m_channelMix);
+        if (m_channelMatrix.empty()) {
+            qDebug() << "Output" << m_format.getChannelCount() << "channels directly";
+        } else {
+            qDebug() << "Downmix" << m_sourceFormat.getChannelCount() << "channels to" << m_format.getChannelCount();
+        }
+    }
+
+    /**
+     * 把变速引擎输出的 frames 帧写入 DataBuffer, 调用者保证 DataBuffer 有足够的空间
+     */
+    void commitStretchedOutput(int frames) {
+        int len = frames * m_format.getBytesPerSampleChannels();
+        m_effects.process(reinterpret_cast<int16_t *>(m_stretchBuffer), static_cast<size_t>(frames));
+        if (m_fadeInFrames > 0) {
+            // 重新处理的数据与已经输出的数据不连续, 淡入避免爆音
+            auto total = static_cast<float>(m_format.getSampleRate()) * RETIME_FADE_SECS;
+            int64_t n = std::min<int64_t>(frames, m_fadeInFrames);
+            float from = 1.0f - static_cast<float>(m_fadeInFrames) / total;
+            float to = 1.0f - static_cast<float>(m_fadeInFrames - n) / total;
+            PcmKernels::gainRamp(reinterpret_cast<int16_t *>(m_stretchBuffer), static_cast<size_t>(n),
+                                 m_format.getChannelCount(), from, to);
+            m_fadeInFrames -= n;
+        }
+        void *ptr[2] = {nullptr};
+        ring_buffer_size_t sizes[2] = {0};
+        PaUtil_GetRingBufferWriteRegions(&m_ringBuffer, static_cast<ring_buffer_size_t>(len), &ptr[0], &sizes[0],
+                                         &ptr[1],
+                                         &sizes[1]);
+        memcpy(ptr[0], m_stretchBuffer, static_cast<size_t>(sizes[0]));
+        memcpy(ptr[1], m_stretchBuffer + sizes[0], static_cast<size_t>(sizes[1]));
+        // 变速引擎内部会缓存一部分输入, 输出的数据只对应 len * speed 字节的输入, 按此折算才不会让时钟超前
+        double represented = static_cast<double>(len) * static_cast<double>(m_stretcher->speed()) + m_stretchCarry;
+        auto alignedLen = static_cast<qint32>(represented / m_format.getBytesPerSampleChannels())
+                          * m_format.getBytesPerSampleChannels();
+        m_stretchCarry = represented - alignedLen;
+        dataInfoQueue.enqueue({alignedLen, len, static_cast<qreal>(alignedLen) / len});
+        PaUtil_AdvanceRingBufferWriteIndex(&m_ringBuffer, static_cast<ring_buffer_size_t>(len));
+    }
+
+    /**
+     * 把还没有处理的 1x 数据送入变速引擎, 并把引擎的输出写入 DataBuffer, 直到 DataBuffer 写满或者没有数据.
+     * 引擎的输出一次写不下时留在引擎内部, 下次再写.
+     */
+    void pump() {
+        const int bytesPerFrame = m_format.getBytesPerSampleChannels();
+        const auto maxFrames = static_cast<ring_buffer_size_t>(m_stretchBufferMaxBytes / static_cast<size_t>(bytesPerFrame));
+        while (true) {
+            ring_buffer_size_t space = PaUtil_GetRingBufferWriteAvailable(&m_ringBuffer) / bytesPerFrame;
+            if (space == 0) { break; }
+            int frames = m_stretcher->read(reinterpret_cast<int16_t *>(m_stretchBuffer),
+                                           static_cast<int>(std::min(space, maxFrames)));
+            if (frames > 0) {
+                commitStretchedOutput(frames);
+                continue;
+            }
+            int64_t pending = m_sourceWritten - m_sourceFed;
+            if (pending <= 0) { break; }
+            auto chunk = static_cast<size_t>(std::min<int64_t>(pending, static_cast<int64_t>(
+                    m_feedBuffer.size() / static_cast<size_t>(bytesPerFrame) * static_cast<size_t>(bytesPerFrame))));
+            readHistory(m_sourceFed, m_feedBuffer.data(), chunk);
+            m_stretcher->write(reinterpret_cast<const int16_t *>(m_feedBuffer.data()),
+                               static_cast<int>(chunk) / bytesPerFrame);
+            m_sourceFed += static_cast<int64_t>(chunk);
+        }
+    }
+
+    /**
+     * 读取 WAV 文件并设置为卷积的脉冲响应, 在调用者的线程上计算频谱
+     * @return 读取失败时返回 false, 当前的脉冲响应不变
+     */
+    bool applyImpulseResponse(const QString &path) {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            qWarning() << "Cannot open impulse response" << path << ":" << file.errorString();
+            return false;
+        }
+        QByteArray bytes = file.readAll();
+        try {
+            auto ir = std::make_shared<const WavData>(WavFile::parse(bytes.constData(),
+                                                                     static_cast<size_t>(bytes.size())));
+            qDebug() << "Impulse response" << path << ":" << ir->frames() << "frames," << ir->channels
+                     << "channels," << ir->sampleRate << "Hz";
+            m_convolver->setImpulseResponse(std::move(ir));
+        } catch (const std::exception &e) {
+            qWarning() << "Invalid impulse response" << path << ":" << e.what();
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * 读取保存的变速引擎和质量档位, 没有保存或者值无效时使用 sonic 和 Balanced
+     */
+    void loadTimeStretch() {
+        QSettings settings(AnytMusic::getConfigFile(), QSettings::IniFormat);
+        int engine = settings.value("Audio/timeStretchEngine", static_cast<int>(TimeStretch::Engine::Sonic)).toInt();
+        int quality = settings.value("Audio/timeStretchQuality",
+                                     static_cast<int>(TimeStretch::Quality::Balanced)).toInt();
+        m_stretchEngine = engine == static_cast<int>(TimeStretch::Engine::Wsola) ? TimeStretch::Engine::Wsola
+                                                                                 : TimeStretch::Engine::Sonic;
+        m_stretchQuality = static_cast<TimeStretch::Quality>(
+                std::clamp(quality, static_cast<int>(TimeStretch::Quality::Fast),
+                           static_cast<int>(TimeStretch::Quality::High)));
+    }
+
+    /**
+     * 按当前的引擎和质量档位创建变速引擎, 并应用当前的速度, 音调和音量
+     */
+    void createStretcher() {
+        m_stretcher = TimeStretch::create(m_stretchEngine, m_stretchQuality,
+                                          m_format.getSampleRate(), m_format.getChannelCount());
+        m_stretcher->setSpeed(static_cast<float>(m_speedFactor));
+        m_stretcher->setPitch(static_cast<float>(m_pitch));
+        m_stretcher->setVolume(static_cast<float>(m_volume));
+        m_stretchCarry = 0.0;
+    }
+
+    /**
+     * 按当前速度重新处理 DataBuffer 中还没有播放的数据, 使速度的改变立即生效. 回调在此期间输出静音, 重新处理的
+     * 数据从当前播放位置继续, 开头淡入.
+     */
+    void retimeBuffered() {
+        std::lock_guard lock(AudioDeviceCatalogue::backendLock());
+        if (PaUtil_GetRingBufferReadAvailable(&m_ringBuffer) == 0 && m_sourceFed == m_sourceWritten) { return; }
+        uint32_t generation = m_activeGeneration.exchange(0, std::memory_order_acq_rel);
+        while (m_ringReader.load(std::memory_order_acquire) != 0) { std::this_thread::yield(); }
+        int64_t played = m_dataWritten;
+        played -= played % m_format.getBytesPerSampleChannels();
+        if (played <= m_sourceWritten
+            && m_sourceWritten - played <= static_cast<int64_t>(m_sourceHistory.size())) {
+            discardRingBuffer();
+            discardStretcher();
+            m_sourceFed = played;
+            m_dataWritten = played;
+            m_fadeInFrames = static_cast<int64_t>(m_format.getSampleRate() * RETIME_FADE_SECS);
+        } else {
+            qWarning() << "Buffered audio is not available in history, speed change will be delayed.";
+        }
+        m_activeGeneration.store(generation, std::memory_order_release);
+        pump();
+    }
+
+    /**
+     * 按处理链的格式分配 DataBuffer, 变速引擎的输出缓冲区和 m_sourceHistory, 其中的数据全部丢弃. 按所有档位中最大的
+     * 长度分配, 自适应调整和切换档位只改变允许写入的长度, 不需要在回调运行时重新分配. 调用时流需要已经关闭.
+     */
+    void allocateBuffers() {
+        m_bufferMaxBytes = bufferBytesFor(m_format);
+        m_stretchBufferMaxBytes = m_bufferMaxBytes * 4;
+        if (m_ringBufferData) { PaUtil_FreeMemory(m_ringBufferData); }
+        m_ringBufferData = static_cast<std::byte *>(PaUtil_AllocateMemory(static_cast<long>(m_bufferMaxBytes)));
+        if (PaUtil_InitializeRingBuffer(&m_ringBuffer,
+                                        sizeof(std::byte),
+                                        static_cast<ring_buffer_size_t>(m_bufferMaxBytes),
+                                        m_ringBufferData) < 0)
+            throw std::runtime_error("can not initialize ring buffer!");
+        while (dataInfoQueue.pop());
+        delete[] m_stretchBuffer;
+        m_stretchBuffer = new std::byte[m_stretchBufferMaxBytes];
+        // DataBuffer 中的数据按 1x 折算最多是容量的 MAX_SPEED_FACTOR 倍
+        m_sourceHistory.assign(static_cast<size_t>(static_cast<qreal>(m_bufferMaxBytes) * MAX_SPEED_FACTOR), std::byte{0});
+        m_sourceWritten = m_sourceFed = m_dataWritten;
+        m_fadeInFrames = 0;
+    }
+
+    /**
+     * 格式对应的 DataBuffer 容量, 采样率和声道数越高, 同样的时长需要的空间越大
+     */
+    static size_t bufferBytesFor(const PonyAudioFormat &format) {
+        return nextPowerOf2(static_cast<unsigned>(std::max(
+                format.suggestedRingBuffer(MAX_SPEED_FACTOR),
+                format.bytesOfDuration(AudioLatencyConfig::largestRingSecs() * MAX_SPEED_FACTOR))));
+    }
+
     static unsigned nextPowerOf2(unsigned val) {
         val--;
         val = (val >> 1) | val;
@@ -228,65 +783,129 @@ private:
 
 public:
     constexpr const static qreal MAX_SPEED_FACTOR = 4;
+    constexpr const static int TELEMETRY_REPORT_INTERVAL_MS = 5000;
+    constexpr const static int RING_ADAPT_INTERVAL_MS = 1000;
+    constexpr const static float RETIME_FADE_SECS = 0.005f;
+    constexpr const static size_t PUMP_CHUNK_BYTES = 32768;
+    constexpr const static size_t REMIX_BLOCK_FRAMES = 512;
+    /**
+     * 暂停后流默认保持运行的时间(单位: 秒), 在这段时间内恢复播放不需要重新启动流
+     */
+    constexpr const static double DEFAULT_KEEP_ALIVE_SECS = 30.0;
 
     /**
-     * 创建PonyAudioSink并attach到默认设备上
+     * 创建PonyAudioSink并attach到默认设备上. 设备目录还没有完成第一次枚举时, 流在枚举完成后打开, 在此之前
+     * m_deviceFormat 按请求的格式估计.
      * @param format 音频格式
-     * @param bufferSizeAdvice DataBuffer 的建议大小, PonyAudioSink 保证实际的 DataBuffer 不小于建议大小.
+     * @param backend 输出后端, 默认按环境变量 PONY_AUDIO_BACKEND 选择
      */
-    explicit PonyAudioSink(PonyAudioFormat format) : m_volume(0.5), m_pitch(1.0), m_state(PlaybackState::STOPPED),
+    explicit PonyAudioSink(PonyAudioFormat format,
+                           std::unique_ptr<IAudioBackend> backend = IAudioBackend::fromEnvironment())
+            : m_backend(std::move(backend)), m_volume(0.5), m_pitch(1.0), m_state(PlaybackState::STOPPED),
                                             m_format(std::move(format)),
-                                            m_deviceFormat(AnytMusic::Unknown, 0, 0), m_speedFactor(1.0) {
-
-
-        paStreamLock.lock();
-        initializeStream();
-        paStreamLock.unlock();
-        m_bufferMaxBytes = nextPowerOf2(static_cast<unsigned>(m_format.suggestedRingBuffer(MAX_SPEED_FACTOR)));
-        m_sonicBufferMaxBytes = m_bufferMaxBytes * 4;
-        m_ringBufferData = static_cast<std::byte *>(PaUtil_AllocateMemory(static_cast<long>(m_bufferMaxBytes)));
-        if (PaUtil_InitializeRingBuffer(&m_ringBuffer,
-                                        sizeof(std::byte),
-                                        static_cast<ring_buffer_size_t>(m_bufferMaxBytes),
-                                        m_ringBufferData) < 0)
-            throw std::runtime_error("can not initialize ring buffer!");
-        sonicBuffer = new std::byte[m_sonicBufferMaxBytes];
-        sonStream = sonicCreateStream(m_format.getSampleRate(), m_format.getChannelCount());
-        sonicSetChordPitch(sonStream, 1);
-        sonicSetSpeed(sonStream, static_cast<float>(m_speedFactor));
-        // HotPlugDetector should be created after PA stream open
-        hotPlugDetector = new HotPlugDetector(this);
-        connect(hotPlugDetector, &HotPlugDetector::audioOutputsChanged, this,
-                &PonyAudioSink::onAudioOutputDevicesChanged);
+                                            m_sourceFormat(m_format),
+                                            m_deviceFormat(AnytMusic::Int16, m_format.getSampleRate(),
+                                                           m_format.getChannelCount(), m_format.getChannelLayout()),
+                                            m_speedFactor(1.0) {
+        m_latencyConfig = AudioLatencyConfig::load(AudioLatencyConfig::loadProfile());
+        m_latencyProfile = m_latencyConfig.profile;
+        m_ringSizer = RingBufferSizer(m_latencyConfig);
+        m_ringSecs = m_ringSizer.secs();
+        if (auto *catalogue = m_backend->catalogue()) {
+            m_resetListenerId = catalogue->addResetListener([this] { onBackendReset(); });
+            connect(catalogue, &AudioDeviceCatalogue::devicesChanged, this, &PonyAudioSink::onDevicesChanged);
+        }
+        // 不按实时速度运行的后端等 DataBuffer 中有一次回调的数据再调用回调
+        m_backend->setDataAvailable([this](size_t bytes) {
+            if (m_gated) { return false; }
+            return m_blockingState || m_pauseRequested
+                   || static_cast<size_t>(PaUtil_GetRingBufferReadAvailable(&m_ringBuffer)) >= bytes;
+        });
+        if (m_backend->snapshot()) {
+            std::lock_guard lock(AudioDeviceCatalogue::backendLock());
+            initializeStream();
+        }
+        allocateBuffers();
+        m_feedBuffer.resize(PUMP_CHUNK_BYTES);
+        m_channelMix = loadChannelMix();
+        m_remixIn.resize(REMIX_BLOCK_FRAMES * PcmKernels::MAX_CHANNELS);
+        m_remixOut.resize(REMIX_BLOCK_FRAMES * PcmKernels::MAX_CHANNELS);
+        loadTimeStretch();
+        createStretcher();
+        m_effects.prepare(m_format.getSampleRate(), m_format.getChannelCount());
+        // 响度归一化放在最前面, 均衡器和卷积看到的是归一化后的电平
+        m_replayGain = std::make_shared<ReplayGainEffect>(loadReplayGain());
+        m_effects.append(m_replayGain);
+        m_equalizer = std::make_shared<ParametricEqualizer>(loadEqualizer());
+        m_effects.append(m_equalizer);
+        m_convolver = std::make_shared<ConvolutionEffect>();
+        m_effects.append(m_convolver);
+        if (QString path = savedImpulseResponse(); !path.isEmpty()) { applyImpulseResponse(path); }
+        m_telemetryTimer = new QTimer(this);
+        connect(m_telemetryTimer, &QTimer::timeout, this, &PonyAudioSink::reportTelemetry);
+        m_telemetryTimer->start(TELEMETRY_REPORT_INTERVAL_MS);
+        m_adaptTimer = new QTimer(this);
+        connect(m_adaptTimer, &QTimer::timeout, this, &PonyAudioSink::adaptRingBuffer);
+        m_adaptTimer->start(RING_ADAPT_INTERVAL_MS);
+        m_keepAliveMs = loadKeepAliveMs();
+        m_idleTimer = new QTimer(this);
+        m_idleTimer->setSingleShot(true);
+        connect(m_idleTimer, &QTimer::timeout, this, &PonyAudioSink::onIdleTimeout);
     }
 
     /**
      * 析构即从deattach当前设备
      */
     ~PonyAudioSink() override {
-        std::lock_guard lock(paStreamLock);
+        std::lock_guard lock(AudioDeviceCatalogue::backendLock());
+        if (auto *catalogue = m_backend->catalogue()) { catalogue->removeResetListener(m_resetListenerId); }
         m_state = PlaybackState::STOPPED;
-        PaError err = Pa_CloseStream(m_stream);
-        m_stream = nullptr;
-        if (err != paNoError) {
-            qWarning() << "Error at Destroying PonyAudioSink" << Pa_GetErrorText(err);
+        closeStream();
+        if (m_ringBufferData) { PaUtil_FreeMemory(m_ringBufferData); }
+        delete[] m_stretchBuffer;
+    }
+
+    /**
+     * 处理发给 PonyAudioSink 的排队调用(设备目录的通知)和已经到期的定时任务. Playback 循环运行时所在线程的事件循环
+     * 不会运行, 由循环在两帧之间调用. 只能在 PonyAudioSink 所在的线程调用.
+     */
+    void serviceEvents() {
+        QCoreApplication::sendPostedEvents(this, QEvent::MetaCall);
+        if (m_telemetryTimer->remainingTime() == 0) {
+            reportTelemetry();
+            m_telemetryTimer->start();
+        }
+        if (m_adaptTimer->remainingTime() == 0) {
+            adaptRingBuffer();
+            m_adaptTimer->start();
+        }
+        if (m_idleTimer->isActive() && m_idleTimer->remainingTime() == 0) {
+            m_idleTimer->stop();
+            onIdleTimeout();
         }
     }
 
     /**
-     * 开始播放, 状态变为 PlaybackState::PLAYING. 若当前DataBuffer内容不足, 状态将会发生改变.
+     * 开始播放, 状态变为 PlaybackState::PLAYING. 若当前DataBuffer内容不足, 状态将会发生改变. 暂停后流仍在运行时
+     * 只需要让回调重新读取 DataBuffer, 不需要重新启动流.
      * @see PonyAudioSink::stateChanged
      * @see PonyAudioSink::resourceInsufficient
      */
     void start() {
-        std::lock_guard lock(paStreamLock);
+        std::lock_guard lock(AudioDeviceCatalogue::backendLock());
         m_pauseRequested = false;
         qDebug() << "Audio start.";
         if (m_state == PlaybackState::PLAYING) {
             qDebug() << "AudioSink already started.";
             return;
         }
-        PaError err = startStreamSafe();
+        m_idleTimer->stop();
+        PaError err = paNoError;
+        if (m_gated) {
+            m_gated = false;
+        } else {
+            err = startStreamSafe();
+        }
         if (err != paNoError) {
             qWarning() << "Error at starting stream:" << Pa_GetErrorText(err);
             ILLEGAL_STATE("Can not start stream!.");
@@ -298,14 +917,21 @@ public:
     }
 
     /**
-     * 暂停播放, 状态变为 PlaybackState::PAUSED. 但已经写入AudioBuffer的音频将会继续播放.
+     * 暂停播放, 状态变为 PlaybackState::PAUSED. 已经写入AudioBuffer的音频会保留到下一次 start. 流在设置
+     * Audio/keepAliveSecs 指定的时间内保持运行并输出静音, 避免恢复播放时重新启动设备的延迟, 到期后才停止.
      */
     void pause() {
-        std::lock_guard lock(paStreamLock);
+        std::lock_guard lock(AudioDeviceCatalogue::backendLock());
         qDebug() << "Audio requesting pause. Current state is " << stateToStr();
         if (m_state == PlaybackState::PLAYING) {
-            Pa_StopStream(m_stream);
-            qDebug() << "Stream Stopped";
+            if (m_stream && m_keepAliveMs > 0) {
+                gate();
+                m_idleTimer->start(m_keepAliveMs);
+                qDebug() << "Stream gated";
+            } else {
+                if (m_stream) { m_backend->stopStream(m_stream); }
+                qDebug() << "Stream Stopped";
+            }
             m_state = PlaybackState::PAUSED;
         } else if (m_state == PlaybackState::STOPPED) {
             // ignore
@@ -315,6 +941,7 @@ public:
     }
 
     void waitComplete() {
+        if (!m_stream) { return; }
         m_pauseRequested = true;
         std::unique_lock lock(m_waitCompleteMutex);
         m_waitCompleteCond.wait(lock);
@@ -324,10 +951,12 @@ public:
      * 停止播放, 状态变为 PlaybackState::STOPPED, 且已写入AudioBuffer的音频将会被放弃, 播放会立即停止.
      */
     void stop() {
-        std::lock_guard lock(paStreamLock);
+        std::lock_guard lock(AudioDeviceCatalogue::backendLock());
         qDebug() << "Audio stateStop.";
         if (m_state == PlaybackState::PLAYING || m_state == PlaybackState::PAUSED) {
-            Pa_AbortStream(m_stream);
+            m_idleTimer->stop();
+            if (m_stream) { m_backend->abortStream(m_stream); }
+            m_gated = false;
             m_state = PlaybackState::STOPPED;
         } else {
             qWarning() << "AudioSink already stopped.";
@@ -351,57 +980,50 @@ public:
     }
 
     /**
-     * 获取AudioBuffer剩余空间
+     * 获取AudioBuffer剩余空间. 允许写入的长度由延迟档位和欠载情况决定, 小于 DataBuffer 的实际容量, 因此剩余空间
+     * 大于 0 时总可以再写入一帧.
      * @return 剩余空间(单位: byte)
      */
     [[nodiscard]] int64_t freeByte() const {
-        return static_cast<int64_t>(PaUtil_GetRingBufferWriteAvailable(&m_ringBuffer))
-               - static_cast<int64_t>((MAX_SPEED_FACTOR - m_speedFactor) * static_cast<qreal>(m_bufferMaxBytes) /
-                                      MAX_SPEED_FACTOR);
+        std::lock_guard lock(m_pipelineMutex);
+        // 还没有送入变速引擎的数据按当前速度折算
+        auto backlog = static_cast<int64_t>(static_cast<qreal>(m_sourceWritten - m_sourceFed) / std::max<qreal>(m_speedFactor, 0.1));
+        return ringTargetBytes() - static_cast<int64_t>(PaUtil_GetRingBufferReadAvailable(&m_ringBuffer)) - backlog;
     }
 
     /**
-     * 写AudioBuffer, 要么写入完全成功, 要么失败. 这个操作保证在VideoThread上进行.
-     * @param buf 数据源
+     * 写AudioBuffer, 要么写入完全成功, 要么失败. 数据先按协商的声道布局缩混, 再经过变速引擎和效果器链后写入
+     * DataBuffer, 通常在 DSP 线程上调用.
+     * @param buf 数据源, 格式为 getCurrentDeviceFormat
      * @param origLen 长度(单位: byte)
      * @return 写入是否成功
      */
     bool write(const char *buf, qint32 origLen) {
-        int len = 0;
         if (m_format.getSampleFormat() != AnytMusic::Int16) {
             throw std::runtime_error("Only support Int16!");
         }
-        if (origLen % m_format.getBytesPerSampleChannels() == 0) {
-            sonicWriteShortToStream(sonStream, reinterpret_cast<const short *>(buf),
-                                    static_cast<int>(origLen) / m_format.getBytesPerSampleChannels());
-            int currentLen;
-            while ((currentLen = sonicReadShortFromStream(sonStream,
-                                                          reinterpret_cast<short *>
-                                                          (sonicBuffer + len * m_format.getChannelCount()),
-                                                          0x7fffffff))) {
-                len += currentLen;
-            }
-        } else
+        std::lock_guard lock(m_pipelineMutex);
+        if (origLen % m_sourceFormat.getBytesPerSampleChannels() != 0)
             ILLEGAL_STATE("Incomplete Int16!");
-        len *= m_format.getBytesPerSampleChannels();
-        ring_buffer_size_t bufAvailCount = PaUtil_GetRingBufferWriteAvailable(&m_ringBuffer);
-
-        if (bufAvailCount < len) return false;
-        void *ptr[2] = {nullptr};
-        ring_buffer_size_t sizes[2] = {0};
-
-        PaUtil_GetRingBufferWriteRegions(&m_ringBuffer, static_cast<ring_buffer_size_t>(len), &ptr[0], &sizes[0],
-                                         &ptr[1],
-                                         &sizes[1]);
-        memcpy(ptr[0], sonicBuffer, static_cast<size_t>(sizes[0]));
-        memcpy(ptr[1], sonicBuffer + sizes[0], static_cast<size_t>(sizes[1]));
-        dataInfoQueue.enqueue({origLen, len, static_cast<qreal>(origLen) / len});
-        PaUtil_AdvanceRingBufferWriteIndex(&m_ringBuffer, static_cast<ring_buffer_size_t>(len));
+        auto data = reinterpret_cast<const std::byte *>(buf);
+        auto len = static_cast<int64_t>(origLen);
+        if (!m_channelMatrix.empty()) {
+            remixChannels(reinterpret_cast<const int16_t *>(buf),
+                          static_cast<size_t>(origLen / m_sourceFormat.getBytesPerSampleChannels()));
+            data = reinterpret_cast<const std::byte *>(m_remixed.data());
+            len = static_cast<int64_t>(m_remixed.size() * sizeof(int16_t));
+        }
+        // 还没有播放的数据不能被覆盖
+        int64_t retained = std::min<int64_t>(m_sourceFed, m_dataWritten);
+        if (m_sourceWritten + len - retained > static_cast<int64_t>(m_sourceHistory.size())) { return false; }
+        writeHistory(m_sourceWritten, data, static_cast<size_t>(len));
+        m_sourceWritten += len;
+        pump();
         return true;
     }
 
     /**
-     * 清空AudioBuffer, 将所有空间标记为可用. 这个操作保证在VideoThread上进行.
+     * 清空AudioBuffer, 将所有空间标记为可用. 调用时 DSP 线程不能写入数据.
      * @return 清空数据长度(单位: byte)
      */
     size_t clear() {
@@ -409,18 +1031,32 @@ public:
             qWarning() << "clear make no effect when state != STOPPED.";
         }
         // 需要保证此刻没有读写操作
-        PaUtil_FlushRingBuffer(&m_ringBuffer);
+        std::lock_guard lock(m_pipelineMutex);
+        discardRingBuffer();
+        // 丢弃变速引擎内部缓存的旧数据
+        discardStretcher();
+        m_sourceWritten = m_sourceFed = m_dataWritten;
+        m_fadeInFrames = 0;
         return 0;
     }
 
 
     /**
      * 获取当前播放的时间, 这个函数只能在 PlaybackState::PLAYING 或 PlaybackState::PAUSED 状态下使用.
+     * 时间根据回调提供的 DAC 时间戳计算, 是此刻真正从扬声器输出的位置, 已经考虑了设备输出延迟和设备的延迟校正.
      * @return 当前已播放音频的长度(单位: 秒)
      */
     [[nodiscard]] qreal getProcessSecs(bool backward) const {
         if (m_state == PlaybackState::STOPPED) { return m_startPoint; }
-        auto processSec = static_cast<double>(m_format.durationOfBytes(m_dataWritten - m_dataLastWrote));
+        const double bytesPerSec = m_format.getSampleRate() * m_format.getBytesPerSampleChannels();
+        double played = playedBytes();
+        if (!backward) {
+            int64_t rebase = m_rebaseBytes;
+            if (rebase != NO_REBASE && played >= static_cast<double>(rebase)) {
+                return m_rebasePoint + (played - static_cast<double>(rebase)) / bytesPerSec;
+            }
+        }
+        auto processSec = played / bytesPerSec;
         if (backward) {
             return m_startPoint - processSec;
         } else {
@@ -428,6 +1064,53 @@ public:
         }
     }
 
+    /**
+     * 从下一次写入的数据开始切换时间基准, 播放到这些数据时 getProcessSecs 从 pts 开始计算. 交叉淡化时用于在淡化
+     * 中点切换到下一个文件的时间, A-B 循环时用于回到 A. 只能在写入数据的线程上调用, 只支持正放. 上一次切换需要已经
+     * 播放, 见 hasPendingRebase.
+     * @param pts 下一次写入的数据在新文件中的时间(单位: 秒)
+     * @param announce 为 false 时 takeClockRebased 不报告这次切换
+     */
+    void rebaseClock(qreal pts, bool announce = true) {
+        std::lock_guard lock(m_pipelineMutex);
+        const double bytesPerSec = m_format.getSampleRate() * m_format.getBytesPerSampleChannels();
+        int64_t previous = m_rebaseBytes;
+        if (previous != NO_REBASE) {
+            // 两次切换之间至少间隔一个文件, 上一次切换早已生效, 并入 m_startPoint
+            m_startPoint = m_rebasePoint - static_cast<double>(previous) / bytesPerSec;
+        }
+        m_rebasePoint = pts;
+        m_rebaseBytes = m_sourceWritten;
+        if (!announce) { m_rebaseReported = m_sourceWritten; }
+    }
+
+    /**
+     * 是否有还没有播放到的时间基准切换. 这个函数是线程安全的.
+     */
+    [[nodiscard]] bool hasPendingRebase() const {
+        int64_t rebase = m_rebaseBytes;
+        return rebase != NO_REBASE && m_state != PlaybackState::STOPPED && playedBytes() < static_cast<double>(rebase);
+    }
+
+    /**
+     * 是否已经播放到 rebaseClock 切换时间基准的位置. 这个函数是线程安全的.
+     */
+    [[nodiscard]] bool isClockRebased() const {
+        int64_t rebase = m_rebaseBytes;
+        if (rebase == NO_REBASE || m_state == PlaybackState::STOPPED) { return false; }
+        return playedBytes() >= static_cast<double>(rebase);
+    }
+
+    /**
+     * 与 isClockRebased 相同, 但是每次切换只返回一次 true. 这个函数是线程安全的.
+     */
+    bool takeClockRebased() {
+        int64_t rebase = m_rebaseBytes;
+        if (rebase == m_rebaseReported || !isClockRebased()) { return false; }
+        m_rebaseReported = rebase;
+        return true;
+    }
+
     /**
      * 设置下一次播放的计时器. 这个函数必须在 PlaybackState::STOPPED 状态下使用. 在播放开始后, 设置生效。
      * @param t 新的播放时间(单位: 秒)
@@ -437,8 +1120,12 @@ public:
             qWarning() << "Trying set start point to NaN";
         }
         if (m_state == PlaybackState::STOPPED) {
+            std::lock_guard lock(m_pipelineMutex);
             m_startPoint = t;
             m_dataWritten = 0;
+            m_sourceWritten = m_sourceFed = 0;
+            m_rebaseBytes = m_rebaseReported = NO_REBASE;
+            m_clock.reset();
         } else {
             qWarning() << "setTimeBase make no effect when state != STOPPED";
         }
@@ -450,8 +1137,9 @@ public:
      * @param newVolume
      */
     void setVolume(qreal newVolume) {
+        std::lock_guard lock(m_pipelineMutex);
         m_volume = qBound(0.0, newVolume, 1.0);
-        sonicSetVolume(sonStream, static_cast<float>(newVolume));
+        m_stretcher->setVolume(static_cast<float>(m_volume));
     }
 
     /**
@@ -459,17 +1147,58 @@ public:
      * @param newPitch
      */
     void setPitch(qreal newPitch) {
+        std::lock_guard lock(m_pipelineMutex);
         m_pitch = qBound(0.0, newPitch, 16.0);
-        sonicSetPitch(sonStream, static_cast<float>(newPitch));
+        m_stretcher->setPitch(static_cast<float>(m_pitch));
     }
 
     /**
-     * 设置速度
+     * 设置速度. DataBuffer 中还没有播放的数据会按新的速度重新处理, 改变立即生效.
      * @param newSpeed
      */
     void setSpeed(qreal newSpeed) {
-        m_speedFactor = qBound(0.0, newSpeed, MAX_SPEED_FACTOR);
-        sonicSetSpeed(sonStream, static_cast<float>(newSpeed));
+        qreal speed = qBound(0.0, newSpeed, MAX_SPEED_FACTOR);
+        std::lock_guard lock(m_pipelineMutex);
+        if (speed == m_speedFactor) { return; }
+        m_speedFactor = speed;
+        m_stretcher->setSpeed(static_cast<float>(speed));
+        if (!m_blockingState) { retimeBuffered(); }
+    }
+
+    /**
+     * 切换变速引擎和质量档位. DataBuffer 中还没有播放的数据会由新的引擎重新处理. 在 DSP 线程上调用, 不保存设置,
+     * 由调用者在自己的线程上调用 saveTimeStretch.
+     * @param engine 变速引擎
+     * @param quality 质量档位, 档位越高搜索越精细, CPU 占用越高
+     */
+    void setTimeStretch(TimeStretch::Engine engine, TimeStretch::Quality quality) {
+        std::lock_guard lock(m_pipelineMutex);
+        if (engine == m_stretchEngine && quality == m_stretchQuality) { return; }
+        m_stretchEngine = engine;
+        m_stretchQuality = quality;
+        createStretcher();
+        qDebug() << "Time stretch engine:" << static_cast<int>(engine) << "quality:" << static_cast<int>(quality);
+        if (!m_blockingState) { retimeBuffered(); }
+    }
+
+    /**
+     * 获取变速引擎, 这个函数是线程安全的
+     */
+    [[nodiscard]] TimeStretch::Engine timeStretchEngine() const {
+        return m_stretchEngine;
+    }
+
+    [[nodiscard]] TimeStretch::Quality timeStretchQuality() const {
+        return m_stretchQuality;
+    }
+
+    /**
+     * 保存变速引擎和质量档位, 下次创建 PonyAudioSink 时加载
+     */
+    static void saveTimeStretch(TimeStretch::Engine engine, TimeStretch::Quality quality) {
+        QSettings settings(AnytMusic::getConfigFile(), QSettings::IniFormat);
+        settings.setValue("Audio/timeStretchEngine", static_cast<int>(engine));
+        settings.setValue("Audio/timeStretchQuality", static_cast<int>(quality));
     }
 
     /**
@@ -488,57 +1217,332 @@ public:
         return m_pitch;
     }
 
-    void _getDeviceList() {
-        devicesList.clear();
-        int devicesCount = Pa_GetDeviceCount();
-        for (auto index = 0; index < devicesCount; index++) {
-            auto deviceInfo = Pa_GetDeviceInfo(index);
-            QString deviceName = Pa_GetDeviceInfo(index)->name;
-            if (deviceInfo->maxOutputChannels < 2) continue;
-#ifdef WIN32
-            if (deviceInfo->hostApi != PaHostApiTypeId::paDirectSound) continue;
-#endif
-            devicesList.push_back(deviceName);
-            qDebug() << deviceName;
+    /**
+     * 设置当前设备的延迟校正并保存, 下次使用这个设备时自动加载. 部分设备(如蓝牙耳机)报告的输出延迟不准确,
+     * 需要手动校正.
+     * @param offset 设备实际输出比报告晚的时间(单位: 秒), 可以为负数
+     */
+    void setLatencyOffset(qreal offset) {
+        m_latencyOffset = offset;
+        QSettings settings(AnytMusic::getConfigFile(), QSettings::IniFormat);
+        settings.setValue(latencyOffsetKey(selectedOutputDevice), offset);
+        qDebug() << "Set latency offset of" << selectedOutputDevice << "to" << offset << "s";
+    }
+
+    /**
+     * 获取当前设备的延迟校正, 这个函数是线程安全的
+     * @return 单位: 秒
+     */
+    [[nodiscard]] qreal latencyOffset() const {
+        return m_latencyOffset;
+    }
+
+    /**
+     * 获取当前流报告的输出延迟
+     * @return 单位: 秒
+     */
+    [[nodiscard]] qreal outputLatency() const {
+        return m_streamLatency;
+    }
+
+    /**
+     * 切换延迟档位并保存. 会重新打开流, DataBuffer 中的数据会被保留.
+     * @param profile 延迟档位
+     */
+    void setLatencyProfile(AudioLatencyProfile profile) {
+        AudioLatencyConfig::saveProfile(profile);
+        {
+            std::lock_guard lock(AudioDeviceCatalogue::backendLock());
+            m_latencyConfig = AudioLatencyConfig::load(profile);
         }
+        m_latencyProfile = profile;
+        m_ringSizer = RingBufferSizer(m_latencyConfig);
+        m_ringSecs = m_ringSizer.secs();
+        qDebug() << "Audio latency profile" << AudioLatencyConfig::nameOf(profile) << ": frames per buffer"
+                 << m_latencyConfig.framesPerBuffer << ", ring buffer" << m_latencyConfig.minRingSecs << "~"
+                 << m_latencyConfig.maxRingSecs << "s";
+        restartStream();
+    }
+
+    /**
+     * 获取当前的延迟档位, 这个函数是线程安全的
+     */
+    [[nodiscard]] AudioLatencyProfile latencyProfile() const {
+        return m_latencyProfile;
+    }
+
+    /**
+     * 获取当前延迟档位的参数
+     */
+    [[nodiscard]] AudioLatencyConfig latencyConfig() const {
+        return m_latencyConfig;
+    }
+
+    /**
+     * 获取 DataBuffer 当前在 1x 速度下允许写入的长度, 随欠载情况自适应调整. 这个函数是线程安全的.
+     * @return 单位: 秒
+     */
+    [[nodiscard]] double ringBufferSecs() const {
+        return m_ringSecs;
+    }
+
+    /**
+     * 最近一次回调开始时 DataBuffer 的填充程度, 相对于当前允许写入的长度, 可能略大于 1. 这个函数是线程安全的.
+     */
+    [[nodiscard]] double ringFill() const {
+        const double target = m_ringSecs * std::max<qreal>(1.0, m_speedFactor);
+        return target > 0 ? m_telemetry.snapshot().levelSecs / target : 0.0;
+    }
+
+    /**
+     * 获取音频回调的统计数据, 这个函数是线程安全的
+     * @return 累计的统计数据
+     */
+    [[nodiscard]] AudioTelemetrySnapshot telemetry() const {
+        return m_telemetry.snapshot();
     }
 
     QString getSelectedOutputDevice() { return selectedOutputDevice; }
 
-    void restartStream(const std::function<void()> &betweenInitAndOpen) {
-        std::lock_guard lock(paStreamLock);
-        if (paInitialized) {
-            Pa_AbortStream(m_stream);
-            Pa_Terminate();
+    /**
+     * 效果器链, 可以在任意线程上增删效果器, 效果器在 DSP 线程上运行
+     */
+    AudioEffectChain &effectChain() { return m_effects; }
+
+    /**
+     * 修改均衡器设置并保存, 这个函数是线程安全的. 新的设置在 DSP 线程上平滑地生效.
+     */
+    void setEqualizer(const EqualizerSettings &settings) {
+        m_equalizer->setSettings(settings);
+        saveEqualizer(settings);
+    }
+
+    /**
+     * 获取均衡器设置, 这个函数是线程安全的
+     */
+    [[nodiscard]] EqualizerSettings equalizer() const {
+        return m_equalizer->settings();
+    }
+
+    /**
+     * 设置当前文件的 ReplayGain 信息, 这个函数是线程安全的. 新的增益在 ReplayGainEffect::RAMP_SECS 内过渡.
+     */
+    void setReplayGainInfo(const ReplayGainInfo &info) {
+        m_replayGain->setInfo(info);
+    }
+
+    /**
+     * 修改 ReplayGain 设置并保存, 这个函数是线程安全的
+     */
+    void setReplayGain(const ReplayGainSettings &settings) {
+        m_replayGain->setSettings(settings);
+        saveReplayGain(settings);
+    }
+
+    /**
+     * 获取 ReplayGain 设置, 这个函数是线程安全的
+     */
+    [[nodiscard]] ReplayGainSettings replayGain() const {
+        return m_replayGain->settings();
+    }
+
+    /**
+     * 读取保存的 ReplayGain 设置, 默认使用音轨增益并防止削波
+     */
+    static ReplayGainSettings loadReplayGain() {
+        QSettings settings(AnytMusic::getConfigFile(), QSettings::IniFormat);
+        ReplayGainSettings rg;
+        rg.mode = static_cast<ReplayGainMode>(std::clamp(settings.value("ReplayGain/mode", 1).toInt(),
+                                                         static_cast<int>(ReplayGainMode::Off),
+                                                         static_cast<int>(ReplayGainMode::Album)));
+        rg.preampDb = settings.value("ReplayGain/preampDb", 0.0).toDouble();
+        rg.preventClipping = settings.value("ReplayGain/preventClipping", true).toBool();
+        return rg;
+    }
+
+    /**
+     * 保存 ReplayGain 设置, 下次创建 PonyAudioSink 时加载
+     */
+    static void saveReplayGain(const ReplayGainSettings &rg) {
+        QSettings settings(AnytMusic::getConfigFile(), QSettings::IniFormat);
+        settings.setValue("ReplayGain/mode", static_cast<int>(rg.mode));
+        settings.setValue("ReplayGain/preampDb", rg.preampDb);
+        settings.setValue("ReplayGain/preventClipping", rg.preventClipping);
+    }
+
+    /**
+     * 加载卷积的脉冲响应(WAV 文件)并保存路径, 下次创建 PonyAudioSink 时自动加载. 这个函数是线程安全的.
+     * 启用卷积会带来 ConvolutionEffect::DEFAULT_BLOCK_FRAMES 帧的延迟, getProcessSecs 会扣除这部分延迟.
+     * @param path 文件路径, 为空时关闭卷积
+     * @return 是否加载成功
+     */
+    bool loadImpulseResponse(const QString &path) {
+        if (path.isEmpty()) {
+            m_convolver->setImpulseResponse(nullptr);
+        } else if (!applyImpulseResponse(path)) {
+            return false;
         }
-        Pa_Initialize();
-        paInitialized = true;
-        if (betweenInitAndOpen) betweenInitAndOpen();
-        initializeStream();
-        if (m_state == PlaybackState::PLAYING) {
-            startStreamSafe();
+        saveImpulseResponse(path);
+        return true;
+    }
+
+    /**
+     * 只保存脉冲响应的路径, 下次创建 PonyAudioSink 时加载
+     */
+    static void saveImpulseResponse(const QString &path) {
+        QSettings settings(AnytMusic::getConfigFile(), QSettings::IniFormat);
+        settings.setValue("Convolution/impulseResponse", path);
+    }
+
+    /**
+     * 获取保存的脉冲响应路径, 没有时返回空字符串
+     */
+    static QString savedImpulseResponse() {
+        QSettings settings(AnytMusic::getConfigFile(), QSettings::IniFormat);
+        return settings.value("Convolution/impulseResponse", QString()).toString();
+    }
+
+    /**
+     * 读取保存的均衡器设置, 没有保存时使用关闭的十段图示均衡
+     */
+    static EqualizerSettings loadEqualizer() {
+        QSettings settings(AnytMusic::getConfigFile(), QSettings::IniFormat);
+        EqualizerSettings eq;
+        eq.enabled = settings.value("Equalizer/enabled", false).toBool();
+        eq.preampDb = settings.value("Equalizer/preampDb", 0.0).toDouble();
+        int count = settings.beginReadArray("Equalizer/bands");
+        for (int i = 0; i < count; ++i) {
+            settings.setArrayIndex(i);
+            EqualizerBand band;
+            band.type = static_cast<Biquad::Type>(std::clamp(settings.value("type", 0).toInt(),
+                                                             static_cast<int>(Biquad::Type::Peaking),
+                                                             static_cast<int>(Biquad::Type::HighShelf)));
+            band.freq = settings.value("freq", band.freq).toDouble();
+            band.gainDb = settings.value("gainDb", 0.0).toDouble();
+            band.q = settings.value("q", band.q).toDouble();
+            eq.bands.push_back(band);
         }
+        settings.endArray();
+        if (eq.bands.empty()) { eq.bands = EqualizerPresets::graphicBands(); }
+        return eq;
     }
 
-    void refreshDevicesList() {
-        qDebug() << "Refreshing Devices list...";
-        auto middleFunc = [this] {
-            _getDeviceList();
-        };
-        restartStream(middleFunc);
-        emit signalAudioOutputDeviceListChanged();
-        emit signalDeviceSwitched();
+    /**
+     * 保存均衡器设置, 下次创建 PonyAudioSink 时加载
+     */
+    static void saveEqualizer(const EqualizerSettings &eq) {
+        QSettings settings(AnytMusic::getConfigFile(), QSettings::IniFormat);
+        settings.setValue("Equalizer/enabled", eq.enabled);
+        settings.setValue("Equalizer/preampDb", eq.preampDb);
+        settings.remove("Equalizer/bands");
+        settings.beginWriteArray("Equalizer/bands", static_cast<int>(eq.bands.size()));
+        for (int i = 0; i < static_cast<int>(eq.bands.size()); ++i) {
+            const EqualizerBand &band = eq.bands[static_cast<size_t>(i)];
+            settings.setArrayIndex(i);
+            settings.setValue("type", static_cast<int>(band.type));
+            settings.setValue("freq", band.freq);
+            settings.setValue("gainDb", band.gainDb);
+            settings.setValue("q", band.q);
+        }
+        settings.endArray();
+    }
+
+    /**
+     * 关闭并重新打开流, 用于改变流的格式. 不会重新初始化 PortAudio, DataBuffer 中的数据会被保留.
+     */
+    void restartStream() {
+        std::lock_guard lock(AudioDeviceCatalogue::backendLock());
+        // 停止旧的流不应该改变播放状态
+        closeStream();
+        if (initializeStream() && m_state == PlaybackState::PLAYING) {
+            startStreamSafe();
+        }
     }
 
+    /**
+     * 获取可以选择的输出设备, 这个函数不会阻塞
+     */
     QStringList getAudioDeviceList() {
-        return devicesList;
+        auto snapshot = m_backend->snapshot();
+        return snapshot ? snapshot->outputNames : QStringList();
     }
 
+    /**
+     * 设置源的格式, 按选择的设备协商输出的声道布局并重新打开流. 设备支持源的声道数时直接输出 5.1/7.1, 否则在
+     * write 中按缩混矩阵混合. 输出的声道数改变时 DataBuffer 中的数据会被丢弃.
+     * @param format 源的格式, 采样率和声道布局有效
+     */
     void setFormat(const PonyAudioFormat &format) {
-        std::unique_lock lock(paStreamLock);
-        m_format = {AnytMusic::Int16, format.getSampleRate(), format.getChannelCount()};
+        std::unique_lock pipelineLock(m_pipelineMutex);
+        std::unique_lock lock(AudioDeviceCatalogue::backendLock());
+        // 先关闭流, 之后修改格式时不会有回调在读取 DataBuffer
+        closeStream();
+        const int previousChannels = m_format.getChannelCount();
+        m_sourceFormat = {AnytMusic::Int16, format.getSampleRate(), format.getChannelCount(), format.getChannelLayout()};
+        auto snapshot = m_backend->snapshot();
+        applyLayout(negotiateLayout(selectedDevice(snapshot.get()), m_channelMix));
         lock.unlock();
-        restartStream(nullptr);
+        if (bufferBytesFor(m_format) != m_bufferMaxBytes) {
+            // 更高的采样率或者更多的声道, 原来的容量不够档位承诺的时长. 流已经关闭, 可以重新分配
+            allocateBuffers();
+        } else if (m_format.getChannelCount() != previousChannels) {
+            discardRingBuffer();
+            m_sourceWritten = m_sourceFed = m_dataWritten;
+            m_fadeInFrames = 0;
+        }
+        // 变速引擎和效果器按格式初始化
+        createStretcher();
+        m_effects.prepare(m_format.getSampleRate(), m_format.getChannelCount());
+        pipelineLock.unlock();
+        restartStream();
+    }
+
+    /**
+     * 修改声道混合设置并保存. 输出的声道布局不变时立即生效并返回 false; 改变时返回 true, 调用者需要停止播放,
+     * 重新调用 setFormat 并重新同步. 这个函数是线程安全的.
+     */
+    bool setChannelMix(const ChannelMixSettings &settings) {
+        saveChannelMix(settings);
+        auto snapshot = m_backend->snapshot();
+        std::lock_guard lock(m_pipelineMutex);
+        m_channelMix = settings;
+        uint64_t layout = negotiateLayout(selectedDevice(snapshot.get()), settings);
+        if (layout != m_format.getChannelLayout()) { return true; }
+        m_channelMatrix = ChannelMixer::matrix(m_sourceFormat.getChannelLayout(), layout, settings);
+        return false;
+    }
+
+    [[nodiscard]] ChannelMixSettings channelMix() const {
+        std::lock_guard lock(m_pipelineMutex);
+        return m_channelMix;
+    }
+
+    /**
+     * 读取保存的声道混合设置, 默认按 ITU-R BS.775 缩混并防止削波
+     */
+    static ChannelMixSettings loadChannelMix() {
+        QSettings settings(AnytMusic::getConfigFile(), QSettings::IniFormat);
+        ChannelMixSettings mix;
+        mix.maxChannels = std::clamp(settings.value("Channels/maxChannels", 0).toInt(), 0, PcmKernels::MAX_CHANNELS);
+        mix.centerDb = settings.value("Channels/centerDb", mix.centerDb).toDouble();
+        mix.surroundDb = settings.value("Channels/surroundDb", mix.surroundDb).toDouble();
+        mix.lfeDb = settings.value("Channels/lfeDb", mix.lfeDb).toDouble();
+        mix.mixLfe = settings.value("Channels/mixLfe", mix.mixLfe).toBool();
+        mix.normalize = settings.value("Channels/normalize", mix.normalize).toBool();
+        return mix;
+    }
+
+    /**
+     * 保存声道混合设置, 下次创建 PonyAudioSink 时加载
+     */
+    static void saveChannelMix(const ChannelMixSettings &mix) {
+        QSettings settings(AnytMusic::getConfigFile(), QSettings::IniFormat);
+        settings.setValue("Channels/maxChannels", mix.maxChannels);
+        settings.setValue("Channels/centerDb", mix.centerDb);
+        settings.setValue("Channels/surroundDb", mix.surroundDb);
+        settings.setValue("Channels/lfeDb", mix.lfeDb);
+        settings.setValue("Channels/mixLfe", mix.mixLfe);
+        settings.setValue("Channels/normalize", mix.normalize);
     }
 
 
@@ -556,31 +1560,80 @@ signals:
 
     void signalAudioOutputDeviceListChanged();
 
-    void signalDeviceSwitched();
+    /**
+     * 输出设备发生改变
+     * @param formatChanged 设备格式是否改变, 改变时需要重新设置解码器的输出格式并重新同步
+     */
+    void signalDeviceSwitched(bool formatChanged);
 
 public slots:
 
-    void onAudioOutputDevicesChanged() {
-        refreshDevicesList();
+    /**
+     * 设备目录发布了新的快照. PortAudio 被重新初始化或者还没有可用的流时重新打开流, 否则只更新设备列表.
+     * @param backendReset PortAudio 是否被重新初始化
+     */
+    void onDevicesChanged(bool backendReset) {
+        PonyAudioFormat previousFormat = m_deviceFormat;
+        bool reopened = false;
+        {
+            std::lock_guard lock(AudioDeviceCatalogue::backendLock());
+            if (backendReset || !m_stream) {
+                closeStream();
+                reopened = initializeStream();
+                if (reopened && m_state == PlaybackState::PLAYING) {
+                    PaError err = startStreamSafe();
+                    if (err != paNoError) { qWarning() << "Error at starting stream:" << Pa_GetErrorText(err); }
+                }
+            }
+        }
+        emit signalAudioOutputDeviceListChanged();
+        if (reopened) { emit signalDeviceSwitched(!isSameFormat(previousFormat, m_deviceFormat)); }
     }
 
+    /**
+     * 切换输出设备. 在新设备上打开一个新的流, 启动后再让它接管 DataBuffer, 最后关闭旧的流, 因此缓冲区中的数据不会
+     * 丢失, 也不需要重新 seek. 新设备不在当前的快照中或者无法以当前格式打开时, 继续使用原来的设备. 新设备协商出的
+     * 声道布局不同时重新设置格式, 缓冲区中的数据被丢弃.
+     * @param device 设备名称
+     */
     void requestDeviceSwitch(const QString &device) {
         qDebug() << "change audio output device to " << device;
-        selectedOutputDevice = device;
-        std::unique_lock lock(paStreamLock);
-        if (paInitialized) {
-            Pa_AbortStream(m_stream);
-            Pa_Terminate();
+        ChannelMixSettings mix = channelMix();
+        std::unique_lock lock(AudioDeviceCatalogue::backendLock());
+        PonyAudioFormat previousFormat = m_deviceFormat;
+        auto snapshot = m_backend->snapshot();
+        const AudioDeviceInfo *info = snapshot ? snapshot->find(device) : nullptr;
+        if (!info) {
+            qWarning() << "Audio device" << device << "is not available, keep using" << selectedOutputDevice;
+            return;
         }
-        paInitialized = false;
-        initializeStream();
+        if (negotiateLayout(info, mix) != m_format.getChannelLayout()) {
+            selectedOutputDevice = device;
+            lock.unlock();
+            setFormat(PonyAudioFormat(m_sourceFormat));
+            emit signalDeviceSwitched(true);
+            return;
+        }
+        StreamContext *ctx = openStream(*info);
+        if (!ctx) {
+            qWarning() << "Keep using audio device" << selectedOutputDevice;
+            return;
+        }
+        selectedOutputDevice = device;
         if (m_state == PlaybackState::PLAYING) {
-            startStreamSafe();
+            PaError err = m_backend->startStream(ctx->stream);
+            if (err != paNoError) { qWarning() << "Error at starting stream:" << Pa_GetErrorText(err); }
         }
+        StreamContext *old = m_streamContext;
+        activateStream(ctx);
+        releaseStream(old);
         lock.unlock();
-        emit signalDeviceSwitched();
+        emit signalDeviceSwitched(!isSameFormat(previousFormat, m_deviceFormat));
     }
 
+    /**
+     * 解码器应该输出的格式: 流的采样率和源的声道布局, 声道数与设备不同时由 write 缩混
+     */
     PonyAudioFormat getCurrentDeviceFormat() {
         return m_deviceFormat;
     }
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include "pcmkernels.hpp"
+
+/**
+ * @brief 二阶 IIR 滤波器(biquad).
+ *
+ * 系数按 RBJ Audio EQ Cookbook 设计, 以 a0 归一化. 滤波使用转置直接 II 型, 状态和中间结果使用 double,
+ * 低频, 高采样率时也不会因为舍入误差而失真.
+ */
+namespace Biquad {
+    enum class Type : int {
+        Peaking = 0,   ///< 峰值滤波器, 在中心频率附近提升或衰减
+        LowShelf = 1,  ///< 低架滤波器, 提升或衰减转折频率以下的部分
+        HighShelf = 2, ///< 高架滤波器, 提升或衰减转折频率以上的部分
+    };
+
+    struct Coefficients {
+        double b0 = 1.0, b1 = 0.0, b2 = 0.0, a1 = 0.0, a2 = 0.0;
+    };
+
+    /**
+     * 设计滤波器. 增益为 0dB 时所有类型都是恒等滤波器.
+     * @param type 类型
+     * @param sampleRate 采样率
+     * @param freq 中心(转折)频率, 会被限制在 (0, 奈奎斯特频率) 内
+     * @param gainDb 增益(单位: dB)
+     * @param q 品质因数, 越大越窄
+     */
+    inline Coefficients design(Type type, double sampleRate, double freq, double gainDb, double q) {
+        freq = std::clamp(freq, 1.0, sampleRate * 0.49);
+        q = std::max(q, 0.01);
+        const double a = std::pow(10.0, gainDb / 40.0);
+        const double w0 = 2.0 * PcmKernels::PI * freq / sampleRate;
+        const double cosW0 = std::cos(w0);
+        const double alpha = std::sin(w0) / (2.0 * q);
+        double b0, b1, b2, a0, a1, a2;
+        switch (type) {
+            case Type::LowShelf: {
+                const double k = 2.0 * std::sqrt(a) * alpha;
+                b0 = a * ((a + 1) - (a - 1) * cosW0 + k);
+                b1 = 2 * a * ((a - 1) - (a + 1) * cosW0);
+                b2 = a * ((a + 1) - (a - 1) * cosW0 - k);
+                a0 = (a + 1) + (a - 1) * cosW0 + k;
+                a1 = -2 * ((a - 1) + (a + 1) * cosW0);
+                a2 = (a + 1) + (a - 1) * cosW0 - k;
+                break;
+            }
+            case Type::HighShelf: {
+                const double k = 2.0 * std::sqrt(a) * alpha;
+                b0 = a * ((a + 1) + (a - 1) * cosW0 + k);
+                b1 = -2 * a * ((a - 1) + (a + 1) * cosW0);
+                b2 = a * ((a + 1) + (a - 1) * cosW0 - k);
+                a0 = (a + 1) - (a - 1) * cosW0 + k;
+                a1 = 2 * ((a - 1) - (a + 1) * cosW0);
+                a2 = (a + 1) - (a - 1) * cosW0 - k;
+                break;
+            }
+            case Type::Peaking:
+            default:
+                b0 = 1 + alpha * a;
+                b1 = -2 * cosW0;
+                b2 = 1 - alpha * a;
+                a0 = 1 + alpha / a;
+                a1 = -2 * cosW0;
+                a2 = 1 - alpha / a;
+                break;
+        }
+        return {b0 / a0, b1 / a0, b2 / a0, a1 / a0, a2 / a0};
+    }
+
+    /**
+     * 标量参考实现, 用于回退和测试
+     * @param samples 交错样本
+     * @param frames 帧数
+     * @param channels 声道数
+     * @param channel 处理的声道
+     * @param k 系数
+     * @param z 该声道的两个状态
+     */
+    inline void processChannel(float *samples, std::size_t frames, int channels, int channel,
+                               const Coefficients &k, double *z) {
+        double z1 = z[0], z2 = z[1];
+        float *p = samples + channel;
+        const auto stride = static_cast<std::size_t>(channels);
+        for (std::size_t f = 0; f < frames; ++f, p += stride) {
+            double x = *p;
+            double y = k.b0 * x + z1;
+            z1 = k.b1 * x - k.a1 * y + z2;
+            z2 = k.b2 * x - k.a2 * y;
+            *p = static_cast<float>(y);
+        }
+        z[0] = z1;
+        z[1] = z2;
+    }
+
+#if defined(PONY_PCM_SSE2)
+    /**
+     * 同时处理相邻的两个声道
+     */
+    inline void processPair(float *samples, std::size_t frames, int channels, int channel,
+                            const Coefficients &k, double *z) {
+        const __m128d b0 = _mm_set1_pd(k.b0), b1 = _mm_set1_pd(k.b1), b2 = _mm_set1_pd(k.b2);
+        const __m128d a1 = _mm_set1_pd(k.a1), a2 = _mm_set1_pd(k.a2);
+        // z 的布局为 [声道][状态], 转换为 [状态][声道]
+        __m128d z1 = _mm_setr_pd(z[0], z[2]);
+        __m128d z2 = _mm_setr_pd(z[1], z[3]);
+        float *p = samples + channel;
+        const auto stride = static_cast<std::size_t>(channels);
+        for (std::size_t f = 0; f < frames; ++f, p += stride) {
+            __m128d x = _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p))));
+            __m128d y = _mm_add_pd(_mm_mul_pd(b0, x), z1);
+            z1 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(b1, x), _mm_mul_pd(a1, y)), z2);
+            z2 = _mm_sub_pd(_mm_mul_pd(b2, x), _mm_mul_pd(a2, y));
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(p), _mm_castps_si128(_mm_cvtpd_ps(y)));
+        }
+        double s1[2], s2[2];
+        _mm_storeu_pd(s1, z1);
+        _mm_storeu_pd(s2, z2);
+        z[0] = s1[0];
+        z[1] = s2[0];
+        z[2] = s1[1];
+        z[3] = s2[1];
+    }
+#endif
+
+#if defined(PONY_PCM_AVX2)
+    /**
+     * 同时处理相邻的四个声道, 用于多声道内容
+     */
+    inline void processQuad(float *samples, std::size_t frames, int channels, int channel,
+                            const Coefficients &k, double *z) {
+        const __m256d b0 = _mm256_set1_pd(k.b0), b1 = _mm256_set1_pd(k.b1), b2 = _mm256_set1_pd(k.b2);
+        const __m256d a1 = _mm256_set1_pd(k.a1), a2 = _mm256_set1_pd(k.a2);
+        __m256d z1 = _mm256_setr_pd(z[0], z[2], z[4], z[6]);
+        __m256d z2 = _mm256_setr_pd(z[1], z[3], z[5], z[7]);
+        float *p = samples + channel;
+        const auto stride = static_cast<std::size_t>(channels);
+        for (std::size_t f = 0; f < frames; ++f, p += stride) {
+            __m256d x = _mm256_cvtps_pd(_mm_loadu_ps(p));
+            __m256d y = _mm256_add_pd(_mm256_mul_pd(b0, x), z1);
+            z1 = _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(b1, x), _mm256_mul_pd(a1, y)), z2);
+            z2 = _mm256_sub_pd(_mm256_mul_pd(b2, x), _mm256_mul_pd(a2, y));
+            _mm_storeu_ps(p, _mm256_cvtpd_ps(y));
+        }
+        double s1[4], s2[4];
+        _mm256_storeu_pd(s1, z1);
+        _mm256_storeu_pd(s2, z2);
+        for (int c = 0; c < 4; ++c) {
+            z[2 * c] = s1[c];
+            z[2 * c + 1] = s2[c];
+        }
+    }
+#endif
+
+    /**
+     * @brief 级联的二阶节, 每个声道有独立的状态.
+     *
+     * 逐节处理整块数据, 块内的数据留在缓存中. 声道按 4 个(AVX2) / 2 个(SSE2) 一组向量化, 剩余的声道使用标量实现.
+     */
+    class Cascade {
+    private:
+        int m_channels = 0;
+        std::vector<Coefficients> m_sections;
+        std::vector<double> m_state; // [节][声道][2]
+
+        /**
+         * 状态衰减到这个值以下时置零, 避免静音后出现非规格化数拖慢计算
+         */
+        constexpr static double DENORMAL_THRESHOLD = 1e-200;
+
+    public:
+        void resize(std::size_t sections, int channels) {
+            m_channels = channels;
+            m_sections.assign(sections, Coefficients{});
+            m_state.assign(sections * static_cast<std::size_t>(channels) * 2, 0.0);
+        }
+
+        [[nodiscard]] std::size_t sections() const { return m_sections.size(); }
+
+        [[nodiscard]] int channels() const { return m_channels; }
+
+        void setCoefficients(std::size_t section, const Coefficients &k) { m_sections[section] = k; }
+
+        [[nodiscard]] const Coefficients &coefficients(std::size_t section) const { return m_sections[section]; }
+
+        void reset() { std::fill(m_state.begin(), m_state.end(), 0.0); }
+
+        /**
+         * 原地处理交错样本
+         * @param vectorized 为 false 时只使用标量实现, 用于测试
+         */
+        void process(float *samples, std::size_t frames, bool vectorized = true) {
+            for (std::size_t s = 0; s < m_sections.size(); ++s) {
+                const Coefficients &k = m_sections[s];
+                double *z = m_state.data() + s * static_cast<std::size_t>(m_channels) * 2;
+                int c = 0;
+                if (vectorized) {
+#if defined(PONY_PCM_AVX2)
+                    for (; c + 4 <= m_channels; c += 4) { processQuad(samples, frames, m_channels, c, k, z + 2 * c); }
+#endif
+#if defined(PONY_PCM_SSE2)
+                    for (; c + 2 <= m_channels; c += 2) { processPair(samples, frames, m_channels, c, k, z + 2 * c); }
+#endif
+                }
+                for (; c < m_channels; ++c) { processChannel(samples, frames, m_channels, c, k, z + 2 * c); }
+            }
+            for (double &z: m_state) {
+                if (std::abs(z) < DENORMAL_THRESHOLD) { z = 0.0; }
+            }
+        }
+    };
+}
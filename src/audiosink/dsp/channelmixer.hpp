@@ -0,0 +1,200 @@
+#pragma once
+
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief 声道布局的位掩码, 定义与 FFmpeg 的 AV_CH_* 相同.
+ *
+ * 交错数据中的声道按位从低到高排列, 这也是 WAVEFORMATEXTENSIBLE 和 CoreAudio 默认的顺序, 因此 5.1/7.1 可以直接
+ * 交给 PortAudio 输出.
+ */
+namespace ChannelLayout {
+    constexpr uint64_t FRONT_LEFT = 0x1;
+    constexpr uint64_t FRONT_RIGHT = 0x2;
+    constexpr uint64_t FRONT_CENTER = 0x4;
+    constexpr uint64_t LOW_FREQUENCY = 0x8;
+    constexpr uint64_t BACK_LEFT = 0x10;
+    constexpr uint64_t BACK_RIGHT = 0x20;
+    constexpr uint64_t FRONT_LEFT_OF_CENTER = 0x40;
+    constexpr uint64_t FRONT_RIGHT_OF_CENTER = 0x80;
+    constexpr uint64_t BACK_CENTER = 0x100;
+    constexpr uint64_t SIDE_LEFT = 0x200;
+    constexpr uint64_t SIDE_RIGHT = 0x400;
+
+    constexpr uint64_t MONO = FRONT_CENTER;
+    constexpr uint64_t STEREO = FRONT_LEFT | FRONT_RIGHT;
+    constexpr uint64_t SURROUND_5_1 = STEREO | FRONT_CENTER | LOW_FREQUENCY | BACK_LEFT | BACK_RIGHT;
+    constexpr uint64_t SURROUND_7_1 = SURROUND_5_1 | SIDE_LEFT | SIDE_RIGHT;
+
+    inline int channels(uint64_t layout) {
+        return static_cast<int>(std::bitset<64>(layout).count());
+    }
+
+    /**
+     * 声道在交错数据中的位置
+     * @return layout 不包含 channel 时返回 -1
+     */
+    inline int indexOf(uint64_t layout, uint64_t channel) {
+        if (!(layout & channel)) { return -1; }
+        return channels(layout & (channel - 1));
+    }
+}
+
+/**
+ * @brief 声道混合的设置.
+ */
+struct ChannelMixSettings {
+    int maxChannels = 0;      ///< 输出的最多声道数, 0 表示由设备决定
+    double centerDb = -3.0;   ///< 中置声道混入左右声道的增益(单位: dB)
+    double surroundDb = -3.0; ///< 环绕声道混入同侧声道的增益(单位: dB)
+    double lfeDb = 0.0;       ///< 低音声道混入左右声道的增益(单位: dB), 只在 mixLfe 时使用
+    bool mixLfe = false;      ///< 是否把低音声道混入左右声道, 默认按 ITU-R BS.775 丢弃
+    bool normalize = true;    ///< 缩放矩阵使任意输出声道的系数绝对值之和不超过 1, 避免削波
+};
+
+/**
+ * @brief 协商输出的声道布局, 生成缩混矩阵.
+ *
+ * 设备支持源的声道数时直接输出; 否则依次尝试 5.1(只对多于 6 声道的源), 立体声和单声道. 缩混矩阵交给
+ * PcmKernels::downmix, 每个文件只计算一次, 解码器不需要为每一帧重新混合声道.
+ */
+namespace ChannelMixer {
+    namespace Detail {
+        inline float dbToGain(double db) {
+            return static_cast<float>(std::pow(10.0, db / 20.0));
+        }
+
+        inline void add(std::vector<float> &matrix, uint64_t source, uint64_t target,
+                        uint64_t from, uint64_t to, float gain) {
+            int s = ChannelLayout::indexOf(source, from);
+            int d = ChannelLayout::indexOf(target, to);
+            if (s < 0 || d < 0) { return; }
+            matrix[static_cast<std::size_t>(d * ChannelLayout::channels(source) + s)] += gain;
+        }
+
+        /**
+         * 按声道名称把 source 的每个声道分配到 target 中最接近的位置, target 不能是单声道
+         */
+        inline std::vector<float> route(uint64_t source, uint64_t target, const ChannelMixSettings &settings) {
+            using namespace ChannelLayout;
+            const int srcChannels = channels(source);
+            std::vector<float> matrix(static_cast<std::size_t>(channels(target) * srcChannels), 0.0F);
+            const float center = dbToGain(settings.centerDb);
+            const float surround = dbToGain(settings.surroundDb);
+            const auto half = static_cast<float>(M_SQRT1_2);
+            for (int i = 0; i < 64; ++i) {
+                const uint64_t ch = uint64_t{1} << i;
+                if (!(source & ch)) { continue; }
+                if (target & ch) {
+                    add(matrix, source, target, ch, ch, 1.0F);
+                    continue;
+                }
+                switch (ch) {
+                    case FRONT_CENTER:
+                        add(matrix, source, target, ch, FRONT_LEFT, center);
+                        add(matrix, source, target, ch, FRONT_RIGHT, center);
+                        break;
+                    case LOW_FREQUENCY:
+                        if (settings.mixLfe) {
+                            const float lfe = dbToGain(settings.lfeDb);
+                            add(matrix, source, target, ch, FRONT_LEFT, lfe);
+                            add(matrix, source, target, ch, FRONT_RIGHT, lfe);
+                        }
+                        break;
+                    case FRONT_LEFT_OF_CENTER:
+                        add(matrix, source, target, ch, FRONT_LEFT, 1.0F);
+                        break;
+                    case FRONT_RIGHT_OF_CENTER:
+                        add(matrix, source, target, ch, FRONT_RIGHT, 1.0F);
+                        break;
+                    case BACK_LEFT:
+                    case SIDE_LEFT: {
+                        // 7.1 到 5.1 时侧环绕并入后环绕, 否则混入左声道
+                        uint64_t other = ch == BACK_LEFT ? SIDE_LEFT : BACK_LEFT;
+                        add(matrix, source, target, ch, (target & other) ? other : FRONT_LEFT, surround);
+                        break;
+                    }
+                    case BACK_RIGHT:
+                    case SIDE_RIGHT: {
+                        uint64_t other = ch == BACK_RIGHT ? SIDE_RIGHT : BACK_RIGHT;
+                        add(matrix, source, target, ch, (target & other) ? other : FRONT_RIGHT, surround);
+                        break;
+                    }
+                    case BACK_CENTER:
+                        if (target & BACK_LEFT) {
+                            add(matrix, source, target, ch, BACK_LEFT, half);
+                            add(matrix, source, target, ch, BACK_RIGHT, half);
+                        } else {
+                            add(matrix, source, target, ch, FRONT_LEFT, surround * half);
+                            add(matrix, source, target, ch, FRONT_RIGHT, surround * half);
+                        }
+                        break;
+                    default:
+                        // 顶部等其他声道不参与混合
+                        break;
+                }
+            }
+            return matrix;
+        }
+    }
+
+    /**
+     * 选择输出的声道布局
+     * @param source 源的声道布局
+     * @param supports 设备是否支持给定的声道数
+     * @param maxChannels 输出的最多声道数, 0 表示不限制
+     */
+    template<typename Predicate>
+    uint64_t negotiate(uint64_t source, Predicate &&supports, int maxChannels = 0) {
+        using namespace ChannelLayout;
+        const int srcChannels = channels(source);
+        auto acceptable = [&](uint64_t layout) {
+            int n = channels(layout);
+            return (maxChannels <= 0 || n <= maxChannels) && supports(n);
+        };
+        if (acceptable(source)) { return source; }
+        if (srcChannels > 6 && acceptable(SURROUND_5_1)) { return SURROUND_5_1; }
+        if (source != STEREO && acceptable(STEREO)) { return STEREO; }
+        if (source != MONO && acceptable(MONO)) { return MONO; }
+        // 设备无法满足时仍然尝试立体声, 打开流失败时由调用者报告
+        return STEREO;
+    }
+
+    /**
+     * 生成缩混矩阵
+     * @return 行优先的 channels(target) * channels(source) 矩阵, 布局相同时返回空矩阵
+     */
+    inline std::vector<float> matrix(uint64_t source, uint64_t target, const ChannelMixSettings &settings) {
+        using namespace ChannelLayout;
+        if (source == target) { return {}; }
+        std::vector<float> result;
+        if (target == MONO) {
+            // 先混合为立体声, 再取左右声道的平均
+            std::vector<float> stereo = Detail::route(source, STEREO, settings);
+            const auto srcChannels = static_cast<std::size_t>(channels(source));
+            result.resize(srcChannels);
+            for (std::size_t s = 0; s < srcChannels; ++s) {
+                result[s] = 0.5F * (stereo[s] + stereo[srcChannels + s]);
+            }
+        } else {
+            result = Detail::route(source, target, settings);
+        }
+        if (settings.normalize) {
+            const auto srcChannels = static_cast<std::size_t>(channels(source));
+            float maxSum = 0.0F;
+            for (std::size_t row = 0; row < result.size(); row += srcChannels) {
+                float sum = 0.0F;
+                for (std::size_t s = 0; s < srcChannels; ++s) { sum += std::abs(result[row + s]); }
+                maxSum = std::max(maxSum, sum);
+            }
+            if (maxSum > 1.0F) {
+                for (float &v: result) { v /= maxSum; }
+            }
+        }
+        return result;
+    }
+}
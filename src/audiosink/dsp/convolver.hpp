@@ -0,0 +1,295 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "effectchain.hpp"
+#include "fft.hpp"
+#include "wavfile.hpp"
+
+namespace Convolution {
+    /**
+     * 脉冲响应的最大长度(单位: 秒), 更长的部分被截断
+     */
+    constexpr double MAX_IR_SECS = 10.0;
+
+    /**
+     * 使用加 Blackman 窗的 sinc 插值改变脉冲响应的采样率. 输出按采样率的比值缩放, 保持滤波器的频率响应不变
+     * (而不是保持样本的幅度). 只用于离线处理.
+     * @param wav 输入
+     * @param sampleRate 目标采样率
+     */
+    inline WavData resample(const WavData &wav, int sampleRate) {
+        if (wav.sampleRate == sampleRate || wav.frames() == 0) { return wav; }
+        constexpr int HALF_TAPS = 32;
+        const double ratio = static_cast<double>(sampleRate) / wav.sampleRate;
+        const double cutoff = std::min(1.0, ratio);
+        const double half = HALF_TAPS / cutoff;
+        const auto inFrames = static_cast<std::ptrdiff_t>(wav.frames());
+        const auto outFrames = static_cast<std::size_t>(std::ceil(static_cast<double>(inFrames) * ratio));
+        const auto channels = static_cast<std::size_t>(wav.channels);
+        WavData out;
+        out.sampleRate = sampleRate;
+        out.channels = wav.channels;
+        out.samples.assign(outFrames * channels, 0.0f);
+        std::vector<double> acc(channels);
+        for (std::size_t t = 0; t < outFrames; ++t) {
+            double pos = static_cast<double>(t) / ratio;
+            auto first = std::max<std::ptrdiff_t>(0, static_cast<std::ptrdiff_t>(std::ceil(pos - half)));
+            auto last = std::min<std::ptrdiff_t>(inFrames - 1, static_cast<std::ptrdiff_t>(std::floor(pos + half)));
+            std::fill(acc.begin(), acc.end(), 0.0);
+            for (std::ptrdiff_t k = first; k <= last; ++k) {
+                double d = pos - static_cast<double>(k);
+                double x = PcmKernels::PI * cutoff * d;
+                double sinc = std::abs(x) < 1e-9 ? 1.0 : std::sin(x) / x;
+                double w = 0.42 + 0.5 * std::cos(PcmKernels::PI * d / half) + 0.08 * std::cos(2 * PcmKernels::PI * d / half);
+                double g = cutoff * sinc * w;
+                const float *in = wav.samples.data() + static_cast<std::size_t>(k) * channels;
+                for (std::size_t c = 0; c < channels; ++c) { acc[c] += g * in[c]; }
+            }
+            for (std::size_t c = 0; c < channels; ++c) {
+                out.samples[t * channels + c] = static_cast<float>(acc[c] / ratio);
+            }
+        }
+        return out;
+    }
+}
+
+/**
+ * @brief 均匀分块的 FFT 卷积(overlap-save).
+ *
+ * 脉冲响应被切成长度为 B 的若干块, 每块补零到 2B 后变换到频域. 每凑满 B 帧输入做一次长度为 2B 的 FFT, 放入
+ * 频域延迟线, 与各块的频谱相乘累加后逆变换, 取后一半作为输出. 计算量随脉冲响应长度线性增长, 延迟固定为 B 帧,
+ * 与脉冲响应的长度无关.
+ *
+ * 构造时分配全部内存, process 不分配内存. 脉冲响应只有一个声道时所有声道共用, 否则第 c 个声道使用脉冲响应的
+ * 第 c % irChannels 个声道.
+ */
+class PartitionedConvolver {
+private:
+    int m_sampleRate;
+    int m_channels;
+    int m_irChannels;
+    std::size_t m_block;
+    std::size_t m_bins;
+    std::size_t m_partitions;
+    Fft::RealFft m_fft;
+
+    std::vector<float> m_hRe, m_hIm;     // [脉冲响应声道][块][频点], 已经乘以 1/2B
+    std::vector<float> m_fdlRe, m_fdlIm; // [声道][块][频点], 频域延迟线
+    std::vector<float> m_window;         // [声道][2B], 最近 2B 帧输入
+    std::vector<float> m_output;         // [声道][B], 上一块的输出
+    std::vector<float> m_accRe, m_accIm, m_time;
+    std::size_t m_head = 0; // 频域延迟线中最新一块的位置
+    std::size_t m_pos = 0;  // 当前块已经凑到的帧数
+
+    [[nodiscard]] std::size_t spectrum(std::size_t channel, std::size_t partition) const {
+        return (channel * m_partitions + partition) * m_bins;
+    }
+
+    void computeBlock() {
+        const std::size_t fftSize = 2 * m_block;
+        for (std::size_t c = 0; c < static_cast<std::size_t>(m_channels); ++c) {
+            float *window = m_window.data() + c * fftSize;
+            std::size_t slot = spectrum(c, m_head);
+            m_fft.forward(window, m_fdlRe.data() + slot, m_fdlIm.data() + slot);
+            std::fill(m_accRe.begin(), m_accRe.end(), 0.0f);
+            std::fill(m_accIm.begin(), m_accIm.end(), 0.0f);
+            const std::size_t ir = c % static_cast<std::size_t>(m_irChannels);
+            for (std::size_t p = 0; p < m_partitions; ++p) {
+                std::size_t x = spectrum(c, (m_head + m_partitions - p) % m_partitions);
+                std::size_t h = spectrum(ir, p);
+                Fft::multiplyAccumulate(m_fdlRe.data() + x, m_fdlIm.data() + x, m_hRe.data() + h, m_hIm.data() + h,
+                                        m_accRe.data(), m_accIm.data(), m_bins);
+            }
+            m_fft.inverse(m_accRe.data(), m_accIm.data(), m_time.data());
+            std::memcpy(m_output.data() + c * m_block, m_time.data() + m_block, m_block * sizeof(float));
+            std::memmove(window, window + m_block, m_block * sizeof(float));
+        }
+        m_head = (m_head + 1) % m_partitions;
+    }
+
+public:
+    /**
+     * @param ir 脉冲响应, 采样率需要与 sampleRate 相同, 超过 Convolution::MAX_IR_SECS 的部分被截断
+     * @param sampleRate 采样率
+     * @param channels 声道数
+     * @param blockFrames 分块长度 B, 必须是 2 的幂, 也就是卷积带来的延迟
+     */
+    PartitionedConvolver(const WavData &ir, int sampleRate, int channels, std::size_t blockFrames)
+            : m_sampleRate(sampleRate), m_channels(channels), m_irChannels(std::max(ir.channels, 1)),
+              m_block(blockFrames), m_bins(blockFrames + 1), m_fft(2 * blockFrames) {
+        const std::size_t fftSize = 2 * m_block;
+        const std::size_t irFrames = std::min(ir.frames(), static_cast<std::size_t>(Convolution::MAX_IR_SECS *
+                                                                                     sampleRate));
+        m_partitions = std::max<std::size_t>(1, (irFrames + m_block - 1) / m_block);
+        const auto irChannels = static_cast<std::size_t>(m_irChannels);
+        const auto channelCount = static_cast<std::size_t>(channels);
+        m_hRe.assign(irChannels * m_partitions * m_bins, 0.0f);
+        m_hIm.assign(irChannels * m_partitions * m_bins, 0.0f);
+        std::vector<float> segment(fftSize);
+        const float scale = 1.0f / static_cast<float>(fftSize);
+        for (std::size_t c = 0; c < irChannels; ++c) {
+            for (std::size_t p = 0; p < m_partitions; ++p) {
+                std::fill(segment.begin(), segment.end(), 0.0f);
+                for (std::size_t i = 0; i < m_block && p * m_block + i < irFrames; ++i) {
+                    segment[i] = ir.samples[(p * m_block + i) * irChannels + c] * scale;
+                }
+                std::size_t h = (c * m_partitions + p) * m_bins;
+                m_fft.forward(segment.data(), m_hRe.data() + h, m_hIm.data() + h);
+            }
+        }
+        m_fdlRe.assign(channelCount * m_partitions * m_bins, 0.0f);
+        m_fdlIm.assign(channelCount * m_partitions * m_bins, 0.0f);
+        m_window.assign(channelCount * fftSize, 0.0f);
+        m_output.assign(channelCount * m_block, 0.0f);
+        m_accRe.resize(m_bins);
+        m_accIm.resize(m_bins);
+        m_time.resize(fftSize);
+    }
+
+    [[nodiscard]] int sampleRate() const { return m_sampleRate; }
+
+    [[nodiscard]] int channels() const { return m_channels; }
+
+    [[nodiscard]] std::size_t partitions() const { return m_partitions; }
+
+    /**
+     * 输出相对输入的延迟(单位: 帧)
+     */
+    [[nodiscard]] std::size_t latencyFrames() const { return m_block; }
+
+    /**
+     * 原地处理交错样本, 帧数任意
+     */
+    void process(float *samples, std::size_t frames) {
+        const auto stride = static_cast<std::size_t>(m_channels);
+        const std::size_t fftSize = 2 * m_block;
+        std::size_t done = 0;
+        while (done < frames) {
+            std::size_t n = std::min(m_block - m_pos, frames - done);
+            for (std::size_t c = 0; c < stride; ++c) {
+                float *window = m_window.data() + c * fftSize + m_block + m_pos;
+                const float *output = m_output.data() + c * m_block + m_pos;
+                float *p = samples + done * stride + c;
+                for (std::size_t f = 0; f < n; ++f, p += stride) {
+                    window[f] = *p;
+                    *p = output[f];
+                }
+            }
+            m_pos += n;
+            done += n;
+            if (m_pos == m_block) {
+                computeBlock();
+                m_pos = 0;
+            }
+        }
+    }
+
+    void reset() {
+        std::fill(m_fdlRe.begin(), m_fdlRe.end(), 0.0f);
+        std::fill(m_fdlIm.begin(), m_fdlIm.end(), 0.0f);
+        std::fill(m_window.begin(), m_window.end(), 0.0f);
+        std::fill(m_output.begin(), m_output.end(), 0.0f);
+        m_head = 0;
+        m_pos = 0;
+    }
+};
+
+/**
+ * @brief 卷积效果器, 用于房间校正和耳机脉冲响应.
+ *
+ * 脉冲响应可以在任意线程上设置. 卷积引擎(分块的频谱)在设置脉冲响应的线程上按最近一次 prepare 的格式建立, 以不可变
+ * 快照交给 DSP 线程, DSP 线程不会因为加载很长的脉冲响应而停顿. 格式改变时在 prepare 中重新建立. 启用时带来
+ * latencyFrames 帧的延迟, 效果器链会把延迟报告给音频时钟.
+ */
+class ConvolutionEffect : public IAudioEffect {
+private:
+    std::size_t m_blockFrames;
+    std::shared_ptr<const WavData> m_ir;
+    std::shared_ptr<PartitionedConvolver> m_pending; // 等待 DSP 线程取走的新引擎
+    std::atomic<int> m_preparedRate = 0;
+    std::atomic<int> m_preparedChannels = 0;
+    std::atomic<std::size_t> m_activeLatency = 0;
+
+    // 下面的成员只在 DSP 线程上访问
+    std::shared_ptr<PartitionedConvolver> m_engine;
+    int m_sampleRate = 0;
+    int m_channels = 0;
+
+    std::shared_ptr<PartitionedConvolver> build(const std::shared_ptr<const WavData> &ir, int sampleRate,
+                                                int channels) const {
+        if (!ir || sampleRate <= 0 || channels <= 0) { return nullptr; }
+        return std::make_shared<PartitionedConvolver>(Convolution::resample(*ir, sampleRate), sampleRate, channels,
+                                                      m_blockFrames);
+    }
+
+    [[nodiscard]] bool matches(const PartitionedConvolver &engine) const {
+        return engine.sampleRate() == m_sampleRate && engine.channels() == m_channels;
+    }
+
+public:
+    /**
+     * 默认分块长度, 48kHz 时约 10.7ms
+     */
+    constexpr static std::size_t DEFAULT_BLOCK_FRAMES = 512;
+
+    /**
+     * @param blockFrames 分块长度, 必须是 2 的幂. 越短延迟越低, 但长脉冲响应的计算量越大.
+     */
+    explicit ConvolutionEffect(std::size_t blockFrames = DEFAULT_BLOCK_FRAMES) : m_blockFrames(blockFrames) {}
+
+    /**
+     * 设置脉冲响应, 这个函数是线程安全的. 会在调用者的线程上重新采样并计算频谱, 脉冲响应很长时可能需要一些时间.
+     * @param ir 脉冲响应, 为 nullptr 时关闭卷积
+     */
+    void setImpulseResponse(std::shared_ptr<const WavData> ir) {
+        std::atomic_store(&m_pending, build(ir, m_preparedRate, m_preparedChannels));
+        std::atomic_store(&m_ir, std::move(ir));
+    }
+
+    /**
+     * 获取脉冲响应, 这个函数是线程安全的
+     */
+    [[nodiscard]] std::shared_ptr<const WavData> impulseResponse() const {
+        return std::atomic_load(&m_ir);
+    }
+
+    void prepare(int sampleRate, int channels) override {
+        if (sampleRate == m_sampleRate && channels == m_channels) { return; }
+        m_sampleRate = sampleRate;
+        m_channels = channels;
+        m_preparedRate = sampleRate;
+        m_preparedChannels = channels;
+        m_engine = build(std::atomic_load(&m_ir), sampleRate, channels);
+        m_activeLatency = m_engine ? m_engine->latencyFrames() : 0;
+    }
+
+    void process(float *samples, std::size_t frames) override {
+        if (auto pending = std::atomic_exchange(&m_pending, std::shared_ptr<PartitionedConvolver>())) {
+            // 按旧格式建立的引擎直接丢弃, prepare 已经按新格式重新建立
+            if (matches(*pending)) { m_engine = std::move(pending); }
+        }
+        if (!m_engine) {
+            m_activeLatency = 0;
+            return;
+        }
+        m_activeLatency = m_engine->latencyFrames();
+        m_engine->process(samples, frames);
+    }
+
+    void reset() override {
+        if (m_engine) { m_engine->reset(); }
+    }
+
+    [[nodiscard]] bool bypassed() const override {
+        return !std::atomic_load(&m_ir);
+    }
+
+    [[nodiscard]] std::size_t latencyFrames() const override {
+        return bypassed() ? 0 : m_activeLatency.load();
+    }
+};
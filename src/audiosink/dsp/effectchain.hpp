@@ -0,0 +1,154 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "pcmkernels.hpp"
+
+/**
+ * @brief 音频效果器.
+ *
+ * 效果器处理交错的浮点样本, 运行在 DSP 线程上. 参数可以在任意线程上修改, 效果器需要自行保证参数修改是线程安全的,
+ * 并且 process 中不能加锁, 不能分配内存.
+ */
+class IAudioEffect {
+public:
+    virtual ~IAudioEffect() = default;
+
+    /**
+     * 设置格式, 在第一次 process 之前, 格式改变或者效果器链改变时调用. 可以分配内存, 格式不变时不应清除状态.
+     * @param sampleRate 采样率
+     * @param channels 声道数
+     */
+    virtual void prepare(int sampleRate, int channels) = 0;
+
+    /**
+     * 原地处理样本
+     * @param samples 交错样本
+     * @param frames 帧数
+     */
+    virtual void process(float *samples, std::size_t frames) = 0;
+
+    /**
+     * 清除内部状态(如滤波器的历史), 在输出不连续时调用
+     */
+    virtual void reset() = 0;
+
+    /**
+     * 是否旁路, 旁路的效果器不参与处理
+     */
+    [[nodiscard]] virtual bool bypassed() const { return false; }
+
+    /**
+     * 输出相对输入的延迟(单位: 帧), 旁路时应返回 0. 可以在任意线程上调用.
+     */
+    [[nodiscard]] virtual std::size_t latencyFrames() const { return 0; }
+};
+
+/**
+ * @brief 效果器链.
+ *
+ * 按顺序调用效果器. 链表以不可变快照的形式发布, 修改链表不会阻塞 DSP 线程, DSP 线程每次处理时读取最新的快照.
+ * 所有效果器都旁路时不做格式转换.
+ */
+class AudioEffectChain {
+private:
+    using Effects = std::vector<std::shared_ptr<IAudioEffect>>;
+
+    std::shared_ptr<const Effects> m_effects = std::make_shared<Effects>();
+    std::mutex m_editMutex;
+    std::vector<float> m_scratch;
+    int m_sampleRate = 0;
+    int m_channels = 0;
+    std::atomic<double> m_latencySecs = 0.0;
+
+    // 下面两项只在 DSP 线程上访问, 用于发现新加入的效果器
+    std::shared_ptr<const Effects> m_prepared;
+    bool m_resetPending = false;
+
+    void publish(std::shared_ptr<const Effects> effects) {
+        std::atomic_store(&m_effects, std::move(effects));
+    }
+
+public:
+    /**
+     * 在链尾加入效果器, 这个函数是线程安全的
+     */
+    void append(std::shared_ptr<IAudioEffect> effect) {
+        std::lock_guard lock(m_editMutex);
+        auto effects = std::make_shared<Effects>(*std::atomic_load(&m_effects));
+        effects->push_back(std::move(effect));
+        publish(std::move(effects));
+    }
+
+    /**
+     * 移除效果器, 这个函数是线程安全的. DSP 线程可能仍在使用旧的快照, 效果器在快照释放后才会析构.
+     */
+    void remove(const std::shared_ptr<IAudioEffect> &effect) {
+        std::lock_guard lock(m_editMutex);
+        auto effects = std::make_shared<Effects>(*std::atomic_load(&m_effects));
+        effects->erase(std::remove(effects->begin(), effects->end(), effect), effects->end());
+        publish(std::move(effects));
+    }
+
+    /**
+     * 设置格式, 只能在 DSP 线程上调用
+     */
+    void prepare(int sampleRate, int channels) {
+        m_sampleRate = sampleRate;
+        m_channels = channels;
+        m_prepared = nullptr;
+    }
+
+    /**
+     * 在下一次处理前清除所有效果器的内部状态, 只能在 DSP 线程上调用
+     */
+    void reset() {
+        m_resetPending = true;
+    }
+
+    /**
+     * 最近一次处理时所有效果器的总延迟, 这个函数是线程安全的
+     * @return 单位: 秒
+     */
+    [[nodiscard]] double latencySecs() const {
+        return m_latencySecs;
+    }
+
+    /**
+     * 原地处理 Int16 样本, 只能在 DSP 线程上调用
+     * @param samples 交错样本
+     * @param frames 帧数
+     */
+    void process(int16_t *samples, std::size_t frames) {
+        auto effects = std::atomic_load(&m_effects);
+        if (effects != m_prepared) {
+            // 链表改变后才重新准备, 平时不分配内存
+            for (auto &effect: *effects) { effect->prepare(m_sampleRate, m_channels); }
+            m_prepared = effects;
+        }
+        if (m_resetPending) {
+            for (auto &effect: *effects) { effect->reset(); }
+            m_resetPending = false;
+        }
+        bool active = false;
+        std::size_t latency = 0;
+        for (auto &effect: *effects) {
+            if (effect->bypassed()) { continue; }
+            active = true;
+            latency += effect->latencyFrames();
+        }
+        m_latencySecs = m_sampleRate > 0 ? static_cast<double>(latency) / m_sampleRate : 0.0;
+        if (!active) { return; }
+        std::size_t count = frames * static_cast<std::size_t>(m_channels);
+        if (m_scratch.size() < count) { m_scratch.resize(count); }
+        PcmKernels::toFloat(samples, m_scratch.data(), count);
+        for (auto &effect: *effects) {
+            if (!effect->bypassed()) { effect->process(m_scratch.data(), frames); }
+        }
+        PcmKernels::fromFloat(m_scratch.data(), samples, count);
+    }
+};
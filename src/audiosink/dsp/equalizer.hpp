@@ -0,0 +1,264 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+#include "biquad.hpp"
+#include "effectchain.hpp"
+
+/**
+ * @brief 均衡器的一个频段.
+ */
+struct EqualizerBand {
+    Biquad::Type type = Biquad::Type::Peaking;
+    double freq = 1000.0; ///< 中心(转折)频率(单位: Hz)
+    double gainDb = 0.0;  ///< 增益(单位: dB)
+    double q = 1.41;      ///< 品质因数, 1.41 约为一个倍频程
+};
+
+/**
+ * @brief 均衡器的设置.
+ */
+struct EqualizerSettings {
+    bool enabled = false;
+    double preampDb = 0.0; ///< 前级增益(单位: dB), 提升频段时用于避免削波
+    std::vector<EqualizerBand> bands;
+};
+
+/**
+ * @brief 内置的预设, 基于 31Hz ~ 16kHz 的十段图示均衡.
+ */
+namespace EqualizerPresets {
+    constexpr std::size_t GRAPHIC_BANDS = 10;
+    constexpr double GRAPHIC_FREQS[GRAPHIC_BANDS] = {31.25, 62.5, 125, 250, 500, 1000, 2000, 4000, 8000, 16000};
+
+    struct Preset {
+        const char *name;
+        double gains[GRAPHIC_BANDS];
+    };
+
+    constexpr Preset PRESETS[] = {
+            {"Flat",       {0, 0, 0, 0, 0, 0, 0, 0, 0, 0}},
+            {"Bass",       {6, 5, 4, 2, 0, 0, 0, 0, 0, 0}},
+            {"Treble",     {0, 0, 0, 0, 0, 0, 2, 4, 5, 6}},
+            {"Vocal",      {-2, -2, -1, 1, 3, 4, 3, 1, 0, -1}},
+            {"Rock",       {5, 4, 2, -1, -2, -1, 1, 3, 4, 5}},
+            {"Pop",        {-1, 1, 3, 4, 3, 0, -1, -1, 0, 1}},
+            {"Jazz",       {3, 2, 1, 2, -1, -1, 0, 1, 2, 3}},
+            {"Classical",  {4, 3, 2, 1, -1, -1, 0, 2, 3, 4}},
+            {"Electronic", {5, 4, 1, 0, -2, 1, 0, 1, 4, 5}},
+    };
+
+    /**
+     * 按名称查找预设
+     * @return 找不到时返回 nullptr
+     */
+    inline const Preset *find(const std::string &name) {
+        for (const auto &preset: PRESETS) {
+            if (name == preset.name) { return &preset; }
+        }
+        return nullptr;
+    }
+
+    /**
+     * 十段图示均衡的频段, 增益为 0
+     */
+    inline std::vector<EqualizerBand> graphicBands() {
+        std::vector<EqualizerBand> bands(GRAPHIC_BANDS);
+        for (std::size_t i = 0; i < GRAPHIC_BANDS; ++i) { bands[i].freq = GRAPHIC_FREQS[i]; }
+        return bands;
+    }
+
+    /**
+     * 把预设应用到设置上. 使用十段图示均衡的频段, 前级增益设为最大提升量的相反数, 保证不会削波.
+     * @return 找不到预设时返回 false, 设置不变
+     */
+    inline bool apply(const std::string &name, EqualizerSettings &settings) {
+        const Preset *preset = find(name);
+        if (!preset) { return false; }
+        settings.bands = graphicBands();
+        double maxGain = 0.0;
+        for (std::size_t i = 0; i < GRAPHIC_BANDS; ++i) {
+            settings.bands[i].gainDb = preset->gains[i];
+            maxGain = std::max(maxGain, preset->gains[i]);
+        }
+        settings.preampDb = -maxGain;
+        return true;
+    }
+}
+
+/**
+ * @brief 参数均衡器.
+ *
+ * 每个频段是一个二阶节, 级联后按块处理. 设置可以在任意线程上修改, 以不可变快照发布. 参数改变时, 增益, 频率和
+ * 品质因数按 SMOOTH_SECS 的时间常数逐步趋近目标, 每 SMOOTH_FRAMES 帧重新计算一次系数, 不会产生拉链噪声.
+ * 关闭时先平滑地回到 0dB 再旁路, 打开时从 0dB 开始平滑地过渡.
+ */
+class ParametricEqualizer : public IAudioEffect {
+private:
+    /**
+     * 平滑中的频段参数, 频率和品质因数在对数域上平滑
+     */
+    struct SmoothedBand {
+        Biquad::Type type = Biquad::Type::Peaking;
+        double gainDb = 0.0;
+        double logFreq = 0.0;
+        double logQ = 0.0;
+    };
+
+    std::shared_ptr<const EqualizerSettings> m_settings = std::make_shared<EqualizerSettings>();
+
+    // 下面的成员只在 DSP 线程上访问
+    int m_sampleRate = 0;
+    int m_channels = 0;
+    Biquad::Cascade m_cascade;
+    std::shared_ptr<const EqualizerSettings> m_applied; // 最近一次开始平滑的目标
+    std::vector<SmoothedBand> m_current;
+    double m_preampDb = 0.0;
+    float m_preampGain = 1.0f;
+    bool m_settled = true;
+    bool m_flat = true; // 当前是否已经平滑到 0dB, 用于判断旁路
+
+    constexpr static double SETTLE_EPSILON = 1e-3;
+
+    static SmoothedBand targetOf(const EqualizerBand &band, bool enabled) {
+        return {band.type, enabled ? band.gainDb : 0.0, std::log(band.freq), std::log(band.q)};
+    }
+
+    void updateCoefficients(std::size_t i) {
+        const SmoothedBand &band = m_current[i];
+        m_cascade.setCoefficients(i, Biquad::design(band.type, m_sampleRate, std::exp(band.logFreq), band.gainDb,
+                                                    std::exp(band.logQ)));
+    }
+
+    /**
+     * 频段的数量或类型改变时重新建立级联, 新的频段从 0dB 开始过渡
+     */
+    void rebuild(const EqualizerSettings &settings) {
+        m_cascade.resize(settings.bands.size(), m_channels);
+        m_current.resize(settings.bands.size());
+        for (std::size_t i = 0; i < settings.bands.size(); ++i) {
+            m_current[i] = targetOf(settings.bands[i], false);
+            updateCoefficients(i);
+        }
+        m_settled = false;
+    }
+
+    [[nodiscard]] bool sameLayout(const EqualizerSettings &settings) const {
+        if (settings.bands.size() != m_current.size()) { return false; }
+        for (std::size_t i = 0; i < m_current.size(); ++i) {
+            if (settings.bands[i].type != m_current[i].type) { return false; }
+        }
+        return true;
+    }
+
+    /**
+     * 参数向目标前进一步
+     * @param alpha 平滑系数
+     */
+    void smooth(const EqualizerSettings &settings, double alpha) {
+        bool settled = true;
+        bool flat = true;
+        auto approach = [alpha, &settled](double &value, double target) {
+            double diff = target - value;
+            if (std::abs(diff) < SETTLE_EPSILON) {
+                value = target;
+            } else {
+                value += diff * alpha;
+                settled = false;
+            }
+        };
+        for (std::size_t i = 0; i < m_current.size(); ++i) {
+            SmoothedBand target = targetOf(settings.bands[i], settings.enabled);
+            SmoothedBand &band = m_current[i];
+            SmoothedBand before = band;
+            approach(band.gainDb, target.gainDb);
+            approach(band.logFreq, target.logFreq);
+            approach(band.logQ, target.logQ);
+            if (band.gainDb != before.gainDb || band.logFreq != before.logFreq || band.logQ != before.logQ) {
+                updateCoefficients(i);
+            }
+            flat = flat && band.gainDb == 0.0;
+        }
+        approach(m_preampDb, settings.enabled ? settings.preampDb : 0.0);
+        m_settled = settled;
+        m_flat = flat && m_preampDb == 0.0;
+    }
+
+public:
+    /**
+     * 每次重新计算系数之间的帧数
+     */
+    constexpr static std::size_t SMOOTH_FRAMES = 64;
+    /**
+     * 参数平滑的时间常数(单位: 秒)
+     */
+    constexpr static double SMOOTH_SECS = 0.02;
+
+    ParametricEqualizer() = default;
+
+    explicit ParametricEqualizer(const EqualizerSettings &settings) {
+        setSettings(settings);
+    }
+
+    /**
+     * 修改设置, 这个函数是线程安全的
+     */
+    void setSettings(const EqualizerSettings &settings) {
+        std::atomic_store(&m_settings, std::make_shared<const EqualizerSettings>(settings));
+    }
+
+    /**
+     * 获取设置, 这个函数是线程安全的
+     */
+    [[nodiscard]] EqualizerSettings settings() const {
+        return *std::atomic_load(&m_settings);
+    }
+
+    void prepare(int sampleRate, int channels) override {
+        if (sampleRate == m_sampleRate && channels == m_channels) { return; }
+        m_sampleRate = sampleRate;
+        m_channels = channels;
+        rebuild(*std::atomic_load(&m_settings));
+    }
+
+    void process(float *samples, std::size_t frames) override {
+        auto settings = std::atomic_load(&m_settings);
+        if (settings != m_applied) {
+            if (!sameLayout(*settings)) { rebuild(*settings); }
+            m_applied = settings;
+            m_settled = false;
+        }
+        const double alpha = 1.0 - std::exp(-static_cast<double>(SMOOTH_FRAMES) / (SMOOTH_SECS * m_sampleRate));
+        const auto stride = static_cast<std::size_t>(m_channels);
+        for (std::size_t f = 0; f < frames; f += SMOOTH_FRAMES) {
+            std::size_t n = std::min(SMOOTH_FRAMES, frames - f);
+            float from = m_preampGain;
+            if (!m_settled) {
+                smooth(*settings, alpha);
+                m_preampGain = static_cast<float>(std::pow(10.0, m_preampDb / 20.0));
+            }
+            float *p = samples + f * stride;
+            m_cascade.process(p, n);
+            // 前级增益在块内线性过渡
+            if (from != 1.0f || m_preampGain != 1.0f) {
+                PcmKernels::scaleRamp(p, n, m_channels, from, (m_preampGain - from) / static_cast<float>(n));
+            }
+        }
+        if (m_flat && !settings->enabled) {
+            // 即将旁路, 旁路期间不会调用 process, 清除状态避免重新打开时输出旧的数据
+            m_cascade.reset();
+        }
+    }
+
+    void reset() override {
+        m_cascade.reset();
+    }
+
+    [[nodiscard]] bool bypassed() const override {
+        return m_flat && !std::atomic_load(&m_settings)->enabled;
+    }
+};
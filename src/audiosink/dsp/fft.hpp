@@ -0,0 +1,207 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "pcmkernels.hpp"
+
+/**
+ * @brief 实数 FFT.
+ *
+ * 复数使用实部和虚部分开存放的格式(split complex), 蝶形运算和频域乘加可以直接按 4 个(SSE2) / 8 个(AVX2) 一组
+ * 向量化. 长度为 N 的实数 FFT 通过长度为 N/2 的复数 FFT 计算, 输出 N/2+1 个频点.
+ */
+namespace Fft {
+    /**
+     * 频域乘加 accRe + i * accIm += (xRe + i * xIm) * (hRe + i * hIm)
+     * @param bins 频点数
+     */
+    inline void multiplyAccumulate(const float *xRe, const float *xIm, const float *hRe, const float *hIm,
+                                   float *accRe, float *accIm, std::size_t bins) {
+        std::size_t i = 0;
+#if defined(PONY_PCM_AVX2)
+        for (; i + 8 <= bins; i += 8) {
+            __m256 ar = _mm256_loadu_ps(xRe + i), ai = _mm256_loadu_ps(xIm + i);
+            __m256 br = _mm256_loadu_ps(hRe + i), bi = _mm256_loadu_ps(hIm + i);
+            __m256 re = _mm256_sub_ps(_mm256_mul_ps(ar, br), _mm256_mul_ps(ai, bi));
+            __m256 im = _mm256_add_ps(_mm256_mul_ps(ar, bi), _mm256_mul_ps(ai, br));
+            _mm256_storeu_ps(accRe + i, _mm256_add_ps(_mm256_loadu_ps(accRe + i), re));
+            _mm256_storeu_ps(accIm + i, _mm256_add_ps(_mm256_loadu_ps(accIm + i), im));
+        }
+#endif
+#if defined(PONY_PCM_SSE2)
+        for (; i + 4 <= bins; i += 4) {
+            __m128 ar = _mm_loadu_ps(xRe + i), ai = _mm_loadu_ps(xIm + i);
+            __m128 br = _mm_loadu_ps(hRe + i), bi = _mm_loadu_ps(hIm + i);
+            __m128 re = _mm_sub_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi));
+            __m128 im = _mm_add_ps(_mm_mul_ps(ar, bi), _mm_mul_ps(ai, br));
+            _mm_storeu_ps(accRe + i, _mm_add_ps(_mm_loadu_ps(accRe + i), re));
+            _mm_storeu_ps(accIm + i, _mm_add_ps(_mm_loadu_ps(accIm + i), im));
+        }
+#endif
+        for (; i < bins; ++i) {
+            accRe[i] += xRe[i] * hRe[i] - xIm[i] * hIm[i];
+            accIm[i] += xRe[i] * hIm[i] + xIm[i] * hRe[i];
+        }
+    }
+
+    /**
+     * @brief 长度为 2 的幂的实数 FFT. 构造时计算旋转因子, 变换时不分配内存.
+     */
+    class RealFft {
+    private:
+        std::size_t m_size;        // 实数长度 N
+        std::size_t m_half;        // 复数长度 M = N / 2
+        std::vector<std::size_t> m_bitReverse;
+        std::vector<float> m_twRe, m_twIm;     // 各级蝶形的旋转因子, 第 h 级从下标 h - 1 开始
+        std::vector<float> m_postRe, m_postIm; // 实数变换后处理的旋转因子 exp(-2πik/N)
+        std::vector<float> m_workRe, m_workIm;
+
+        /**
+         * 原地复数 FFT, 输入已经按位反转排列. 交换实部和虚部即可计算逆变换.
+         */
+        void butterflies(float *re, float *im) const {
+            for (std::size_t h = 1; h < m_half; h <<= 1) {
+                const float *wr = m_twRe.data() + h - 1;
+                const float *wi = m_twIm.data() + h - 1;
+                for (std::size_t g = 0; g < m_half; g += 2 * h) {
+                    float *ar = re + g, *ai = im + g, *br = re + g + h, *bi = im + g + h;
+                    std::size_t j = 0;
+#if defined(PONY_PCM_AVX2)
+                    for (; j + 8 <= h; j += 8) {
+                        __m256 xr = _mm256_loadu_ps(br + j), xi = _mm256_loadu_ps(bi + j);
+                        __m256 cr = _mm256_loadu_ps(wr + j), ci = _mm256_loadu_ps(wi + j);
+                        __m256 tr = _mm256_sub_ps(_mm256_mul_ps(xr, cr), _mm256_mul_ps(xi, ci));
+                        __m256 ti = _mm256_add_ps(_mm256_mul_ps(xr, ci), _mm256_mul_ps(xi, cr));
+                        __m256 ur = _mm256_loadu_ps(ar + j), ui = _mm256_loadu_ps(ai + j);
+                        _mm256_storeu_ps(br + j, _mm256_sub_ps(ur, tr));
+                        _mm256_storeu_ps(bi + j, _mm256_sub_ps(ui, ti));
+                        _mm256_storeu_ps(ar + j, _mm256_add_ps(ur, tr));
+                        _mm256_storeu_ps(ai + j, _mm256_add_ps(ui, ti));
+                    }
+#endif
+#if defined(PONY_PCM_SSE2)
+                    for (; j + 4 <= h; j += 4) {
+                        __m128 xr = _mm_loadu_ps(br + j), xi = _mm_loadu_ps(bi + j);
+                        __m128 cr = _mm_loadu_ps(wr + j), ci = _mm_loadu_ps(wi + j);
+                        __m128 tr = _mm_sub_ps(_mm_mul_ps(xr, cr), _mm_mul_ps(xi, ci));
+                        __m128 ti = _mm_add_ps(_mm_mul_ps(xr, ci), _mm_mul_ps(xi, cr));
+                        __m128 ur = _mm_loadu_ps(ar + j), ui = _mm_loadu_ps(ai + j);
+                        _mm_storeu_ps(br + j, _mm_sub_ps(ur, tr));
+                        _mm_storeu_ps(bi + j, _mm_sub_ps(ui, ti));
+                        _mm_storeu_ps(ar + j, _mm_add_ps(ur, tr));
+                        _mm_storeu_ps(ai + j, _mm_add_ps(ui, ti));
+                    }
+#endif
+                    for (; j < h; ++j) {
+                        float tr = br[j] * wr[j] - bi[j] * wi[j];
+                        float ti = br[j] * wi[j] + bi[j] * wr[j];
+                        br[j] = ar[j] - tr;
+                        bi[j] = ai[j] - ti;
+                        ar[j] += tr;
+                        ai[j] += ti;
+                    }
+                }
+            }
+        }
+
+    public:
+        /**
+         * @param size 实数长度, 必须是 2 的幂且不小于 4
+         */
+        explicit RealFft(std::size_t size) : m_size(size), m_half(size / 2) {
+            if (size < 4 || (size & (size - 1)) != 0) {
+                throw std::invalid_argument("FFT size must be a power of 2 and at least 4");
+            }
+            std::size_t bits = 0;
+            while ((std::size_t{1} << bits) < m_half) { ++bits; }
+            m_bitReverse.resize(m_half);
+            for (std::size_t i = 0; i < m_half; ++i) {
+                std::size_t r = 0;
+                for (std::size_t b = 0; b < bits; ++b) { r |= ((i >> b) & 1U) << (bits - 1 - b); }
+                m_bitReverse[i] = r;
+            }
+            m_twRe.resize(m_half);
+            m_twIm.resize(m_half);
+            for (std::size_t h = 1; h < m_half; h <<= 1) {
+                for (std::size_t j = 0; j < h; ++j) {
+                    double angle = -PcmKernels::PI * static_cast<double>(j) / static_cast<double>(h);
+                    m_twRe[h - 1 + j] = static_cast<float>(std::cos(angle));
+                    m_twIm[h - 1 + j] = static_cast<float>(std::sin(angle));
+                }
+            }
+            m_postRe.resize(m_half + 1);
+            m_postIm.resize(m_half + 1);
+            for (std::size_t k = 0; k <= m_half; ++k) {
+                double angle = -2.0 * PcmKernels::PI * static_cast<double>(k) / static_cast<double>(m_size);
+                m_postRe[k] = static_cast<float>(std::cos(angle));
+                m_postIm[k] = static_cast<float>(std::sin(angle));
+            }
+            m_workRe.resize(m_half);
+            m_workIm.resize(m_half);
+        }
+
+        [[nodiscard]] std::size_t size() const { return m_size; }
+
+        /**
+         * 频点数, 等于 N/2+1
+         */
+        [[nodiscard]] std::size_t bins() const { return m_half + 1; }
+
+        /**
+         * 正变换, 不做缩放
+         * @param in N 个实数
+         * @param re 输出 N/2+1 个频点的实部
+         * @param im 输出 N/2+1 个频点的虚部
+         */
+        void forward(const float *in, float *re, float *im) {
+            for (std::size_t i = 0; i < m_half; ++i) {
+                std::size_t r = m_bitReverse[i];
+                m_workRe[r] = in[2 * i];
+                m_workIm[r] = in[2 * i + 1];
+            }
+            butterflies(m_workRe.data(), m_workIm.data());
+            // 由交错的偶数项和奇数项的变换分离出实数序列的变换
+            const float *zr = m_workRe.data(), *zi = m_workIm.data();
+            re[0] = zr[0] + zi[0];
+            im[0] = 0.0f;
+            re[m_half] = zr[0] - zi[0];
+            im[m_half] = 0.0f;
+            for (std::size_t k = 1; k < m_half; ++k) {
+                std::size_t n = m_half - k;
+                float er = 0.5f * (zr[k] + zr[n]), ei = 0.5f * (zi[k] - zi[n]);
+                float or_ = 0.5f * (zi[k] + zi[n]), oi = -0.5f * (zr[k] - zr[n]);
+                re[k] = er + or_ * m_postRe[k] - oi * m_postIm[k];
+                im[k] = ei + or_ * m_postIm[k] + oi * m_postRe[k];
+            }
+        }
+
+        /**
+         * 逆变换, 结果乘以 N, 调用者负责缩放
+         * @param re N/2+1 个频点的实部
+         * @param im N/2+1 个频点的虚部
+         * @param out 输出 N 个实数
+         */
+        void inverse(const float *re, const float *im, float *out) {
+            for (std::size_t k = 0; k < m_half; ++k) {
+                std::size_t n = m_half - k;
+                float er = re[k] + re[n], ei = im[k] - im[n];
+                float dr = re[k] - re[n], di = im[k] + im[n];
+                // 乘以 exp(2πik/N)
+                float or_ = dr * m_postRe[k] + di * m_postIm[k];
+                float oi = di * m_postRe[k] - dr * m_postIm[k];
+                // Z = E + iO, 交换实部和虚部后用正变换计算逆变换
+                std::size_t r = m_bitReverse[k];
+                m_workIm[r] = er - oi;
+                m_workRe[r] = ei + or_;
+            }
+            butterflies(m_workRe.data(), m_workIm.data());
+            for (std::size_t i = 0; i < m_half; ++i) {
+                out[2 * i] = m_workIm[i];
+                out[2 * i + 1] = m_workRe[i];
+            }
+        }
+    };
+}
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+#include "biquad.hpp"
+
+/**
+ * @brief 按 ITU-R BS.1770-4 / EBU R128 测量响度.
+ *
+ * 样本先经过 K 计权(高架预滤波 + RLB 高通), 按声道加权求均方. 以 400ms 为一个门限块, 每 100ms 前进一次(75% 重叠).
+ * 积分响度先丢弃低于 -70 LUFS 的块, 再丢弃比剩余块的平均响度低 10 LU 以上的块. 真峰值通过过采样估计: 采样率低于
+ * 96kHz 时 4 倍, 低于 192kHz 时 2 倍.
+ */
+class LoudnessMeter {
+private:
+    int m_sampleRate;
+    int m_channels;
+    std::vector<double> m_weights;
+    Biquad::Cascade m_kWeighting;
+    std::vector<float> m_scratch;
+
+    std::size_t m_stepFrames;      // 100ms
+    std::size_t m_stepFilled = 0;  // 当前 100ms 已经累计的帧数
+    double m_stepEnergy = 0.0;     // 当前 100ms 的加权平方和
+    double m_recent[4] = {};       // 最近 4 个 100ms 的加权平方和
+    std::size_t m_steps = 0;
+    std::vector<double> m_blockPowers; // 每个门限块的均方
+
+    // 真峰值
+    int m_oversample;
+    std::vector<float> m_phases;    // [相位][抽头]
+    std::vector<float> m_history;   // [声道][抽头], 环形
+    std::size_t m_historyPos = 0;
+    float m_truePeak = 0.0f;
+
+    constexpr static std::size_t PHASE_TAPS = 12;
+
+    static Biquad::Coefficients preFilter(double fs) {
+        const double f0 = 1681.974450955533, gain = 3.999843853973347, q = 0.7071752369554196;
+        const double k = std::tan(PcmKernels::PI * f0 / fs);
+        const double vh = std::pow(10.0, gain / 20.0);
+        const double vb = std::pow(vh, 0.4996667741545416);
+        const double a0 = 1.0 + k / q + k * k;
+        return {(vh + vb * k / q + k * k) / a0, 2.0 * (k * k - vh) / a0, (vh - vb * k / q + k * k) / a0,
+                2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0};
+    }
+
+    static Biquad::Coefficients rlbFilter(double fs) {
+        const double f0 = 38.13547087602444, q = 0.5003270373238773;
+        const double k = std::tan(PcmKernels::PI * f0 / fs);
+        const double a0 = 1.0 + k / q + k * k;
+        return {1.0, -2.0, 1.0, 2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0};
+    }
+
+    /**
+     * 声道权重, 按 SMPTE 顺序 L R C LFE Ls Rs, LFE 不参与计算, 环绕声道 +1.5dB
+     */
+    static double channelWeight(int channel, int channels) {
+        if (channels < 5) { return 1.0; }
+        if (channel == 3) { return 0.0; }
+        if (channel == 4 || channel == 5) { return 1.41; }
+        return 1.0;
+    }
+
+    void designOversampler() {
+        m_oversample = m_sampleRate < 96000 ? 4 : (m_sampleRate < 192000 ? 2 : 1);
+        const std::size_t taps = PHASE_TAPS * static_cast<std::size_t>(m_oversample);
+        const double center = static_cast<double>(taps - 1) / 2.0;
+        m_phases.assign(taps, 0.0f);
+        for (std::size_t n = 0; n < taps; ++n) {
+            double t = (static_cast<double>(n) - center) / m_oversample;
+            double sinc = std::abs(t) < 1e-9 ? 1.0 : std::sin(PcmKernels::PI * t) / (PcmKernels::PI * t);
+            double window = 0.5 - 0.5 * std::cos(2.0 * PcmKernels::PI * (static_cast<double>(n) + 0.5) / static_cast<double>(taps));
+            // 相位 p 的第 k 个抽头对应原型滤波器的第 p + k * oversample 个系数
+            std::size_t phase = n % static_cast<std::size_t>(m_oversample);
+            std::size_t k = n / static_cast<std::size_t>(m_oversample);
+            m_phases[phase * PHASE_TAPS + k] = static_cast<float>(sinc * window);
+        }
+        m_history.assign(PHASE_TAPS * static_cast<std::size_t>(m_channels), 0.0f);
+    }
+
+    void measurePeak(const float *samples, std::size_t frames) {
+        const auto channels = static_cast<std::size_t>(m_channels);
+        float peak = m_truePeak;
+        for (std::size_t f = 0; f < frames; ++f) {
+            const float *in = samples + f * channels;
+            m_historyPos = (m_historyPos + PHASE_TAPS - 1) % PHASE_TAPS;
+            for (std::size_t c = 0; c < channels; ++c) {
+                float *history = m_history.data() + c * PHASE_TAPS;
+                history[m_historyPos] = in[c];
+                peak = std::max(peak, std::abs(in[c]));
+                if (m_oversample == 1) { continue; }
+                for (int p = 0; p < m_oversample; ++p) {
+                    const float *h = m_phases.data() + static_cast<std::size_t>(p) * PHASE_TAPS;
+                    float acc = 0.0f;
+                    for (std::size_t k = 0; k < PHASE_TAPS; ++k) {
+                        acc += h[k] * history[(m_historyPos + k) % PHASE_TAPS];
+                    }
+                    peak = std::max(peak, std::abs(acc));
+                }
+            }
+        }
+        m_truePeak = peak;
+    }
+
+    void finishStep() {
+        m_recent[m_steps % 4] = m_stepEnergy;
+        ++m_steps;
+        m_stepEnergy = 0.0;
+        m_stepFilled = 0;
+        if (m_steps >= 4) {
+            double energy = m_recent[0] + m_recent[1] + m_recent[2] + m_recent[3];
+            m_blockPowers.push_back(energy / static_cast<double>(4 * m_stepFrames));
+        }
+    }
+
+public:
+    constexpr static double ABSOLUTE_GATE_LUFS = -70.0;
+    constexpr static double RELATIVE_GATE_LU = -10.0;
+    /**
+     * ReplayGain 2.0 的参考响度
+     */
+    constexpr static double REFERENCE_LUFS = -18.0;
+
+    LoudnessMeter(int sampleRate, int channels) : m_sampleRate(sampleRate), m_channels(channels),
+                                                  m_stepFrames(static_cast<std::size_t>(sampleRate / 10)) {
+        m_kWeighting.resize(2, channels);
+        m_kWeighting.setCoefficients(0, preFilter(sampleRate));
+        m_kWeighting.setCoefficients(1, rlbFilter(sampleRate));
+        for (int c = 0; c < channels; ++c) { m_weights.push_back(channelWeight(c, channels)); }
+        designOversampler();
+    }
+
+    /**
+     * 加入交错样本
+     */
+    void process(const float *samples, std::size_t frames) {
+        measurePeak(samples, frames);
+        const auto channels = static_cast<std::size_t>(m_channels);
+        std::size_t done = 0;
+        while (done < frames) {
+            std::size_t n = std::min(m_stepFrames - m_stepFilled, frames - done);
+            m_scratch.assign(samples + done * channels, samples + (done + n) * channels);
+            m_kWeighting.process(m_scratch.data(), n);
+            for (std::size_t c = 0; c < channels; ++c) {
+                if (m_weights[c] == 0.0) { continue; }
+                double sum = 0.0;
+                for (std::size_t f = 0; f < n; ++f) {
+                    double v = m_scratch[f * channels + c];
+                    sum += v * v;
+                }
+                m_stepEnergy += m_weights[c] * sum;
+            }
+            m_stepFilled += n;
+            done += n;
+            if (m_stepFilled == m_stepFrames) { finishStep(); }
+        }
+    }
+
+    /**
+     * 均方换算为响度
+     */
+    static double toLufs(double power) {
+        return power > 0.0 ? -0.691 + 10.0 * std::log10(power) : -std::numeric_limits<double>::infinity();
+    }
+
+    /**
+     * 积分响度(单位: LUFS), 没有超过绝对门限的块时返回 -inf
+     */
+    [[nodiscard]] double integratedLoudness() const {
+        return gatedLoudness(m_blockPowers);
+    }
+
+    /**
+     * 对一组门限块做两级门限, 得到积分响度(单位: LUFS)
+     */
+    static double gatedLoudness(const std::vector<double> &powers) {
+        const double absolute = std::pow(10.0, (ABSOLUTE_GATE_LUFS + 0.691) / 10.0);
+        double sum = 0.0;
+        std::size_t count = 0;
+        for (double p: powers) {
+            if (p > absolute) { sum += p, ++count; }
+        }
+        if (count == 0) { return -std::numeric_limits<double>::infinity(); }
+        const double relative = sum / static_cast<double>(count) * std::pow(10.0, RELATIVE_GATE_LU / 10.0);
+        const double gate = std::max(absolute, relative);
+        sum = 0.0;
+        count = 0;
+        for (double p: powers) {
+            if (p > gate) { sum += p, ++count; }
+        }
+        return count == 0 ? -std::numeric_limits<double>::infinity() : toLufs(sum / static_cast<double>(count));
+    }
+
+    /**
+     * 真峰值(线性, 1.0 为满幅)
+     */
+    [[nodiscard]] float truePeak() const { return m_truePeak; }
+
+    /**
+     * 所有门限块的均方, 用于计算专辑的响度
+     */
+    [[nodiscard]] const std::vector<double> &blockPowers() const { return m_blockPowers; }
+
+    /**
+     * 达到参考响度需要的增益(单位: dB)
+     */
+    static double replayGain(double lufs) {
+        return std::isfinite(lufs) ? REFERENCE_LUFS - lufs : 0.0;
+    }
+};
@@ -0,0 +1,727 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define PONY_PCM_AVX2 1
+#define PONY_PCM_SSE2 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PONY_PCM_SSE2 1
+#endif
+
+/**
+ * @brief PCM 样本处理内核.
+ *
+ * 所有内核按样本格式在编译期特化, 并根据编译选项选择 AVX2 / SSE2 实现, 不支持时回退到标量实现.
+ * 交错(interleaved)数据按帧存放, 一帧包含所有声道的一个样本. 浮点样本的范围约定为 [-1, 1].
+ * 内核不分配内存, 可以在音频回调等实时线程中调用.
+ */
+namespace PcmKernels {
+    /**
+     * 内核支持的最大声道数
+     */
+    constexpr int MAX_CHANNELS = 8;
+
+    /**
+     * 圆周率. M_PI 不属于标准 C++, MSVC 需要 _USE_MATH_DEFINES 才会定义
+     */
+    constexpr double PI = 3.14159265358979323846;
+
+    /**
+     * 分块处理时每块的样本数, 分块保证中间结果留在 L1 缓存中
+     */
+    constexpr std::size_t BLOCK_SAMPLES = 512;
+
+    template<typename T>
+    constexpr bool isSupportedSample = std::is_same_v<T, uint8_t> || std::is_same_v<T, int16_t>
+                                       || std::is_same_v<T, int32_t> || std::is_same_v<T, float>;
+
+    /**
+     * 标量参考实现, 用于回退和测试
+     */
+    namespace Scalar {
+        template<typename T>
+        inline void toFloat(const T *src, float *dst, std::size_t count) {
+            static_assert(isSupportedSample<T>, "Unsupported sample format.");
+            for (std::size_t i = 0; i < count; ++i) {
+                if constexpr (std::is_same_v<T, uint8_t>) {
+                    dst[i] = static_cast<float>(static_cast<int>(src[i]) - 128) * (1.0F / 128.0F);
+                } else if constexpr (std::is_same_v<T, int16_t>) {
+                    dst[i] = static_cast<float>(src[i]) * (1.0F / 32768.0F);
+                } else if constexpr (std::is_same_v<T, int32_t>) {
+                    dst[i] = static_cast<float>(src[i]) * (1.0F / 2147483648.0F);
+                } else {
+                    dst[i] = src[i];
+                }
+            }
+        }
+
+        /**
+         * 四舍五入, .5 远离零. 截断后按小数部分进位, 小数部分可以精确表示, 结果与 SIMD 实现逐位相同.
+         * 直接加 0.5 再截断会在 v 接近 0.5 或者超过 2^23 时因为浮点舍入多进一位.
+         */
+        template<typename F>
+        inline int32_t roundHalfAway(F v) {
+            auto t = static_cast<int32_t>(v);
+            F frac = v - static_cast<F>(t);
+            return t + (frac >= F(0.5)) - (frac <= F(-0.5));
+        }
+
+        template<typename T>
+        inline void fromFloat(const float *src, T *dst, std::size_t count) {
+            static_assert(isSupportedSample<T>, "Unsupported sample format.");
+            for (std::size_t i = 0; i < count; ++i) {
+                if constexpr (std::is_same_v<T, float>) {
+                    dst[i] = src[i];
+                } else {
+                    float x = std::clamp(src[i], -1.0F, 1.0F);
+                    if constexpr (std::is_same_v<T, uint8_t>) {
+                        dst[i] = static_cast<uint8_t>(std::min(roundHalfAway(x * 128.0F) + 128, 255));
+                    } else if constexpr (std::is_same_v<T, int16_t>) {
+                        dst[i] = static_cast<int16_t>(std::min(roundHalfAway(x * 32768.0F), 32767));
+                    } else {
+                        // 2147483520 是小于 2^31 的最大 float
+                        dst[i] = roundHalfAway(std::min(x * 2147483648.0F, 2147483520.0F));
+                    }
+                }
+            }
+        }
+
+        inline void scale(float *data, std::size_t count, float gain) {
+            for (std::size_t i = 0; i < count; ++i) { data[i] *= gain; }
+        }
+
+        inline void scaleRamp(float *data, std::size_t frames, int channels, float from, float step) {
+            for (std::size_t f = 0; f < frames; ++f) {
+                float g = from + step * static_cast<float>(f);
+                for (int c = 0; c < channels; ++c) { data[f * static_cast<std::size_t>(channels) + static_cast<std::size_t>(c)] *= g; }
+            }
+        }
+
+        inline float dot(const float *a, const float *b, std::size_t count) {
+            float sum = 0;
+            for (std::size_t i = 0; i < count; ++i) { sum += a[i] * b[i]; }
+            return sum;
+        }
+
+        inline void reverseFrames(std::byte *data, std::size_t frames, std::size_t frameBytes) {
+            if (frames < 2) { return; }
+            std::byte *left = data;
+            std::byte *right = data + (frames - 1) * frameBytes;
+            while (left < right) {
+                std::swap_ranges(left, left + frameBytes, right);
+                left += frameBytes;
+                right -= frameBytes;
+            }
+        }
+
+        template<typename T>
+        inline void interleave(const T *const *planes, T *dst, std::size_t frames, int channels) {
+            for (std::size_t f = 0; f < frames; ++f) {
+                for (int c = 0; c < channels; ++c) { *dst++ = planes[c][f]; }
+            }
+        }
+
+        template<typename T>
+        inline void deinterleave(const T *src, T *const *planes, std::size_t frames, int channels) {
+            for (std::size_t f = 0; f < frames; ++f) {
+                for (int c = 0; c < channels; ++c) { planes[c][f] = *src++; }
+            }
+        }
+
+        inline void downmix(const float *src, int srcChannels, float *dst, int dstChannels,
+                            const float *matrix, std::size_t frames) {
+            for (std::size_t f = 0; f < frames; ++f) {
+                const float *in = src + f * static_cast<std::size_t>(srcChannels);
+                float *out = dst + f * static_cast<std::size_t>(dstChannels);
+                for (int d = 0; d < dstChannels; ++d) {
+                    float acc = 0.0F;
+                    for (int s = 0; s < srcChannels; ++s) { acc += matrix[d * srcChannels + s] * in[s]; }
+                    out[d] = acc;
+                }
+            }
+        }
+
+        inline void mixAdd(float *dst, const float *src, std::size_t count, float gain) {
+            for (std::size_t i = 0; i < count; ++i) { dst[i] += src[i] * gain; }
+        }
+    }
+
+    namespace Detail {
+#ifdef PONY_PCM_SSE2
+        inline __m128 clampUnit(__m128 x) {
+            return _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-1.0F)), _mm_set1_ps(1.0F));
+        }
+
+        /**
+         * 与 Scalar::roundHalfAway 相同. _mm_cvtps_epi32 按当前舍入模式(默认 .5 取偶)舍入, 不能直接使用
+         */
+        inline __m128i roundHalfAway(__m128 v) {
+            __m128i t = _mm_cvttps_epi32(v);
+            __m128 frac = _mm_sub_ps(v, _mm_cvtepi32_ps(t));
+            // 比较结果为全 1, 即整数 -1
+            __m128i up = _mm_castps_si128(_mm_cmpge_ps(frac, _mm_set1_ps(0.5F)));
+            __m128i down = _mm_castps_si128(_mm_cmple_ps(frac, _mm_set1_ps(-0.5F)));
+            return _mm_add_epi32(_mm_sub_epi32(t, up), down);
+        }
+
+        inline __m128i reverse16(__m128i v) {
+            v = _mm_shuffle_epi32(v, 0x4E);
+            v = _mm_shufflelo_epi16(v, 0x1B);
+            return _mm_shufflehi_epi16(v, 0x1B);
+        }
+#endif
+#ifdef PONY_PCM_AVX2
+        inline __m256 clampUnit256(__m256 x) {
+            return _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-1.0F)), _mm256_set1_ps(1.0F));
+        }
+
+        inline __m256i roundHalfAway256(__m256 v) {
+            __m256i t = _mm256_cvttps_epi32(v);
+            __m256 frac = _mm256_sub_ps(v, _mm256_cvtepi32_ps(t));
+            __m256i up = _mm256_castps_si256(_mm256_cmp_ps(frac, _mm256_set1_ps(0.5F), _CMP_GE_OQ));
+            __m256i down = _mm256_castps_si256(_mm256_cmp_ps(frac, _mm256_set1_ps(-0.5F), _CMP_LE_OQ));
+            return _mm256_add_epi32(_mm256_sub_epi32(t, up), down);
+        }
+#endif
+
+        /**
+         * 双指针向量化翻转: 每次从两端各取一个向量, 向量内翻转后交换写回, 中间剩余部分交给标量处理.
+         */
+        template<typename E, std::size_t W, typename Load, typename Store, typename Rev>
+        inline void reverseVector(E *p, std::size_t n, Load load, Store store, Rev rev) {
+            std::size_t i = 0, j = n;
+            while (j - i >= 2 * W) {
+                auto a = load(p + i);
+                auto b = load(p + j - W);
+                store(p + i, rev(b));
+                store(p + j - W, rev(a));
+                i += W;
+                j -= W;
+            }
+            while (j - i >= 2) {
+                std::swap(p[i], p[j - 1]);
+                ++i;
+                --j;
+            }
+        }
+    }
+
+    /**
+     * 将样本转换为浮点
+     * @tparam T 样本类型
+     * @param src 源样本
+     * @param dst 目标浮点样本, 范围 [-1, 1]
+     * @param count 样本数(帧数 * 声道数)
+     */
+    template<typename T>
+    inline void toFloat(const T *src, float *dst, std::size_t count) {
+        static_assert(isSupportedSample<T>, "Unsupported sample format.");
+        std::size_t i = 0;
+        if constexpr (std::is_same_v<T, float>) {
+            if (static_cast<const void *>(src) != static_cast<const void *>(dst)) {
+                std::memmove(dst, src, count * sizeof(float));
+            }
+            return;
+        } else if constexpr (std::is_same_v<T, int16_t>) {
+#if defined(PONY_PCM_AVX2)
+            const __m256 k = _mm256_set1_ps(1.0F / 32768.0F);
+            for (; i + 16 <= count; i += 16) {
+                __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+                __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 8));
+                _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(lo)), k));
+                _mm256_storeu_ps(dst + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(hi)), k));
+            }
+#elif defined(PONY_PCM_SSE2)
+            const __m128 k = _mm_set1_ps(1.0F / 32768.0F);
+            for (; i + 8 <= count; i += 8) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+                __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+                __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+                _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), k));
+                _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), k));
+            }
+#endif
+        } else if constexpr (std::is_same_v<T, int32_t>) {
+#if defined(PONY_PCM_AVX2)
+            const __m256 k = _mm256_set1_ps(1.0F / 2147483648.0F);
+            for (; i + 8 <= count; i += 8) {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+                _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), k));
+            }
+#elif defined(PONY_PCM_SSE2)
+            const __m128 k = _mm_set1_ps(1.0F / 2147483648.0F);
+            for (; i + 4 <= count; i += 4) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+                _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), k));
+            }
+#endif
+        } else if constexpr (std::is_same_v<T, uint8_t>) {
+#if defined(PONY_PCM_SSE2)
+            const __m128 k = _mm_set1_ps(1.0F / 128.0F);
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i bias = _mm_set1_epi16(128);
+            for (; i + 16 <= count; i += 16) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+                __m128i lo16 = _mm_sub_epi16(_mm_unpacklo_epi8(v, zero), bias);
+                __m128i hi16 = _mm_sub_epi16(_mm_unpackhi_epi8(v, zero), bias);
+                __m128i parts[4] = {
+                        _mm_srai_epi32(_mm_unpacklo_epi16(lo16, lo16), 16),
+                        _mm_srai_epi32(_mm_unpackhi_epi16(lo16, lo16), 16),
+                        _mm_srai_epi32(_mm_unpacklo_epi16(hi16, hi16), 16),
+                        _mm_srai_epi32(_mm_unpackhi_epi16(hi16, hi16), 16),
+                };
+                for (int p = 0; p < 4; ++p) {
+                    _mm_storeu_ps(dst + i + static_cast<std::size_t>(p) * 4, _mm_mul_ps(_mm_cvtepi32_ps(parts[p]), k));
+                }
+            }
+#endif
+        }
+        Scalar::toFloat(src + i, dst + i, count - i);
+    }
+
+    /**
+     * 将浮点样本转换为目标格式, 超出 [-1, 1] 的部分饱和截断
+     * @tparam T 样本类型
+     * @param src 源浮点样本
+     * @param dst 目标样本
+     * @param count 样本数(帧数 * 声道数)
+     */
+    template<typename T>
+    inline void fromFloat(const float *src, T *dst, std::size_t count) {
+        static_assert(isSupportedSample<T>, "Unsupported sample format.");
+        std::size_t i = 0;
+        if constexpr (std::is_same_v<T, float>) {
+            if (static_cast<const void *>(src) != static_cast<const void *>(dst)) {
+                std::memmove(dst, src, count * sizeof(float));
+            }
+            return;
+        } else if constexpr (std::is_same_v<T, int16_t>) {
+#if defined(PONY_PCM_AVX2)
+            const __m256 k = _mm256_set1_ps(32768.0F);
+            for (; i + 16 <= count; i += 16) {
+                __m256i a = Detail::roundHalfAway256(_mm256_mul_ps(Detail::clampUnit256(_mm256_loadu_ps(src + i)), k));
+                __m256i b = Detail::roundHalfAway256(_mm256_mul_ps(Detail::clampUnit256(_mm256_loadu_ps(src + i + 8)), k));
+                // packs 按 128 位通道交错, 需要重新排列
+                __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), packed);
+            }
+#elif defined(PONY_PCM_SSE2)
+            const __m128 k = _mm_set1_ps(32768.0F);
+            for (; i + 8 <= count; i += 8) {
+                __m128i a = Detail::roundHalfAway(_mm_mul_ps(Detail::clampUnit(_mm_loadu_ps(src + i)), k));
+                __m128i b = Detail::roundHalfAway(_mm_mul_ps(Detail::clampUnit(_mm_loadu_ps(src + i + 4)), k));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packs_epi32(a, b));
+            }
+#endif
+        } else if constexpr (std::is_same_v<T, int32_t>) {
+#if defined(PONY_PCM_AVX2)
+            const __m256 k = _mm256_set1_ps(2147483648.0F);
+            const __m256 top = _mm256_set1_ps(2147483520.0F);
+            for (; i + 8 <= count; i += 8) {
+                __m256 x = _mm256_min_ps(_mm256_mul_ps(Detail::clampUnit256(_mm256_loadu_ps(src + i)), k), top);
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), Detail::roundHalfAway256(x));
+            }
+#elif defined(PONY_PCM_SSE2)
+            const __m128 k = _mm_set1_ps(2147483648.0F);
+            const __m128 top = _mm_set1_ps(2147483520.0F);
+            for (; i + 4 <= count; i += 4) {
+                __m128 x = _mm_min_ps(_mm_mul_ps(Detail::clampUnit(_mm_loadu_ps(src + i)), k), top);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), Detail::roundHalfAway(x));
+            }
+#endif
+        } else if constexpr (std::is_same_v<T, uint8_t>) {
+#if defined(PONY_PCM_SSE2)
+            const __m128 k = _mm_set1_ps(128.0F);
+            const __m128i bias = _mm_set1_epi16(128);
+            for (; i + 16 <= count; i += 16) {
+                __m128i p0 = Detail::roundHalfAway(_mm_mul_ps(Detail::clampUnit(_mm_loadu_ps(src + i)), k));
+                __m128i p1 = Detail::roundHalfAway(_mm_mul_ps(Detail::clampUnit(_mm_loadu_ps(src + i + 4)), k));
+                __m128i p2 = Detail::roundHalfAway(_mm_mul_ps(Detail::clampUnit(_mm_loadu_ps(src + i + 8)), k));
+                __m128i p3 = Detail::roundHalfAway(_mm_mul_ps(Detail::clampUnit(_mm_loadu_ps(src + i + 12)), k));
+                __m128i lo = _mm_add_epi16(_mm_packs_epi32(p0, p1), bias);
+                __m128i hi = _mm_add_epi16(_mm_packs_epi32(p2, p3), bias);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(lo, hi));
+            }
+#endif
+        }
+        Scalar::fromFloat(src + i, dst + i, count - i);
+    }
+
+    /**
+     * 浮点样本乘以常数增益
+     */
+    inline void scale(float *data, std::size_t count, float gain) {
+        std::size_t i = 0;
+#if defined(PONY_PCM_AVX2)
+        const __m256 g = _mm256_set1_ps(gain);
+        for (; i + 8 <= count; i += 8) { _mm256_storeu_ps(data + i, _mm256_mul_ps(_mm256_loadu_ps(data + i), g)); }
+#elif defined(PONY_PCM_SSE2)
+        const __m128 g = _mm_set1_ps(gain);
+        for (; i + 4 <= count; i += 4) { _mm_storeu_ps(data + i, _mm_mul_ps(_mm_loadu_ps(data + i), g)); }
+#endif
+        Scalar::scale(data + i, count - i, gain);
+    }
+
+    /**
+     * 浮点交错样本乘以线性变化的增益, 第 f 帧的增益为 from + step * f
+     * @param data 交错样本
+     * @param frames 帧数
+     * @param channels 声道数
+     * @param from 首帧增益
+     * @param step 每帧增益变化量
+     */
+    inline void scaleRamp(float *data, std::size_t frames, int channels, float from, float step) {
+        std::size_t f = 0;
+#if defined(PONY_PCM_SSE2)
+        if (channels == 1 || channels == 2 || channels == 4) {
+            // 一个向量覆盖 4 / channels 帧, 预先计算每个通道对应的帧偏移
+            const std::size_t framesPerVec = 4 / static_cast<std::size_t>(channels);
+            const __m128 laneFrame = channels == 1 ? _mm_setr_ps(0, 1, 2, 3)
+                                                   : channels == 2 ? _mm_setr_ps(0, 0, 1, 1)
+                                                                   : _mm_setzero_ps();
+            const __m128 s = _mm_set1_ps(step);
+            for (; f + framesPerVec <= frames; f += framesPerVec) {
+                __m128 g = _mm_add_ps(_mm_set1_ps(from + step * static_cast<float>(f)), _mm_mul_ps(laneFrame, s));
+                float *p = data + f * static_cast<std::size_t>(channels);
+                _mm_storeu_ps(p, _mm_mul_ps(_mm_loadu_ps(p), g));
+            }
+        }
+#endif
+        Scalar::scaleRamp(data + f * static_cast<std::size_t>(channels), frames - f, channels,
+                          from + step * static_cast<float>(f), step);
+    }
+
+    /**
+     * dst += src * gain, 用于混音
+     */
+    inline void mixAdd(float *dst, const float *src, std::size_t count, float gain) {
+        std::size_t i = 0;
+#if defined(PONY_PCM_AVX2)
+        const __m256 g = _mm256_set1_ps(gain);
+        for (; i + 8 <= count; i += 8) {
+            __m256 v = _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_mul_ps(_mm256_loadu_ps(src + i), g));
+            _mm256_storeu_ps(dst + i, v);
+        }
+#elif defined(PONY_PCM_SSE2)
+        const __m128 g = _mm_set1_ps(gain);
+        for (; i + 4 <= count; i += 4) {
+            _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), g)));
+        }
+#endif
+        Scalar::mixAdd(dst + i, src + i, count - i, gain);
+    }
+
+    /**
+     * 浮点样本的内积, 用于计算互相关
+     */
+    inline float dot(const float *a, const float *b, std::size_t count) {
+        std::size_t i = 0;
+        float sum = 0;
+#if defined(PONY_PCM_AVX2)
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        for (; i + 16 <= count; i += 16) {
+            acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+            acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+        }
+        __m256 acc = _mm256_add_ps(acc0, acc1);
+        __m128 v = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+        v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+        v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 0x55));
+        sum = _mm_cvtss_f32(v);
+#elif defined(PONY_PCM_SSE2)
+        __m128 acc0 = _mm_setzero_ps();
+        __m128 acc1 = _mm_setzero_ps();
+        for (; i + 8 <= count; i += 8) {
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+            acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+        }
+        __m128 v = _mm_add_ps(acc0, acc1);
+        v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+        v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 0x55));
+        sum = _mm_cvtss_f32(v);
+#endif
+        return sum + Scalar::dot(a + i, b + i, count - i);
+    }
+
+    /**
+     * 对样本原地施加增益. 增益从 from 线性变化到 to, from == to 时为常数增益.
+     * 整数格式先分块转换为浮点处理, 再饱和写回, 因此不会发生溢出回绕.
+     * @tparam T 样本类型
+     * @param samples 交错样本
+     * @param frames 帧数
+     * @param channels 声道数
+     * @param from 首帧增益
+     * @param to 末帧之后的增益
+     */
+    template<typename T>
+    inline void gainRamp(T *samples, std::size_t frames, int channels, float from, float to) {
+        static_assert(isSupportedSample<T>, "Unsupported sample format.");
+        if (frames == 0) { return; }
+        const float step = (to - from) / static_cast<float>(frames);
+        const auto ch = static_cast<std::size_t>(channels);
+        if constexpr (std::is_same_v<T, float>) {
+            if (from == to) { scale(samples, frames * ch, from); }
+            else { scaleRamp(samples, frames, channels, from, step); }
+        } else {
+            alignas(32) float block[BLOCK_SAMPLES];
+            const std::size_t blockFrames = std::max<std::size_t>(1, BLOCK_SAMPLES / ch);
+            for (std::size_t f = 0; f < frames; f += blockFrames) {
+                std::size_t n = std::min(blockFrames, frames - f);
+                T *p = samples + f * ch;
+                toFloat(p, block, n * ch);
+                if (from == to) { scale(block, n * ch, from); }
+                else { scaleRamp(block, n, channels, from + step * static_cast<float>(f), step); }
+                fromFloat(block, p, n * ch);
+            }
+        }
+    }
+
+    /**
+     * 对样本原地施加常数增益
+     * @tparam T 样本类型
+     * @param samples 样本
+     * @param count 样本数(帧数 * 声道数)
+     * @param gain 增益
+     */
+    template<typename T>
+    inline void gain(T *samples, std::size_t count, float gain) {
+        gainRamp<T>(samples, count, 1, gain, gain);
+    }
+
+    /**
+     * 等功率交叉淡化, 进度为 t 时 dst = outgoing * cos(t * pi / 2) + incoming * sin(t * pi / 2), 两路增益的平方和
+     * 恒为 1, 不相关的信号在淡化过程中响度不变. 增益只在每个块的边界求三角函数, 块内线性插值. 块对应的相位为 h 时插值误差不超过 h^2 / 8, 0.5 秒以上的淡化
+     * 误差小于 16 位样本的 1 LSB.
+     * @tparam T 样本类型
+     * @param outgoing 淡出的交错样本
+     * @param incoming 淡入的交错样本
+     * @param dst 输出, 可以与 outgoing 或 incoming 相同
+     * @param frames 帧数
+     * @param channels 声道数
+     * @param from 首帧的进度, 范围 [0, 1]
+     * @param to 末帧之后的进度, 范围 [0, 1]
+     */
+    template<typename T>
+    inline void crossfade(const T *outgoing, const T *incoming, T *dst, std::size_t frames, int channels,
+                          float from, float to) {
+        static_assert(isSupportedSample<T>, "Unsupported sample format.");
+        if (frames == 0) { return; }
+        const auto ch = static_cast<std::size_t>(channels);
+        const std::size_t blockFrames = std::max<std::size_t>(1, BLOCK_SAMPLES / ch);
+        const float step = (to - from) / static_cast<float>(frames);
+        alignas(32) float a[BLOCK_SAMPLES];
+        alignas(32) float b[BLOCK_SAMPLES];
+        for (std::size_t f = 0; f < frames; f += blockFrames) {
+            std::size_t n = std::min(blockFrames, frames - f);
+            const float t0 = (from + step * static_cast<float>(f)) * static_cast<float>(PI / 2);
+            const float t1 = (from + step * static_cast<float>(f + n)) * static_cast<float>(PI / 2);
+            const float out0 = std::cos(t0), in0 = std::sin(t0);
+            toFloat(outgoing + f * ch, a, n * ch);
+            toFloat(incoming + f * ch, b, n * ch);
+            scaleRamp(a, n, channels, out0, (std::cos(t1) - out0) / static_cast<float>(n));
+            scaleRamp(b, n, channels, in0, (std::sin(t1) - in0) / static_cast<float>(n));
+            mixAdd(a, b, n * ch, 1.0F);
+            fromFloat(a, dst + f * ch, n * ch);
+        }
+    }
+
+    /**
+     * 原地翻转帧的顺序, 帧内声道顺序保持不变. 用于倒放.
+     * @param data 交错样本
+     * @param frames 帧数
+     * @param frameBytes 每帧字节数(样本字节数 * 声道数)
+     */
+    inline void reverseFrames(std::byte *data, std::size_t frames, std::size_t frameBytes) {
+#if defined(PONY_PCM_SSE2)
+        auto loadu = [](auto *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); };
+        auto storeu = [](auto *p, __m128i v) { _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v); };
+        switch (frameBytes) {
+            case 2:
+                // 单声道 Int16
+                Detail::reverseVector<uint16_t, 8>(reinterpret_cast<uint16_t *>(data), frames, loadu, storeu,
+                                                   [](__m128i v) { return Detail::reverse16(v); });
+                return;
+            case 4: {
+                // 双声道 Int16 / 单声道 Float
+#if defined(PONY_PCM_AVX2)
+                const __m256i idx = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+                Detail::reverseVector<uint32_t, 8>(
+                        reinterpret_cast<uint32_t *>(data), frames,
+                        [](uint32_t *p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)); },
+                        [](uint32_t *p, __m256i v) { _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v); },
+                        [idx](__m256i v) { return _mm256_permutevar8x32_epi32(v, idx); });
+#else
+                Detail::reverseVector<uint32_t, 4>(reinterpret_cast<uint32_t *>(data), frames, loadu, storeu,
+                                                   [](__m128i v) { return _mm_shuffle_epi32(v, 0x1B); });
+#endif
+                return;
+            }
+            case 8:
+                // 双声道 Float / Int32
+#if defined(PONY_PCM_AVX2)
+                Detail::reverseVector<uint64_t, 4>(
+                        reinterpret_cast<uint64_t *>(data), frames,
+                        [](uint64_t *p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)); },
+                        [](uint64_t *p, __m256i v) { _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v); },
+                        [](__m256i v) { return _mm256_permute4x64_epi64(v, 0x1B); });
+#else
+                Detail::reverseVector<uint64_t, 2>(reinterpret_cast<uint64_t *>(data), frames, loadu, storeu,
+                                                   [](__m128i v) { return _mm_shuffle_epi32(v, 0x4E); });
+#endif
+                return;
+            default:
+                break;
+        }
+#endif
+        Scalar::reverseFrames(data, frames, frameBytes);
+    }
+
+    /**
+     * 将平面(planar)样本交错. 超过 MAX_CHANNELS 的声道数使用标量实现
+     * @param planes 每个声道的样本指针
+     * @param dst 交错输出
+     * @param frames 帧数
+     * @param channels 声道数
+     */
+    template<typename T>
+    inline void interleave(const T *const *planes, T *dst, std::size_t frames, int channels) {
+        if (channels > MAX_CHANNELS) {
+            Scalar::interleave(planes, dst, frames, channels);
+            return;
+        }
+        std::size_t f = 0;
+#if defined(PONY_PCM_SSE2)
+        if (channels == 2) {
+            const T *l = planes[0];
+            const T *r = planes[1];
+            if constexpr (std::is_same_v<T, float>) {
+                for (; f + 4 <= frames; f += 4) {
+                    __m128 a = _mm_loadu_ps(l + f), b = _mm_loadu_ps(r + f);
+                    _mm_storeu_ps(dst + 2 * f, _mm_unpacklo_ps(a, b));
+                    _mm_storeu_ps(dst + 2 * f + 4, _mm_unpackhi_ps(a, b));
+                }
+            } else if constexpr (std::is_same_v<T, int16_t>) {
+                for (; f + 8 <= frames; f += 8) {
+                    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(l + f));
+                    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(r + f));
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 2 * f), _mm_unpacklo_epi16(a, b));
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 2 * f + 8), _mm_unpackhi_epi16(a, b));
+                }
+            }
+        }
+#endif
+        if (f == frames) { return; }
+        const T *rest[MAX_CHANNELS];
+        for (int c = 0; c < channels; ++c) { rest[c] = planes[c] + f; }
+        Scalar::interleave(rest, dst + f * static_cast<std::size_t>(channels), frames - f, channels);
+    }
+
+    /**
+     * 将交错样本拆分为平面(planar)样本. 超过 MAX_CHANNELS 的声道数使用标量实现
+     * @param src 交错输入
+     * @param planes 每个声道的输出指针
+     * @param frames 帧数
+     * @param channels 声道数
+     */
+    template<typename T>
+    inline void deinterleave(const T *src, T *const *planes, std::size_t frames, int channels) {
+        if (channels > MAX_CHANNELS) {
+            Scalar::deinterleave(src, planes, frames, channels);
+            return;
+        }
+        std::size_t f = 0;
+#if defined(PONY_PCM_SSE2)
+        if (channels == 2) {
+            T *l = planes[0];
+            T *r = planes[1];
+            if constexpr (std::is_same_v<T, float>) {
+                for (; f + 4 <= frames; f += 4) {
+                    __m128 a = _mm_loadu_ps(src + 2 * f), b = _mm_loadu_ps(src + 2 * f + 4);
+                    _mm_storeu_ps(l + f, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+                    _mm_storeu_ps(r + f, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+                }
+            } else if constexpr (std::is_same_v<T, int16_t>) {
+                for (; f + 8 <= frames; f += 8) {
+                    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 2 * f));
+                    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 2 * f + 8));
+                    // 低 16 位是左声道, 高 16 位是右声道, 符号扩展后再饱和打包(不会溢出)
+                    __m128i la = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+                    __m128i lb = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+                    __m128i ra = _mm_srai_epi32(a, 16);
+                    __m128i rb = _mm_srai_epi32(b, 16);
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(l + f), _mm_packs_epi32(la, lb));
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(r + f), _mm_packs_epi32(ra, rb));
+                }
+            }
+        }
+#endif
+        if (f == frames) { return; }
+        T *rest[MAX_CHANNELS];
+        for (int c = 0; c < channels; ++c) { rest[c] = planes[c] + f; }
+        Scalar::deinterleave(src + f * static_cast<std::size_t>(channels), rest, frames - f, channels);
+    }
+
+    namespace Detail {
+        /**
+         * 输入声道数在编译期确定, 矩阵的一行可以完全展开, 编译器能够把帧循环向量化
+         */
+        template<int S, int D>
+        inline void downmixFixed(const float *src, float *dst, const float *matrix, std::size_t frames) {
+            float m[D][S];
+            for (int d = 0; d < D; ++d) {
+                for (int s = 0; s < S; ++s) { m[d][s] = matrix[d * S + s]; }
+            }
+            for (std::size_t f = 0; f < frames; ++f) {
+                const float *in = src + f * S;
+                float *out = dst + f * D;
+                for (int d = 0; d < D; ++d) {
+                    float acc = 0.0F;
+                    for (int s = 0; s < S; ++s) { acc += m[d][s] * in[s]; }
+                    out[d] = acc;
+                }
+            }
+        }
+    }
+
+    /**
+     * 按矩阵重新混合声道, out[d] = sum(matrix[d][s] * in[s]). 常见的声道组合使用编译期展开的实现,
+     * 其余组合回退到标量实现.
+     * @param src 交错输入
+     * @param srcChannels 输入声道数
+     * @param dst 交错输出, 不能与 src 重叠
+     * @param dstChannels 输出声道数
+     * @param matrix 行优先的 dstChannels * srcChannels 矩阵
+     * @param frames 帧数
+     */
+    inline void downmix(const float *src, int srcChannels, float *dst, int dstChannels,
+                        const float *matrix, std::size_t frames) {
+#define PONY_DOWNMIX_CASE(S, D) \
+        if (srcChannels == (S) && dstChannels == (D)) { \
+            Detail::downmixFixed<S, D>(src, dst, matrix, frames); \
+            return; \
+        }
+        PONY_DOWNMIX_CASE(1, 2)
+        PONY_DOWNMIX_CASE(2, 1)
+        PONY_DOWNMIX_CASE(2, 2)
+        PONY_DOWNMIX_CASE(3, 2)
+        PONY_DOWNMIX_CASE(4, 2)
+        PONY_DOWNMIX_CASE(5, 2)
+        PONY_DOWNMIX_CASE(6, 2)
+        PONY_DOWNMIX_CASE(7, 2)
+        PONY_DOWNMIX_CASE(8, 2)
+        PONY_DOWNMIX_CASE(6, 1)
+        PONY_DOWNMIX_CASE(8, 1)
+        PONY_DOWNMIX_CASE(8, 6)
+#undef PONY_DOWNMIX_CASE
+        Scalar::downmix(src, srcChannels, dst, dstChannels, matrix, frames);
+    }
+}
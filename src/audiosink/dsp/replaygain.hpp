@@ -0,0 +1,146 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include "effectchain.hpp"
+
+/**
+ * @brief 一个文件的 ReplayGain 信息, 由媒体库导入时的响度分析得到.
+ */
+struct ReplayGainInfo {
+    bool scanned = false;
+    double trackGain = 0.0; ///< 音轨增益(单位: dB)
+    double trackPeak = 0.0; ///< 音轨真峰值(线性)
+    double albumGain = 0.0; ///< 专辑增益(单位: dB), 专辑没有分析完毕时 albumPeak 为 0
+    double albumPeak = 0.0; ///< 专辑真峰值(线性)
+};
+
+enum class ReplayGainMode {
+    Off = 0,
+    Track = 1,
+    Album = 2
+};
+
+/**
+ * @brief ReplayGain 的设置.
+ */
+struct ReplayGainSettings {
+    ReplayGainMode mode = ReplayGainMode::Track;
+    double preampDb = 0.0;        ///< 在分析得到的增益之上额外的增益(单位: dB)
+    bool preventClipping = true;  ///< 限制增益使真峰值不超过满幅
+};
+
+/**
+ * @brief 播放时应用预先计算的 ReplayGain 增益.
+ *
+ * 增益在 setInfo/setSettings 的调用线程上计算, 通过原子变量交给 DSP 线程. 增益改变时在 RAMP_SECS 内线性过渡,
+ * 避免切换文件或模式时产生爆音. 增益为 0dB 时旁路.
+ */
+class ReplayGainEffect : public IAudioEffect {
+private:
+    std::shared_ptr<const ReplayGainInfo> m_info = std::make_shared<ReplayGainInfo>();
+    std::shared_ptr<const ReplayGainSettings> m_settings = std::make_shared<ReplayGainSettings>();
+    std::atomic<float> m_target = 1.0f;
+
+    // 下面的成员只在 DSP 线程上访问
+    int m_sampleRate = 0;
+    int m_channels = 0;
+    float m_current = 1.0f;
+    float m_rampTarget = 1.0f;
+    float m_rampStep = 0.0f;
+    std::size_t m_rampRemaining = 0;
+
+    void update() {
+        m_target = static_cast<float>(linearGain(*std::atomic_load(&m_info), *std::atomic_load(&m_settings)));
+    }
+
+public:
+    /**
+     * 增益过渡的时间(单位: 秒)
+     */
+    constexpr static double RAMP_SECS = 0.05;
+
+    ReplayGainEffect() = default;
+
+    explicit ReplayGainEffect(const ReplayGainSettings &settings) {
+        setSettings(settings);
+    }
+
+    /**
+     * 计算线性增益. 没有分析结果或者关闭时为 1; 专辑模式下专辑没有分析完毕时使用音轨增益.
+     */
+    static double linearGain(const ReplayGainInfo &info, const ReplayGainSettings &settings) {
+        if (settings.mode == ReplayGainMode::Off || !info.scanned) { return 1.0; }
+        bool album = settings.mode == ReplayGainMode::Album && info.albumPeak > 0.0;
+        double gainDb = (album ? info.albumGain : info.trackGain) + settings.preampDb;
+        double peak = album ? info.albumPeak : info.trackPeak;
+        double gain = std::pow(10.0, gainDb / 20.0);
+        if (settings.preventClipping && peak > 0.0) { gain = std::min(gain, 1.0 / peak); }
+        return gain;
+    }
+
+    /**
+     * 设置当前文件的分析结果, 这个函数是线程安全的
+     */
+    void setInfo(const ReplayGainInfo &info) {
+        std::atomic_store(&m_info, std::make_shared<const ReplayGainInfo>(info));
+        update();
+    }
+
+    /**
+     * 修改设置, 这个函数是线程安全的
+     */
+    void setSettings(const ReplayGainSettings &settings) {
+        std::atomic_store(&m_settings, std::make_shared<const ReplayGainSettings>(settings));
+        update();
+    }
+
+    /**
+     * 获取设置, 这个函数是线程安全的
+     */
+    [[nodiscard]] ReplayGainSettings settings() const {
+        return *std::atomic_load(&m_settings);
+    }
+
+    /**
+     * 当前的目标增益(线性), 这个函数是线程安全的
+     */
+    [[nodiscard]] float targetGain() const { return m_target; }
+
+    void prepare(int sampleRate, int channels) override {
+        m_sampleRate = sampleRate;
+        m_channels = channels;
+    }
+
+    void process(float *samples, std::size_t frames) override {
+        float target = m_target;
+        if (target != m_rampTarget) {
+            auto rampFrames = std::max<std::size_t>(1, static_cast<std::size_t>(RAMP_SECS * m_sampleRate));
+            m_rampTarget = target;
+            m_rampRemaining = rampFrames;
+            m_rampStep = (target - m_current) / static_cast<float>(rampFrames);
+        }
+        std::size_t ramp = std::min(frames, m_rampRemaining);
+        if (ramp > 0) {
+            PcmKernels::scaleRamp(samples, ramp, m_channels, m_current, m_rampStep);
+            m_rampRemaining -= ramp;
+            m_current = m_rampRemaining == 0 ? m_rampTarget : m_current + m_rampStep * static_cast<float>(ramp);
+        }
+        if (ramp < frames && m_current != 1.0f) {
+            PcmKernels::scale(samples + ramp * static_cast<std::size_t>(m_channels),
+                              (frames - ramp) * static_cast<std::size_t>(m_channels), m_current);
+        }
+    }
+
+    void reset() override {
+        // 输出不连续时直接跳到目标增益
+        m_current = m_rampTarget = m_target;
+        m_rampRemaining = 0;
+    }
+
+    [[nodiscard]] bool bypassed() const override {
+        return m_current == 1.0f && m_rampRemaining == 0 && m_target == 1.0f;
+    }
+};
@@ -0,0 +1,355 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+#include "sonic.h"
+#include "pcmkernels.hpp"
+
+/**
+ * @brief 变速不变调引擎.
+ *
+ * 所有引擎接受和输出交错的 Int16 样本, 内部缓存一部分输入, 因此写入和读出的帧数不一一对应.
+ */
+class ITimeStretcher {
+public:
+    virtual ~ITimeStretcher() = default;
+
+    virtual void setSpeed(float speed) = 0;
+
+    virtual void setPitch(float pitch) = 0;
+
+    virtual void setVolume(float volume) = 0;
+
+    [[nodiscard]] virtual float speed() const = 0;
+
+    /**
+     * 写入样本
+     * @param samples 交错样本
+     * @param frames 帧数
+     */
+    virtual void write(const int16_t *samples, int frames) = 0;
+
+    /**
+     * 读取处理后的样本, 没有读出的样本保留到下一次读取
+     * @param samples 交错样本
+     * @param maxFrames 最多读取的帧数
+     * @return 实际读取的帧数
+     */
+    virtual int read(int16_t *samples, int maxFrames) = 0;
+
+    /**
+     * 丢弃内部缓存的所有样本
+     */
+    virtual void clear() = 0;
+};
+
+namespace TimeStretch {
+    enum class Engine : int {
+        Sonic = 0, ///< 基于基音周期的 PICOLA, CPU 占用最低, 人声以外的内容在高倍速下失真明显
+        Wsola = 1, ///< 波形相似叠加, 对音乐和多人对话更自然
+    };
+
+    enum class Quality : int {
+        Fast = 0,
+        Balanced = 1,
+        High = 2,
+    };
+
+    /**
+     * WSOLA 的参数(单位: 秒)
+     */
+    struct WsolaParams {
+        double sequenceSecs; ///< 每次拼接的片段长度
+        double seekSecs;     ///< 搜索最相似位置的范围(单侧)
+        double overlapSecs;  ///< 相邻片段交叉淡化的长度
+        int coarseStep;      ///< 粗搜索的步长(单位: 帧), 之后在最优位置附近逐帧细化
+    };
+
+    inline WsolaParams paramsOf(Quality quality) {
+        switch (quality) {
+            case Quality::Fast:
+                return {0.060, 0.012, 0.008, 4};
+            case Quality::Balanced:
+                return {0.040, 0.015, 0.010, 2};
+            case Quality::High:
+                return {0.030, 0.020, 0.012, 1};
+        }
+        return {0.040, 0.015, 0.010, 2};
+    }
+
+    namespace Detail {
+        /**
+         * 按帧存取的浮点 FIFO, 从头部消费时只移动下标, 积累到一定长度再整体前移
+         */
+        class FrameFifo {
+        private:
+            std::vector<float> m_data;
+            std::size_t m_head = 0; // 单位: 样本
+            std::size_t m_channels;
+
+        public:
+            explicit FrameFifo(int channels) : m_channels(static_cast<std::size_t>(channels)) {}
+
+            [[nodiscard]] std::size_t frames() const { return (m_data.size() - m_head) / m_channels; }
+
+            [[nodiscard]] float *at(std::size_t frame) { return m_data.data() + m_head + frame * m_channels; }
+
+            float *append(std::size_t frames) {
+                std::size_t old = m_data.size();
+                m_data.resize(old + frames * m_channels);
+                return m_data.data() + old;
+            }
+
+            void consume(std::size_t frames) {
+                m_head = std::min(m_data.size(), m_head + frames * m_channels);
+                if (m_head == m_data.size()) {
+                    m_data.clear();
+                    m_head = 0;
+                } else if (m_head > 16384 && m_head * 2 > m_data.size()) {
+                    m_data.erase(m_data.begin(), m_data.begin() + static_cast<std::ptrdiff_t>(m_head));
+                    m_head = 0;
+                }
+            }
+
+            void clear() {
+                m_data.clear();
+                m_head = 0;
+            }
+        };
+    }
+}
+
+/**
+ * @brief sonic 引擎.
+ */
+class SonicStretcher : public ITimeStretcher {
+private:
+    sonicStream m_stream;
+    std::vector<int16_t> m_discard;
+
+public:
+    SonicStretcher(int sampleRate, int channels, TimeStretch::Quality quality) {
+        m_stream = sonicCreateStream(sampleRate, channels);
+        sonicSetChordPitch(m_stream, 1);
+        sonicSetQuality(m_stream, quality == TimeStretch::Quality::High ? 1 : 0);
+        m_discard.resize(static_cast<std::size_t>(4096 * channels));
+    }
+
+    ~SonicStretcher() override {
+        sonicDestroyStream(m_stream);
+    }
+
+    void setSpeed(float speed) override { sonicSetSpeed(m_stream, speed); }
+
+    void setPitch(float pitch) override { sonicSetPitch(m_stream, pitch); }
+
+    void setVolume(float volume) override { sonicSetVolume(m_stream, volume); }
+
+    [[nodiscard]] float speed() const override { return sonicGetSpeed(m_stream); }
+
+    void write(const int16_t *samples, int frames) override {
+        sonicWriteShortToStream(m_stream, samples, frames);
+    }
+
+    int read(int16_t *samples, int maxFrames) override {
+        return sonicReadShortFromStream(m_stream, samples, maxFrames);
+    }
+
+    void clear() override {
+        sonicFlushStream(m_stream);
+        int maxFrames = static_cast<int>(m_discard.size()) / sonicGetNumChannels(m_stream);
+        while (sonicReadShortFromStream(m_stream, m_discard.data(), maxFrames) > 0);
+    }
+};
+
+/**
+ * @brief WSOLA 引擎.
+ *
+ * 每次从输入的名义位置附近 seek 范围内找到与上一片段结尾最相似的位置, 取 sequence 长的片段与上一片段交叉淡化后
+ * 拼接, 名义位置按 (sequence - overlap) * tempo 前进. tempo 为 1 时不搜索, 输出与输入完全相同. 变调时先按
+ * speed / pitch 变速, 再按 pitch 线性插值重采样. 检测到瞬态(新片段能量明显高于上一片段)时缩短交叉淡化,
+ * 避免打击乐的起音被抹平. 相似度使用归一化互相关, 内积由 PcmKernels::dot 向量化计算.
+ */
+class WsolaStretcher : public ITimeStretcher {
+private:
+    constexpr static float TRANSIENT_RATIO = 4.0f;
+    constexpr static float ENERGY_EPSILON = 1e-9f;
+
+    int m_channels;
+    std::size_t m_sequence, m_seek, m_overlap, m_coarseStep;
+    float m_speed = 1.0f, m_pitch = 1.0f, m_volume = 1.0f;
+
+    TimeStretch::Detail::FrameFifo m_input;
+    TimeStretch::Detail::FrameFifo m_stretched;
+    TimeStretch::Detail::FrameFifo m_output;
+    double m_inputPos = 0.0;    // 下一个片段在 m_input 中的名义位置(单位: 帧)
+    double m_resamplePos = 0.0; // 重采样在 m_stretched 中的位置(单位: 帧)
+    std::vector<float> m_mid;   // 上一片段的结尾, 用于交叉淡化
+    std::vector<float> m_fade;
+    bool m_hasMid = false;
+
+    [[nodiscard]] std::size_t samplesOf(std::size_t frames) const {
+        return frames * static_cast<std::size_t>(m_channels);
+    }
+
+    [[nodiscard]] float similarity(const float *candidate) const {
+        std::size_t n = samplesOf(m_overlap);
+        float energy = PcmKernels::dot(candidate, candidate, n);
+        return PcmKernels::dot(m_mid.data(), candidate, n) / std::sqrt(energy + ENERGY_EPSILON);
+    }
+
+    /**
+     * 在 [lo, hi] 中寻找与 m_mid 最相似的片段起点
+     */
+    std::size_t search(std::size_t lo, std::size_t hi) {
+        std::size_t best = lo;
+        float bestScore = -std::numeric_limits<float>::infinity();
+        for (std::size_t pos = lo; pos <= hi; pos += m_coarseStep) {
+            float score = similarity(m_input.at(pos));
+            if (score > bestScore) {
+                bestScore = score;
+                best = pos;
+            }
+        }
+        if (m_coarseStep > 1) {
+            std::size_t refineLo = best > lo + m_coarseStep ? best - m_coarseStep : lo;
+            std::size_t refineHi = std::min(hi, best + m_coarseStep);
+            for (std::size_t pos = refineLo; pos <= refineHi; ++pos) {
+                float score = similarity(m_input.at(pos));
+                if (score > bestScore) {
+                    bestScore = score;
+                    best = pos;
+                }
+            }
+        }
+        return best;
+    }
+
+    void stretch() {
+        const double tempo = static_cast<double>(m_speed) / static_cast<double>(m_pitch);
+        const std::size_t hop = m_sequence - m_overlap;
+        while (true) {
+            auto nominal = static_cast<std::size_t>(m_inputPos);
+            if (nominal + m_seek + m_sequence > m_input.frames()) { break; }
+            std::size_t start = nominal;
+            if (m_hasMid && tempo != 1.0) {
+                start = search(nominal > m_seek ? nominal - m_seek : 0, nominal + m_seek);
+            }
+            const float *segment = m_input.at(start);
+            float *out = m_stretched.append(hop);
+            const std::size_t overlapSamples = samplesOf(m_overlap);
+            if (m_hasMid) {
+                std::size_t fadeFrames = m_overlap;
+                float midEnergy = PcmKernels::dot(m_mid.data(), m_mid.data(), overlapSamples);
+                float segmentEnergy = PcmKernels::dot(segment, segment, overlapSamples);
+                if (segmentEnergy > TRANSIENT_RATIO * midEnergy + ENERGY_EPSILON) { fadeFrames = std::max<std::size_t>(1, m_overlap / 4); }
+                const std::size_t fadeSamples = samplesOf(fadeFrames);
+                const float step = 1.0f / static_cast<float>(fadeFrames);
+                std::copy(m_mid.begin(), m_mid.begin() + static_cast<std::ptrdiff_t>(fadeSamples), out);
+                PcmKernels::scaleRamp(out, fadeFrames, m_channels, 1.0f, -step);
+                std::copy(segment, segment + fadeSamples, m_fade.begin());
+                PcmKernels::scaleRamp(m_fade.data(), fadeFrames, m_channels, 0.0f, step);
+                PcmKernels::mixAdd(out, m_fade.data(), fadeSamples, 1.0f);
+                std::copy(segment + fadeSamples, segment + samplesOf(hop), out + fadeSamples);
+            } else {
+                std::copy(segment, segment + samplesOf(hop), out);
+            }
+            std::copy(segment + samplesOf(hop), segment + samplesOf(m_sequence), m_mid.begin());
+            m_hasMid = true;
+            m_inputPos += static_cast<double>(hop) * tempo;
+        }
+        // 保留名义位置之前 seek 范围内的输入用于搜索
+        auto keepFrom = static_cast<std::size_t>(m_inputPos);
+        keepFrom = keepFrom > m_seek ? keepFrom - m_seek : 0;
+        keepFrom = std::min(keepFrom, m_input.frames());
+        m_input.consume(keepFrom);
+        m_inputPos -= static_cast<double>(keepFrom);
+    }
+
+    void resample() {
+        const std::size_t ch = static_cast<std::size_t>(m_channels);
+        if (m_pitch == 1.0f && m_resamplePos == 0.0) {
+            std::size_t frames = m_stretched.frames();
+            if (frames == 0) { return; }
+            std::copy(m_stretched.at(0), m_stretched.at(0) + samplesOf(frames), m_output.append(frames));
+            m_stretched.consume(frames);
+            return;
+        }
+        while (m_resamplePos + 1.0 < static_cast<double>(m_stretched.frames())) {
+            auto index = static_cast<std::size_t>(m_resamplePos);
+            auto frac = static_cast<float>(m_resamplePos - static_cast<double>(index));
+            const float *a = m_stretched.at(index);
+            const float *b = a + ch;
+            float *out = m_output.append(1);
+            for (std::size_t c = 0; c < ch; ++c) { out[c] = a[c] + (b[c] - a[c]) * frac; }
+            m_resamplePos += m_pitch;
+        }
+        auto consumed = std::min(static_cast<std::size_t>(m_resamplePos), m_stretched.frames());
+        m_stretched.consume(consumed);
+        m_resamplePos -= static_cast<double>(consumed);
+    }
+
+public:
+    WsolaStretcher(int sampleRate, int channels, TimeStretch::Quality quality) : m_channels(channels),
+                                                                                m_input(channels),
+                                                                                m_stretched(channels),
+                                                                                m_output(channels) {
+        TimeStretch::WsolaParams params = TimeStretch::paramsOf(quality);
+        auto framesOf = [sampleRate](double secs) {
+            return static_cast<std::size_t>(std::lround(secs * sampleRate));
+        };
+        m_overlap = std::max<std::size_t>(8, framesOf(params.overlapSecs));
+        m_sequence = std::max(2 * m_overlap, framesOf(params.sequenceSecs));
+        m_seek = framesOf(params.seekSecs);
+        m_coarseStep = static_cast<std::size_t>(std::max(1, params.coarseStep));
+        m_mid.resize(samplesOf(m_overlap));
+        m_fade.resize(samplesOf(m_overlap));
+    }
+
+    void setSpeed(float speed) override { m_speed = std::max(speed, 0.05f); }
+
+    void setPitch(float pitch) override { m_pitch = std::max(pitch, 0.05f); }
+
+    void setVolume(float volume) override { m_volume = volume; }
+
+    [[nodiscard]] float speed() const override { return m_speed; }
+
+    void write(const int16_t *samples, int frames) override {
+        if (frames <= 0) { return; }
+        auto n = static_cast<std::size_t>(frames);
+        PcmKernels::toFloat(samples, m_input.append(n), samplesOf(n));
+        stretch();
+        resample();
+    }
+
+    int read(int16_t *samples, int maxFrames) override {
+        std::size_t n = std::min(m_output.frames(), static_cast<std::size_t>(std::max(maxFrames, 0)));
+        if (n == 0) { return 0; }
+        float *data = m_output.at(0);
+        if (m_volume != 1.0f) { PcmKernels::scale(data, samplesOf(n), m_volume); }
+        PcmKernels::fromFloat(data, samples, samplesOf(n));
+        m_output.consume(n);
+        return static_cast<int>(n);
+    }
+
+    void clear() override {
+        m_input.clear();
+        m_stretched.clear();
+        m_output.clear();
+        m_inputPos = 0.0;
+        m_resamplePos = 0.0;
+        m_hasMid = false;
+    }
+};
+
+namespace TimeStretch {
+    inline std::unique_ptr<ITimeStretcher> create(Engine engine, Quality quality, int sampleRate, int channels) {
+        if (engine == Engine::Wsola) {
+            return std::make_unique<WsolaStretcher>(sampleRate, channels, quality);
+        }
+        return std::make_unique<SonicStretcher>(sampleRate, channels, quality);
+    }
+}
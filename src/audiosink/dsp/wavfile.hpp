@@ -0,0 +1,174 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * @brief 解码后的 WAV 音频.
+ */
+struct WavData {
+    int sampleRate = 0;
+    int channels = 0;
+    std::vector<float> samples; ///< 交错样本, 范围 [-1, 1]
+
+    [[nodiscard]] std::size_t frames() const {
+        return channels > 0 ? samples.size() / static_cast<std::size_t>(channels) : 0;
+    }
+};
+
+/**
+ * @brief 读取 RIFF/WAVE 文件, 用于加载脉冲响应.
+ *
+ * 支持 8/16/24/32 位整数和 32/64 位浮点 PCM, 包括 WAVE_FORMAT_EXTENSIBLE. 格式错误时抛出 std::runtime_error.
+ */
+namespace WavFile {
+    namespace Private {
+        constexpr uint16_t FORMAT_PCM = 1;
+        constexpr uint16_t FORMAT_FLOAT = 3;
+        constexpr uint16_t FORMAT_EXTENSIBLE = 0xFFFE;
+
+        inline uint16_t u16(const unsigned char *p) {
+            return static_cast<uint16_t>(p[0] | (p[1] << 8));
+        }
+
+        inline uint32_t u32(const unsigned char *p) {
+            return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+                   (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+        }
+
+        inline float sampleAt(const unsigned char *p, uint16_t format, uint16_t bits) {
+            if (format == FORMAT_FLOAT) {
+                if (bits == 32) {
+                    float v;
+                    uint32_t raw = u32(p);
+                    std::memcpy(&v, &raw, sizeof(v));
+                    return v;
+                }
+                double v;
+                uint64_t raw = static_cast<uint64_t>(u32(p)) | (static_cast<uint64_t>(u32(p + 4)) << 32);
+                std::memcpy(&v, &raw, sizeof(v));
+                return static_cast<float>(v);
+            }
+            switch (bits) {
+                case 8:
+                    return static_cast<float>(static_cast<int>(p[0]) - 128) / 128.0f;
+                case 16:
+                    return static_cast<float>(static_cast<int16_t>(u16(p))) / 32768.0f;
+                case 24: {
+                    auto v = static_cast<int32_t>(static_cast<uint32_t>(p[0] << 8) | static_cast<uint32_t>(p[1] << 16) |
+                                                  (static_cast<uint32_t>(p[2]) << 24));
+                    return static_cast<float>(v >> 8) / 8388608.0f;
+                }
+                default:
+                    return static_cast<float>(static_cast<double>(static_cast<int32_t>(u32(p))) / 2147483648.0);
+            }
+        }
+    }
+
+    /**
+     * 解析内存中的 WAV 文件
+     * @param data 文件内容
+     * @param size 文件长度
+     */
+    inline WavData parse(const void *data, std::size_t size) {
+        using namespace Private;
+        const auto *bytes = static_cast<const unsigned char *>(data);
+        if (size < 12 || std::memcmp(bytes, "RIFF", 4) != 0 || std::memcmp(bytes + 8, "WAVE", 4) != 0) {
+            throw std::runtime_error("not a RIFF/WAVE file");
+        }
+        uint16_t format = 0, channels = 0, bits = 0;
+        uint32_t sampleRate = 0;
+        const unsigned char *payload = nullptr;
+        std::size_t payloadSize = 0;
+        std::size_t pos = 12;
+        while (pos + 8 <= size) {
+            const unsigned char *chunk = bytes + pos;
+            std::size_t chunkSize = u32(chunk + 4);
+            const unsigned char *body = chunk + 8;
+            std::size_t available = std::min(chunkSize, size - pos - 8);
+            if (std::memcmp(chunk, "fmt ", 4) == 0) {
+                if (available < 16) { throw std::runtime_error("truncated fmt chunk"); }
+                format = u16(body);
+                channels = u16(body + 2);
+                sampleRate = u32(body + 4);
+                bits = u16(body + 14);
+                if (format == FORMAT_EXTENSIBLE) {
+                    // 子格式 GUID 的前两个字节就是格式代码
+                    if (available < 26) { throw std::runtime_error("truncated extensible fmt chunk"); }
+                    format = u16(body + 24);
+                }
+            } else if (std::memcmp(chunk, "data", 4) == 0) {
+                payload = body;
+                payloadSize = available;
+            }
+            pos += 8 + chunkSize + (chunkSize & 1U);
+        }
+        if (format == 0 || payload == nullptr) { throw std::runtime_error("missing fmt or data chunk"); }
+        bool supported = (format == FORMAT_PCM && (bits == 8 || bits == 16 || bits == 24 || bits == 32)) ||
+                         (format == FORMAT_FLOAT && (bits == 32 || bits == 64));
+        if (!supported || channels == 0 || sampleRate == 0) {
+            throw std::runtime_error("unsupported WAV format " + std::to_string(format) + " with " +
+                                     std::to_string(bits) + " bits");
+        }
+        WavData wav;
+        wav.sampleRate = static_cast<int>(sampleRate);
+        wav.channels = channels;
+        const std::size_t bytesPerSample = bits / 8U;
+        const std::size_t count = payloadSize / bytesPerSample / channels * channels;
+        wav.samples.resize(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            wav.samples[i] = sampleAt(payload + i * bytesPerSample, format, bits);
+        }
+        return wav;
+    }
+
+    /**
+     * 生成 44 字节的 WAV 文件头, 用于流式写入: 先写入长度为 0 的文件头, 写完数据后再用实际长度重写
+     * @param isFloat 样本是否为浮点, 否则为整数 PCM
+     * @param dataSize 数据长度(单位: byte)
+     */
+    inline std::vector<char> header(int sampleRate, int channels, int bitsPerSample, bool isFloat, uint32_t dataSize) {
+        auto put16 = [](std::vector<char> &out, uint16_t v) {
+            out.push_back(static_cast<char>(v & 0xFF));
+            out.push_back(static_cast<char>(v >> 8));
+        };
+        auto put32 = [](std::vector<char> &out, uint32_t v) {
+            for (int i = 0; i < 4; ++i) { out.push_back(static_cast<char>((v >> (8 * i)) & 0xFF)); }
+        };
+        const int blockAlign = channels * bitsPerSample / 8;
+        std::vector<char> out;
+        out.reserve(44);
+        out.insert(out.end(), {'R', 'I', 'F', 'F'});
+        put32(out, 36 + dataSize);
+        out.insert(out.end(), {'W', 'A', 'V', 'E', 'f', 'm', 't', ' '});
+        put32(out, 16);
+        put16(out, isFloat ? Private::FORMAT_FLOAT : Private::FORMAT_PCM);
+        put16(out, static_cast<uint16_t>(channels));
+        put32(out, static_cast<uint32_t>(sampleRate));
+        put32(out, static_cast<uint32_t>(sampleRate * blockAlign));
+        put16(out, static_cast<uint16_t>(blockAlign));
+        put16(out, static_cast<uint16_t>(bitsPerSample));
+        out.insert(out.end(), {'d', 'a', 't', 'a'});
+        put32(out, dataSize);
+        return out;
+    }
+
+    /**
+     * 编码为 32 位浮点 WAV 文件, 用于测试和导出
+     */
+    inline std::vector<char> encode(const WavData &wav) {
+        auto dataSize = static_cast<uint32_t>(wav.samples.size() * sizeof(float));
+        std::vector<char> out = header(wav.sampleRate, wav.channels, 32, true, dataSize);
+        out.reserve(out.size() + dataSize);
+        for (float v: wav.samples) {
+            uint32_t raw;
+            std::memcpy(&raw, &v, sizeof(raw));
+            for (int i = 0; i < 4; ++i) { out.push_back(static_cast<char>((raw >> (8 * i)) & 0xFF)); }
+        }
+        return out;
+    }
+}
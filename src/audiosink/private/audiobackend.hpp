@@ -0,0 +1,369 @@
+#pragma once
+
+#include <QtCore>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "portaudio.h"
+#include "devicecatalogue.hpp"
+#include "dsp/pcmkernels.hpp"
+#include "dsp/wavfile.hpp"
+
+/**
+ * @brief 音频输出后端, 负责打开和控制流.
+ *
+ * 接口与 PortAudio 的流接口一一对应: 流由 PaStream * 标识, 回调的参数和返回值与 PortAudio 相同. 因此 DataBuffer,
+ * 变速引擎, 效果器链和时钟的逻辑由所有后端共用, 后端只决定回调在什么时候, 以什么速度被调用, 以及输出写到哪里.
+ * 除 PortAudioBackend 以外的后端不需要声卡, 可以在 CI 和没有音频设备的渲染节点上运行.
+ *
+ * 后端通过环境变量 PONY_AUDIO_BACKEND 选择: portaudio(默认), null, wav, raw. wav 和 raw 写入 PONY_AUDIO_OUTPUT
+ * 指定的文件. PONY_AUDIO_RATE 是 null, wav, raw 消耗数据的速度, 1 为实时(默认), 0 为尽可能快.
+ */
+class IAudioBackend {
+public:
+    enum class Kind {
+        PortAudio, ///< 声卡
+        Null,      ///< 丢弃输出
+        Wav,       ///< 写入 WAV 文件
+        Raw        ///< 写入裸 PCM 文件
+    };
+
+    virtual ~IAudioBackend() = default;
+
+    /**
+     * 设备目录, 不需要设备的后端返回 nullptr
+     */
+    virtual AudioDeviceCatalogue *catalogue() { return nullptr; }
+
+    /**
+     * 可以使用的设备, 这个函数是线程安全的且不会阻塞
+     * @return 还没有可用的设备时返回 nullptr
+     */
+    [[nodiscard]] virtual std::shared_ptr<const AudioDeviceSnapshot> snapshot() const = 0;
+
+    /**
+     * 不按实时速度运行的后端在 available 返回 false 时等待, 而不是输出静音. available 在回调线程上调用, 不能阻塞.
+     * @param available 参数为这次回调需要的数据(单位: byte), 返回是否可以调用回调
+     */
+    virtual void setDataAvailable(std::function<bool(size_t)> available) {}
+
+    virtual PaError openStream(PaStream **stream, const PaStreamParameters &param, double sampleRate,
+                               unsigned long framesPerBuffer, PaStreamCallback *callback, void *userData) = 0;
+
+    virtual PaError setStreamFinishedCallback(PaStream *stream, PaStreamFinishedCallback *callback) = 0;
+
+    virtual PaError startStream(PaStream *stream) = 0;
+
+    virtual PaError stopStream(PaStream *stream) = 0;
+
+    virtual PaError abortStream(PaStream *stream) = 0;
+
+    virtual PaError closeStream(PaStream *stream) = 0;
+
+    virtual const PaStreamInfo *streamInfo(PaStream *stream) = 0;
+
+    virtual PaTime streamTime(PaStream *stream) = 0;
+
+    /**
+     * 环境变量 PONY_AUDIO_BACKEND 选择的后端
+     */
+    static Kind configuredKind() {
+        QString name = qEnvironmentVariable("PONY_AUDIO_BACKEND").toLower();
+        if (name == "null") { return Kind::Null; }
+        if (name == "wav") { return Kind::Wav; }
+        if (name == "raw") { return Kind::Raw; }
+        if (!name.isEmpty() && name != "portaudio") {
+            qWarning() << "Unknown audio backend" << name << ", use PortAudio.";
+        }
+        return Kind::PortAudio;
+    }
+
+    /**
+     * 按环境变量创建后端
+     */
+    static std::unique_ptr<IAudioBackend> fromEnvironment();
+};
+
+/**
+ * @brief 通过 PortAudio 输出到声卡.
+ */
+class PortAudioBackend : public IAudioBackend {
+public:
+    AudioDeviceCatalogue *catalogue() override { return AudioDeviceCatalogue::instance(); }
+
+    [[nodiscard]] std::shared_ptr<const AudioDeviceSnapshot> snapshot() const override {
+        return AudioDeviceCatalogue::instance()->snapshot();
+    }
+
+    PaError openStream(PaStream **stream, const PaStreamParameters &param, double sampleRate,
+                       unsigned long framesPerBuffer, PaStreamCallback *callback, void *userData) override {
+        return Pa_OpenStream(stream, nullptr, &param, sampleRate, framesPerBuffer, paClipOff, callback, userData);
+    }
+
+    PaError setStreamFinishedCallback(PaStream *stream, PaStreamFinishedCallback *callback) override {
+        return Pa_SetStreamFinishedCallback(stream, callback);
+    }
+
+    PaError startStream(PaStream *stream) override { return Pa_StartStream(stream); }
+
+    PaError stopStream(PaStream *stream) override { return Pa_StopStream(stream); }
+
+    PaError abortStream(PaStream *stream) override { return Pa_AbortStream(stream); }
+
+    PaError closeStream(PaStream *stream) override { return Pa_CloseStream(stream); }
+
+    const PaStreamInfo *streamInfo(PaStream *stream) override { return Pa_GetStreamInfo(stream); }
+
+    PaTime streamTime(PaStream *stream) override { return Pa_GetStreamTime(stream); }
+};
+
+/**
+ * @brief 不需要声卡的后端, 在每个流自己的线程上按设定的速度调用回调.
+ *
+ * rate 为 1 时与真实设备一样按实时速度消耗数据, 大于 1 时加速, 为 0 时尽可能快. 尽可能快时没有数据就等待,
+ * 输出不会因为解码跟不上而出现静音. 流时间是虚拟的, 每次回调前进一个缓冲区的时长, 因此时钟和播放位置与消耗的
+ * 数据严格对应, 不受调度抖动影响.
+ *
+ * 指定输出文件时把回调输出的数据按播放顺序写入同一个 WAV 或者裸 PCM 文件. 格式改变时 WAV 不能继续写入,
+ * 之后的数据写入带有序号的新文件, 例如 out-1.wav.
+ */
+class HeadlessAudioBackend : public IAudioBackend {
+private:
+    struct Stream {
+        PaStreamCallback *callback;
+        void *userData;
+        PaStreamFinishedCallback *finished = nullptr;
+        int channels;
+        int bytesPerFrame;
+        unsigned long framesPerBuffer;
+        PaStreamInfo info{};
+        std::vector<std::byte> buffer;
+        std::thread thread;
+        std::atomic<bool> running = false;
+        std::atomic<PaTime> time = 0.0;
+    };
+
+    Kind m_kind;
+    std::string m_path;
+    double m_rate;
+    std::shared_ptr<const AudioDeviceSnapshot> m_snapshot;
+    std::function<bool(size_t)> m_available;
+
+    std::mutex m_fileMutex;
+    FILE *m_file = nullptr;
+    int m_fileSampleRate = 0;
+    int m_fileChannels = 0;
+    uint64_t m_fileBytes = 0;
+    int m_fileSegment = 0;
+    bool m_fileFailed = false;
+
+    constexpr static unsigned long DEFAULT_FRAMES_PER_BUFFER = 512;
+
+    static double steadyNow() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    std::string segmentPath() const {
+        if (m_fileSegment == 0) { return m_path; }
+        auto slash = m_path.find_last_of("/\\");
+        auto dot = m_path.rfind('.');
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) { dot = m_path.size(); }
+        return m_path.substr(0, dot) + "-" + std::to_string(m_fileSegment) + m_path.substr(dot);
+    }
+
+    /**
+     * 用实际的长度重写 WAV 文件头, 需要持有 m_fileMutex
+     */
+    void syncFileLocked() {
+        if (!m_file) { return; }
+        if (m_kind == Kind::Wav) {
+            auto dataSize = static_cast<uint32_t>(std::min<uint64_t>(m_fileBytes, UINT32_MAX - 36));
+            std::vector<char> header = WavFile::header(m_fileSampleRate, m_fileChannels, 16, false, dataSize);
+            long end = std::ftell(m_file);
+            std::fseek(m_file, 0, SEEK_SET);
+            std::fwrite(header.data(), 1, header.size(), m_file);
+            std::fseek(m_file, end, SEEK_SET);
+        }
+        std::fflush(m_file);
+    }
+
+    void closeFileLocked() {
+        if (!m_file) { return; }
+        syncFileLocked();
+        std::fclose(m_file);
+        m_file = nullptr;
+        ++m_fileSegment;
+    }
+
+    void writeFile(const Stream *stream, const void *data, size_t len) {
+        std::lock_guard lock(m_fileMutex);
+        const auto sampleRate = static_cast<int>(stream->info.sampleRate);
+        if (m_file && (m_fileSampleRate != sampleRate || m_fileChannels != stream->channels)) { closeFileLocked(); }
+        if (!m_file) {
+            std::string path = segmentPath();
+            if (m_fileFailed) { return; }
+            m_file = std::fopen(path.c_str(), "wb");
+            if (!m_file) {
+                qWarning() << "Can not open audio output file" << QString::fromStdString(path);
+                m_fileFailed = true;
+                return;
+            }
+            m_fileSampleRate = sampleRate;
+            m_fileChannels = stream->channels;
+            m_fileBytes = 0;
+            if (m_kind == Kind::Wav) {
+                std::vector<char> header = WavFile::header(sampleRate, stream->channels, 16, false, 0);
+                std::fwrite(header.data(), 1, header.size(), m_file);
+            }
+        }
+        m_fileBytes += std::fwrite(data, 1, len, m_file);
+    }
+
+    void run(Stream *stream) {
+        const double bufferSecs = static_cast<double>(stream->framesPerBuffer) / stream->info.sampleRate;
+        const auto wallStart = std::chrono::steady_clock::now();
+        const PaTime start = stream->time;
+        while (stream->running) {
+            if (m_rate <= 0 && m_available && !m_available(stream->buffer.size())) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            PaStreamCallbackTimeInfo timeInfo;
+            timeInfo.inputBufferAdcTime = 0.0;
+            timeInfo.currentTime = stream->time;
+            timeInfo.outputBufferDacTime = stream->time + stream->info.outputLatency;
+            int result = stream->callback(nullptr, stream->buffer.data(), stream->framesPerBuffer, &timeInfo, 0,
+                                          stream->userData);
+            // 只有 DataBuffer 为空时才会返回 paComplete, 这时的输出是静音, 不写入文件
+            if (result == paContinue && m_kind != Kind::Null) {
+                writeFile(stream, stream->buffer.data(), stream->buffer.size());
+            }
+            stream->time = stream->time + bufferSecs;
+            if (result != paContinue) { break; }
+            if (m_rate > 0) {
+                std::this_thread::sleep_until(wallStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                        std::chrono::duration<double>((stream->time - start) / m_rate)));
+            }
+        }
+        stream->running = false;
+        if (stream->finished) { stream->finished(stream->userData); }
+    }
+
+    static void join(Stream *stream) {
+        stream->running = false;
+        if (stream->thread.joinable() && stream->thread.get_id() != std::this_thread::get_id()) {
+            stream->thread.join();
+        }
+    }
+
+public:
+    /**
+     * @param kind Null, Wav 或者 Raw
+     * @param path 输出文件, kind 为 Null 时忽略
+     * @param rate 相对实时的速度, 0 表示尽可能快
+     */
+    HeadlessAudioBackend(Kind kind, std::string path, double rate) : m_kind(kind), m_path(std::move(path)),
+                                                                      m_rate(std::max(0.0, rate)) {
+        auto snapshot = std::make_shared<AudioDeviceSnapshot>();
+        AudioDeviceInfo info;
+        info.name = kind == Kind::Null ? "Null Output" : QString("File Output (%1)").arg(QString::fromStdString(m_path));
+        info.index = 0;
+        info.maxOutputChannels = PcmKernels::MAX_CHANNELS;
+        info.defaultSampleRate = 48000.0;
+        info.defaultLowOutputLatency = static_cast<double>(DEFAULT_FRAMES_PER_BUFFER) / info.defaultSampleRate;
+        info.defaultHighOutputLatency = info.defaultLowOutputLatency;
+        snapshot->devices.insert(info.name, info);
+        snapshot->outputNames.append(info.name);
+        snapshot->defaultDevice = info.name;
+        m_snapshot = std::move(snapshot);
+    }
+
+    ~HeadlessAudioBackend() override {
+        std::lock_guard lock(m_fileMutex);
+        closeFileLocked();
+    }
+
+    [[nodiscard]] std::shared_ptr<const AudioDeviceSnapshot> snapshot() const override { return m_snapshot; }
+
+    void setDataAvailable(std::function<bool(size_t)> available) override { m_available = std::move(available); }
+
+    PaError openStream(PaStream **stream, const PaStreamParameters &param, double sampleRate,
+                       unsigned long framesPerBuffer, PaStreamCallback *callback, void *userData) override {
+        if (param.channelCount <= 0 || param.channelCount > PcmKernels::MAX_CHANNELS) { return paInvalidChannelCount; }
+        if (param.sampleFormat != paInt16) { return paSampleFormatNotSupported; }
+        if (sampleRate <= 0) { return paInvalidSampleRate; }
+        auto *s = new Stream;
+        s->callback = callback;
+        s->userData = userData;
+        s->channels = param.channelCount;
+        s->bytesPerFrame = param.channelCount * static_cast<int>(sizeof(int16_t));
+        s->framesPerBuffer = framesPerBuffer == paFramesPerBufferUnspecified ? DEFAULT_FRAMES_PER_BUFFER
+                                                                              : framesPerBuffer;
+        s->buffer.resize(s->framesPerBuffer * static_cast<unsigned long>(s->bytesPerFrame));
+        s->info.structVersion = 1;
+        s->info.outputLatency = static_cast<double>(s->framesPerBuffer) / sampleRate;
+        s->info.sampleRate = sampleRate;
+        s->time = steadyNow();
+        *stream = s;
+        return paNoError;
+    }
+
+    PaError setStreamFinishedCallback(PaStream *stream, PaStreamFinishedCallback *callback) override {
+        static_cast<Stream *>(stream)->finished = callback;
+        return paNoError;
+    }
+
+    PaError startStream(PaStream *stream) override {
+        auto *s = static_cast<Stream *>(stream);
+        if (s->running) { return paStreamIsNotStopped; }
+        join(s);
+        s->running = true;
+        s->thread = std::thread([this, s] { run(s); });
+        return paNoError;
+    }
+
+    PaError stopStream(PaStream *stream) override {
+        auto *s = static_cast<Stream *>(stream);
+        join(s);
+        std::lock_guard lock(m_fileMutex);
+        syncFileLocked();
+        return paNoError;
+    }
+
+    PaError abortStream(PaStream *stream) override {
+        return stopStream(stream);
+    }
+
+    PaError closeStream(PaStream *stream) override {
+        auto *s = static_cast<Stream *>(stream);
+        stopStream(s);
+        delete s;
+        return paNoError;
+    }
+
+    const PaStreamInfo *streamInfo(PaStream *stream) override {
+        return &static_cast<Stream *>(stream)->info;
+    }
+
+    PaTime streamTime(PaStream *stream) override {
+        return static_cast<Stream *>(stream)->time;
+    }
+};
+
+inline std::unique_ptr<IAudioBackend> IAudioBackend::fromEnvironment() {
+    Kind kind = configuredKind();
+    if (kind == Kind::PortAudio) { return std::make_unique<PortAudioBackend>(); }
+    bool ok = false;
+    double rate = qEnvironmentVariable("PONY_AUDIO_RATE").toDouble(&ok);
+    if (!ok) { rate = 1.0; }
+    QString path = qEnvironmentVariable("PONY_AUDIO_OUTPUT");
+    if (path.isEmpty()) { path = kind == Kind::Wav ? "pony-output.wav" : "pony-output.pcm"; }
+    qDebug() << "Headless audio backend, rate" << rate << (kind == Kind::Null ? QString() : path);
+    return std::make_unique<HeadlessAudioBackend>(kind, path.toStdString(), rate);
+}
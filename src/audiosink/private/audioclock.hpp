@@ -0,0 +1,138 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/**
+ * @brief 基于 DAC 时间戳的音频时钟.
+ *
+ * 音频回调每次被调用时, 通过 publish 记录一个锚点: 这次回调写入的第一个样本将在 dacTime 从扬声器输出, 在此之前
+ * 已经输出了 bytes 字节(按 1x 速度折算), 这次回调写入的数据相当于 spanBytes 字节, 持续 spanSecs 秒. 锚点保存
+ * 在一个环形历史中, 查询时找到覆盖当前时刻的锚点并在其内部线性插值, 从而得到此刻真正从扬声器输出的位置. 设备的
+ * 输出延迟越大, 需要回溯的锚点越多.
+ *
+ * publish 只能由一个线程(音频回调)调用, 且不会阻塞; bytesAt 可以在任意线程调用. 每个锚点带有序列号, 读者发现
+ * 锚点正在被改写时重试. reset 只能在音频回调停止时调用.
+ *
+ * 部分 Host API 的 Pa_GetStreamTime 需要加锁, 在回调以外的线程调用不安全. 回调通过 syncStreamTime 记录流时间与
+ * steady_clock 的差, 其他线程通过 streamNow 换算出当前的流时间, 不需要访问 PortAudio.
+ */
+class AudioClock {
+private:
+    struct Anchor {
+        std::atomic<uint32_t> seq{0};
+        std::atomic<double> dacTime{0.0};
+        std::atomic<int64_t> bytes{0};
+        std::atomic<int64_t> spanBytes{0};
+        std::atomic<double> spanSecs{0.0};
+    };
+
+    struct Snapshot {
+        double dacTime;
+        int64_t bytes;
+        int64_t spanBytes;
+        double spanSecs;
+    };
+
+    /**
+     * 历史长度, 需要覆盖设备输出延迟内的所有回调. 蓝牙设备的延迟通常在 200ms 左右, 按每次回调 2ms 计算也足够
+     */
+    constexpr static uint32_t HISTORY = 128;
+
+    std::array<Anchor, HISTORY> m_anchors;
+    std::atomic<uint32_t> m_published{0};
+    std::atomic<double> m_streamTimeOffset{0.0}; // steady_clock 时间减去流时间
+
+    static double steadyNow() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    bool read(uint32_t index, Snapshot &out) const {
+        const Anchor &anchor = m_anchors[index % HISTORY];
+        for (int retry = 0; retry < 4; ++retry) {
+            uint32_t before = anchor.seq.load(std::memory_order_acquire);
+            if (before & 1U) { continue; }
+            out.dacTime = anchor.dacTime.load(std::memory_order_relaxed);
+            out.bytes = anchor.bytes.load(std::memory_order_relaxed);
+            out.spanBytes = anchor.spanBytes.load(std::memory_order_relaxed);
+            out.spanSecs = anchor.spanSecs.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (anchor.seq.load(std::memory_order_relaxed) == before) { return true; }
+        }
+        return false;
+    }
+
+public:
+    /**
+     * 清空历史. 调用时音频回调必须已经停止.
+     */
+    void reset() {
+        m_published.store(0, std::memory_order_release);
+    }
+
+    /**
+     * 记录一次回调的锚点, 只能在音频回调中调用
+     * @param dacTime 这次回调的第一个样本从 DAC 输出的时刻(流时间, 单位: 秒)
+     * @param bytes 在此之前已经输出的数据(按 1x 速度折算, 单位: byte)
+     * @param spanBytes 这次回调输出的数据(按 1x 速度折算, 单位: byte), 输出静音时为 0
+     * @param spanSecs 这次回调中有效数据的实际播放时长(单位: 秒)
+     */
+    void publish(double dacTime, int64_t bytes, int64_t spanBytes, double spanSecs) {
+        uint32_t index = m_published.load(std::memory_order_relaxed);
+        Anchor &anchor = m_anchors[index % HISTORY];
+        uint32_t seq = anchor.seq.load(std::memory_order_relaxed);
+        anchor.seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        anchor.dacTime.store(dacTime, std::memory_order_relaxed);
+        anchor.bytes.store(bytes, std::memory_order_relaxed);
+        anchor.spanBytes.store(spanBytes, std::memory_order_relaxed);
+        anchor.spanSecs.store(spanSecs, std::memory_order_relaxed);
+        anchor.seq.store(seq + 2, std::memory_order_release);
+        m_published.store(index + 1, std::memory_order_release);
+    }
+
+    /**
+     * 记录当前的流时间, 只能在音频回调中调用
+     * @param streamTime 当前的流时间(单位: 秒)
+     */
+    void syncStreamTime(double streamTime) {
+        m_streamTimeOffset.store(steadyNow() - streamTime, std::memory_order_relaxed);
+    }
+
+    /**
+     * 根据回调最近一次记录的流时间换算当前的流时间, 可以在任意线程调用
+     * @return 当前的流时间(单位: 秒)
+     */
+    [[nodiscard]] double streamNow() const {
+        return steadyNow() - m_streamTimeOffset.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * 查询某一时刻从扬声器输出的位置
+     * @param now 查询的时刻(流时间, 单位: 秒)
+     * @param bytes 输出: 已经输出的数据(按 1x 速度折算, 单位: byte)
+     * @return 是否有可用的锚点, 没有时 bytes 不会被修改
+     */
+    bool bytesAt(double now, double &bytes) const {
+        uint32_t published = m_published.load(std::memory_order_acquire);
+        if (published == 0) { return false; }
+        uint32_t depth = std::min(published, HISTORY - 1);
+        Snapshot snapshot{};
+        bool found = false;
+        for (uint32_t k = 1; k <= depth; ++k) {
+            if (!read(published - k, snapshot)) { continue; }
+            found = true;
+            if (snapshot.dacTime <= now) {
+                double progress = snapshot.spanSecs > 0 ? std::min(1.0, (now - snapshot.dacTime) / snapshot.spanSecs) : 0.0;
+                bytes = static_cast<double>(snapshot.bytes) + progress * static_cast<double>(snapshot.spanBytes);
+                return true;
+            }
+        }
+        // 所有锚点都还没有开始播放, 返回最早的锚点
+        if (found) { bytes = static_cast<double>(snapshot.bytes); }
+        return found;
+    }
+};
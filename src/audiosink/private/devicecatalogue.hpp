@@ -0,0 +1,273 @@
+#pragma once
+
+#include <QtCore>
+#include <QThread>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include "portaudio.h"
+#include "ponyplayer.h"
+#include "hotplug.hpp"
+
+/**
+ * @brief 音频输出设备的信息和能力.
+ */
+struct AudioDeviceInfo {
+    QString name;
+    PaDeviceIndex index = paNoDevice;
+    PaHostApiTypeId hostApi{};
+    int maxOutputChannels = 0;
+    double defaultSampleRate = 0.0;
+    PaTime defaultLowOutputLatency = 0.0;
+    PaTime defaultHighOutputLatency = 0.0;
+
+    bool probed = false;                ///< 下面的能力是否已经探测
+    QList<int> sampleRates;             ///< 支持的采样率 (Int16, 双声道)
+    QList<PaSampleFormat> sampleFormats; ///< 支持的样本格式 (默认采样率, 双声道)
+    QList<int> channelCounts;           ///< 支持的声道数 (Int16, 默认采样率)
+
+    [[nodiscard]] bool supportsSampleRate(int rate) const {
+        return !probed || sampleRates.contains(rate);
+    }
+
+    [[nodiscard]] bool supportsChannelCount(int channels) const {
+        return probed ? channelCounts.contains(channels) : channels <= maxOutputChannels;
+    }
+};
+
+/**
+ * @brief 设备目录的快照, 创建后不再修改, 可以在任意线程读取.
+ *
+ * 快照中的 PaDeviceIndex 只在对应的 PortAudio 初始化周期内有效. 目录重新初始化 PortAudio 时会先发布新的快照再释放
+ * backendLock, 因此持有 backendLock 时读取到的快照总是与 PortAudio 的状态一致.
+ */
+struct AudioDeviceSnapshot {
+    QHash<QString, AudioDeviceInfo> devices; ///< 所有支持输出的设备, 同名设备只保留第一个
+    QStringList outputNames;                 ///< 可供用户选择的设备, 按枚举顺序排列. 单声道设备输出缩混后的音频
+    QString defaultDevice;                   ///< 系统默认输出设备
+
+    /**
+     * 按名称查找设备, O(1)
+     * @return 找不到时返回 nullptr
+     */
+    [[nodiscard]] const AudioDeviceInfo *find(const QString &name) const {
+        auto it = devices.constFind(name);
+        return it == devices.constEnd() ? nullptr : &it.value();
+    }
+};
+
+/**
+ * @brief 音频设备目录, 在独立的线程上枚举和探测设备.
+ *
+ * 目录负责 PortAudio 的初始化和重新初始化(热插拔时需要重新枚举设备). 所有 PortAudio 调用都需要持有 backendLock.
+ * 重新初始化前会调用通过 addResetListener 注册的回调, 这些回调在持有 backendLock 的情况下在目录线程上执行,
+ * 用于让使用者放弃即将失效的流. 查询通过 snapshot 读取不可变的快照, 不会阻塞.
+ */
+class AudioDeviceCatalogue : public QObject {
+    Q_OBJECT
+private:
+    QThread *m_affinityThread;
+    HotPlugDetector *m_hotPlugDetector = nullptr;
+    std::shared_ptr<const AudioDeviceSnapshot> m_snapshot;
+    bool m_initialized = false;
+
+    std::mutex m_listenerMutex;
+    QHash<int, std::function<void()>> m_resetListeners;
+    int m_nextListenerId = 0;
+
+    constexpr static int PROBE_SAMPLE_RATES[] = {8000, 11025, 16000, 22050, 32000, 44100, 48000, 88200, 96000,
+                                                 176400, 192000};
+    constexpr static PaSampleFormat PROBE_SAMPLE_FORMATS[] = {paInt16, paInt32, paFloat32, paUInt8};
+    constexpr static int MAX_PROBE_CHANNELS = 8;
+
+    AudioDeviceCatalogue() : QObject(nullptr) {
+        m_affinityThread = new QThread;
+        m_affinityThread->setObjectName(AnytMusic::AUDIO_DEVICE);
+        this->moveToThread(m_affinityThread);
+        connect(m_affinityThread, &QThread::started, this, [this] {
+            // QMediaDevices 需要在目录线程上创建
+            m_hotPlugDetector = new HotPlugDetector(this);
+            connect(m_hotPlugDetector, &HotPlugDetector::audioOutputsChanged, this, [this] { enumerate(); });
+            enumerate();
+        });
+        connect(this, &AudioDeviceCatalogue::refreshRequested, this, &AudioDeviceCatalogue::enumerate);
+        m_affinityThread->start();
+    }
+
+    void publish(std::shared_ptr<const AudioDeviceSnapshot> snapshot) {
+        std::atomic_store(&m_snapshot, std::move(snapshot));
+    }
+
+    static AudioDeviceInfo readDevice(PaDeviceIndex index, const PaDeviceInfo *deviceInfo) {
+        AudioDeviceInfo info;
+        info.name = deviceInfo->name;
+        info.index = index;
+        info.hostApi = Pa_GetHostApiInfo(deviceInfo->hostApi)->type;
+        info.maxOutputChannels = deviceInfo->maxOutputChannels;
+        info.defaultSampleRate = deviceInfo->defaultSampleRate;
+        info.defaultLowOutputLatency = deviceInfo->defaultLowOutputLatency;
+        info.defaultHighOutputLatency = deviceInfo->defaultHighOutputLatency;
+        return info;
+    }
+
+    /**
+     * 在持有 backendLock 的情况下调用一次 Pa_IsFormatSupported
+     * @param expected 探测开始时发布的快照
+     * @return 已经重新枚举(设备序号失效)时返回 std::nullopt
+     */
+    std::optional<bool> isFormatSupported(const PaStreamParameters &param, double rate,
+                                          const std::shared_ptr<const AudioDeviceSnapshot> &expected) const {
+        std::lock_guard lock(backendLock());
+        if (std::atomic_load(&m_snapshot) != expected) { return std::nullopt; }
+        return Pa_IsFormatSupported(nullptr, &param, rate) == paFormatIsSupported;
+    }
+
+    /**
+     * 探测设备支持的采样率, 格式和声道数. 部分 Host API 探测时需要打开设备, 比较耗时, 因此只在每次
+     * Pa_IsFormatSupported 期间持有 backendLock, 两次调用之间 Playback 和 DSP 线程可以使用 PortAudio.
+     * @param expected 探测开始时发布的快照
+     * @return 探测是否完成, 已经重新枚举时返回 false
+     */
+    bool probe(AudioDeviceInfo &info, const std::shared_ptr<const AudioDeviceSnapshot> &expected) const {
+        PaStreamParameters param;
+        param.device = info.index;
+        param.channelCount = std::min(2, info.maxOutputChannels);
+        param.sampleFormat = paInt16;
+        param.suggestedLatency = info.defaultLowOutputLatency;
+        param.hostApiSpecificStreamInfo = nullptr;
+        for (int rate: PROBE_SAMPLE_RATES) {
+            auto supported = isFormatSupported(param, rate, expected);
+            if (!supported) { return false; }
+            if (*supported) { info.sampleRates.append(rate); }
+        }
+        for (PaSampleFormat format: PROBE_SAMPLE_FORMATS) {
+            param.sampleFormat = format;
+            auto supported = isFormatSupported(param, info.defaultSampleRate, expected);
+            if (!supported) { return false; }
+            if (*supported) { info.sampleFormats.append(format); }
+        }
+        param.sampleFormat = paInt16;
+        for (int channels = 1; channels <= std::min(MAX_PROBE_CHANNELS, info.maxOutputChannels); ++channels) {
+            param.channelCount = channels;
+            auto supported = isFormatSupported(param, info.defaultSampleRate, expected);
+            if (!supported) { return false; }
+            if (*supported) { info.channelCounts.append(channels); }
+        }
+        info.probed = true;
+        return true;
+    }
+
+private slots:
+
+    /**
+     * (重新)初始化 PortAudio 并枚举设备. 先发布只含基本信息的快照, 再逐个探测设备能力并发布完整的快照.
+     */
+    void enumerate() {
+        auto snapshot = std::make_shared<AudioDeviceSnapshot>();
+        bool reset;
+        {
+            std::lock_guard lock(backendLock());
+            reset = m_initialized;
+            if (reset) {
+                std::lock_guard listenerLock(m_listenerMutex);
+                for (auto &listener: m_resetListeners) { listener(); }
+                Pa_Terminate();
+            }
+            PaError err = Pa_Initialize();
+            if (err != paNoError) {
+                qWarning() << "Can not initialize PortAudio:" << Pa_GetErrorText(err);
+                m_initialized = false;
+                publish(nullptr);
+                return;
+            }
+            m_initialized = true;
+            int deviceCount = Pa_GetDeviceCount();
+            for (PaDeviceIndex index = 0; index < deviceCount; ++index) {
+                const PaDeviceInfo *deviceInfo = Pa_GetDeviceInfo(index);
+                if (deviceInfo->maxOutputChannels <= 0) { continue; }
+                AudioDeviceInfo info = readDevice(index, deviceInfo);
+                if (!snapshot->devices.contains(info.name)) { snapshot->devices.insert(info.name, info); }
+#ifdef WIN32
+                if (info.hostApi != PaHostApiTypeId::paDirectSound) { continue; }
+#endif
+                if (!snapshot->outputNames.contains(info.name)) { snapshot->outputNames.append(info.name); }
+            }
+            PaDeviceIndex defaultDevice = Pa_GetDefaultOutputDevice();
+            if (defaultDevice != paNoDevice) { snapshot->defaultDevice = Pa_GetDeviceInfo(defaultDevice)->name; }
+            publish(snapshot);
+        }
+        qDebug() << "Audio devices:" << snapshot->outputNames;
+        emit devicesChanged(reset);
+
+        // 逐个设备探测, 每次 Pa_IsFormatSupported 只短暂持有 backendLock, 热插拔时不阻塞 Playback 和 DSP 线程
+        auto probed = std::make_shared<AudioDeviceSnapshot>(*snapshot);
+        for (auto it = probed->devices.begin(); it != probed->devices.end(); ++it) {
+            if (!probe(it.value(), snapshot)) { return; } // 已经重新枚举
+        }
+        {
+            std::lock_guard lock(backendLock());
+            if (std::atomic_load(&m_snapshot) != snapshot) { return; }
+            publish(probed);
+        }
+        emit devicesChanged(false);
+    }
+
+public:
+    /**
+     * 获取目录实例, 第一次调用时创建目录线程并开始枚举
+     */
+    static AudioDeviceCatalogue *instance() {
+        static auto *catalogue = new AudioDeviceCatalogue;
+        return catalogue;
+    }
+
+    /**
+     * 保护所有 PortAudio 调用的锁
+     */
+    static std::mutex &backendLock() {
+        static std::mutex lock;
+        return lock;
+    }
+
+    /**
+     * 获取当前的快照, 这个函数是线程安全的且不会阻塞
+     * @return 第一次枚举完成前或者 PortAudio 不可用时返回 nullptr
+     */
+    [[nodiscard]] std::shared_ptr<const AudioDeviceSnapshot> snapshot() const {
+        return std::atomic_load(&m_snapshot);
+    }
+
+    /**
+     * 注册 PortAudio 重新初始化前的回调, 回调在目录线程上执行, 执行时持有 backendLock
+     * @return 用于取消注册的 id
+     */
+    int addResetListener(std::function<void()> listener) {
+        std::lock_guard lock(m_listenerMutex);
+        int id = m_nextListenerId++;
+        m_resetListeners.insert(id, std::move(listener));
+        return id;
+    }
+
+    void removeResetListener(int id) {
+        std::lock_guard lock(m_listenerMutex);
+        m_resetListeners.remove(id);
+    }
+
+    /**
+     * 请求重新枚举设备, 这个函数会立即返回
+     */
+    void refresh() {
+        emit refreshRequested();
+    }
+
+signals:
+
+    /**
+     * 发布了新的快照
+     * @param backendReset PortAudio 是否被重新初始化, 为 true 时之前打开的流已经失效
+     */
+    void devicesChanged(bool backendReset);
+
+    void refreshRequested();
+};
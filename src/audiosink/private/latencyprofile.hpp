@@ -0,0 +1,184 @@
+#pragma once
+
+#include <QSettings>
+#include <QString>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include "ponyplayer.h"
+
+/**
+ * @brief 音频输出的延迟档位.
+ */
+enum class AudioLatencyProfile : int {
+    LowLatency = 0,  ///< 小回调, 小缓冲区, 适合需要及时响应的场景, 对系统调度要求高
+    Balanced = 1,    ///< 默认档位
+    PowerSaving = 2, ///< 大回调, 大缓冲区, 减少唤醒次数
+};
+
+/**
+ * @brief 延迟档位对应的参数.
+ *
+ * 每个档位有内置的默认值, 可以在配置文件的 AudioLatency/<档位名>/ 下逐项覆盖, 便于针对不同的部署环境调整.
+ */
+struct AudioLatencyConfig {
+    AudioLatencyProfile profile = AudioLatencyProfile::Balanced;
+    unsigned long framesPerBuffer = 0; ///< 每次回调的帧数, 0 表示由 PortAudio 决定
+    bool preferHighLatency = false;    ///< 使用设备的 defaultHighOutputLatency 而不是 defaultLowOutputLatency
+    double suggestedLatency = 0.0;     ///< 建议的输出延迟(单位: 秒), 不大于 0 时使用设备的默认值
+    double ringSecs = 0.2;             ///< DataBuffer 1x 速度下的初始可用长度(单位: 秒)
+    double minRingSecs = 0.1;          ///< 自适应调整的下限(单位: 秒)
+    double maxRingSecs = 0.4;          ///< 自适应调整的上限(单位: 秒)
+
+    constexpr static AudioLatencyProfile PROFILES[] = {AudioLatencyProfile::LowLatency,
+                                                       AudioLatencyProfile::Balanced,
+                                                       AudioLatencyProfile::PowerSaving};
+
+    constexpr static unsigned long MAX_FRAMES_PER_BUFFER = 4096; ///< 内置档位中最大的回调帧数
+    constexpr static double MIN_RING_SECS = 0.02;                 ///< 内置档位中最小的 minRingSecs
+    constexpr static double MAX_RING_SECS = 1.0;                  ///< 内置档位中最大的 maxRingSecs
+
+    static QString nameOf(AudioLatencyProfile profile) {
+        switch (profile) {
+            case AudioLatencyProfile::LowLatency:
+                return "LowLatency";
+            case AudioLatencyProfile::Balanced:
+                return "Balanced";
+            case AudioLatencyProfile::PowerSaving:
+                return "PowerSaving";
+        }
+        return "Balanced";
+    }
+
+    /**
+     * 读取一个以秒为单位的参数并限制在 [lo, hi], 无法解析时使用内置值
+     */
+    static double readSecs(const QSettings &settings, const QString &key, double fallback, double lo, double hi) {
+        bool ok = false;
+        double value = settings.value(key, fallback).toDouble(&ok);
+        if (!ok || !std::isfinite(value)) { value = fallback; }
+        return std::clamp(value, lo, hi);
+    }
+
+    /**
+     * 档位的内置参数
+     */
+    static AudioLatencyConfig defaultsOf(AudioLatencyProfile profile) {
+        AudioLatencyConfig config;
+        config.profile = profile;
+        switch (profile) {
+            case AudioLatencyProfile::LowLatency:
+                config.framesPerBuffer = 128;
+                config.ringSecs = 0.05;
+                config.minRingSecs = 0.02;
+                config.maxRingSecs = 0.2;
+                break;
+            case AudioLatencyProfile::Balanced:
+                break;
+            case AudioLatencyProfile::PowerSaving:
+                config.framesPerBuffer = 4096;
+                config.preferHighLatency = true;
+                config.ringSecs = 0.5;
+                config.minRingSecs = 0.3;
+                config.maxRingSecs = 1.0;
+                break;
+        }
+        return config;
+    }
+
+    /**
+     * 读取档位的参数, 配置文件中的值覆盖内置参数. 覆盖的值限制在内置档位的范围内: DataBuffer 按所有档位中最大的
+     * maxRingSecs 分配, 写错的配置不能让它变成任意大小.
+     */
+    static AudioLatencyConfig load(AudioLatencyProfile profile) {
+        AudioLatencyConfig config = defaultsOf(profile);
+        QSettings settings(AnytMusic::getConfigFile(), QSettings::IniFormat);
+        settings.beginGroup("AudioLatency/" + nameOf(profile));
+        config.framesPerBuffer = std::min<qulonglong>(
+                MAX_FRAMES_PER_BUFFER,
+                settings.value("framesPerBuffer", static_cast<qulonglong>(config.framesPerBuffer)).toULongLong());
+        config.preferHighLatency = settings.value("preferHighLatency", config.preferHighLatency).toBool();
+        config.suggestedLatency = readSecs(settings, "suggestedLatency", config.suggestedLatency, 0.0, MAX_RING_SECS);
+        config.minRingSecs = readSecs(settings, "minRingSecs", config.minRingSecs, MIN_RING_SECS, MAX_RING_SECS);
+        config.maxRingSecs = readSecs(settings, "maxRingSecs", config.maxRingSecs, config.minRingSecs, MAX_RING_SECS);
+        config.ringSecs = readSecs(settings, "ringSecs", config.ringSecs, config.minRingSecs, config.maxRingSecs);
+        settings.endGroup();
+        return config;
+    }
+
+    /**
+     * 读取保存的档位, 没有保存时使用 Balanced
+     */
+    static AudioLatencyProfile loadProfile() {
+        QSettings settings(AnytMusic::getConfigFile(), QSettings::IniFormat);
+        int value = settings.value("AudioLatency/profile", static_cast<int>(AudioLatencyProfile::Balanced)).toInt();
+        for (auto profile: PROFILES) {
+            if (static_cast<int>(profile) == value) { return profile; }
+        }
+        return AudioLatencyProfile::Balanced;
+    }
+
+    static void saveProfile(AudioLatencyProfile profile) {
+        QSettings settings(AnytMusic::getConfigFile(), QSettings::IniFormat);
+        settings.setValue("AudioLatency/profile", static_cast<int>(profile));
+    }
+
+    /**
+     * 所有档位中最大的 maxRingSecs, 用于分配 DataBuffer, 切换档位时不需要重新分配
+     */
+    static double largestRingSecs() {
+        double secs = 0.0;
+        for (auto profile: PROFILES) { secs = std::max(secs, load(profile).maxRingSecs); }
+        return secs;
+    }
+};
+
+/**
+ * @brief 根据欠载情况调整 DataBuffer 的可用长度.
+ *
+ * 出现欠载时可用长度翻倍, 连续 SHRINK_AFTER_SECS 秒没有欠载时缩小到 3/4, 范围由 AudioLatencyConfig 限定.
+ * 增大要快, 避免持续卡顿; 缩小要慢, 避免在边界上反复抖动.
+ */
+class RingBufferSizer {
+private:
+    double m_secs;
+    double m_minSecs;
+    double m_maxSecs;
+    double m_quietSecs = 0.0;
+
+public:
+    constexpr static double GROW_FACTOR = 2.0;
+    constexpr static double SHRINK_FACTOR = 0.75;
+    constexpr static double SHRINK_AFTER_SECS = 30.0;
+
+    explicit RingBufferSizer(const AudioLatencyConfig &config = {}) : m_secs(config.ringSecs),
+                                                                      m_minSecs(config.minRingSecs),
+                                                                      m_maxSecs(config.maxRingSecs) {}
+
+    /**
+     * 报告一段时间内的欠载次数
+     * @param underruns 欠载次数
+     * @param elapsedSecs 经过的时间(单位: 秒)
+     * @return 可用长度是否改变
+     */
+    bool update(uint64_t underruns, double elapsedSecs) {
+        double previous = m_secs;
+        if (underruns > 0) {
+            m_secs = std::min(m_maxSecs, m_secs * GROW_FACTOR);
+            m_quietSecs = 0.0;
+        } else {
+            m_quietSecs += elapsedSecs;
+            if (m_quietSecs >= SHRINK_AFTER_SECS) {
+                m_secs = std::max(m_minSecs, m_secs * SHRINK_FACTOR);
+                m_quietSecs = 0.0;
+            }
+        }
+        return m_secs != previous;
+    }
+
+    /**
+     * 1x 速度下 DataBuffer 的可用长度
+     * @return 单位: 秒
+     */
+    [[nodiscard]] double secs() const { return m_secs; }
+};
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/**
+ * @brief 无锁直方图, 可以在实时线程中记录.
+ * @tparam N 桶的数量
+ */
+template<size_t N>
+class AtomicHistogram {
+private:
+    std::array<std::atomic<uint64_t>, N> m_buckets{};
+
+public:
+    constexpr static size_t size() { return N; }
+
+    void record(size_t bucket) {
+        m_buckets[bucket < N ? bucket : N - 1].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] std::array<uint64_t, N> snapshot() const {
+        std::array<uint64_t, N> out{};
+        for (size_t i = 0; i < N; ++i) { out[i] = m_buckets[i].load(std::memory_order_relaxed); }
+        return out;
+    }
+};
+
+/**
+ * @brief 音频回调统计数据的快照, 所有计数都是累计值.
+ */
+struct AudioTelemetrySnapshot {
+    /**
+     * 回调耗时直方图的桶数, 第 i 个桶表示耗时在 [2^(i-1), 2^i) 微秒, 第 0 个桶表示小于 1 微秒
+     */
+    constexpr static size_t DURATION_BUCKETS = 16;
+    /**
+     * 缓冲区填充率直方图的桶数, 第 i 个桶表示填充率在 [i/N, (i+1)/N)
+     */
+    constexpr static size_t FILL_BUCKETS = 10;
+
+    uint64_t callbacks = 0;         ///< 回调次数
+    uint64_t underruns = 0;         ///< 缓冲区为空, 整个回调输出静音
+    uint64_t partialFills = 0;      ///< 缓冲区数据不足, 部分输出静音
+    uint64_t silentCallbacks = 0;   ///< 因为禁用音频而输出静音
+    uint64_t deviceUnderflows = 0;  ///< 设备报告的 underflow (paOutputUnderflow)
+    uint64_t maxCallbackNanos = 0;  ///< 最长的回调耗时
+    double levelSecs = 0.0;         ///< 最近一次回调开始时缓冲区中数据的时长(单位: 秒)
+    std::array<uint64_t, DURATION_BUCKETS> durationHistogram{};
+    std::array<uint64_t, FILL_BUCKETS> fillHistogram{};
+
+    /**
+     * 计算两个快照之间的增量, maxCallbackNanos 和 levelSecs 取较新的值
+     */
+    [[nodiscard]] AudioTelemetrySnapshot since(const AudioTelemetrySnapshot &old) const {
+        AudioTelemetrySnapshot delta = *this;
+        delta.callbacks -= old.callbacks;
+        delta.underruns -= old.underruns;
+        delta.partialFills -= old.partialFills;
+        delta.silentCallbacks -= old.silentCallbacks;
+        delta.deviceUnderflows -= old.deviceUnderflows;
+        for (size_t i = 0; i < DURATION_BUCKETS; ++i) { delta.durationHistogram[i] -= old.durationHistogram[i]; }
+        for (size_t i = 0; i < FILL_BUCKETS; ++i) { delta.fillHistogram[i] -= old.fillHistogram[i]; }
+        return delta;
+    }
+
+    /**
+     * 从直方图估计回调耗时的分位数
+     * @param quantile 分位, 范围 [0, 1]
+     * @return 对应桶的上界(单位: 微秒), 没有数据时返回 0
+     */
+    [[nodiscard]] uint64_t durationQuantileMicros(double quantile) const {
+        uint64_t total = 0;
+        for (auto count: durationHistogram) { total += count; }
+        if (total == 0) { return 0; }
+        auto target = static_cast<uint64_t>(quantile * static_cast<double>(total));
+        uint64_t accumulated = 0;
+        for (size_t i = 0; i < DURATION_BUCKETS; ++i) {
+            accumulated += durationHistogram[i];
+            if (accumulated > target) { return uint64_t{1} << i; }
+        }
+        return uint64_t{1} << (DURATION_BUCKETS - 1);
+    }
+};
+
+/**
+ * @brief 音频回调的统计.
+ *
+ * record 系列函数只使用 relaxed 原子操作, 不加锁, 不分配内存, 不输出日志, 可以在 PortAudio 的实时线程中调用.
+ * snapshot 可以在任意线程调用, 各个计数之间不保证严格一致, 但每个计数都是单调的.
+ */
+class AudioTelemetry {
+private:
+    std::atomic<uint64_t> m_callbacks{0};
+    std::atomic<uint64_t> m_underruns{0};
+    std::atomic<uint64_t> m_partialFills{0};
+    std::atomic<uint64_t> m_silentCallbacks{0};
+    std::atomic<uint64_t> m_deviceUnderflows{0};
+    std::atomic<uint64_t> m_maxCallbackNanos{0};
+    std::atomic<double> m_levelSecs{0.0};
+    AtomicHistogram<AudioTelemetrySnapshot::DURATION_BUCKETS> m_duration;
+    AtomicHistogram<AudioTelemetrySnapshot::FILL_BUCKETS> m_fill;
+
+    static void add(std::atomic<uint64_t> &counter) { counter.fetch_add(1, std::memory_order_relaxed); }
+
+public:
+    using Clock = std::chrono::steady_clock;
+
+    void recordUnderrun() { add(m_underruns); }
+
+    void recordPartialFill() { add(m_partialFills); }
+
+    void recordSilent() { add(m_silentCallbacks); }
+
+    void recordDeviceUnderflow() { add(m_deviceUnderflows); }
+
+    /**
+     * 记录回调开始时缓冲区的填充率
+     * @param used 缓冲区中的数据量
+     * @param capacity 缓冲区容量
+     */
+    void recordFill(int64_t used, int64_t capacity) {
+        if (capacity <= 0) { return; }
+        m_fill.record(static_cast<size_t>(used * static_cast<int64_t>(AudioTelemetrySnapshot::FILL_BUCKETS) / capacity));
+    }
+
+    /**
+     * 记录回调开始时缓冲区中数据的时长
+     * @param secs 单位: 秒
+     */
+    void recordLevel(double secs) { m_levelSecs.store(secs, std::memory_order_relaxed); }
+
+    /**
+     * 记录一次回调结束
+     * @param begin 回调开始的时刻
+     */
+    void recordCallback(Clock::time_point begin) {
+        auto nanos = static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count());
+        add(m_callbacks);
+        uint64_t micros = nanos / 1000;
+        size_t bucket = 0;
+        while (micros) {
+            micros >>= 1;
+            ++bucket;
+        }
+        m_duration.record(bucket);
+        uint64_t prev = m_maxCallbackNanos.load(std::memory_order_relaxed);
+        while (prev < nanos && !m_maxCallbackNanos.compare_exchange_weak(prev, nanos, std::memory_order_relaxed));
+    }
+
+    [[nodiscard]] AudioTelemetrySnapshot snapshot() const {
+        AudioTelemetrySnapshot s;
+        s.callbacks = m_callbacks.load(std::memory_order_relaxed);
+        s.underruns = m_underruns.load(std::memory_order_relaxed);
+        s.partialFills = m_partialFills.load(std::memory_order_relaxed);
+        s.silentCallbacks = m_silentCallbacks.load(std::memory_order_relaxed);
+        s.deviceUnderflows = m_deviceUnderflows.load(std::memory_order_relaxed);
+        s.maxCallbackNanos = m_maxCallbackNanos.load(std::memory_order_relaxed);
+        s.levelSecs = m_levelSecs.load(std::memory_order_relaxed);
+        s.durationHistogram = m_duration.snapshot();
+        s.fillHistogram = m_fill.snapshot();
+        return s;
+    }
+};
@@ -0,0 +1,92 @@
+project(micro_benchmarks)
+include(FetchContent)
+if(NOT NO_SSH_KEY)
+    set(benchmark_GIT git@github.com:google/benchmark.git)
+else()
+    set(benchmark_GIT https://github.com/google/benchmark.git)
+endif()
+
+FetchContent_Declare(benchmark
+        GIT_REPOSITORY ${benchmark_GIT}
+        GIT_TAG        v1.7.1
+        GIT_SHALLOW TRUE
+        )
+
+set(BENCHMARK_ENABLE_TESTING OFF CACHE BOOL "" FORCE)
+set(BENCHMARK_ENABLE_GTEST_TESTS OFF CACHE BOOL "" FORCE)
+set(BENCHMARK_ENABLE_INSTALL OFF CACHE BOOL "" FORCE)
+FetchContent_MakeAvailable(benchmark)
+
+add_executable(
+        micro_benchmarks
+        benchmarks/pcmkernels_bench.cpp
+        benchmarks/timestretch_bench.cpp
+        benchmarks/equalizer_bench.cpp
+        benchmarks/convolver_bench.cpp
+)
+
+target_link_libraries(micro_benchmarks
+        PRIVATE
+        benchmark::benchmark_main
+        audiosink
+        )
+
+# 端到端播放基准, 不依赖 google benchmark, 结果以 JSON 输出
+add_executable(
+        pony_bench
+        benchmarks/pony_bench.cpp
+)
+
+target_link_libraries(pony_bench
+        PRIVATE
+        Qt::Core
+        Qt::Gui
+        Qt::Quick
+        player
+        decoder
+        audiosink
+        utils
+        ${FFmpeg}
+        )
+
+if (WIN32)
+    target_link_libraries(pony_bench PRIVATE psapi)
+endif ()
+
+# 核心组件基准, 依赖 Qt 和 FFmpeg, 与只测 DSP 内核的 micro_benchmarks 分开
+add_executable(
+        core_benchmarks
+        benchmarks/twinsqueue_bench.cpp
+        benchmarks/frame_bench.cpp
+        benchmarks/audiosink_bench.cpp
+        benchmarks/decoder_bench.cpp
+        benchmarks/kvengine_bench.cpp
+        benchmarks/looptiming_bench.cpp
+)
+
+# looptiming_bench 只使用 player 中的头文件 looptiming.hpp, 不链接 QML 插件
+target_include_directories(core_benchmarks PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/player)
+
+target_link_libraries(core_benchmarks
+        PRIVATE
+        benchmark::benchmark_main
+        Qt::Core
+        Qt::Sql
+        playlist
+        decoder
+        audiosink
+        utils
+        ${FFmpeg}
+        )
+
+# 重复 5 次只报告均值, 中位数和标准差, 结果写入构建目录的 core_benchmarks.json 便于对比
+add_custom_target(core_benchmarks_report
+        COMMAND core_benchmarks
+                --benchmark_repetitions=5
+                --benchmark_report_aggregates_only=true
+                --benchmark_out=${CMAKE_BINARY_DIR}/core_benchmarks.json
+                --benchmark_out_format=json
+        DEPENDS core_benchmarks
+        WORKING_DIRECTORY ${CMAKE_BINARY_DIR}
+        USES_TERMINAL
+        )
@@ -0,0 +1,37 @@
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <random>
+#include <vector>
+#include "audiosink.hpp"
+#include "benchenv.hpp"
+
+/**
+ * PonyAudioSink::write 的吞吐: 数据经过缩混, 变速引擎和效果器链写入 DataBuffer. 使用丢弃输出的后端, 流不启动,
+ * 剩余空间不足一次写入时暂停计时并清空, 与 DSP 线程等待回调消费的时间无关.
+ * @param state.range(0) 速度的百分数
+ */
+static void BM_AudioSinkWrite(benchmark::State &state) {
+    constexpr int CHUNK_FRAMES = 1024;
+    prepareBenchEnvironment();
+    PonyAudioFormat format(AnytMusic::Int16, 44100, 2);
+    PonyAudioSink sink(format, std::make_unique<HeadlessAudioBackend>(IAudioBackend::Kind::Null, "", 0.0));
+    sink.setSpeed(static_cast<qreal>(state.range(0)) / 100.0);
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> dist(-8192, 8191);
+    std::vector<int16_t> chunk(CHUNK_FRAMES * 2);
+    for (auto &s: chunk) { s = static_cast<int16_t>(dist(rng)); }
+    const auto bytes = static_cast<qint32>(chunk.size() * sizeof(int16_t));
+    for (auto _: state) {
+        if (sink.freeByte() < bytes) {
+            state.PauseTiming();
+            sink.clear();
+            state.ResumeTiming();
+        }
+        benchmark::DoNotOptimize(sink.write(reinterpret_cast<const char *>(chunk.data()), bytes));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * bytes);
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * CHUNK_FRAMES);
+}
+
+BENCHMARK(BM_AudioSinkWrite)->ArgName("speed%")->Arg(100)->Arg(150)->Arg(200)->Arg(300)->Arg(400)
+    ->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <QCoreApplication>
+#include <QTemporaryDir>
+#include <QtGlobal>
+#include <cstdio>
+#include <mutex>
+
+/**
+ * 准备依赖 Qt 的基准的运行环境, 可以重复调用.
+ *
+ * 创建 QCoreApplication(定时器和 SQL 驱动插件需要), 并把 HOME 指向临时目录: AnytMusic::getHome 在 HOME 之下,
+ * 用户的配置(均衡器, 变速引擎, 延迟档位)和播放列表数据库不会影响结果, 也不会被基准修改. 丢弃 debug 和 info 日志,
+ * 逐条输出 SQL 等日志的耗时随终端变化, 会让结果不稳定.
+ */
+inline void prepareBenchEnvironment() {
+    static std::once_flag once;
+    std::call_once(once, [] {
+        static QTemporaryDir home;
+        qputenv("HOME", home.path().toUtf8());
+        qputenv("USERPROFILE", home.path().toUtf8());
+        qInstallMessageHandler([](QtMsgType type, const QMessageLogContext &, const QString &message) {
+            if (type == QtDebugMsg || type == QtInfoMsg) { return; }
+            std::fprintf(stderr, "%s\n", message.toLocal8Bit().constData());
+        });
+        static int argc = 1;
+        static char name[] = "core_benchmarks";
+        static char *argv[] = {name, nullptr};
+        static QCoreApplication app(argc, argv);
+    });
+}
@@ -0,0 +1,88 @@
+#include <benchmark/benchmark.h>
+#include <cmath>
+#include <random>
+#include <vector>
+#include "dsp/convolver.hpp"
+
+/**
+ * 输入是 1 秒 48000Hz 双声道白噪声, 脉冲响应是指数衰减的噪声, 近似房间的混响
+ */
+constexpr int SAMPLE_RATE = 48000;
+constexpr int CHANNELS = 2;
+constexpr std::size_t INPUT_FRAMES = SAMPLE_RATE;
+constexpr std::size_t CHUNK_FRAMES = 1024;
+
+static std::vector<float> noise(std::size_t count, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> dist(-0.5f, 0.5f);
+    std::vector<float> out(count);
+    for (auto &v: out) { v = dist(rng); }
+    return out;
+}
+
+static WavData roomLike(std::size_t taps) {
+    WavData ir;
+    ir.sampleRate = SAMPLE_RATE;
+    ir.channels = CHANNELS;
+    ir.samples = noise(taps * CHANNELS, 7);
+    for (std::size_t i = 0; i < taps; ++i) {
+        float decay = std::exp(-6.9f * static_cast<float>(i) / static_cast<float>(taps));
+        for (std::size_t c = 0; c < CHANNELS; ++c) { ir.samples[i * CHANNELS + c] *= decay; }
+    }
+    return ir;
+}
+
+/**
+ * 报告占用单个核心的百分比: 处理 1 秒音频所需的时间 / 1 秒 * 100
+ * @param state.range(0) 脉冲响应的长度(单位: 帧)
+ * @param state.range(1) 分块长度, 也就是延迟(单位: 帧)
+ */
+static void BM_PartitionedConvolver(benchmark::State &state) {
+    auto taps = static_cast<std::size_t>(state.range(0));
+    auto block = static_cast<std::size_t>(state.range(1));
+    PartitionedConvolver convolver(roomLike(taps), SAMPLE_RATE, CHANNELS, block);
+    auto data = noise(INPUT_FRAMES * CHANNELS, 42);
+    for (auto _: state) {
+        for (std::size_t f = 0; f < INPUT_FRAMES; f += CHUNK_FRAMES) {
+            convolver.process(data.data() + f * CHANNELS, std::min(CHUNK_FRAMES, INPUT_FRAMES - f));
+        }
+        benchmark::DoNotOptimize(data.data());
+        benchmark::ClobberMemory();
+    }
+    state.counters["core%"] = benchmark::Counter(
+            static_cast<double>(state.iterations()) * INPUT_FRAMES / SAMPLE_RATE / 100.0,
+            benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+    state.counters["partitions"] = static_cast<double>(convolver.partitions());
+}
+
+BENCHMARK(BM_PartitionedConvolver)
+        ->ArgNames({"taps", "block"})
+        ->ArgsProduct({{4096, 65536, 262144}, {256, 512, 1024}})
+        ->Unit(benchmark::kMillisecond);
+
+/**
+ * 直接卷积作为对照, 只测较短的脉冲响应
+ */
+static void BM_DirectConvolution(benchmark::State &state) {
+    auto taps = static_cast<std::size_t>(state.range(0));
+    WavData ir = roomLike(taps);
+    auto input = noise(INPUT_FRAMES * CHANNELS, 42);
+    std::vector<float> output(input.size());
+    for (auto _: state) {
+        for (std::size_t n = taps; n < INPUT_FRAMES; ++n) {
+            for (std::size_t c = 0; c < CHANNELS; ++c) {
+                float acc = 0.0f;
+                for (std::size_t k = 0; k < taps; ++k) {
+                    acc += ir.samples[k * CHANNELS + c] * input[(n - k) * CHANNELS + c];
+                }
+                output[n * CHANNELS + c] = acc;
+            }
+        }
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.counters["core%"] = benchmark::Counter(
+            static_cast<double>(state.iterations()) * INPUT_FRAMES / SAMPLE_RATE / 100.0,
+            benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+}
+
+BENCHMARK(BM_DirectConvolution)->ArgName("taps")->Arg(4096)->Unit(benchmark::kMillisecond);
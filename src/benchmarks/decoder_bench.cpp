@@ -0,0 +1,112 @@
+#include <benchmark/benchmark.h>
+#include <random>
+#include <vector>
+#include "private/forward.hpp"
+#include "private/backward.hpp"
+
+/**
+ * 不打开文件, 用 codecpar 描述一个音频流, 解码器按它打开. AAC 解码器输出 FLTP, 与大多数压缩格式相同;
+ * PCM 解码器输出交错的 S16 和 FLT, 对应无损和 WAV 文件.
+ */
+struct SyntheticAudioStream {
+    AVFormatContext *formatCtx;
+    AVStream *stream;
+
+    SyntheticAudioStream(AVCodecID codecId, int sampleRate, int channels) {
+        formatCtx = avformat_alloc_context();
+        stream = avformat_new_stream(formatCtx, nullptr);
+        stream->time_base = {1, sampleRate};
+        stream->duration = 600 * sampleRate;
+        auto *par = stream->codecpar;
+        par->codec_type = AVMEDIA_TYPE_AUDIO;
+        par->codec_id = codecId;
+        par->sample_rate = sampleRate;
+        par->channels = channels;
+        par->channel_layout = static_cast<uint64_t>(av_get_default_channel_layout(channels));
+        par->format = codecId == AV_CODEC_ID_PCM_S16LE ? AV_SAMPLE_FMT_S16 :
+                      codecId == AV_CODEC_ID_PCM_F32LE ? AV_SAMPLE_FMT_FLT : AV_SAMPLE_FMT_FLTP;
+    }
+
+    ~SyntheticAudioStream() {
+        avformat_free_context(formatCtx);
+    }
+};
+
+/**
+ * 解码器输出格式的一帧, 内容为随机噪声, 每次迭代复制引用后送入队列
+ */
+static AVFrame *makeNoiseFrame(const AVCodecContext *codecCtx, int nbSamples) {
+    AVFrame *frame = av_frame_alloc();
+    frame->format = codecCtx->sample_fmt;
+    frame->sample_rate = codecCtx->sample_rate;
+    frame->channels = codecCtx->channels;
+    frame->channel_layout = AnytMusic::channelLayoutOf(codecCtx->channel_layout, codecCtx->channels);
+    frame->nb_samples = nbSamples;
+    frame->pts = 0;
+    if (av_frame_get_buffer(frame, 0) < 0) { throw std::runtime_error("Cannot alloc frame buffer."); }
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> dist(-0.5f, 0.5f);
+    auto fmt = static_cast<AVSampleFormat>(frame->format);
+    int planes = av_sample_fmt_is_planar(fmt) ? frame->channels : 1;
+    int perPlane = av_sample_fmt_is_planar(fmt) ? nbSamples : nbSamples * frame->channels;
+    for (int p = 0; p < planes; ++p) {
+        if (fmt == AV_SAMPLE_FMT_S16) {
+            auto *data = reinterpret_cast<int16_t *>(frame->extended_data[p]);
+            for (int i = 0; i < perPlane; ++i) { data[i] = static_cast<int16_t>(dist(rng) * 32767.0f); }
+        } else {
+            auto *data = reinterpret_cast<float *>(frame->extended_data[p]);
+            for (int i = 0; i < perPlane; ++i) { data[i] = dist(rng); }
+        }
+    }
+    return frame;
+}
+
+/**
+ * DecoderImpl<Audio>::getSample: 从队列取出一帧, swr_convert 转换为输出格式 S16 44100Hz 立体声并释放.
+ * 输入采样率为 48000Hz 时包含重采样.
+ * @param state.range(0) 0 为 AAC(FLTP), 1 为 PCM S16, 2 为 PCM FLT
+ * @param state.range(1) 输入采样率
+ */
+static void BM_DecoderGetSample(benchmark::State &state) {
+    constexpr int FRAME_SAMPLES = 1024;
+    static const AVCodecID CODECS[] = {AV_CODEC_ID_AAC, AV_CODEC_ID_PCM_S16LE, AV_CODEC_ID_PCM_F32LE};
+    av_log_set_level(AV_LOG_ERROR);
+    SyntheticAudioStream source(CODECS[state.range(0)], static_cast<int>(state.range(1)), 2);
+    TwinsBlockQueue<AVFrame *> queue("AudioQueue", 16);
+    DecoderImpl<Audio> decoder(source.stream, &queue);
+    decoder.setOutputFormat(PonyAudioFormat(AnytMusic::Int16, 44100, 2));
+    AVFrame *noise = makeNoiseFrame(decoder.codecCtx, FRAME_SAMPLES);
+    for (auto _: state) {
+        queue.push(av_frame_clone(noise));
+        AudioFrame sample = decoder.getSample();
+        benchmark::DoNotOptimize(sample);
+    }
+    av_frame_free(&noise);
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * FRAME_SAMPLES);
+}
+
+/**
+ * ReverseDecoderImpl<Audio>::reverseSample: 倒放时把转换后的一帧按采样帧逆序
+ * @param state.range(0) 输出声道数
+ */
+static void BM_DecoderReverseSample(benchmark::State &state) {
+    constexpr int FRAME_SAMPLES = 1024;
+    const auto channels = static_cast<int>(state.range(0));
+    av_log_set_level(AV_LOG_ERROR);
+    SyntheticAudioStream source(AV_CODEC_ID_PCM_S16LE, 44100, channels);
+    TwinsBlockQueue<AVFrame *> queue("AudioQueue", 200);
+    ReverseDecoderImpl<Audio> decoder(source.stream, &queue);
+    decoder.setOutputFormat(PonyAudioFormat(AnytMusic::Int16, 44100, channels));
+    std::vector<uint8_t> samples(static_cast<size_t>(FRAME_SAMPLES * channels) * sizeof(int16_t));
+    std::mt19937 rng(42);
+    for (auto &b: samples) { b = static_cast<uint8_t>(rng()); }
+    for (auto _: state) {
+        decoder.reverseSample(samples.data(), static_cast<int>(samples.size()));
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * samples.size()));
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * FRAME_SAMPLES);
+}
+
+BENCHMARK(BM_DecoderGetSample)->ArgNames({"codec", "rate"})->ArgsProduct({{0, 1, 2}, {44100, 48000}});
+BENCHMARK(BM_DecoderReverseSample)->ArgName("channels")->Arg(2)->Arg(6);
@@ -0,0 +1,87 @@
+#include <benchmark/benchmark.h>
+#include <cmath>
+#include <random>
+#include <vector>
+#include "dsp/equalizer.hpp"
+
+/**
+ * 输入是 1 秒 96000Hz 双声道白噪声, 按 DSP 线程的块大小处理
+ */
+constexpr int SAMPLE_RATE = 96000;
+constexpr int CHANNELS = 2;
+constexpr std::size_t INPUT_FRAMES = SAMPLE_RATE;
+constexpr std::size_t BLOCK_FRAMES = 1024;
+
+static std::vector<float> noise() {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> dist(-0.5f, 0.5f);
+    std::vector<float> out(INPUT_FRAMES * CHANNELS);
+    for (auto &v: out) { v = dist(rng); }
+    return out;
+}
+
+/**
+ * 报告占用单个核心的百分比: 处理 1 秒音频所需的时间 / 1 秒 * 100
+ */
+static void reportCore(benchmark::State &state) {
+    state.counters["core%"] = benchmark::Counter(
+            static_cast<double>(state.iterations()) * INPUT_FRAMES / SAMPLE_RATE / 100.0,
+            benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+}
+
+/**
+ * 十段级联的二阶节
+ * @param state.range(0) 是否向量化
+ */
+static void BM_BiquadCascade(benchmark::State &state) {
+    bool vectorized = state.range(0) != 0;
+    auto input = noise();
+    auto data = input;
+    Biquad::Cascade cascade;
+    cascade.resize(EqualizerPresets::GRAPHIC_BANDS, CHANNELS);
+    const auto *preset = EqualizerPresets::find("Rock");
+    for (std::size_t i = 0; i < EqualizerPresets::GRAPHIC_BANDS; ++i) {
+        cascade.setCoefficients(i, Biquad::design(Biquad::Type::Peaking, SAMPLE_RATE,
+                                                  EqualizerPresets::GRAPHIC_FREQS[i], preset->gains[i], 1.41));
+    }
+    for (auto _: state) {
+        for (std::size_t f = 0; f < INPUT_FRAMES; f += BLOCK_FRAMES) {
+            cascade.process(data.data() + f * CHANNELS, std::min(BLOCK_FRAMES, INPUT_FRAMES - f), vectorized);
+        }
+        benchmark::DoNotOptimize(data.data());
+        benchmark::ClobberMemory();
+    }
+    reportCore(state);
+}
+
+BENCHMARK(BM_BiquadCascade)->ArgName("simd")->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+
+/**
+ * 完整的均衡器, 包括系数平滑
+ * @param state.range(0) 是否在每一块之前切换预设, 使平滑一直进行
+ */
+static void BM_ParametricEqualizer(benchmark::State &state) {
+    bool switching = state.range(0) != 0;
+    auto data = noise();
+    EqualizerSettings rock, pop;
+    EqualizerPresets::apply("Rock", rock);
+    EqualizerPresets::apply("Pop", pop);
+    rock.enabled = pop.enabled = true;
+    ParametricEqualizer eq(rock);
+    eq.prepare(SAMPLE_RATE, CHANNELS);
+    bool flip = false;
+    for (auto _: state) {
+        for (std::size_t f = 0; f < INPUT_FRAMES; f += BLOCK_FRAMES) {
+            if (switching) {
+                eq.setSettings(flip ? rock : pop);
+                flip = !flip;
+            }
+            eq.process(data.data() + f * CHANNELS, std::min(BLOCK_FRAMES, INPUT_FRAMES - f));
+        }
+        benchmark::DoNotOptimize(data.data());
+        benchmark::ClobberMemory();
+    }
+    reportCore(state);
+}
+
+BENCHMARK(BM_ParametricEqualizer)->ArgName("switching")->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,67 @@
+#include <benchmark/benchmark.h>
+#include <utility>
+#include "frame.hpp"
+
+/**
+ * 所有线程共享的画面, 模拟 Playback, VsyncScheduler 和渲染线程同时持有同一个画面
+ */
+static const VideoFrameRef &sharedFrame() {
+    static const VideoFrameRef frame(av_frame_alloc(), true, 0.0);
+    return frame;
+}
+
+/**
+ * 复制一次并析构, 即引用计数加一再减一. 多线程时所有线程复制同一个画面, 引用计数在核之间竞争.
+ */
+static void BM_VideoFrameRefCopy(benchmark::State &state) {
+    const VideoFrameRef &frame = sharedFrame();
+    for (auto _: state) {
+        VideoFrameRef copy(frame);
+        benchmark::DoNotOptimize(copy);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/**
+ * 移动两次, 画面回到原处, 不改变引用计数
+ */
+static void BM_VideoFrameRefMove(benchmark::State &state) {
+    VideoFrameRef frame(av_frame_alloc(), true, 0.0);
+    for (auto _: state) {
+        VideoFrameRef moved(std::move(frame));
+        frame = std::move(moved);
+        benchmark::DoNotOptimize(frame);
+    }
+    state.SetItemsProcessed(state.iterations() * 2);
+}
+
+/**
+ * 复制赋值到已经持有另一个画面的引用, 需要先释放旧的引用
+ */
+static void BM_VideoFrameRefCopyAssign(benchmark::State &state) {
+    VideoFrameRef first(av_frame_alloc(), true, 0.0);
+    VideoFrameRef second(av_frame_alloc(), true, 1.0);
+    VideoFrameRef target = first;
+    for (auto _: state) {
+        target = second;
+        target = first;
+        benchmark::DoNotOptimize(target);
+    }
+    state.SetItemsProcessed(state.iterations() * 2);
+}
+
+/**
+ * 默认构造的无效画面也会分配 VideoFrame, 解码队列为空和打断时频繁出现
+ */
+static void BM_VideoFrameRefDefault(benchmark::State &state) {
+    for (auto _: state) {
+        VideoFrameRef frame;
+        benchmark::DoNotOptimize(frame);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_VideoFrameRefCopy)->ThreadRange(1, 4)->UseRealTime();
+BENCHMARK(BM_VideoFrameRefMove);
+BENCHMARK(BM_VideoFrameRefCopyAssign);
+BENCHMARK(BM_VideoFrameRefDefault);
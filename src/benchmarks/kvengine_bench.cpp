@@ -0,0 +1,81 @@
+#include <benchmark/benchmark.h>
+#include <QtSql/QSqlDatabase>
+#include <memory>
+#include <vector>
+#include "kv_engine.h"
+#include "playlist.h"
+#include "benchenv.hpp"
+
+/**
+ * PonyKVConnect 总是使用默认连接, 重复创建会替换掉旧的连接, 所有基准共用一个. 数据库位于临时目录.
+ */
+static PonyKVConnect &benchConnect() {
+    static PonyKVConnect *connect = [] {
+        prepareBenchEnvironment();
+        qRegisterMetaType<PlayListItem *>("PlayListItem");
+        return new PonyKVConnect("bench.db");
+    }();
+    return *connect;
+}
+
+static std::vector<std::unique_ptr<PlayListItem>> makeItems(int64_t count) {
+    std::vector<std::unique_ptr<PlayListItem>> items;
+    items.reserve(static_cast<size_t>(count));
+    for (int64_t i = 0; i < count; ++i) {
+        auto item = std::make_unique<PlayListItem>(QString("track_%1.mp4").arg(i), QDir("/media/videos"));
+        item->setPath(QString("/media/videos/track_%1.mp4").arg(i));
+        item->setDuration("00:03:25");
+        item->setFrameRate(30);
+        item->setBitRate(4000);
+        item->setSampleRate(44100);
+        items.push_back(std::move(item));
+    }
+    return items;
+}
+
+static void recreateTable(PonyKVConnect &connect, const QString &table) {
+    QSqlDatabase::database().exec("DROP TABLE IF EXISTS `" + table + "`");
+    connect.createTableFrom("PlayListItem", table);
+}
+
+/**
+ * 向空表逐条插入, 与播放列表添加文件相同, 每条语句单独提交. 耗时以秒计, 每次重复只运行一次.
+ * @param state.range(0) 行数
+ */
+static void BM_KVEngineInsert(benchmark::State &state) {
+    PonyKVConnect &connect = benchConnect();
+    auto items = makeItems(state.range(0));
+    for (auto _: state) {
+        state.PauseTiming();
+        recreateTable(connect, "bench_insert");
+        state.ResumeTiming();
+        for (const auto &item: items) { connect.insert("bench_insert", item.get()); }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+
+/**
+ * 读出整张表并构造对象, 与启动时加载播放列表相同. 表在一个事务中预先填充, 不计入时间.
+ * @param state.range(0) 行数
+ */
+static void BM_KVEngineRetrieve(benchmark::State &state) {
+    PonyKVConnect &connect = benchConnect();
+    {
+        auto items = makeItems(state.range(0));
+        recreateTable(connect, "bench_retrieve");
+        QSqlDatabase::database().transaction();
+        for (const auto &item: items) { connect.insert("bench_retrieve", item.get()); }
+        QSqlDatabase::database().commit();
+    }
+    for (auto _: state) {
+        QList<QObject *> rows = connect.retrieveData("bench_retrieve", "PlayListItem");
+        benchmark::DoNotOptimize(rows.size());
+        state.PauseTiming();
+        qDeleteAll(rows);
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+
+BENCHMARK(BM_KVEngineInsert)->ArgName("rows")->Arg(10000)->Iterations(1)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_KVEngineRetrieve)->ArgName("rows")->Arg(10000)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,128 @@
+#include <benchmark/benchmark.h>
+#include <QCoreApplication>
+#include <QObject>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include "concurrentqueue.h"
+#include "looptiming.hpp"
+#include "benchenv.hpp"
+
+/**
+ * Playback 循环每次迭代自身的耗时, 比较两种处理外部请求的方式: 每一帧调用 QCoreApplication::processEvents,
+ * 以及从无锁队列中每一帧最多取出 MAX_COMMANDS_PER_FRAME 条命令. 两者使用相同的 PlaybackLoopTiming 统计.
+ *
+ * GUI 线程按固定的节奏提交命令(拖动滑块), 偶尔一次提交一批(松开滑块, 切换设置页). 提交的时刻由固定种子决定,
+ * 两种循环看到的负载相同. 循环每次迭代之间等待 1ms 代替等待显示.
+ */
+namespace {
+    constexpr int LOOP_ITERATIONS = 4000;
+    constexpr auto LOOP_INTERVAL = std::chrono::milliseconds(1);
+    constexpr size_t MAX_COMMANDS_PER_FRAME = 4; // 与 Playback::MAX_COMMANDS_PER_FRAME 相同
+    constexpr int BURST_EVERY = 200;
+    constexpr int BURST_SIZE = 16;
+
+    /**
+     * 一条命令的工作量: 修改一个参数并交给 DSP 线程
+     */
+    struct LoopTarget {
+        std::atomic<double> value = 0.0;
+
+        void apply(double v) {
+            auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(2);
+            while (std::chrono::steady_clock::now() < until) {}
+            value = v;
+        }
+    };
+
+    /**
+     * 在另一个线程上按 LOOP_INTERVAL 的节奏调用 post, 每 BURST_EVERY 次额外提交 BURST_SIZE 条
+     */
+    template<typename Post>
+    std::thread startProducer(std::atomic<bool> &running, Post post) {
+        return std::thread([&running, post] {
+            std::mt19937 rng(42);
+            std::uniform_int_distribution<int> jitter(0, 500);
+            int n = 0;
+            while (running) {
+                post(static_cast<double>(n));
+                if (++n % BURST_EVERY == 0) {
+                    for (int i = 0; i < BURST_SIZE; ++i) { post(static_cast<double>(i)); }
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(750 + jitter(rng)));
+            }
+        });
+    }
+
+    void reportTiming(benchmark::State &state, const PlaybackLoopTiming &timing, uint64_t commands) {
+        state.counters["p50_us"] = static_cast<double>(timing.quantileMicros(0.5));
+        state.counters["p99_us"] = static_cast<double>(timing.quantileMicros(0.99));
+        state.counters["p999_us"] = static_cast<double>(timing.quantileMicros(0.999));
+        state.counters["max_us"] = timing.maxMicros();
+        state.counters["commands"] = static_cast<double>(commands);
+    }
+}
+
+/**
+ * 修改前: 每一帧运行一次事件循环, 处理期间排队的所有槽函数
+ */
+static void BM_PlaybackLoopProcessEvents(benchmark::State &state) {
+    prepareBenchEnvironment();
+    LoopTarget target;
+    QObject receiver;
+    std::atomic<uint64_t> commands = 0;
+    PlaybackLoopTiming timing;
+    std::atomic<bool> running = true;
+    std::thread producer = startProducer(running, [&](double v) {
+        QMetaObject::invokeMethod(&receiver, [&target, &commands, v] {
+            target.apply(v);
+            ++commands;
+        }, Qt::QueuedConnection);
+    });
+    for (auto _: state) {
+        for (int i = 0; i < LOOP_ITERATIONS; ++i) {
+            auto begin = PlaybackLoopTiming::Clock::now();
+            uint64_t before = commands;
+            QCoreApplication::processEvents();
+            timing.record(begin, PlaybackLoopTiming::Clock::now(), static_cast<size_t>(commands - before));
+            std::this_thread::sleep_for(LOOP_INTERVAL);
+        }
+    }
+    running = false;
+    producer.join();
+    QCoreApplication::processEvents();
+    reportTiming(state, timing, commands);
+}
+
+/**
+ * 修改后: 从无锁队列中每一帧最多取出 MAX_COMMANDS_PER_FRAME 条命令, 剩下的留到下一帧
+ */
+static void BM_PlaybackLoopCommandQueue(benchmark::State &state) {
+    LoopTarget target;
+    moodycamel::ConcurrentQueue<double> queue;
+    uint64_t commands = 0;
+    PlaybackLoopTiming timing;
+    std::atomic<bool> running = true;
+    std::thread producer = startProducer(running, [&queue](double v) { queue.enqueue(v); });
+    for (auto _: state) {
+        for (int i = 0; i < LOOP_ITERATIONS; ++i) {
+            auto begin = PlaybackLoopTiming::Clock::now();
+            size_t applied = 0;
+            double v;
+            while (applied < MAX_COMMANDS_PER_FRAME && queue.try_dequeue(v)) {
+                target.apply(v);
+                ++applied;
+            }
+            timing.record(begin, PlaybackLoopTiming::Clock::now(), applied);
+            commands += applied;
+            std::this_thread::sleep_for(LOOP_INTERVAL);
+        }
+    }
+    running = false;
+    producer.join();
+    reportTiming(state, timing, commands);
+}
+
+BENCHMARK(BM_PlaybackLoopProcessEvents)->Iterations(1)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_PlaybackLoopCommandQueue)->Iterations(1)->UseRealTime()->Unit(benchmark::kMillisecond);
@@ -0,0 +1,182 @@
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "dsp/pcmkernels.hpp"
+
+/**
+ * 每次迭代处理的帧数, 约等于 44100Hz 下 46ms 音频, 与一次 writeAudio 的数据量相当
+ */
+constexpr std::size_t FRAMES = 2048;
+
+template<typename T>
+static std::vector<T> randomSamples(std::size_t count) {
+    std::mt19937 rng(42);
+    std::vector<T> out(count);
+    std::uniform_real_distribution<float> dist(-1.0F, 1.0F);
+    std::vector<float> f(count);
+    for (auto &x: f) { x = dist(rng); }
+    PcmKernels::Scalar::fromFloat(f.data(), out.data(), count);
+    return out;
+}
+
+template<typename T>
+static void setProcessed(benchmark::State &state, std::size_t samples) {
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * samples));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * samples * sizeof(T)));
+}
+
+template<typename T>
+static void BM_ToFloatScalar(benchmark::State &state) {
+    auto src = randomSamples<T>(FRAMES * 2);
+    std::vector<float> dst(src.size());
+    for (auto _: state) {
+        PcmKernels::Scalar::toFloat(src.data(), dst.data(), src.size());
+        benchmark::DoNotOptimize(dst.data());
+    }
+    setProcessed<T>(state, src.size());
+}
+
+template<typename T>
+static void BM_ToFloat(benchmark::State &state) {
+    auto src = randomSamples<T>(FRAMES * 2);
+    std::vector<float> dst(src.size());
+    for (auto _: state) {
+        PcmKernels::toFloat(src.data(), dst.data(), src.size());
+        benchmark::DoNotOptimize(dst.data());
+    }
+    setProcessed<T>(state, src.size());
+}
+
+template<typename T>
+static void BM_FromFloatScalar(benchmark::State &state) {
+    auto ref = randomSamples<float>(FRAMES * 2);
+    std::vector<T> dst(ref.size());
+    for (auto _: state) {
+        PcmKernels::Scalar::fromFloat(ref.data(), dst.data(), ref.size());
+        benchmark::DoNotOptimize(dst.data());
+    }
+    setProcessed<T>(state, ref.size());
+}
+
+template<typename T>
+static void BM_FromFloat(benchmark::State &state) {
+    auto ref = randomSamples<float>(FRAMES * 2);
+    std::vector<T> dst(ref.size());
+    for (auto _: state) {
+        PcmKernels::fromFloat(ref.data(), dst.data(), ref.size());
+        benchmark::DoNotOptimize(dst.data());
+    }
+    setProcessed<T>(state, ref.size());
+}
+
+/**
+ * 原 PonySampleFormat 中逐样本乘法的实现, 作为对照
+ */
+static void BM_GainLegacyInt16(benchmark::State &state) {
+    auto ref = randomSamples<int16_t>(FRAMES * 2);
+    auto data = ref;
+    for (auto _: state) {
+        // 每次迭代恢复原始数据, 避免样本衰减到 0 后测到的是非典型输入
+        std::copy(ref.begin(), ref.end(), data.begin());
+        for (auto &x: data) { x = static_cast<int16_t>(x * 0.999); }
+        benchmark::DoNotOptimize(data.data());
+    }
+    setProcessed<int16_t>(state, data.size());
+}
+
+template<typename T>
+static void BM_Gain(benchmark::State &state) {
+    auto ref = randomSamples<T>(FRAMES * 2);
+    auto data = ref;
+    for (auto _: state) {
+        std::copy(ref.begin(), ref.end(), data.begin());
+        PcmKernels::gain(data.data(), data.size(), 0.999F);
+        benchmark::DoNotOptimize(data.data());
+    }
+    setProcessed<T>(state, data.size());
+}
+
+static void BM_GainRampInt16(benchmark::State &state) {
+    auto ref = randomSamples<int16_t>(FRAMES * 2);
+    auto data = ref;
+    for (auto _: state) {
+        std::copy(ref.begin(), ref.end(), data.begin());
+        PcmKernels::gainRamp(data.data(), FRAMES, 2, 1.0F, 0.999F);
+        benchmark::DoNotOptimize(data.data());
+    }
+    setProcessed<int16_t>(state, data.size());
+}
+
+static void BM_ReverseFramesScalar(benchmark::State &state) {
+    auto frameBytes = static_cast<std::size_t>(state.range(0));
+    std::vector<std::byte> data(FRAMES * frameBytes);
+    for (auto _: state) {
+        PcmKernels::Scalar::reverseFrames(data.data(), FRAMES, frameBytes);
+        benchmark::DoNotOptimize(data.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * data.size()));
+}
+
+static void BM_ReverseFrames(benchmark::State &state) {
+    auto frameBytes = static_cast<std::size_t>(state.range(0));
+    std::vector<std::byte> data(FRAMES * frameBytes);
+    for (auto _: state) {
+        PcmKernels::reverseFrames(data.data(), FRAMES, frameBytes);
+        benchmark::DoNotOptimize(data.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * data.size()));
+}
+
+template<typename T>
+static void BM_Deinterleave(benchmark::State &state) {
+    auto src = randomSamples<T>(FRAMES * 2);
+    std::vector<T> l(FRAMES), r(FRAMES);
+    T *planes[2] = {l.data(), r.data()};
+    for (auto _: state) {
+        PcmKernels::deinterleave(src.data(), planes, FRAMES, 2);
+        benchmark::DoNotOptimize(l.data());
+        benchmark::DoNotOptimize(r.data());
+    }
+    setProcessed<T>(state, src.size());
+}
+
+template<bool scalar>
+static void BM_Downmix51(benchmark::State &state) {
+    auto src = randomSamples<float>(FRAMES * 6);
+    std::vector<float> dst(FRAMES * 2);
+    const float matrix[12] = {
+            1.0F, 0.0F, 0.707F, 0.0F, 0.707F, 0.0F,
+            0.0F, 1.0F, 0.707F, 0.0F, 0.0F, 0.707F,
+    };
+    for (auto _: state) {
+        if constexpr (scalar) {
+            PcmKernels::Scalar::downmix(src.data(), 6, dst.data(), 2, matrix, FRAMES);
+        } else {
+            PcmKernels::downmix(src.data(), 6, dst.data(), 2, matrix, FRAMES);
+        }
+        benchmark::DoNotOptimize(dst.data());
+    }
+    setProcessed<float>(state, src.size());
+}
+
+BENCHMARK_TEMPLATE(BM_ToFloatScalar, int16_t);
+BENCHMARK_TEMPLATE(BM_ToFloat, int16_t);
+BENCHMARK_TEMPLATE(BM_ToFloatScalar, uint8_t);
+BENCHMARK_TEMPLATE(BM_ToFloat, uint8_t);
+BENCHMARK_TEMPLATE(BM_ToFloat, int32_t);
+BENCHMARK_TEMPLATE(BM_FromFloatScalar, int16_t);
+BENCHMARK_TEMPLATE(BM_FromFloat, int16_t);
+BENCHMARK_TEMPLATE(BM_FromFloatScalar, uint8_t);
+BENCHMARK_TEMPLATE(BM_FromFloat, uint8_t);
+BENCHMARK_TEMPLATE(BM_FromFloat, int32_t);
+BENCHMARK(BM_GainLegacyInt16);
+BENCHMARK_TEMPLATE(BM_Gain, int16_t);
+BENCHMARK_TEMPLATE(BM_Gain, float);
+BENCHMARK(BM_GainRampInt16);
+BENCHMARK(BM_ReverseFramesScalar)->Arg(2)->Arg(4)->Arg(8)->Arg(12);
+BENCHMARK(BM_ReverseFrames)->Arg(2)->Arg(4)->Arg(8)->Arg(12);
+BENCHMARK_TEMPLATE(BM_Deinterleave, int16_t);
+BENCHMARK_TEMPLATE(BM_Deinterleave, float);
+BENCHMARK_TEMPLATE(BM_Downmix51, true);
+BENCHMARK_TEMPLATE(BM_Downmix51, false);
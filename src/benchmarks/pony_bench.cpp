@@ -0,0 +1,417 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QDebug>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSysInfo>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include "framecontroller.hpp"
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+/*
+ * 无界面的端到端播放基准. 用法:
+ *     pony_bench [--secs 30] [--realtime-secs 10] [--seeks 20] [--output result.json] FILE...
+ *
+ * 通过 FrameController 驱动 Demuxer 和 Playback, 音频输出到 null 后端(见 IAudioBackend), 画面由 NullRenderer
+ * 从 VsyncScheduler 取出后直接丢弃. 每个文件依次测量:
+ *   fast     null 后端尽可能快地消耗音频, 从头播放到结束或者 --secs, 报告解码帧率和实时倍数;
+ *   seek     暂停时跳转到 --seeks 个固定随机种子的位置, 报告从请求到解码器到达目标的延迟分位数;
+ *   reverse  从结尾倒放, 报告倒放的帧率和实时倍数;
+ *   realtime null 后端按实时速度消耗音频, 播放 --realtime-secs, 报告实时倍数, 音画偏差, 丢帧和欠载.
+ * 结果以 JSON 写入标准输出或者 --output, 日志写入标准错误.
+ */
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * 每次等待 FrameController 的上限(单位: 秒), 超时的操作记为失败
+     */
+    constexpr double WAIT_TIMEOUT_SECS = 20.0;
+    /**
+     * 倒放从距离结尾这么多秒的位置开始
+     */
+    constexpr double REVERSE_MARGIN_SECS = 0.5;
+
+    double secondsSince(Clock::time_point begin) {
+        return std::chrono::duration<double>(Clock::now() - begin).count();
+    }
+
+    /**
+     * 进程的峰值常驻内存(单位: byte)
+     */
+    qint64 peakRssBytes() {
+#ifdef Q_OS_WIN
+        PROCESS_MEMORY_COUNTERS counters{};
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) { return 0; }
+        return static_cast<qint64>(counters.PeakWorkingSetSize);
+#else
+        rusage usage{};
+        if (getrusage(RUSAGE_SELF, &usage) != 0) { return 0; }
+#ifdef Q_OS_MAC
+        return static_cast<qint64>(usage.ru_maxrss);
+#else
+        return static_cast<qint64>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+    }
+
+    double quantile(std::vector<double> values, double q) {
+        if (values.empty()) { return 0.0; }
+        std::sort(values.begin(), values.end());
+        return values[static_cast<size_t>(q * static_cast<double>(values.size() - 1))];
+    }
+
+    /**
+     * @brief 代替 Fireworks 的渲染线程.
+     *
+     * 按固定的刷新率从 VsyncScheduler 选择画面并记录交换缓冲区, 不绘制. 画面按照与界面相同的规则显示或者丢弃,
+     * 因此 PresentationStats 与实际播放时可比.
+     */
+    class NullRenderer {
+    private:
+        std::shared_ptr<VsyncScheduler> m_scheduler;
+        std::atomic<bool> m_running = true;
+        std::thread m_thread;
+
+    public:
+        NullRenderer(std::shared_ptr<VsyncScheduler> scheduler, double hz) : m_scheduler(std::move(scheduler)) {
+            m_scheduler->setNominalRate(hz);
+            const auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / hz));
+            m_thread = std::thread([this, period] {
+                auto next = Clock::now();
+                while (m_running) {
+                    m_scheduler->present(VsyncClock::now());
+                    m_scheduler->onVsync(VsyncClock::now());
+                    next = std::max(next + period, Clock::now());
+                    std::this_thread::sleep_until(next);
+                }
+            });
+        }
+
+        ~NullRenderer() {
+            m_running = false;
+            m_thread.join();
+        }
+    };
+
+    /**
+     * @brief 在主线程上同步地控制 FrameController.
+     *
+     * FrameController 的信号在它自己的线程或者 Playback 线程上发出, 这里直接连接并计数, 主线程等待计数增加.
+     */
+    class BenchPlayer {
+    private:
+        std::shared_ptr<VsyncScheduler> m_presenter = std::make_shared<VsyncScheduler>();
+        std::unique_ptr<NullRenderer> m_renderer;
+        FrameController *m_controller;
+
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+        uint64_t m_opened = 0;
+        bool m_openSucceeded = false;
+        uint64_t m_seeked = 0;
+        uint64_t m_ended = 0;
+
+        bool waitFor(const std::function<bool()> &predicate, double timeoutSecs) {
+            std::unique_lock lock(m_mutex);
+            return m_cond.wait_for(lock, std::chrono::duration<double>(timeoutSecs), predicate);
+        }
+
+        template<typename Func>
+        void notify(Func &&func) {
+            std::lock_guard lock(m_mutex);
+            func();
+            m_cond.notify_all();
+        }
+
+    public:
+        /**
+         * PonyAudioSink 在 Playback 线程启动时按环境变量选择后端, 构造函数等待它创建完成, 之后才能修改环境变量
+         * 创建另一个 BenchPlayer.
+         * @param rendererHz NullRenderer 的刷新率
+         */
+        explicit BenchPlayer(double rendererHz) {
+            m_controller = new FrameController(m_presenter, nullptr);
+            QObject::connect(m_controller, &FrameController::openFileResult, m_controller,
+                             [this](AnytMusic::OpenFileResultType result) {
+                                 notify([this, result] {
+                                     ++m_opened;
+                                     m_openSucceeded = result != AnytMusic::OpenFileResultType::FAILED;
+                                 });
+                             }, Qt::DirectConnection);
+            QObject::connect(m_controller, &FrameController::signalPositionChangedBySeek, m_controller, [this] {
+                notify([this] { ++m_seeked; });
+            }, Qt::DirectConnection);
+            QObject::connect(m_controller, &FrameController::resourcesEnd, m_controller, [this] {
+                notify([this] { ++m_ended; });
+            }, Qt::DirectConnection);
+            auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::duration<double>(WAIT_TIMEOUT_SECS));
+            while (m_controller->getAudioDeviceList().isEmpty() && Clock::now() < deadline) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+            m_renderer = std::make_unique<NullRenderer>(m_presenter, rendererHz);
+        }
+
+        FrameController *controller() { return m_controller; }
+
+        bool open(const QString &path) {
+            uint64_t target;
+            {
+                std::lock_guard lock(m_mutex);
+                target = m_opened + 1;
+            }
+            QMetaObject::invokeMethod(m_controller, [this, path] { m_controller->openFile(path); });
+            if (!waitFor([this, target] { return m_opened >= target; }, WAIT_TIMEOUT_SECS)) { return false; }
+            std::lock_guard lock(m_mutex);
+            return m_openSucceeded;
+        }
+
+        void close() {
+            QMetaObject::invokeMethod(m_controller, &FrameController::close, Qt::BlockingQueuedConnection);
+        }
+
+        void play() {
+            QMetaObject::invokeMethod(m_controller, &FrameController::start);
+        }
+
+        void pause() {
+            QMetaObject::invokeMethod(m_controller, &FrameController::pause, Qt::BlockingQueuedConnection);
+        }
+
+        /**
+         * 执行 request 并等待它引起的跳转完成
+         * @return 从请求到解码器到达目标的时间(单位: 毫秒), 超时时返回 -1
+         */
+        double awaitSeek(const std::function<void()> &request) {
+            uint64_t target;
+            {
+                std::lock_guard lock(m_mutex);
+                target = m_seeked + 1;
+            }
+            auto begin = Clock::now();
+            request();
+            if (!waitFor([this, target] { return m_seeked >= target; }, WAIT_TIMEOUT_SECS)) { return -1.0; }
+            return secondsSince(begin) * 1000.0;
+        }
+
+        double seek(qreal pos) {
+            return awaitSeek([this, pos] { m_controller->requestSeek(pos); });
+        }
+
+        /**
+         * 播放到结束或者超过 limitSecs
+         * @return 是否播放到结束
+         */
+        bool playFor(double limitSecs) {
+            uint64_t target;
+            {
+                std::lock_guard lock(m_mutex);
+                target = m_ended + 1;
+            }
+            play();
+            bool ended = waitFor([this, target] { return m_ended >= target; }, limitSecs);
+            pause();
+            return ended;
+        }
+    };
+
+    /**
+     * 两次采集之间的画面数, 包括 VsyncScheduler 丢弃和高倍速时跳过的画面
+     */
+    uint64_t decodedPictures(const PlaybackMetrics &begin, const PlaybackMetrics &end) {
+        return end.presentation.presented - begin.presentation.presented
+               + end.presentation.dropped - begin.presentation.dropped
+               + end.skippedPictures - begin.skippedPictures;
+    }
+
+    QJsonObject throughput(double wallSecs, double mediaSecs, uint64_t pictures, bool ended) {
+        QJsonObject result;
+        result["wallSecs"] = wallSecs;
+        result["mediaSecs"] = mediaSecs;
+        result["realtimeFactor"] = wallSecs > 0 ? mediaSecs / wallSecs : 0.0;
+        result["pictures"] = static_cast<qint64>(pictures);
+        result["fps"] = wallSecs > 0 ? static_cast<double>(pictures) / wallSecs : 0.0;
+        result["reachedEnd"] = ended;
+        return result;
+    }
+
+    QJsonObject measureFast(BenchPlayer &player, double limitSecs) {
+        player.seek(0.0);
+        FrameController *controller = player.controller();
+        PlaybackMetrics begin = controller->getPlaybackMetrics();
+        auto wall = Clock::now();
+        bool ended = player.playFor(limitSecs);
+        double wallSecs = secondsSince(wall);
+        PlaybackMetrics end = controller->getPlaybackMetrics();
+        return throughput(wallSecs, controller->getPreferablePos(), decodedPictures(begin, end), ended);
+    }
+
+    QJsonObject measureSeeks(BenchPlayer &player, qreal duration, int count) {
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<double> position(0.0, std::max(0.0, duration * 0.95));
+        std::vector<double> latencies;
+        int failed = 0;
+        for (int i = 0; i < count; ++i) {
+            double ms = player.seek(position(rng));
+            if (ms < 0) {
+                ++failed;
+            } else {
+                latencies.push_back(ms);
+            }
+        }
+        QJsonObject result;
+        result["count"] = static_cast<int>(latencies.size());
+        result["failed"] = failed;
+        result["p50Ms"] = quantile(latencies, 0.5);
+        result["p95Ms"] = quantile(latencies, 0.95);
+        result["p99Ms"] = quantile(latencies, 0.99);
+        result["maxMs"] = quantile(latencies, 1.0);
+        return result;
+    }
+
+    QJsonObject measureReverse(BenchPlayer &player, qreal duration, double limitSecs) {
+        FrameController *controller = player.controller();
+        if (player.awaitSeek([controller] { controller->backward(); }) < 0) { return {{"error", "backward failed"}}; }
+        qreal start = std::max(0.0, duration - REVERSE_MARGIN_SECS);
+        player.seek(start);
+        PlaybackMetrics begin = controller->getPlaybackMetrics();
+        auto wall = Clock::now();
+        bool ended = player.playFor(limitSecs);
+        double wallSecs = secondsSince(wall);
+        PlaybackMetrics end = controller->getPlaybackMetrics();
+        QJsonObject result = throughput(wallSecs, start - controller->getPreferablePos(), decodedPictures(begin, end),
+                                        ended);
+        player.awaitSeek([controller] { controller->forward(); });
+        return result;
+    }
+
+    QJsonObject measureRealtime(BenchPlayer &player, double limitSecs) {
+        player.seek(0.0);
+        FrameController *controller = player.controller();
+        PlaybackMetrics begin = controller->getPlaybackMetrics();
+        auto wall = Clock::now();
+        bool ended = player.playFor(limitSecs);
+        double wallSecs = secondsSince(wall);
+        PlaybackMetrics end = controller->getPlaybackMetrics();
+        QJsonObject result = throughput(wallSecs, controller->getPreferablePos(), decodedPictures(begin, end), ended);
+        result["driftP50Ms"] = end.presentation.driftP50Ms;
+        result["driftP95Ms"] = end.presentation.driftP95Ms;
+        result["driftP99Ms"] = end.presentation.driftP99Ms;
+        result["judderMs"] = end.presentation.judderMs;
+        result["presented"] = static_cast<qint64>(end.presentation.presented - begin.presentation.presented);
+        result["dropped"] = static_cast<qint64>(end.presentation.dropped - begin.presentation.dropped
+                                                + end.skippedPictures - begin.skippedPictures);
+        result["repeated"] = static_cast<qint64>(end.presentation.repeated - begin.presentation.repeated);
+        result["underruns"] = static_cast<qint64>(end.audio.underruns - begin.audio.underruns);
+        result["partialFills"] = static_cast<qint64>(end.audio.partialFills - begin.audio.partialFills);
+        return result;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("pony_bench");
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless end-to-end playback benchmark, results are written as JSON.");
+    parser.addHelpOption();
+    QCommandLineOption secsOption("secs", "Wall-clock limit of the fast and reverse runs (seconds).", "secs", "30");
+    QCommandLineOption realtimeOption("realtime-secs", "Length of the realtime run (seconds).", "secs", "10");
+    QCommandLineOption seeksOption("seeks", "Number of seeks per file.", "count", "20");
+    QCommandLineOption outputOption("output", "Write the JSON report to this file instead of stdout.", "file");
+    parser.addOptions({secsOption, realtimeOption, seeksOption, outputOption});
+    parser.addPositionalArgument("files", "Media files to play.", "FILE...");
+    parser.process(app);
+    const QStringList files = parser.positionalArguments();
+    if (files.isEmpty()) { parser.showHelp(1); }
+    const double secs = parser.value(secsOption).toDouble();
+    const double realtimeSecs = parser.value(realtimeOption).toDouble();
+    const int seeks = parser.value(seeksOption).toInt();
+
+    std::vector<QJsonObject> reports(static_cast<size_t>(files.size()));
+    std::vector<bool> opened(reports.size(), false);
+    qputenv("PONY_AUDIO_BACKEND", "null");
+
+    // 音频尽可能快地消耗, NullRenderer 使用 VsyncClock 允许的最高刷新率, 尽快取走画面
+    qputenv("PONY_AUDIO_RATE", "0");
+    BenchPlayer fast(500.0);
+    for (size_t i = 0; i < reports.size(); ++i) {
+        QJsonObject &report = reports[i];
+        report["path"] = files[static_cast<int>(i)];
+        if (!fast.open(files[static_cast<int>(i)])) {
+            qWarning() << "Cannot open" << files[static_cast<int>(i)];
+            report["error"] = "open failed";
+            continue;
+        }
+        opened[i] = true;
+        FrameController *controller = fast.controller();
+        const bool hasVideo = controller->hasVideo();
+        const qreal duration = hasVideo ? controller->getVideoDuration() : controller->getAudioDuration();
+        report["hasVideo"] = hasVideo;
+        report["duration"] = duration;
+        report["fast"] = measureFast(fast, secs);
+        report["seek"] = measureSeeks(fast, duration, seeks);
+        report["reverse"] = measureReverse(fast, duration, secs);
+        fast.close();
+        qDebug() << "Fast runs finished for" << files[static_cast<int>(i)];
+    }
+
+    qputenv("PONY_AUDIO_RATE", "1");
+    BenchPlayer realtime(60.0);
+    for (size_t i = 0; i < reports.size(); ++i) {
+        if (!opened[i] || !realtime.open(files[static_cast<int>(i)])) { continue; }
+        reports[i]["realtime"] = measureRealtime(realtime, realtimeSecs);
+        realtime.close();
+        qDebug() << "Realtime run finished for" << files[static_cast<int>(i)];
+    }
+
+    QJsonArray results;
+    for (auto &report : reports) { results.append(report); }
+    QJsonObject root;
+    root["tool"] = "pony_bench";
+    root["schema"] = 1;
+    root["date"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    root["system"] = QJsonObject{
+            {"os",   QSysInfo::prettyProductName()},
+            {"cpu",  QSysInfo::currentCpuArchitecture()},
+            {"qt",   qVersion()},
+            {"cores", static_cast<int>(std::thread::hardware_concurrency())}
+    };
+    root["options"] = QJsonObject{{"secs", secs}, {"realtimeSecs", realtimeSecs}, {"seeks", seeks}};
+    root["files"] = results;
+    root["peakRssBytes"] = peakRssBytes();
+
+    QByteArray json = QJsonDocument(root).toJson();
+    if (parser.isSet(outputOption)) {
+        QFile out(parser.value(outputOption));
+        if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            qWarning() << "Cannot write" << out.fileName();
+            return 1;
+        }
+        out.write(json);
+    } else {
+        QFile out;
+        if (!out.open(stdout, QIODevice::WriteOnly)) { return 1; }
+        out.write(json);
+    }
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include <benchmark/benchmark.h>
+#include <cmath>
+#include <random>
+#include <vector>
+#include "dsp/timestretch.hpp"
+
+/**
+ * 输入是 2 秒 44100Hz 双声道音频, 由几个正弦波和少量噪声组成, 近似音乐内容
+ */
+constexpr int SAMPLE_RATE = 44100;
+constexpr int CHANNELS = 2;
+constexpr int INPUT_FRAMES = SAMPLE_RATE * 2;
+constexpr int CHUNK_FRAMES = 1024;
+
+static std::vector<int16_t> musicLike() {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> noise(-0.02, 0.02);
+    std::vector<int16_t> out(static_cast<std::size_t>(INPUT_FRAMES * CHANNELS));
+    for (int i = 0; i < INPUT_FRAMES; ++i) {
+        double t = static_cast<double>(i) / SAMPLE_RATE;
+        double v = 0.3 * std::sin(2 * PcmKernels::PI * 220 * t) + 0.2 * std::sin(2 * PcmKernels::PI * 330 * t)
+                   + 0.1 * std::sin(2 * PcmKernels::PI * 1760 * t) + noise(rng);
+        for (int c = 0; c < CHANNELS; ++c) {
+            out[static_cast<std::size_t>(i * CHANNELS + c)] = static_cast<int16_t>(v * 32767);
+        }
+    }
+    return out;
+}
+
+/**
+ * 报告实时倍数: 每秒处理的输入音频秒数. 例如 200 表示处理 1 秒音频只需要 5ms.
+ * @param state.range(0) TimeStretch::Engine
+ * @param state.range(1) TimeStretch::Quality
+ * @param state.range(2) 速度的百分数
+ */
+static void BM_TimeStretch(benchmark::State &state) {
+    auto engine = static_cast<TimeStretch::Engine>(state.range(0));
+    auto quality = static_cast<TimeStretch::Quality>(state.range(1));
+    auto speed = static_cast<float>(state.range(2)) / 100.0f;
+    auto input = musicLike();
+    std::vector<int16_t> output(static_cast<std::size_t>(8192 * CHANNELS));
+    auto stretcher = TimeStretch::create(engine, quality, SAMPLE_RATE, CHANNELS);
+    stretcher->setSpeed(speed);
+    for (auto _: state) {
+        for (int i = 0; i < INPUT_FRAMES; i += CHUNK_FRAMES) {
+            stretcher->write(input.data() + i * CHANNELS, CHUNK_FRAMES);
+            while (stretcher->read(output.data(), 8192) > 0);
+        }
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.counters["realtime"] = benchmark::Counter(
+            static_cast<double>(state.iterations()) * INPUT_FRAMES / SAMPLE_RATE, benchmark::Counter::kIsRate);
+}
+
+static void stretchArgs(benchmark::internal::Benchmark *b) {
+    b->ArgNames({"engine", "quality", "speed%"});
+    for (int64_t speed: {50, 125, 150, 200, 400}) {
+        b->Args({static_cast<int64_t>(TimeStretch::Engine::Sonic),
+                 static_cast<int64_t>(TimeStretch::Quality::Balanced), speed});
+        for (auto quality: {TimeStretch::Quality::Fast, TimeStretch::Quality::Balanced, TimeStretch::Quality::High}) {
+            b->Args({static_cast<int64_t>(TimeStretch::Engine::Wsola), static_cast<int64_t>(quality), speed});
+        }
+    }
+}
+
+BENCHMARK(BM_TimeStretch)->Apply(stretchArgs)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,92 @@
+#include <benchmark/benchmark.h>
+#include <thread>
+#include <vector>
+#include "private/decoders.hpp"
+
+/**
+ * 队列只传递指针, 基准不解码也不释放画面. 每个 AVFrame 的 PTS 等于它在池中的下标.
+ */
+struct FramePool {
+    std::vector<AVFrame *> frames;
+
+    explicit FramePool(size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            AVFrame *frame = av_frame_alloc();
+            frame->pts = static_cast<int64_t>(i);
+            frames.push_back(frame);
+        }
+    }
+
+    ~FramePool() {
+        for (AVFrame *frame: frames) { av_frame_free(&frame); }
+    }
+};
+
+/**
+ * 没有竞争时入队后立即出队的开销
+ */
+static void BM_TwinsQueuePushRemove(benchmark::State &state) {
+    FramePool pool(1);
+    TwinsBlockQueue<AVFrame *> queue("AudioQueue", 16);
+    for (auto _: state) {
+        queue.push(pool.frames[0]);
+        benchmark::DoNotOptimize(queue.remove(true));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/**
+ * 与 Demuxer 相同的线程模型: 解码线程交替向音频和画面两个联动队列写入, DSP 线程和 Playback 线程分别取出.
+ * 音频帧的数量是画面的两倍. 报告每秒经过队列的元素数.
+ * @param state.range(0) 两个队列的 prefer, 正放为 16, 倒放为 200
+ */
+static void BM_TwinsQueueContended(benchmark::State &state) {
+    constexpr size_t PICTURES = 4096;
+    constexpr size_t SAMPLES = 2 * PICTURES;
+    FramePool pool(1);
+    AVFrame *frame = pool.frames[0];
+    const auto prefer = static_cast<size_t>(state.range(0));
+    TwinsBlockQueue<AVFrame *> audio("AudioQueue", prefer);
+    TwinsBlockQueue<AVFrame *> *video = audio.twins("VideoQueue", prefer);
+    for (auto _: state) {
+        std::thread picture([video] {
+            for (size_t i = 0; i < PICTURES; ++i) { benchmark::DoNotOptimize(video->remove(true)); }
+        });
+        std::thread sample([&audio] {
+            for (size_t i = 0; i < SAMPLES; ++i) { benchmark::DoNotOptimize(audio.remove(true)); }
+        });
+        for (size_t i = 0; i < PICTURES; ++i) {
+            audio.push(frame);
+            video->push(frame);
+            audio.push(frame);
+        }
+        picture.join();
+        sample.join();
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * (PICTURES + SAMPLES)));
+    delete video;
+}
+
+/**
+ * 跳转后丢弃目标之前的帧: 队列中有 n 帧, skip 移除前 n - 1 帧. 填充队列不计入时间.
+ * @param state.range(0) 队列中的帧数
+ */
+static void BM_TwinsQueueSkip(benchmark::State &state) {
+    const auto count = static_cast<size_t>(state.range(0));
+    FramePool pool(count);
+    TwinsBlockQueue<AVFrame *> queue("VideoQueue", count + 1);
+    const auto target = static_cast<int64_t>(count - 1);
+    for (auto _: state) {
+        state.PauseTiming();
+        for (AVFrame *frame: pool.frames) { queue.push(frame); }
+        state.ResumeTiming();
+        int skipped = queue.skip([target](AVFrame *frame) { return frame->pts < target; }, [](AVFrame *) {});
+        benchmark::DoNotOptimize(skipped);
+        benchmark::DoNotOptimize(queue.remove(true));
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * count));
+}
+
+BENCHMARK(BM_TwinsQueuePushRemove);
+BENCHMARK(BM_TwinsQueueContended)->ArgName("prefer")->Arg(16)->Arg(200)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_TwinsQueueSkip)->ArgName("frames")->Arg(16)->Arg(200);
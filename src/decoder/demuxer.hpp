@@ -4,6 +4,7 @@
 #pragma once
 
 #include <QObject>
+#include <shared_mutex>
 #include <utility>
 #include "private/dispatcher.hpp"
 #include "audioformat.hpp"
@@ -20,7 +21,36 @@ private:
     ReverseDecodeDispatcher *m_backward = nullptr;
 
     QThread *m_affinityThread = nullptr;
-    std::mutex m_workerLock;
+    /**
+     * 保护 m_worker 的切换. 取帧等操作只读取 m_worker, 持有共享锁, Playback 线程取画面和 DSP 线程取音频时
+     * 不会互相阻塞.
+     */
+    std::shared_mutex m_workerLock;
+
+    /**
+     * 在 worker 所在的线程上执行 func 并等待完成. 交叉淡化接管的解码器运行在自己的线程上, 修改解码状态的操作
+     * 需要排在它的解码循环之后.
+     */
+    template<typename Func>
+    static void runOnWorkerThread(DemuxDispatcherBase *worker, Func &&func) {
+        if (worker->thread() == QThread::currentThread()) {
+            func();
+        } else {
+            QMetaObject::invokeMethod(worker, std::forward<Func>(func), Qt::BlockingQueuedConnection);
+        }
+    }
+
+    /**
+     * 与 runOnWorkerThread 相同, 但不等待完成. func 排在 worker 当前的解码循环之后, 按提交的顺序执行.
+     */
+    template<typename Func>
+    static void postOnWorkerThread(DemuxDispatcherBase *worker, Func &&func) {
+        if (worker->thread() == QThread::currentThread()) {
+            func();
+        } else {
+            QMetaObject::invokeMethod(worker, std::forward<Func>(func), Qt::QueuedConnection);
+        }
+    }
 public:
 
 
@@ -39,26 +69,27 @@ public:
     PONY_GUARD_BY(MAIN, FRAME, DECODER)
 
     VideoFrameRef getPicture() {
-        std::unique_lock lock(m_workerLock);
+        std::shared_lock lock(m_workerLock);
         return m_worker->getPicture();
     }
 
     PONY_GUARD_BY(MAIN, FRAME, DECODER)
 
     qreal frontPicture() {
-        std::unique_lock lock(m_workerLock);
+        std::shared_lock lock(m_workerLock);
         return m_worker->frontPicture();
     }
 
     PONY_THREAD_SAFE int skipPicture(const std::function<bool(qreal)> &predicate) {
-        std::unique_lock lock(m_workerLock);
+        std::shared_lock lock(m_workerLock);
         return m_worker->skipPicture(predicate);
     }
 
-    PONY_GUARD_BY(MAIN, FRAME, DECODER)
+    PONY_GUARD_BY(MAIN, FRAME, DECODER, AUDIO_DSP)
 
     AudioFrame getSample() {
-        std::unique_lock lock(m_workerLock);
+        std::shared_lock lock(m_workerLock);
+        if (!m_worker) { return {}; }
         return m_worker->getSample();
     }
 
@@ -66,17 +97,37 @@ public:
     PONY_GUARD_BY(MAIN, FRAME, DECODER)
 
     qreal frontSample() {
-        std::unique_lock lock(m_workerLock);
+        std::shared_lock lock(m_workerLock);
+        if (!m_worker) { return std::numeric_limits<qreal>::quiet_NaN(); }
         return m_worker->frontSample();
     }
 
     PONY_THREAD_SAFE int skipSample(const std::function<bool(qreal)> &predicate) {
-        std::unique_lock lock(m_workerLock);
+        std::shared_lock lock(m_workerLock);
+        if (!m_worker) { return 0; }
         return m_worker->skipSample(predicate);
     }
 
+    /**
+     * 解码队列中等待显示的画面数, 没有打开文件时返回 0
+     */
+    PONY_THREAD_SAFE size_t pictureQueueSize() {
+        std::shared_lock lock(m_workerLock);
+        if (!m_worker) { return 0; }
+        return m_worker->pictureQueueSize();
+    }
+
+    /**
+     * 解码队列中等待播放的音频帧数, 没有打开文件时返回 0
+     */
+    PONY_THREAD_SAFE size_t sampleQueueSize() {
+        std::shared_lock lock(m_workerLock);
+        if (!m_worker) { return 0; }
+        return m_worker->sampleQueueSize();
+    }
 
-    PONY_GUARD_BY(MAIN, FRAME, DECODER)
+
+    PONY_GUARD_BY(MAIN, FRAME, DECODER, AUDIO_DSP)
 
     qreal audioDuration() {
         std::unique_lock lock(m_workerLock);
@@ -106,13 +157,13 @@ public:
      * @return
      */
     PONY_THREAD_SAFE bool isBackward() {
-        std::unique_lock lock(m_workerLock);
+        std::shared_lock lock(m_workerLock);
         return dynamic_cast<ReverseDecodeDispatcher *>(m_worker);
     }
 
 
     PONY_THREAD_SAFE bool hasVideo() {
-        std::unique_lock lock(m_workerLock);
+        std::shared_lock lock(m_workerLock);
         return m_forward && m_forward->hasVideo();
     }
 
@@ -124,12 +175,12 @@ public:
     */
     PONY_CONDITION("OpenFileResult")
     PONY_THREAD_SAFE void pause() {
-        std::unique_lock lock(m_workerLock);
+        std::shared_lock lock(m_workerLock);
         m_worker->statePause();
     }
 
     PONY_THREAD_SAFE bool isFileOpen() {
-        std::unique_lock lock(m_workerLock);
+        std::shared_lock lock(m_workerLock);
         return m_worker != nullptr;
     }
 
@@ -176,31 +227,53 @@ public:
     }
 
 
-public slots:
-
     /**
-     * 调整视频进度, 必须保证解码器线程空闲且缓冲区为空. 方法返回后保证产生的帧是在时间正确. \n
-     * 一次完整的调整进度操作应该为: \n
-     * 1. 在VideoThread线程调用 Demuxer2::statePause 使解码器线程停止运行; \n
-     * 2. 在VideoThread线程调用 Demuxer2::seek 并阻塞等待函数返回, 接下来产生的帧是新的帧. \n
-     * 3. 在VideoThread线程调用 Demuxer2::flush 清空队列中的旧帧. \n
-     * 4. 在DeocdeThread线程中执行 Demuxer2::start, 恢复解码器线程线程运行. \n
+     * 调整视频进度, 方法返回后取出的帧保证在正确的时间. 一次完整的调整进度操作应该为: \n
+     * 1. 调用 Demuxer::pause 唤醒阻塞的取帧请求并打断解码循环; \n
+     * 2. 调用 Demuxer::seek; \n
+     * 3. 调用 Demuxer::start 恢复解码. \n
+     * 正放时不等待解码线程: 之前解码的帧立即过期, 队列中的直接释放, 之后入队的在取出时丢弃, 跳转排在解码线程当前
+     * 的工作之后执行. 倒放的解码器在解码线程上维护帧栈, 仍然阻塞地跳转并清空队列.
      * @param secs 视频进度(单位: s)
-     * @see Demuxer2::statePause
-     * @see Demuxer2::flush
+     * @see DecodeDispatcher::supersede
      * @see DecodeDispatcher::seek
      */
-    void seek(qreal secs) {
-        m_worker->seek(secs);
+    PONY_GUARD_BY(FRAME) void seek(qreal secs) {
+        DemuxDispatcherBase *worker;
+        {
+            std::shared_lock lock(m_workerLock);
+            worker = m_worker;
+            if (worker == m_forward) {
+                uint64_t generation = m_forward->supersede();
+                postOnWorkerThread(m_forward, [forward = m_forward, secs, generation] {
+                    forward->seek(secs, generation);
+                });
+                return;
+            }
+        }
+        runOnWorkerThread(worker, [worker, secs] { worker->seek(secs); });
+        flush();
     }
 
+    /**
+     * 开始或者结束拖动预览, 只对正放生效. 排在解码线程当前的工作之后执行, 不等待完成. 预览时解码器只输出关键帧,
+     * 需要重新 seek 才能保证获取到正确的帧.
+     * @see DecodeDispatcher::setScrubbing
+     */
+    PONY_GUARD_BY(FRAME) void setScrubbing(bool scrubbing) {
+        std::shared_lock lock(m_workerLock);
+        postOnWorkerThread(m_forward, [forward = m_forward, scrubbing] { forward->setScrubbing(scrubbing); });
+    }
+
+public slots:
+
     /**
      * 设置音频索引, 必须保证解码器线程空闲且缓冲区为空
      * @param index
      * @see DecodeDispatcher::seek
      */
     void setAudioIndex(StreamIndex index) {
-        m_forward->setAudioIndex(index);
+        runOnWorkerThread(m_forward, [this, index] { m_forward->setAudioIndex(index); });
     }
 
     /**
@@ -282,9 +355,48 @@ public slots:
         }
     }
 
+    /**
+     * 切换音轨. 阻塞等待解码线程执行期间不持有 m_workerLock, 否则与 adopt 争用写锁时会死锁.
+     * @param i 音轨序号
+     */
     void setTrack(int i) {
+        DemuxDispatcherBase *worker;
+        {
+            std::shared_lock lock(m_workerLock);
+            worker = m_worker;
+        }
+        if (!worker) {
+            qWarning() << "Try to set track while no file has been opened.";
+            return;
+        }
+        runOnWorkerThread(worker, [worker, i] { worker->setTrack(i); });
+    }
+
+    /**
+     * 交叉淡化时接管下一个文件的解码器, 当前文件的解码器在各自的线程上销毁. 调用时 DSP 线程不能读取音频帧.
+     * @return 是否接管. 文件已经关闭时不接管, 并且释放传入的解码器.
+     */
+    PONY_GUARD_BY(AUDIO_DSP, FRAME)
+
+    bool adopt(DecodeDispatcher *forward, ReverseDecodeDispatcher *backward) {
         std::unique_lock lock(m_workerLock);
-        m_worker->setTrack(i);
+        if (!m_worker) {
+            qWarning() << "Try to adopt decoder while no file has been opened.";
+            backward->statePause();
+            backward->deleteLater();
+            forward->statePause();
+            forward->deleteLater();
+            return false;
+        }
+        qDebug() << "Adopt" << forward->filename.c_str() << "from crossfade";
+        m_forward->statePause();
+        m_forward->deleteLater();
+        m_backward->statePause();
+        m_backward->deleteLater();
+        m_forward = forward;
+        m_backward = backward;
+        m_worker = m_forward;
+        return true;
     }
 
 
@@ -207,14 +207,9 @@ public:
     }
 
     void reverseSample(uint8_t *samples, int len) {
-        int sampleSize = targetFmt.getBytesPerSampleChannels();
-        int left = 0, right = len-sampleSize;
-        while (left < right) {
-            for (int i = 0; i < sampleSize; i++)
-                std::swap(samples[left+i], samples[right+i]);
-            left += sampleSize;
-            right -= sampleSize;
-        }
+        auto sampleSize = static_cast<size_t>(targetFmt.getBytesPerSampleChannels());
+        PcmKernels::reverseFrames(reinterpret_cast<std::byte *>(samples), static_cast<size_t>(len) / sampleSize,
+                                  sampleSize);
     }
 
     PONY_THREAD_SAFE AudioFrame getSample() override {
@@ -242,15 +237,18 @@ public:
     }
 
     PonyAudioFormat getInputFormat() override {
-        return {AnytMusic::valueOf(codecCtx->sample_fmt), codecCtx->sample_rate, codecCtx->channels};
+        return {AnytMusic::valueOf(codecCtx->sample_fmt), codecCtx->sample_rate, codecCtx->channels,
+                AnytMusic::channelLayoutOf(codecCtx->channel_layout, codecCtx->channels)};
     }
 
     void setOutputFormat(const PonyAudioFormat& format) override {
         targetFmt = format;
         if (swrCtx) { swr_free(&swrCtx); }
-        this->swrCtx = swr_alloc_set_opts(swrCtx, av_get_default_channel_layout(format.getChannelCount()),
+        // 输出布局由 PonyAudioSink 按源的布局协商, 通常与输入相同, swr 只转换样本格式和采样率, 缩混在输出端完成
+        auto inputLayout = AnytMusic::channelLayoutOf(codecCtx->channel_layout, codecCtx->channels);
+        this->swrCtx = swr_alloc_set_opts(swrCtx, static_cast<int64_t>(format.getChannelLayout()),
                                           format.getSampleFormatForFFmpeg(), format.getSampleRate(),
-                                          static_cast<int64_t>(codecCtx->channel_layout), codecCtx->sample_fmt,
+                                          static_cast<int64_t>(inputLayout), codecCtx->sample_fmt,
                                           codecCtx->sample_rate, 0, nullptr);
 
         if (!swrCtx || swr_init(swrCtx) < 0) {
@@ -4,6 +4,7 @@
 #pragma once
 
 #include "helper.hpp"
+#include "ponyplayer.h"
 INCLUDE_FFMPEG_BEGIN
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
@@ -17,8 +18,20 @@ INCLUDE_FFMPEG_END
 #include "concurrentqueue.h"
 #include "audioformat.hpp"
 #include <atomic>
+#include <cstdint>
 #include <utility>
 
+/**
+ * 解码出的帧所属的跳转代数, 保存在 AVFrame::opaque 中. FFmpeg 不使用这个字段, 帧入队前写入.
+ */
+inline void setFrameGeneration(AVFrame *frame, uint64_t generation) {
+    frame->opaque = reinterpret_cast<void *>(static_cast<uintptr_t>(generation));
+}
+
+inline uint64_t frameGeneration(const AVFrame *frame) {
+    return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(frame->opaque));
+}
+
 class IDemuxDecoder {
 
 public:
@@ -93,6 +106,17 @@ public:
 
     virtual void setStart(qreal secs) {}
 
+    /**
+     * 设置之后解码的帧所属的跳转代数
+     * @see setFrameGeneration
+     */
+    virtual void setGeneration(uint64_t generation) {}
+
+    /**
+     * 只输出关键帧, 用于拖动进度条时预览
+     */
+    virtual void setKeyframeOnly(bool b) {}
+
     virtual qreal nextSegment() {
         NOT_IMPLEMENT_YET
     }
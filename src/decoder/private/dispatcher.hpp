@@ -131,6 +131,10 @@ public:
 
     virtual int skipSample(const std::function<bool(qreal)> &function) {NOT_IMPLEMENT_YET}
 
+    PONY_THREAD_SAFE virtual size_t pictureQueueSize() {NOT_IMPLEMENT_YET}
+
+    PONY_THREAD_SAFE virtual size_t sampleQueueSize() {NOT_IMPLEMENT_YET}
+
     virtual void setTrack(int i) {NOT_IMPLEMENT_YET}
 
     virtual bool hasVideo() {NOT_IMPLEMENT_YET}
@@ -168,6 +172,21 @@ private:
     std::atomic<bool> interrupt = true;
     AVPacket *packet = nullptr;
 
+    /**
+     * 跳转的代数. 帧入队时记录解码它的代数, 队列遇到代数不是 m_generation 的帧时直接丢弃, 跳转不需要等待
+     * 解码线程停下来, 也不需要清空队列. m_decodingGeneration 是解码线程上正在产生的帧的代数, 两者不同时说明
+     * 跳转还没有在解码线程上执行, 此时队列中的文件结束标记(nullptr)也属于旧的位置.
+     */
+    std::atomic<uint64_t> m_generation = 0;
+    std::atomic<uint64_t> m_decodingGeneration = 0;
+    std::mutex m_generationMutex; // 解码到文件末尾时与 supersede 互斥, 见 onWork
+
+    [[nodiscard]] bool superseded() const { return m_decodingGeneration != m_generation; }
+
+    [[nodiscard]] bool isStale(AVFrame *frame) const {
+        return frame ? frameGeneration(frame) != m_generation : superseded();
+    }
+
 public:
     explicit DecodeDispatcher(
             const std::string &fn,
@@ -215,6 +234,10 @@ public:
             videoDecoder = new DecoderImpl<Video>(fmtCtx->streams[m_videoStreamIndex], videoQueue);
         }
         description.videoDuration = videoDecoder->duration();
+        auto stale = [this](AVFrame *frame) { return isStale(frame); };
+        auto freeFrame = [](AVFrame *frame) { av_frame_free(&frame); };
+        audioQueue->setDiscard(stale, freeFrame);
+        videoQueue->setDiscard(stale, freeFrame);
         connect(this, &DecodeDispatcher::signalStartWorker, this, &DecodeDispatcher::onWork, Qt::QueuedConnection);
     }
 
@@ -257,18 +280,47 @@ public:
     }
 
     /**
-     * 修改视频播放进度, 注意: 这个方法必须在解码线程上调用.
+     * 开始新的跳转: 之前解码的帧全部过期, 队列中的立即释放, 解码线程上还没有入队的在取出时丢弃. 正在运行的
+     * 解码循环处理完当前的 packet 后退出. 这个方法是线程安全的, 不等待解码线程.
+     * @return 新的代数, 传给 DecodeDispatcher::seek
+     */
+    PONY_THREAD_SAFE uint64_t supersede() {
+        uint64_t generation;
+        {
+            std::lock_guard lock(m_generationMutex);
+            generation = m_generation.fetch_add(1) + 1;
+        }
+        videoQueue->discardStale();
+        audioQueue->discardStale();
+        return generation;
+    }
+
+    /**
+     * 修改视频播放进度, 之后产生的帧属于 generation. 注意: 这个方法必须在解码线程上调用, 并且排在 supersede
+     * 之后. 已经有更新的跳转时什么也不做.
      * @param secs 新的视频进度(单位: 秒)
+     * @param generation DecodeDispatcher::supersede 返回的代数
      */
-    void seek(qreal secs) override {
-        // case 1: currently decoding, interrupt
-        // case 2: not decoding, seek
-        interrupt = true;
-        qDebug() << "a Seek:" << secs;
+    PONY_GUARD_BY(DECODER) void seek(qreal secs, uint64_t generation) {
+        if (generation != m_generation) { return; }
+        qDebug() << "a Seek:" << secs << "generation" << generation;
         int ret = av_seek_frame(fmtCtx, -1, static_cast<int64_t>(secs * AV_TIME_BASE), AVSEEK_FLAG_BACKWARD);
         if (m_audioDecoder) { m_audioDecoder->flushFFmpegBuffers(); }
         if (videoDecoder) { videoDecoder->flushFFmpegBuffers(); }
         if (ret != 0) { qWarning() << "Error av_seek_frame:" << ffmpegErrToString(ret); }
+        // 旧的解码循环已经退出, 队列中剩下的(包括文件结束标记)都属于旧的位置
+        flush();
+        m_audioDecoder->setGeneration(generation);
+        videoDecoder->setGeneration(generation);
+        m_decodingGeneration = generation;
+    }
+
+    /**
+     * 修改视频播放进度, 注意: 这个方法必须在解码线程上调用.
+     * @param secs 新的视频进度(单位: 秒)
+     */
+    void seek(qreal secs) override {
+        seek(secs, supersede());
     }
 
     PONY_THREAD_SAFE VideoFrameRef getPicture() override { return videoDecoder->getPicture(); }
@@ -287,6 +339,19 @@ public:
         return m_audioDecoder->skip(predicate);
     }
 
+    PONY_THREAD_SAFE size_t pictureQueueSize() override { return videoQueue->size(); }
+
+    PONY_THREAD_SAFE size_t sampleQueueSize() override { return audioQueue->size(); }
+
+    /**
+     * 开始或者结束拖动预览, 预览时视频解码器只输出关键帧. 注意: 这个方法必须在解码线程上调用.
+     */
+    PONY_GUARD_BY(DECODER)
+
+    void setScrubbing(bool scrubbing) {
+        videoDecoder->setKeyframeOnly(scrubbing);
+    }
+
     PONY_GUARD_BY(MAIN, FRAME, DECODER)
 
     [[nodiscard]] qreal getAudionLength() const { return description.audioDuration; }
@@ -302,6 +367,7 @@ public:
         m_audioStreamIndex = description.m_audioStreamsIndex[static_cast<size_t>(i)];
         auto stream = fmtCtx->streams[m_audioStreamIndex];
         m_audioDecoder = new DecoderImpl<Audio>(stream, audioQueue);
+        m_audioDecoder->setGeneration(m_decodingGeneration);
     }
 
     PONY_GUARD_BY(DECODER)
@@ -322,6 +388,7 @@ public:
         delete m_audioDecoder;
         m_audioStreamIndex = i;
         m_audioDecoder = new DecoderImpl<Audio>(fmtCtx->streams[m_audioStreamIndex], audioQueue);
+        m_audioDecoder->setGeneration(m_decodingGeneration);
     }
 
     PONY_GUARD_BY(DECODER)
@@ -350,9 +417,13 @@ public:
 
 private slots:
 
+    /**
+     * 解码循环. 有新的跳转时退出, 让排在后面的 seek 执行; 此时跳转之后的 stateResume 已经启动了下一个解码循环,
+     * 不能再设置 interrupt.
+     */
     void onWork() {
         videoQueue->open();
-        while (!interrupt) {
+        while (!interrupt && !superseded()) {
             int ret = av_read_frame(fmtCtx, packet);
             if (ret == 0) {
                 if (static_cast<StreamIndex>(packet->stream_index) == m_videoStreamIndex) {
@@ -364,13 +435,14 @@ private slots:
                 videoQueue->push(nullptr);
                 audioQueue->push(nullptr);
                 av_packet_unref(packet);
+                std::lock_guard lock(m_generationMutex);
+                if (!superseded()) { interrupt = true; }
                 break;
             } else {
                 qWarning() << "Error av_read_frame:" << ffmpegErrToString(ret);
             }
             av_packet_unref(packet);
         }
-        interrupt = true;
     };
 
 
@@ -532,6 +604,10 @@ public:
 
     PONY_THREAD_SAFE qreal frontSample() override {NOT_IMPLEMENT_YET}
 
+    PONY_THREAD_SAFE size_t pictureQueueSize() override { return videoQueue->size(); }
+
+    PONY_THREAD_SAFE size_t sampleQueueSize() override { return audioQueue->size(); }
+
     PONY_GUARD_BY(DECODER)
 
     void setEnableAudio(bool enable) override { m_audioDecoder->setEnable(enable); }
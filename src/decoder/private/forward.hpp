@@ -9,6 +9,7 @@ template<IDemuxDecoder::DecoderType type>
 class DecoderImpl : public DecoderContext, public IDemuxDecoder {
 protected:
     TwinsBlockQueue<AVFrame *> *frameQueue;
+    uint64_t m_generation = 0;
 public:
     DecoderImpl(AVStream *vs, TwinsBlockQueue<AVFrame *> *queue)
             : DecoderContext(vs), frameQueue(queue) {}
@@ -28,6 +29,7 @@ public:
         while(ret >= 0 && !interrupt) {
             ret = avcodec_receive_frame(codecCtx, frameBuf);
             if (ret >= 0) {
+                setFrameGeneration(frameBuf, m_generation);
                 if(!frameQueue->push(frameBuf)) {
                     frameQueue->clear([](AVFrame *frame) { av_frame_free(&frame); });
                     av_frame_unref(frameBuf);
@@ -81,6 +83,10 @@ public:
         avcodec_flush_buffers(codecCtx);
     }
 
+    PONY_GUARD_BY(DECODER) void setGeneration(uint64_t generation) override {
+        m_generation = generation;
+    }
+
 };
 
 /**
@@ -127,15 +133,18 @@ public:
     }
 
     PonyAudioFormat getInputFormat() override {
-        return {AnytMusic::valueOf(codecCtx->sample_fmt), codecCtx->sample_rate, codecCtx->channels};
+        return {AnytMusic::valueOf(codecCtx->sample_fmt), codecCtx->sample_rate, codecCtx->channels,
+                AnytMusic::channelLayoutOf(codecCtx->channel_layout, codecCtx->channels)};
     }
 
     void setOutputFormat(const PonyAudioFormat& format) override {
         targetFmt = format;
         if (swrCtx) { swr_free(&swrCtx); }
-        this->swrCtx = swr_alloc_set_opts(swrCtx, av_get_default_channel_layout(format.getChannelCount()),
+        // 输出布局由 PonyAudioSink 按源的布局协商, 通常与输入相同, swr 只转换样本格式和采样率, 缩混在输出端完成
+        auto inputLayout = AnytMusic::channelLayoutOf(codecCtx->channel_layout, codecCtx->channels);
+        this->swrCtx = swr_alloc_set_opts(swrCtx, static_cast<int64_t>(format.getChannelLayout()),
                                           format.getSampleFormatForFFmpeg(), format.getSampleRate(),
-                                          static_cast<int64_t>(codecCtx->channel_layout), codecCtx->sample_fmt,
+                                          static_cast<int64_t>(inputLayout), codecCtx->sample_fmt,
                                           codecCtx->sample_rate, 0, nullptr);
 
         if (!swrCtx || swr_init(swrCtx) < 0) {
@@ -157,6 +166,13 @@ private:
 public:
     DecoderImpl(AVStream *vs, TwinsBlockQueue<AVFrame *> *queue) : DecoderImpl<Common>(vs, queue) {}
 
+    /**
+     * 让 FFmpeg 跳过非关键帧的解码, 跳转到关键帧之后第一个输出的就是这个关键帧
+     */
+    PONY_GUARD_BY(DECODER) void setKeyframeOnly(bool b) override {
+        codecCtx->skip_frame = b ? AVDISCARD_NONKEY : AVDISCARD_DEFAULT;
+    }
+
 
     VideoFrameRef getPicture() override {
         if (stillVideoFrame != nullptr) { return {stillVideoFrame, true, -1}; }
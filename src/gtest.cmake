@@ -21,6 +21,17 @@ add_executable(
         tests/example_test.cpp
         tests/decoder_test.cpp
         tests/frame_test.cpp
+        tests/pcmkernels_test.cpp
+        tests/audioclock_test.cpp
+        tests/timestretch_test.cpp
+        tests/equalizer_test.cpp
+        tests/convolver_test.cpp
+        tests/loudness_test.cpp
+        tests/channelmixer_test.cpp
+        tests/audiobackend_test.cpp
+        tests/twinsqueue_test.cpp
+        tests/abloop_test.cpp
+        tests/vsyncscheduler_test.cpp
 )
 
 target_link_libraries(unit_tests
@@ -32,6 +43,9 @@ target_link_libraries(unit_tests
         Qt::Quick
         )
 
+# abloop_test 和 vsyncscheduler_test 只使用 player 中的头文件, 不链接 QML 插件
+target_include_directories(unit_tests PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/player)
+
 # automatic discovery of unit tests
 include(GoogleTest)
 gtest_discover_tests(unit_tests
@@ -0,0 +1,301 @@
+#pragma once
+
+#include <QDebug>
+#include <QSettings>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+#include "ponyplayer.h"
+#include "audioformat.hpp"
+#include "frame.hpp"
+#include "framehistory.hpp"
+
+/**
+ * @brief A-B 循环区间中的音频.
+ *
+ * 第一次从 A 播放到 B 时记录解码器输出的音频, 之后每次循环都从内存中读取, 不需要跳转. 拼接处用 FADE_SECS 的等功率
+ * 交叉淡化把 B 之前的音频过渡到 A 之后的音频, 因此第一次播放只写入到 B - FADE_SECS, 之后每次循环依次写入淡化部分
+ * 和 [A + FADE_SECS, B - FADE_SECS). 没有从 A 开始播放(例如跳转到区间中间)时只写入到 B, 由调用者跳转到 A 后重新记录.
+ * 只在持有 AudioDspStage::m_workMutex 时访问.
+ */
+class LoopAudioCache {
+public:
+    enum class State {
+        Disarmed,  ///< 没有循环区间
+        Armed,     ///< 还没有播放到 A
+        Recording, ///< 正在记录区间中的音频
+        Looping,   ///< 从内存中循环
+        Uncached   ///< 不是从 A 开始播放或者被禁用, 播放到 B 时需要跳转
+    };
+
+    /**
+     * 拼接处交叉淡化的时长(单位: 秒)
+     */
+    constexpr static double FADE_SECS = 0.02;
+    /**
+     * 区间最短和最长的长度(单位: 秒), 10 分钟的 48 kHz 立体声约 110 MB
+     */
+    constexpr static double MIN_SECS = 0.5;
+    constexpr static double MAX_SECS = 600.0;
+    /**
+     * 第一个音频帧或者画面与 A 相差不超过这个值(单位: 秒)时认为是从 A 开始播放
+     */
+    constexpr static double EDGE_SECS = 0.1;
+    /**
+     * 循环时每次写入的帧数
+     */
+    constexpr static size_t CHUNK_FRAMES = 1024;
+
+private:
+    State m_state = State::Disarmed;
+    qreal m_a = std::numeric_limits<qreal>::quiet_NaN();
+    qreal m_b = std::numeric_limits<qreal>::quiet_NaN();
+    qreal m_start = 0.0;     // 记录的第一个音频帧的时间
+    size_t m_frameBytes = 4;
+    int m_channels = 2;
+    double m_bytesPerSec = 0.0;
+    size_t m_targetBytes = 0; // [m_start, B) 的长度
+    size_t m_fadeBytes = 0;
+    std::vector<std::byte> m_pcm;
+    std::vector<std::byte> m_fade; // [B - FADE_SECS, B) 淡出与 [A, A + FADE_SECS) 淡入混合的结果
+    bool m_inFade = true;     // Looping 时正在写入淡化部分
+    size_t m_pos = 0;         // Looping 时在当前部分中的位置
+    bool m_ended = false;     // Uncached 时已经写入到 B
+
+    [[nodiscard]] size_t align(double bytes) const {
+        auto n = static_cast<size_t>(std::max(0.0, bytes));
+        return n - n % m_frameBytes;
+    }
+
+    void beginLoop() {
+        m_fade.resize(m_fadeBytes);
+        PcmKernels::crossfade(reinterpret_cast<const int16_t *>(m_pcm.data() + m_pcm.size() - m_fadeBytes),
+                              reinterpret_cast<const int16_t *>(m_pcm.data()),
+                              reinterpret_cast<int16_t *>(m_fade.data()), m_fadeBytes / m_frameBytes, m_channels,
+                              0.0F, 1.0F);
+        m_state = State::Looping;
+        m_inFade = true;
+        m_pos = 0;
+        qDebug() << "Loop recorded" << m_pcm.size() << "bytes from" << m_start;
+    }
+
+public:
+    /**
+     * 设置循环区间, 丢弃之前记录的音频
+     * @param format 解码器输出的格式
+     */
+    void arm(qreal a, qreal b, const PonyAudioFormat &format) {
+        disarm();
+        if (std::isnan(a) || std::isnan(b)) { return; }
+        m_a = a;
+        m_b = b;
+        m_frameBytes = static_cast<size_t>(format.getBytesPerSampleChannels());
+        m_channels = format.getChannelCount();
+        m_bytesPerSec = format.getSampleRate() * format.getBytesPerSampleChannels();
+        m_fadeBytes = std::max(m_frameBytes, align(FADE_SECS * m_bytesPerSec));
+        m_state = State::Armed;
+    }
+
+    void disarm() {
+        m_state = State::Disarmed;
+        m_pcm.clear();
+        m_pcm.shrink_to_fit();
+        m_fade.clear();
+        m_ended = false;
+    }
+
+    /**
+     * 不再记录, 播放到 B 时由调用者跳转. 画面无法缓存时调用, 声音和画面需要同时回到 A.
+     */
+    void disable() {
+        if (m_state != State::Armed && m_state != State::Recording) { return; }
+        m_state = State::Uncached;
+        m_pcm.clear();
+        m_pcm.shrink_to_fit();
+    }
+
+    [[nodiscard]] bool isArmed() const { return m_state != State::Disarmed; }
+
+    [[nodiscard]] bool isLooping() const { return m_state == State::Looping; }
+
+    /**
+     * 没有缓存时是否已经写入到 B
+     */
+    [[nodiscard]] bool isEnded() const { return m_ended; }
+
+    /**
+     * 处理从解码器取出的音频帧, Looping 时不再调用
+     * @return 需要写入的长度, 从音频帧的开头计算
+     */
+    size_t accept(const AudioFrame &sample) {
+        const auto len = static_cast<size_t>(sample.getDataLen());
+        const qreal pts = sample.getPTS();
+        if (m_state == State::Armed) {
+            if (pts + static_cast<double>(len) / m_bytesPerSec <= m_a) { return len; }
+            if (pts > m_a + EDGE_SECS) {
+                m_state = State::Uncached;
+            } else {
+                m_state = State::Recording;
+                m_start = pts;
+                m_targetBytes = std::max(2 * m_fadeBytes, align((m_b - pts) * m_bytesPerSec));
+                m_pcm.reserve(m_targetBytes);
+            }
+        }
+        if (m_state == State::Uncached) {
+            if (m_ended) { return 0; }
+            size_t before = align((m_b - pts) * m_bytesPerSec);
+            if (before >= len) { return len; }
+            m_ended = true;
+            return before;
+        }
+        if (m_state != State::Recording) { return len; }
+        const size_t recorded = m_pcm.size();
+        const size_t take = std::min(len, m_targetBytes - recorded);
+        m_pcm.insert(m_pcm.end(), sample.getSampleData(), sample.getSampleData() + take);
+        // 最后 FADE_SECS 留到拼接时与 A 之后的音频混合
+        const size_t writeLimit = m_targetBytes - m_fadeBytes;
+        size_t write = recorded < writeLimit ? std::min(m_pcm.size(), writeLimit) - recorded : 0;
+        if (m_pcm.size() == m_targetBytes) { beginLoop(); }
+        return write;
+    }
+
+    /**
+     * 下一次读取是否从淡化之后开始, 这时需要切换时间基准
+     */
+    [[nodiscard]] bool atSplice() const { return m_state == State::Looping && !m_inFade && m_pos == 0; }
+
+    /**
+     * 淡化之后的第一个样本的时间
+     */
+    [[nodiscard]] qreal splicePts() const { return m_start + static_cast<double>(m_fadeBytes) / m_bytesPerSec; }
+
+    /**
+     * 读取下一段音频, 只能在 Looping 时调用
+     * @return 数据和长度(单位: byte)
+     */
+    std::pair<const std::byte *, size_t> read() {
+        const size_t chunk = CHUNK_FRAMES * m_frameBytes;
+        if (m_inFade) {
+            size_t n = std::min(chunk, m_fade.size() - m_pos);
+            const std::byte *data = m_fade.data() + m_pos;
+            m_pos += n;
+            if (m_pos == m_fade.size()) {
+                m_inFade = false;
+                m_pos = 0;
+            }
+            return {data, n};
+        }
+        const size_t end = m_pcm.size() - m_fadeBytes;
+        size_t n = std::min(chunk, end - m_fadeBytes - m_pos);
+        const std::byte *data = m_pcm.data() + m_fadeBytes + m_pos;
+        m_pos += n;
+        if (m_fadeBytes + m_pos == end) {
+            m_inFade = true;
+            m_pos = 0;
+        }
+        return {data, n};
+    }
+};
+
+/**
+ * @brief A-B 循环区间中的画面.
+ *
+ * 与 LoopAudioCache 一起记录第一次从 A 播放到 B 时的画面, 之后循环显示. 画面占用的内存超过预算时放弃缓存, 每次播放到
+ * B 时跳转. 只在 Playback 线程上使用.
+ */
+class LoopVideoCache {
+public:
+    using State = LoopAudioCache::State;
+    /**
+     * 默认的内存预算(单位: MB), 1080p 大约可以缓存 7 秒
+     */
+    constexpr static int DEFAULT_BUDGET_MB = 512;
+
+private:
+    State m_state = State::Disarmed;
+    qreal m_a = std::numeric_limits<qreal>::quiet_NaN();
+    qreal m_b = std::numeric_limits<qreal>::quiet_NaN();
+    size_t m_budgetBytes;
+    size_t m_bytes = 0;
+    std::vector<VideoFrameRef> m_frames;
+    size_t m_next = 0;
+
+public:
+    explicit LoopVideoCache(size_t budgetBytes = static_cast<size_t>(DEFAULT_BUDGET_MB) << 20)
+            : m_budgetBytes(budgetBytes) {}
+
+    /**
+     * 读取设置 Video/loopCacheMB, 0 表示不缓存画面, 每次循环都跳转
+     */
+    static LoopVideoCache load() {
+        QSettings settings(AnytMusic::getConfigFile(), QSettings::IniFormat);
+        int mb = std::clamp(settings.value("Video/loopCacheMB", DEFAULT_BUDGET_MB).toInt(), 0, 8192);
+        return LoopVideoCache(static_cast<size_t>(mb) << 20);
+    }
+
+    void arm(qreal a, qreal b) {
+        disarm();
+        if (std::isnan(a) || std::isnan(b)) { return; }
+        m_a = a;
+        m_b = b;
+        m_state = State::Armed;
+    }
+
+    void disarm() {
+        m_state = State::Disarmed;
+        m_frames.clear();
+        m_frames.shrink_to_fit();
+        m_bytes = 0;
+        m_next = 0;
+    }
+
+    [[nodiscard]] State state() const { return m_state; }
+
+    [[nodiscard]] bool isLooping() const { return m_state == State::Looping; }
+
+    /**
+     * 处理从解码器取出的画面, Looping 时不再调用. 纯音频文件的画面没有时间, 直接忽略.
+     * @return 画面是否在 B 之前. 否则 Looping 时改为从 next 读取, Uncached 时需要跳转到 A
+     */
+    bool accept(const VideoFrameRef &pic) {
+        const qreal pts = pic.getPTS();
+        if (m_state == State::Disarmed || std::isnan(pts)) { return true; }
+        if (m_state == State::Armed) {
+            if (pts < m_a) { return true; }
+            m_state = pts > m_a + LoopAudioCache::EDGE_SECS ? State::Uncached : State::Recording;
+        }
+        if (m_state == State::Uncached) { return pts < m_b; }
+        if (pts >= m_b) {
+            m_state = m_frames.empty() ? State::Uncached : State::Looping;
+            m_next = 0;
+            if (isLooping()) { qDebug() << "Loop recorded" << m_frames.size() << "pictures," << m_bytes << "bytes"; }
+            return false;
+        }
+        m_bytes += FrameHistory::frameBytes(pic);
+        if (m_bytes > m_budgetBytes) {
+            qWarning() << "Loop region exceeds the picture budget, seek on every repetition";
+            m_frames.clear();
+            m_frames.shrink_to_fit();
+            m_state = State::Uncached;
+            return true;
+        }
+        m_frames.push_back(pic);
+        return true;
+    }
+
+    /**
+     * 下一次 next 是否回到 A
+     */
+    [[nodiscard]] bool atWrap() const { return m_next == 0; }
+
+    /**
+     * 循环中的下一个画面, 只能在 Looping 时调用
+     */
+    VideoFrameRef next() {
+        VideoFrameRef pic = m_frames[m_next];
+        m_next = (m_next + 1) % m_frames.size();
+        return pic;
+    }
+};
@@ -0,0 +1,336 @@
+#pragma once
+
+#include <QObject>
+#include <QThread>
+#include <QSettings>
+#include <QDebug>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <vector>
+#include "demuxer.hpp"
+
+/**
+ * @brief 交叉淡化时下一个文件的解码器.
+ *
+ * 当前文件的解码循环在 DecoderThread 上一直运行到文件结束, 因此下一个文件的 DecodeDispatcher 在自己的线程上解码.
+ * 为了不让内存峰值翻倍, 只在当前文件剩余 淡化时长 + PRELOAD_SECS 时才打开下一个文件, 并且只支持纯音频文件,
+ * 解码队列与普通播放相同. 当前文件的音频读取完毕后, Demuxer 接管这里的解码器和它的线程, 不需要重新打开文件.
+ */
+class CrossfadeDeck : public QObject {
+    Q_OBJECT
+    PONY_THREAD_AFFINITY(CROSSFADE)
+public:
+    enum class State {
+        Empty,   ///< 没有下一个文件
+        Armed,   ///< 已经设置下一个文件, 还没有打开
+        Opening, ///< 正在打开
+        Ready    ///< 已经打开并开始解码
+    };
+
+    /**
+     * 最长的淡化时间(单位: 秒)
+     */
+    constexpr static qreal MAX_SECS = 12.0;
+    /**
+     * 提前打开下一个文件的时间(单位: 秒)
+     */
+    constexpr static qreal PRELOAD_SECS = 2.0;
+
+private:
+    QThread *m_affinityThread;
+
+    /**
+     * 保护下一个文件的路径和解码器. DSP 线程从解码器取帧时不持有, 取帧可能阻塞, 不能让 setNextFile 和 reset 等待.
+     */
+    std::mutex m_mutex;
+    std::string m_path;
+    bool m_mixing = false; // DSP 线程正在混合, 这时设置的下一个文件等交出解码器后再生效
+    std::optional<std::string> m_queuedPath;
+    uint64_t m_generation = 0; // 每次放弃解码器时增加, 用于丢弃过期的打开请求
+    DecodeDispatcher *m_forward = nullptr;
+    ReverseDecodeDispatcher *m_backward = nullptr;
+    DecodeDispatcher *m_reading = nullptr; // DSP 线程正在从这个解码器取帧
+    DecodeDispatcher *m_retiredForward = nullptr; // 取帧期间被放弃的解码器, 由 DSP 线程取帧返回后释放
+    ReverseDecodeDispatcher *m_retiredBackward = nullptr;
+    std::atomic<State> m_state = State::Empty;
+    std::atomic<qreal> m_secs;
+
+    // 下面的成员由 m_mutex 保护, 只在 DSP 线程上访问
+    PonyAudioFormat m_format = AnytMusic::DEFAULT_AUDIO_FORMAT;
+    std::vector<std::byte> m_pending; // 已经取出但还没有读取的音频帧
+    size_t m_pendingPos = 0;
+    qreal m_pendingPts = std::numeric_limits<qreal>::quiet_NaN();
+    bool m_ended = false;
+
+    static void release(DecodeDispatcher *forward, ReverseDecodeDispatcher *backward) {
+        // 线程在 forward 销毁后退出
+        backward->statePause();
+        backward->deleteLater();
+        forward->statePause();
+        forward->deleteLater();
+    }
+
+    void discardLocked() {
+        ++m_generation;
+        if (m_forward && m_forward == m_reading) {
+            // 关闭队列唤醒正在取帧的 DSP 线程, 解码器在它返回后释放
+            m_backward->statePause();
+            m_forward->statePause();
+            m_retiredForward = m_forward;
+            m_retiredBackward = m_backward;
+            m_forward = nullptr;
+            m_backward = nullptr;
+        } else if (m_forward) {
+            release(m_forward, m_backward);
+            m_forward = nullptr;
+            m_backward = nullptr;
+        }
+        m_pending.clear();
+        m_pendingPos = 0;
+        m_pendingPts = std::numeric_limits<qreal>::quiet_NaN();
+        m_ended = false;
+        m_state = m_path.empty() ? State::Empty : State::Armed;
+    }
+
+    /**
+     * 取出下一个音频帧. 解码器的队列为空时 getSample 会阻塞, 因此取帧期间释放 m_mutex. 期间解码器被放弃时丢弃取出的帧.
+     * @param lock 持有 m_mutex, 返回时仍然持有
+     */
+    bool nextSample(std::unique_lock<std::mutex> &lock) {
+        if (!m_forward || m_ended) { return false; }
+        const uint64_t generation = m_generation;
+        m_reading = m_forward;
+        lock.unlock();
+        AudioFrame frame = m_reading->getSample();
+        lock.lock();
+        m_reading = nullptr;
+        if (generation != m_generation) {
+            if (m_retiredForward) {
+                release(m_retiredForward, m_retiredBackward);
+                m_retiredForward = nullptr;
+                m_retiredBackward = nullptr;
+            }
+            return false;
+        }
+        if (!frame.isValid()) {
+            m_ended = true;
+            return false;
+        }
+        m_pending.assign(frame.getSampleData(), frame.getSampleData() + frame.getDataLen());
+        m_pendingPos = 0;
+        m_pendingPts = frame.getPTS();
+        return true;
+    }
+
+    PONY_GUARD_BY(CROSSFADE)
+
+    void open(uint64_t generation, const std::string &path, const PonyAudioFormat &format) {
+        AnytMusic::OpenFileResultType result = AnytMusic::OpenFileResultType::FAILED;
+        DecodeDispatcher *forward = nullptr;
+        ReverseDecodeDispatcher *backward = nullptr;
+        try {
+            forward = new DecodeDispatcher(path, result);
+            if (result != AnytMusic::OpenFileResultType::AUDIO) {
+                throw std::runtime_error("Only audio files can crossfade.");
+            }
+            backward = new ReverseDecodeDispatcher(path);
+        } catch (std::runtime_error &ex) {
+            qWarning() << "Cannot open next file for crossfade:" << ex.what();
+            delete forward;
+            std::lock_guard lock(m_mutex);
+            if (generation == m_generation) { m_state = State::Empty; }
+            return;
+        }
+        forward->setAudioOutputFormat(format);
+        backward->setAudioOutputFormat(format);
+        auto *thread = new QThread;
+        thread->setObjectName(AnytMusic::DECODER);
+        forward->moveToThread(thread);
+        backward->moveToThread(thread);
+        connect(forward, &QObject::destroyed, thread, &QThread::quit);
+        connect(thread, &QThread::finished, thread, &QObject::deleteLater);
+        thread->start();
+        forward->stateResume();
+
+        std::lock_guard lock(m_mutex);
+        if (generation != m_generation) {
+            release(forward, backward);
+            return;
+        }
+        m_forward = forward;
+        m_backward = backward;
+        m_state = State::Ready;
+        qDebug() << "Crossfade preloaded" << QString::fromStdString(path);
+    }
+
+public:
+    CrossfadeDeck() : QObject(nullptr), m_secs(loadSecs()) {
+        m_affinityThread = new QThread;
+        m_affinityThread->setObjectName(AnytMusic::CROSSFADE);
+        this->moveToThread(m_affinityThread);
+        m_affinityThread->start();
+    }
+
+    ~CrossfadeDeck() override {
+        {
+            std::lock_guard lock(m_mutex);
+            m_path.clear();
+            m_mixing = false;
+            discardLocked();
+        }
+        m_affinityThread->quit();
+    }
+
+    static qreal loadSecs() {
+        QSettings settings(AnytMusic::getConfigFile(), QSettings::IniFormat);
+        return std::clamp(settings.value("Crossfade/secs", 0.0).toDouble(), 0.0, MAX_SECS);
+    }
+
+    static void saveSecs(qreal secs) {
+        QSettings settings(AnytMusic::getConfigFile(), QSettings::IniFormat);
+        settings.setValue("Crossfade/secs", std::clamp(secs, 0.0, MAX_SECS));
+    }
+
+    /**
+     * 设置淡化时间并保存, 0 表示关闭. 这个函数是线程安全的.
+     * @param secs 单位: 秒, 范围 [0, MAX_SECS]
+     */
+    PONY_THREAD_SAFE void setSecs(qreal secs) {
+        m_secs = std::clamp(secs, 0.0, MAX_SECS);
+        saveSecs(m_secs);
+    }
+
+    PONY_THREAD_SAFE qreal secs() const { return m_secs; }
+
+    /**
+     * 设置下一个文件, 放弃已经打开的下一个文件. 这个函数是线程安全的.
+     * @param path 本地文件路径, 为空时不淡化
+     */
+    PONY_THREAD_SAFE void setNextFile(const std::string &path) {
+        std::lock_guard lock(m_mutex);
+        if (m_mixing) {
+            m_queuedPath = path;
+            return;
+        }
+        if (path == m_path) { return; }
+        m_path = path;
+        discardLocked();
+    }
+
+    /**
+     * 放弃已经打开的解码器, 保留下一个文件的路径, 之后需要时重新打开. 重新播放或者跳转时调用.
+     */
+    PONY_THREAD_SAFE void reset() {
+        std::lock_guard lock(m_mutex);
+        if (m_mixing) {
+            // 没有交出解码器, 仍然以同一个文件作为下一个文件, 除非期间设置了新的文件
+            if (m_queuedPath) { m_path = *m_queuedPath; }
+            m_mixing = false;
+            m_queuedPath.reset();
+        }
+        discardLocked();
+    }
+
+    PONY_THREAD_SAFE State state() const { return m_state; }
+
+    /**
+     * 在后台打开下一个文件, 这个函数会立即返回. 已经打开或者没有下一个文件时不做任何事.
+     * @param format 解码器的输出格式, 与当前文件相同
+     */
+    PONY_GUARD_BY(AUDIO_DSP)
+
+    void preload(const PonyAudioFormat &format) {
+        std::lock_guard lock(m_mutex);
+        if (m_state != State::Armed) { return; }
+        m_state = State::Opening;
+        m_format = format;
+        QMetaObject::invokeMethod(this, [this, generation = m_generation, path = m_path, format] {
+            open(generation, path, format);
+        });
+    }
+
+    /**
+     * 开始混合. 之后设置的下一个文件在交出解码器或者 reset 之后才生效.
+     * @return 下一个文件是否已经打开
+     */
+    PONY_GUARD_BY(AUDIO_DSP)
+
+    bool claim() {
+        std::lock_guard lock(m_mutex);
+        if (m_state != State::Ready) { return false; }
+        m_mixing = true;
+        m_queuedPath.reset();
+        return true;
+    }
+
+    /**
+     * 下一个文件的长度(单位: 秒), 还没有打开时返回 0
+     */
+    PONY_GUARD_BY(AUDIO_DSP)
+
+    qreal duration() {
+        std::lock_guard lock(m_mutex);
+        return m_forward ? m_forward->getAudionLength() : 0.0;
+    }
+
+    /**
+     * 读取下一个文件的音频, 文件已经结束时补零
+     * @param dst 输出
+     * @param len 长度(单位: byte)
+     * @return dst 开头的数据在下一个文件中的时间(单位: 秒), 没有数据时返回 NaN
+     */
+    PONY_GUARD_BY(AUDIO_DSP)
+
+    qreal read(std::byte *dst, int len) {
+        std::unique_lock lock(m_mutex);
+        const double bytesPerSec = m_format.getSampleRate() * m_format.getBytesPerSampleChannels();
+        qreal pts = std::numeric_limits<qreal>::quiet_NaN();
+        auto remaining = static_cast<size_t>(len);
+        while (remaining > 0) {
+            if (m_pendingPos == m_pending.size() && !nextSample(lock)) {
+                std::memset(dst, 0, remaining);
+                break;
+            }
+            if (std::isnan(pts)) { pts = m_pendingPts + static_cast<double>(m_pendingPos) / bytesPerSec; }
+            size_t n = std::min(remaining, m_pending.size() - m_pendingPos);
+            std::memcpy(dst, m_pending.data() + m_pendingPos, n);
+            m_pendingPos += n;
+            dst += n;
+            remaining -= n;
+        }
+        return pts;
+    }
+
+    /**
+     * 交出解码器, 由 Demuxer 接管. 之后混合期间设置的下一个文件生效, 没有设置时回到没有下一个文件的状态.
+     * @param remainder 已经从解码器取出但还没有读取的数据, 需要在 Demuxer 的下一帧之前播放
+     * @return remainder 开头的数据在下一个文件中的时间(单位: 秒), 没有打开下一个文件时返回 NaN
+     */
+    PONY_GUARD_BY(AUDIO_DSP, FRAME)
+
+    qreal take(DecodeDispatcher *&forward, ReverseDecodeDispatcher *&backward, std::vector<std::byte> &remainder) {
+        std::unique_lock lock(m_mutex);
+        if (m_forward && m_pendingPos == m_pending.size()) { nextSample(lock); }
+        forward = m_forward;
+        backward = m_backward;
+        qreal pts = std::numeric_limits<qreal>::quiet_NaN();
+        remainder.clear();
+        if (m_forward) {
+            const double bytesPerSec = m_format.getSampleRate() * m_format.getBytesPerSampleChannels();
+            pts = m_pendingPts + static_cast<double>(m_pendingPos) / bytesPerSec;
+            remainder.assign(m_pending.begin() + static_cast<std::ptrdiff_t>(m_pendingPos), m_pending.end());
+        }
+        m_forward = nullptr;
+        m_backward = nullptr;
+        m_path = m_queuedPath.value_or(std::string());
+        m_mixing = false;
+        m_queuedPath.reset();
+        discardLocked();
+        return pts;
+    }
+};
@@ -0,0 +1,418 @@
+#pragma once
+
+#include <QObject>
+#include <QThread>
+#include <QDebug>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include "readerwriterqueue.h"
+#include "demuxer.hpp"
+#include "audiosink.hpp"
+#include "crossfade.hpp"
+#include "abloop.hpp"
+
+/**
+ * @brief 解码器和 PonyAudioSink 之间的 DSP 阶段.
+ *
+ * DSP 线程从解码器取出音频帧, 经过变速引擎和效果器链后写入 DataBuffer, 并按 DataBuffer 的长度定时补充数据, 不依赖
+ * 画面的节奏, 低帧率的视频也不会让 DataBuffer 饿死. 运行期间 DSP 线程独占音频帧的读取, 其他线程需要读取或者跳过
+ * 音频帧时先调用 park 让 DSP 线程停下. 音量, 音调, 速度等参数通过有界的无锁队列交给 DSP 线程, 在两次写入之间
+ * 生效, Playback 线程不会被重新处理缓冲区之类的耗时操作阻塞.
+ *
+ * 开启交叉淡化时, 纯音频文件剩余的时间不足淡化时长时, DSP 线程同时读取 CrossfadeDeck 中下一个文件的音频, 按等功率
+ * 曲线混合后写入. 淡化过半时切换 PonyAudioSink 的时间基准, 当前文件读取完毕后由 Demuxer 接管下一个文件的解码器.
+ *
+ * 设置 A-B 循环时, 第一次播放区间时把音频记录到 LoopAudioCache, 之后循环从内存中写入, 每次回到 A 时切换时间基准.
+ */
+class AudioDspStage : public QObject {
+    Q_OBJECT
+    PONY_THREAD_AFFINITY(AUDIO_DSP)
+public:
+    struct Command {
+        enum Type {
+            Volume, Pitch, Speed, TimeStretch
+        } type;
+        qreal value = 0.0;
+        int engine = 0;
+        int quality = 0;
+    };
+
+    constexpr static size_t COMMAND_CAPACITY = 64;
+    constexpr static int FILL_BATCH = 8;
+    constexpr static double MIN_INTERVAL_SECS = 0.002;
+    constexpr static double MAX_INTERVAL_SECS = 0.02;
+
+private:
+    QThread *m_affinityThread;
+    Demuxer *m_demuxer;
+    PonyAudioSink *m_audioSink;
+
+    /**
+     * 单生产者单消费者. 生产者是 Playback 线程, 消费者是持有 m_workMutex 的线程.
+     */
+    moodycamel::ReaderWriterQueue<Command> m_commands{COMMAND_CAPACITY};
+
+    std::mutex m_workMutex;
+    std::mutex m_interruptMutex;
+    std::condition_variable m_interruptCond;
+    std::atomic<bool> m_isInterrupt = true;
+    std::atomic<bool> m_audioEnded = false;
+    std::atomic<qreal> m_videoPos = std::numeric_limits<qreal>::quiet_NaN();
+
+    CrossfadeDeck *m_deck;
+    // 下面的成员只在持有 m_workMutex 时访问
+    bool m_crossfading = false;
+    bool m_clockRebased = false;
+    qreal m_outgoingEnd = std::numeric_limits<qreal>::quiet_NaN(); // 当前文件的长度, 切换文件后重新读取
+    qreal m_fadeStart = 0.0;
+    qreal m_fadeLength = 0.0;
+    float m_fadePosition = 0.0F;
+    std::vector<std::byte> m_mixBuffer;
+    LoopAudioCache m_loop;
+    std::atomic<uint64_t> m_loopSplices = 0;     // 写入的拼接数, resetLoop 后从 0 开始
+    std::atomic<bool> m_loopEnded = false;       // 没有缓存, 已经写入到 B
+    std::atomic<bool> m_loopCacheDisabled = false;
+
+    void applyCommands() {
+        Command command{};
+        while (m_commands.try_dequeue(command)) {
+            switch (command.type) {
+                case Command::Volume:
+                    m_audioSink->setVolume(command.value);
+                    break;
+                case Command::Pitch:
+                    m_audioSink->setPitch(command.value);
+                    break;
+                case Command::Speed:
+                    m_audioSink->setSpeed(command.value);
+                    break;
+                case Command::TimeStretch:
+                    m_audioSink->setTimeStretch(static_cast<TimeStretch::Engine>(command.engine),
+                                                static_cast<TimeStretch::Quality>(command.quality));
+                    break;
+            }
+        }
+    }
+
+    /**
+     * 当前文件即将结束时提前打开下一个文件, 剩余时间不足淡化时长时开始淡化. 只有正放的纯音频文件才会淡化.
+     * @param pts 即将写入的音频帧的时间
+     * @return 是否开始淡化
+     */
+    bool beginCrossfade(qreal pts) {
+        qreal secs = m_deck->secs();
+        if (secs <= 0.0 || m_deck->state() == CrossfadeDeck::State::Empty || m_loop.isArmed()) { return false; }
+        if (m_demuxer->hasVideo() || m_demuxer->isBackward()) { return false; }
+        if (std::isnan(m_outgoingEnd)) { m_outgoingEnd = m_demuxer->audioDuration(); }
+        qreal remaining = m_outgoingEnd - pts;
+        if (remaining > secs + CrossfadeDeck::PRELOAD_SECS) { return false; }
+        if (m_deck->state() != CrossfadeDeck::State::Ready) {
+            m_deck->preload(m_audioSink->getCurrentDeviceFormat());
+            return false;
+        }
+        if (remaining > secs) { return false; }
+        // 下一个文件打开得晚或者很短时缩短淡化
+        m_fadeLength = std::min(remaining, m_deck->duration() / 2);
+        if (m_fadeLength <= 0.0 || !m_deck->claim()) { return false; }
+        m_fadeStart = pts;
+        m_fadePosition = 0.0F;
+        m_crossfading = true;
+        m_clockRebased = false;
+        qDebug() << "Crossfade begin at" << pts << "for" << m_fadeLength << "s";
+        return true;
+    }
+
+    /**
+     * 将当前文件的音频帧与下一个文件混合, 淡化过半时切换时间基准
+     * @return 混合后的数据, 长度与 sample 相同
+     */
+    const char *mixIncoming(const AudioFrame &sample) {
+        const PonyAudioFormat format = m_audioSink->getCurrentDeviceFormat();
+        const int len = sample.getDataLen();
+        const auto frames = static_cast<size_t>(len / format.getBytesPerSampleChannels());
+        m_mixBuffer.resize(static_cast<size_t>(len));
+        qreal incomingPts = m_deck->read(m_mixBuffer.data(), len);
+        qreal end = sample.getPTS() + format.durationOfBytes(len);
+        auto from = static_cast<float>(std::clamp((sample.getPTS() - m_fadeStart) / m_fadeLength, 0.0, 1.0));
+        auto to = static_cast<float>(std::clamp((end - m_fadeStart) / m_fadeLength, 0.0, 1.0));
+        if (!m_clockRebased && to >= 0.5F && !std::isnan(incomingPts)) {
+            m_audioSink->rebaseClock(incomingPts);
+            m_clockRebased = true;
+        }
+        auto *mixed = reinterpret_cast<int16_t *>(m_mixBuffer.data());
+        PcmKernels::crossfade(reinterpret_cast<const int16_t *>(sample.getSampleData()), mixed, mixed, frames,
+                              format.getChannelCount(), from, to);
+        m_fadePosition = to;
+        return reinterpret_cast<const char *>(m_mixBuffer.data());
+    }
+
+    /**
+     * 当前文件读取完毕, 由 Demuxer 接管下一个文件的解码器, 写入已经取出的剩余数据并完成淡入
+     * @return 是否接管
+     */
+    bool adoptIncoming() {
+        m_crossfading = false;
+        m_outgoingEnd = std::numeric_limits<qreal>::quiet_NaN();
+        DecodeDispatcher *forward = nullptr;
+        ReverseDecodeDispatcher *backward = nullptr;
+        qreal pts = m_deck->take(forward, backward, m_mixBuffer);
+        if (!forward || !m_demuxer->adopt(forward, backward)) { return false; }
+        if (!m_clockRebased && !std::isnan(pts)) {
+            m_audioSink->rebaseClock(pts);
+            m_clockRebased = true;
+        }
+        if (!m_mixBuffer.empty()) {
+            const PonyAudioFormat format = m_audioSink->getCurrentDeviceFormat();
+            auto *samples = reinterpret_cast<int16_t *>(m_mixBuffer.data());
+            const size_t frames = m_mixBuffer.size() / static_cast<size_t>(format.getBytesPerSampleChannels());
+            // 当前文件比预期早结束时, 在剩余数据内把下一个文件的增益升到 1
+            auto from = static_cast<float>(std::sin(m_fadePosition * PcmKernels::PI / 2));
+            PcmKernels::gainRamp(samples, frames, format.getChannelCount(), from, 1.0F);
+            m_audioSink->write(reinterpret_cast<const char *>(samples), static_cast<qint32>(m_mixBuffer.size()));
+        }
+        qDebug() << "Crossfade end, continue at" << pts;
+        return true;
+    }
+
+    /**
+     * 从 LoopAudioCache 写入一段音频, 回到 A 时切换时间基准. 上一次拼接还没有播放时不写入, DataBuffer 中剩余的
+     * 数据至少可以播放到那里, 因此区间比 DataBuffer 短也不会让时间基准错乱.
+     * @return 是否写入
+     */
+    bool writeLoop() {
+        if (m_loop.atSplice()) {
+            if (m_audioSink->hasPendingRebase()) { return false; }
+            m_audioSink->rebaseClock(m_loop.splicePts(), false);
+            ++m_loopSplices;
+        }
+        auto [data, len] = m_loop.read();
+        m_audioSink->write(reinterpret_cast<const char *>(data), static_cast<qint32>(len));
+        return true;
+    }
+
+    /**
+     * 向 PonyAudioSink 写入音频, 调用者需要持有 m_workMutex
+     * @param batch 最多写入的帧数
+     * @return 写入的帧数, 没有更多音频时返回 -1
+     */
+    int fill(int batch) {
+        if (m_audioSink->isBlock()) {
+            // 禁用音频时解码器仍然输出音频, 丢弃已经落后于画面的音频帧, 以便随时恢复. 只支持正放的视频.
+            qreal videoPos = m_videoPos;
+            if (!std::isnan(videoPos) && m_demuxer->hasVideo() && !m_demuxer->isBackward()) {
+                m_demuxer->skipSample([videoPos](qreal pts) { return pts < videoPos; });
+            }
+            return 0;
+        }
+        int written = 0;
+        while (written < batch && m_audioSink->freeByte() > 0) {
+            if (m_loop.isLooping()) {
+                if (!writeLoop()) { return written; }
+                ++written;
+                continue;
+            }
+            if (m_loop.isEnded()) {
+                // 等待 Playback 跳转回 A
+                m_loopEnded = true;
+                return written;
+            }
+            AudioFrame sample = m_demuxer->getSample();
+            if (!sample.isValid()) {
+                if (m_crossfading && adoptIncoming()) {
+                    ++written;
+                    continue;
+                }
+                return -1;
+            }
+            const char *data = reinterpret_cast<const char *>(sample.getSampleData());
+            auto len = static_cast<qint32>(sample.getDataLen());
+            if (m_loop.isArmed()) {
+                if (m_loopCacheDisabled) { m_loop.disable(); }
+                len = static_cast<qint32>(m_loop.accept(sample));
+            } else if (m_crossfading || beginCrossfade(sample.getPTS())) {
+                data = mixIncoming(sample);
+            }
+            if (len > 0) { m_audioSink->write(data, len); }
+            ++written;
+        }
+        return written;
+    }
+
+    /**
+     * 两次补充之间的等待时间, DataBuffer 越短补充越频繁
+     */
+    [[nodiscard]] std::chrono::duration<double> interval() const {
+        return std::chrono::duration<double>(
+                std::clamp(m_audioSink->ringBufferSecs() / 4, MIN_INTERVAL_SECS, MAX_INTERVAL_SECS));
+    }
+
+private slots:
+
+    void onWork() {
+        std::unique_lock lock(m_workMutex);
+        while (!m_isInterrupt) {
+            applyCommands();
+            int written = fill(FILL_BATCH);
+            if (written < 0) {
+                m_audioEnded = true;
+                emit audioEnded();
+                break;
+            }
+            // DataBuffer 还没有写满时立即继续
+            if (written == FILL_BATCH) { continue; }
+            std::unique_lock condLock(m_interruptMutex);
+            if (!m_isInterrupt) { m_interruptCond.wait_for(condLock, interval()); }
+        }
+    }
+
+public:
+    AudioDspStage(Demuxer *demuxer, PonyAudioSink *audioSink, CrossfadeDeck *deck) : QObject(nullptr),
+                                                                                      m_demuxer(demuxer),
+                                                                                      m_audioSink(audioSink),
+                                                                                      m_deck(deck) {
+        m_affinityThread = new QThread;
+        m_affinityThread->setObjectName(AnytMusic::AUDIO_DSP);
+        this->moveToThread(m_affinityThread);
+        connect(this, &AudioDspStage::startWork, this, &AudioDspStage::onWork);
+        m_affinityThread->start();
+    }
+
+    ~AudioDspStage() override {
+        park();
+        m_affinityThread->quit();
+    }
+
+    /**
+     * 在 DSP 线程上开始补充音频, 这个函数会立即返回
+     */
+    void start() {
+        m_isInterrupt = false;
+        m_audioEnded = false;
+        emit startWork(QPrivateSignal());
+    }
+
+    /**
+     * 让 DSP 线程停止补充音频, 这个函数会阻塞直到 DSP 线程停下. 返回后调用者可以读取和跳过音频帧.
+     */
+    void park() {
+        {
+            std::lock_guard condLock(m_interruptMutex);
+            m_isInterrupt = true;
+            m_interruptCond.notify_all();
+        }
+        std::lock_guard lock(m_workMutex);
+    }
+
+    /**
+     * 在调用者的线程上写入音频, 用于开始播放前预先填充 DataBuffer. 只能在 DSP 线程停下时调用.
+     * @param batch 最多写入的帧数
+     * @return 是否还有更多音频
+     */
+    bool prime(int batch) {
+        std::lock_guard lock(m_workMutex);
+        applyCommands();
+        return fill(batch) >= 0;
+    }
+
+    /**
+     * 提交参数修改, 只能在 Playback 线程上调用. DSP 线程停下时在调用者的线程上立即生效, 否则在 DSP 线程上
+     * 下一次写入前生效.
+     */
+    void post(const Command &command) {
+        while (!m_commands.try_enqueue(command)) {
+            // 队列已满, DSP 线程停下时由调用者处理, 否则等待 DSP 线程取走
+            std::unique_lock lock(m_workMutex, std::try_to_lock);
+            if (lock.owns_lock()) {
+                applyCommands();
+            } else {
+                m_interruptCond.notify_all();
+                std::this_thread::yield();
+            }
+        }
+        std::unique_lock lock(m_workMutex, std::try_to_lock);
+        if (lock.owns_lock()) {
+            applyCommands();
+        } else {
+            m_interruptCond.notify_all();
+        }
+    }
+
+    /**
+     * 结束正在进行的交叉淡化, 重新播放或者跳转前调用. 已经播放到淡化中点时直接切换到下一个文件, 否则放弃下一个文件
+     * 已经解码的数据, 需要时重新打开. 只能在 DSP 线程停下时调用.
+     */
+    void resetCrossfade() {
+        std::lock_guard lock(m_workMutex);
+        if (m_crossfading && m_audioSink->isClockRebased() && m_demuxer->isFileOpen()) {
+            DecodeDispatcher *forward = nullptr;
+            ReverseDecodeDispatcher *backward = nullptr;
+            m_deck->take(forward, backward, m_mixBuffer);
+            if (forward) { m_demuxer->adopt(forward, backward); }
+        }
+        m_crossfading = false;
+        m_clockRebased = false;
+        m_outgoingEnd = std::numeric_limits<qreal>::quiet_NaN();
+        m_deck->reset();
+    }
+
+    /**
+     * 设置 A-B 循环区间, 丢弃已经记录的音频, 跳转或者停止时调用. 只能在 DSP 线程停下时调用.
+     * @param a 区间的开始(单位: 秒), 为 NaN 时取消循环
+     * @param b 区间的结束(单位: 秒)
+     */
+    void resetLoop(qreal a, qreal b) {
+        std::lock_guard lock(m_workMutex);
+        m_loop.arm(a, b, m_audioSink->getCurrentDeviceFormat());
+        m_loopSplices = 0;
+        m_loopEnded = false;
+        m_loopCacheDisabled = false;
+    }
+
+    /**
+     * 画面无法缓存, 声音也不再记录, 播放到 B 时跳转. 这个函数是线程安全的.
+     */
+    void disableLoopCache() {
+        m_loopCacheDisabled = true;
+    }
+
+    /**
+     * 已经写入的循环拼接数, 这个函数是线程安全的
+     */
+    [[nodiscard]] uint64_t loopSplices() const {
+        return m_loopSplices;
+    }
+
+    /**
+     * 没有缓存的循环是否已经写入到 B, 这个函数是线程安全的
+     */
+    [[nodiscard]] bool isLoopEnded() const {
+        return m_loopEnded;
+    }
+
+    /**
+     * 设置正在显示的画面的时间, 禁用音频时丢弃在此之前的音频帧. 这个函数是线程安全的.
+     */
+    void setVideoPos(qreal pos) {
+        m_videoPos = pos;
+    }
+
+    /**
+     * 上一次运行是否因为没有更多音频而结束, 这个函数是线程安全的
+     */
+    [[nodiscard]] bool isAudioEnded() const {
+        return m_audioEnded;
+    }
+
+signals:
+
+    void startWork(QPrivateSignal);
+
+    /**
+     * 没有更多音频, 在 DSP 线程上发出
+     */
+    void audioEnded();
+};
@@ -1,7 +1,9 @@
 #pragma once
 #include <QQuickItem>
 #include <QObject>
+#include <QPointer>
 #include <QQuickWindow>
+#include <QScreen>
 #include <QOpenGLShaderProgram>
 #include "renderer.hpp"
 #include "platform.hpp"
@@ -26,11 +28,59 @@ private:
     int m_frameHeight = 1;
     int m_frameWidth = 1;
     double m_frameRate = 1.0;
+    QMetaObject::Connection m_screenConnection;
+    QMetaObject::Connection m_swapConnection;
+
+    void updateFrameSize(int width, int height) {
+        if (width == m_frameWidth && height == m_frameHeight) { return; }
+        m_frameWidth = width;
+        m_frameHeight = height;
+        m_frameRate = static_cast<double>(m_frameHeight) / static_cast<double>(m_frameWidth);
+        emit frameSizeChanged();
+    }
+
+    /**
+     * 播放期间每次交换缓冲区后请求下一帧, 让 VsyncScheduler 在每次垂直同步时都有机会更换画面. 更换窗口时先断开
+     * 与之前窗口的连接.
+     */
+    void connectScheduler(QQuickWindow *win) {
+        disconnectScheduler();
+        if (win->screen()) { m_scheduler->setNominalRate(win->screen()->refreshRate()); }
+        m_screenConnection = connect(win, &QWindow::screenChanged, this, [this](QScreen *screen) {
+            if (screen) { m_scheduler->setNominalRate(screen->refreshRate()); }
+        });
+        m_swapConnection = connect(win, &QQuickWindow::frameSwapped, this, [this, win] {
+            if (m_scheduler->onVsync(VsyncClock::now())) { win->update(); }
+        }, Qt::DirectConnection);
+        // VsyncScheduler::setActive 在锁外调用回调, 回调可能在析构函数清除它之后才执行
+        m_scheduler->setWakeup([self = QPointer<Fireworks>(this)] {
+            if (!self) { return; }
+            QMetaObject::invokeMethod(self.data(), [self] {
+                if (self && self->window()) { self->window()->update(); }
+            }, Qt::QueuedConnection);
+        });
+    }
+
+    void disconnectScheduler() {
+        disconnect(m_screenConnection);
+        disconnect(m_swapConnection);
+    }
+
 protected:
+    std::shared_ptr<VsyncScheduler> m_scheduler;
+
     QSGNode *updatePaintNode(QSGNode *node, UpdatePaintNodeData *data) override {
         return m_renderer;
     }
 
+    /**
+     * 播放时由 scheduler 按垂直同步选择显示的画面, 需要在加入窗口之前调用
+     */
+    void setScheduler(std::shared_ptr<VsyncScheduler> scheduler) {
+        m_scheduler = scheduler;
+        m_renderer->m_scheduler = std::move(scheduler);
+    }
+
 public:
     explicit Fireworks(QQuickItem *parent = nullptr): QQuickItem(parent), m_renderer(new FireworksRenderer),
         m_filterPrefix(AnytMusic::getAssetsDir() + u"/filters"_qs), m_filterJsons() {
@@ -42,13 +92,17 @@ public:
             file.close();
         }
         this->setFlag(QQuickItem::ItemHasContents);
+        connect(m_renderer, &FireworksRenderer::presentedSizeChanged, this, &Fireworks::updateFrameSize,
+                Qt::QueuedConnection);
         connect(this, &QQuickItem::windowChanged, this, [this](QQuickWindow *win){
             qDebug() << "Window Size Changed:" << static_cast<void *>(win) << ".";
             if (win) {
                 connect(this->window(), &QQuickWindow::beforeSynchronizing, m_renderer, &FireworksRenderer::sync, Qt::DirectConnection);
                 connect(this->window(), &QQuickWindow::beforeRendering, m_renderer, &FireworksRenderer::init, Qt::DirectConnection);
+                if (m_scheduler) { connectScheduler(win); }
                 win->setColor(Qt::black);
             } else {
+                disconnectScheduler();
                 qWarning() << "Window destroy.";
             }
 
@@ -56,6 +110,7 @@ public:
         qDebug() << "Create Hurricane QuickItem.";
     }
     ~Fireworks() override {
+        if (m_scheduler) { m_scheduler->setWakeup(nullptr); }
         m_renderer = nullptr;
     }
 
@@ -117,12 +172,7 @@ public slots:
         if (m_renderer->setVideoFrame(pic)) {
             // make dirty
             this->update();
-            if (!pic.isSameSize(m_frameWidth, m_frameHeight)) {
-                m_frameWidth = pic.getWidth();
-                m_frameHeight = pic.getHeight();
-                m_frameRate = static_cast<double>(m_frameHeight) / static_cast<double>(m_frameWidth);
-                emit frameSizeChanged();
-            }
+            if (!pic.isSameSize(m_frameWidth, m_frameHeight)) { updateFrameSize(pic.getWidth(), pic.getHeight()); }
         }
     }
 
@@ -19,8 +19,113 @@ private:
     QThread *m_affinityThread = nullptr;
     Demuxer *m_demuxer = nullptr;
     Playback *m_playback = nullptr;
+    std::shared_ptr<VsyncScheduler> m_presenter;
+
+    /**
+     * 跳转的代数. 每个跳转请求先写入目标位置再增加代数; 正在执行的跳转发现代数改变时放弃当前的目标,
+     * 直接跳转到最新的位置, 已经被取代的请求不再执行. 拖动进度条时最终总是停在最后的位置, 延迟不随请求数增加.
+     */
+    std::atomic<uint64_t> m_seekGeneration = 0;
+    std::atomic<qreal> m_seekTarget = 0.0;
+    uint64_t m_seekHandled = 0; // 已经完成的代数, 只在 FrameController 线程上访问
+    std::atomic<bool> m_scrubRequested = false; // 用户正在拖动进度条
+    bool m_scrubbing = false; // 解码器处于预览模式, 只在 FrameController 线程上访问
+
+    /**
+     * 离开预览模式, 需要保证解码器已经暂停
+     */
+    PONY_GUARD_BY(FRAME) void leaveScrub() {
+        if (!m_scrubbing) { return; }
+        m_demuxer->setScrubbing(false);
+        m_scrubbing = false;
+    }
+
+    /**
+     * 拖动预览: 跳转到最新位置之前的关键帧, 只解码这一帧并立即显示, 不播放声音. 倒放和纯音频文件不预览,
+     * 松开时再跳转.
+     */
+    PONY_GUARD_BY(FRAME) void performScrub() {
+        if (m_demuxer->isBackward() || !m_demuxer->hasVideo()) { return; }
+        uint64_t generation = m_seekGeneration.load(std::memory_order_acquire);
+        qreal seekPos = m_seekTarget;
+        m_playback->stop();
+        m_demuxer->pause();
+        if (!m_scrubbing) {
+            m_demuxer->setScrubbing(true);
+            m_scrubbing = true;
+        }
+        m_demuxer->seek(seekPos);
+        m_demuxer->start();
+        // 只等待一个关键帧的解码, 期间的请求会被合并
+        VideoFrameRef pic = m_demuxer->getPicture();
+        m_seekHandled = generation;
+        if (pic.isValid()) { emit setPicture(pic); }
+    }
+
+    /**
+     * 执行最新的跳转请求, 执行期间有新的请求时重新开始
+     */
+    PONY_GUARD_BY(FRAME) void performSeek() {
+        uint64_t generation;
+        qreal seekPos;
+        qreal startPoint = 0.0;
+        do {
+            generation = m_seekGeneration.load(std::memory_order_acquire);
+            seekPos = m_seekTarget;
+            qDebug() << "Start seek for" << seekPos << "generation" << generation;
+            m_playback->stop();
+            m_demuxer->pause();  // wake up pic and sample requests blocked on the decoder
+            leaveScrub();
+
+            // frames decoded before the seek are dropped by generation, no need to wait for the decoder thread
+            m_demuxer->seek(seekPos);
+            m_demuxer->start();
+
+            bool backward = m_demuxer->isBackward();
+            // time-consuming job, abandoned once a newer seek arrives
+            // use audio frame pts may be more accurate, but it is not available in rewinding.
+            if (backward) {
+                // if rewinding, there is no need to skip frame. (dispatcher guarantee)
+                if (m_demuxer->hasVideo()) {
+                    startPoint = m_demuxer->frontPicture();
+                } else {
+                    startPoint = seekPos;
+                }
+            } else {
+                auto current = [this, generation] { return m_seekGeneration == generation; };
+                if (m_demuxer->hasVideo()) {
+                    m_demuxer->skipPicture([seekPos, &current](qreal framePos) {
+                        return framePos < seekPos && current();
+                    });
+                }
+                startPoint = seekPos;
+                m_demuxer->skipSample([seekPos, &startPoint, &current](qreal framePos) {
+                    return startPoint = framePos, framePos < seekPos && current();
+                });
+            }
+        } while (m_seekGeneration != generation);
+        m_seekHandled = generation;
+
+        emit signalPositionChangedBySeek(); // block
+        m_playback->setStartPoint(startPoint);
+        m_playback->showFrame();
+
+        qDebug() << "End seek for" << seekPos << "generation" << generation;
+    }
+
+    /**
+     * 记录跳转请求, 返回新的代数
+     */
+    PONY_THREAD_SAFE uint64_t publishSeek(qreal seekPos) {
+        m_seekTarget = seekPos;
+        return m_seekGeneration.fetch_add(1, std::memory_order_acq_rel) + 1;
+    }
 public:
-    explicit FrameController([[maybe_unused]] QObject *parent) : QObject(nullptr) {
+    /**
+     * @param presenter 与显示画面的 Fireworks 共享, 由渲染线程按垂直同步选择画面
+     */
+    FrameController(std::shared_ptr<VsyncScheduler> presenter, [[maybe_unused]] QObject *parent)
+            : QObject(nullptr), m_presenter(std::move(presenter)) {
         m_affinityThread = new QThread;
         m_affinityThread->setObjectName(AnytMusic::FRAME);
         this->moveToThread(m_affinityThread);
@@ -32,13 +137,11 @@ private slots:
 
     void initOnThread() {
         this->m_demuxer = new Demuxer{this};
-        this->m_playback = new Playback{m_demuxer, this};
+        this->m_playback = new Playback{m_demuxer, m_presenter, this};
         connect(m_playback, &Playback::setPicture, this, &FrameController::setPicture, Qt::DirectConnection);
         connect(m_playback, &Playback::stateChanged, this, &FrameController::playbackStateChanged,
                 Qt::DirectConnection);
         connect(this, &FrameController::signalDecoderOpenFile, m_demuxer, &Demuxer::openFile);
-        // WARNING: BLOCKING_QUEUED_CONNECTION!!!
-        connect(this, &FrameController::signalDecoderSeek, m_demuxer, &Demuxer::seek, Qt::BlockingQueuedConnection);
         connect(m_demuxer, &Demuxer::openFileResult, this, [this](AnytMusic::OpenFileResultType result) {
             if (result != AnytMusic::OpenFileResultType::FAILED) {
                 m_playback->setDesiredFormat(m_demuxer->getInputFormat());
@@ -50,7 +153,24 @@ private slots:
             emit openFileResult(result);
         });
         connect(m_playback, &Playback::resourcesEnd, this, &FrameController::resourcesEnd, Qt::DirectConnection);
+        connect(m_playback, &Playback::trackAdvanced, this, &FrameController::trackAdvanced, Qt::DirectConnection);
         connect(this, &FrameController::signalDecoderSetTrack, m_demuxer, &Demuxer::setTrack);
+        connect(this, &FrameController::signalSeekRequested, this, [this] {
+            // 排队期间有更新的请求时, 第一个请求已经跳转到了最新的位置
+            if (m_seekHandled >= m_seekGeneration) { return; }
+            performSeek();
+        });
+        connect(this, &FrameController::signalScrubRequested, this, [this] {
+            if (!m_scrubRequested || m_seekHandled >= m_seekGeneration) { return; }
+            performScrub();
+        });
+        // 松开时总是精确地跳转一次, 同时离开预览模式
+        connect(this, &FrameController::signalScrubEnded, this, &FrameController::performSeek);
+        connect(this, &FrameController::signalStepRequested, this, [this](int frames) {
+            if (!m_demuxer->isFileOpen() || !m_demuxer->hasVideo() || m_demuxer->isBackward()) { return; }
+            m_playback->pause();
+            emit frameStepped(m_playback->stepFrame(frames));
+        });
         connect(this, &FrameController::signalSetTrack, this, [this](int i) {
             qreal pos = m_playback->getPreferablePos();
             m_playback->stop();
@@ -91,6 +211,22 @@ private slots:
             m_demuxer->start();
             if (isPlay) { m_playback->start(); }
         }, Qt::QueuedConnection);
+        // 没有缓存的 A-B 循环播放到 B 时跳转回 A, 循环区间改变时从 A 开始记录, 取消时从当前位置继续解码
+        connect(m_playback, &Playback::requestLoopRestart, this, [this] {
+            if (!m_demuxer->isFileOpen()) return;
+            bool isPlay = m_playback->isPlaying();
+            qreal a = m_playback->getLoopStart();
+            seek(std::isnan(a) ? m_playback->getPreferablePos() : a);
+            if (isPlay) { m_playback->start(); }
+        }, Qt::QueuedConnection);
+        connect(this, &FrameController::signalSetLoop, this, [this](qreal a, qreal b) {
+            if (!m_demuxer->isFileOpen()) return;
+            bool isPlay = m_playback->isPlaying();
+            qreal pos = m_playback->getPreferablePos();
+            m_playback->setLoop(a, b);
+            seek(std::isnan(a) ? pos : a);
+            if (isPlay) { m_playback->start(); }
+        });
         connect(m_playback, &Playback::signalAudioOutputDevicesListChanged, this,
                 &FrameController::signalAudioOutputDevicesChanged);
         connect(m_playback, &Playback::signalDeviceSwitched, this, [this] {
@@ -126,6 +262,57 @@ public:
         return m_playback->getPreferablePos();
     }
 
+    /**
+     * 请求跳转, 这个方法会立即返回. 连续的请求会被合并, 只保证跳转到最后一次请求的位置.
+     * @param seekPos 目标位置(单位: 秒)
+     */
+    PONY_THREAD_SAFE void requestSeek(qreal seekPos) {
+        publishSeek(seekPos);
+        emit signalSeekRequested();
+    }
+
+    /**
+     * 拖动进度条时请求预览, 这个方法会立即返回. 连续的请求会被合并.
+     * @param seekPos 目标位置(单位: 秒)
+     */
+    PONY_THREAD_SAFE void requestScrub(qreal seekPos) {
+        m_scrubRequested = true;
+        publishSeek(seekPos);
+        emit signalScrubRequested();
+    }
+
+    /**
+     * 结束拖动, 精确地跳转到 seekPos. 还没有执行的预览请求会被丢弃.
+     * @param seekPos 目标位置(单位: 秒)
+     */
+    PONY_THREAD_SAFE void requestEndScrub(qreal seekPos) {
+        m_scrubRequested = false;
+        publishSeek(seekPos);
+        emit signalScrubEnded();
+    }
+
+    /**
+     * 暂停时逐帧步进, 这个方法会立即返回. 最近显示过的画面不需要重新解码.
+     * @param frames 步进的帧数, 负数表示向前
+     * @see FrameController::frameStepped
+     */
+    PONY_THREAD_SAFE void requestStep(int frames) {
+        emit signalStepRequested(frames);
+    }
+
+    /**
+     * 设置 A-B 循环, 这个方法会立即返回. 从 A 开始播放, 第一次播放区间时记录解码的音频和画面, 之后从内存中循环.
+     * @param a 区间的开始(单位: 秒), 为 NaN 时取消循环, 从当前位置继续播放
+     * @param b 区间的结束(单位: 秒)
+     */
+    PONY_THREAD_SAFE void setLoop(qreal a, qreal b) {
+        emit signalSetLoop(a, b);
+    }
+
+    PONY_THREAD_SAFE PlaybackMetrics getPlaybackMetrics() {
+        return m_playback->getMetrics();
+    }
+
     /**
      * 这个方法是线程安全的
      * @return
@@ -154,6 +341,44 @@ public:
 
     void setSpeed(qreal speed) { m_playback->setSpeed(speed); }
 
+    void setLatencyOffset(qreal offset) { m_playback->setLatencyOffset(offset); }
+
+    qreal getLatencyOffset() { return m_playback ? m_playback->getLatencyOffset() : 0.0; }
+
+    void setLatencyProfile(int profile) { m_playback->setLatencyProfile(profile); }
+
+    int getLatencyProfile() { return m_playback ? m_playback->getLatencyProfile() : 0; }
+
+    void setTimeStretch(int engine, int quality) { m_playback->setTimeStretch(engine, quality); }
+
+    int getTimeStretchEngine() { return m_playback ? m_playback->getTimeStretchEngine() : 0; }
+
+    int getTimeStretchQuality() { return m_playback ? m_playback->getTimeStretchQuality() : 1; }
+
+    void setEqualizer(const EqualizerSettings &settings) { m_playback->setEqualizer(settings); }
+
+    EqualizerSettings getEqualizer() { return m_playback ? m_playback->getEqualizer() : PonyAudioSink::loadEqualizer(); }
+
+    void setReplayGainInfo(const ReplayGainInfo &info) { m_playback->setReplayGainInfo(info); }
+
+    void setReplayGain(const ReplayGainSettings &settings) { m_playback->setReplayGain(settings); }
+
+    ReplayGainSettings getReplayGain() { return m_playback ? m_playback->getReplayGain() : PonyAudioSink::loadReplayGain(); }
+
+    void setChannelMix(const ChannelMixSettings &settings) { m_playback->setChannelMix(settings); }
+
+    ChannelMixSettings getChannelMix() { return m_playback ? m_playback->getChannelMix() : PonyAudioSink::loadChannelMix(); }
+
+    void setCrossfade(qreal secs) { m_playback->setCrossfade(secs); }
+
+    qreal getCrossfade() { return m_playback ? m_playback->getCrossfade() : CrossfadeDeck::loadSecs(); }
+
+    void setNextFile(const QString &path) { m_playback->setNextFile(path.toStdString()); }
+
+    void setImpulseResponse(const QString &path) { m_playback->setImpulseResponse(path); }
+
+    QString getImpulseResponse() { return PonyAudioSink::savedImpulseResponse(); }
+
     QStringList getAudioDeviceList() { return m_playback ? m_playback->getAudioDeviceList() : QStringList(); }
 
 public slots:
@@ -178,59 +403,44 @@ public slots:
 
     void close() {
         qDebug() << "Closing";
+        m_playback->setNextFile({});
+        m_playback->setLoop(std::numeric_limits<qreal>::quiet_NaN(), std::numeric_limits<qreal>::quiet_NaN());
+        // 预览模式随解码器一起销毁
+        m_scrubbing = false;
         m_demuxer->close();
         m_playback->stop();
     }
 
     void start() {
         qDebug() << "Starting";
+        // 步进后音频还停在暂停的位置, 从当前画面重新开始
+        if (m_playback->takeFrameStepped()) { seek(m_playback->getPreferablePos()); }
         m_demuxer->start();
         m_playback->start();
     }
 
+    /**
+     * 立即跳转, 取代还没有完成的跳转请求
+     * @param seekPos 目标位置(单位: 秒)
+     */
     void seek(qreal seekPos) {
-        qDebug() << "Start seek for" << seekPos;
-        m_playback->stop();
-        m_demuxer->pause();  // blocking, make sure pic and sample request can be blocked
-
-        // WARNING: must make sure everything (especially PTS) has been properly updated
-        // otherwise, the video thread will be BLOCKING for a long time.
-        emit signalDecoderSeek(seekPos); // blocking connection
-        m_demuxer->flush();
-        m_demuxer->start();
+        publishSeek(seekPos);
+        performSeek();
+    }
 
-        bool backward = m_demuxer->isBackward();
-        // time-consuming job
-        // use audio frame pts may be more accurate, but it is not available in rewinding.
-        qreal startPoint;
-        if (backward) {
-            // if rewinding, there is no need to skip frame. (dispatcher guarantee)
-            if (m_demuxer->hasVideo()) {
-                startPoint = m_demuxer->frontPicture();
-            } else {
-                startPoint = seekPos;
-            }
-        } else {
-            if (m_demuxer->hasVideo()) {
-                m_demuxer->skipPicture([seekPos](qreal framePos) { return framePos < seekPos; });
-            }
-            m_demuxer->skipSample(
-                    [seekPos, &startPoint](qreal framePos) { return startPoint = framePos, framePos < seekPos; });
+signals:
 
-        }
+    void signalDecoderOpenFile(std::string path);
 
-        emit signalPositionChangedBySeek(); // block
-        m_playback->setStartPoint(startPoint);
-        m_playback->showFrame();
+    void signalSeekRequested();
 
-        qDebug() << "End seek for" << seekPos;
-    }
+    void signalScrubRequested();
 
-signals:
+    void signalScrubEnded();
 
-    void signalDecoderOpenFile(std::string path);
+    void signalStepRequested(int frames);
 
-    void signalDecoderSeek(qreal pos);
+    void signalSetLoop(qreal a, qreal b);
 
     void signalPositionChangedBySeek();
 
@@ -252,8 +462,16 @@ signals:
 
     void resourcesEnd();
 
+    void trackAdvanced();
+
     void setPicture(VideoFrameRef pic);
 
+    /**
+     * 逐帧步进完成
+     * @param pos 当前画面的位置(单位: 秒)
+     */
+    void frameStepped(qreal pos);
+
 
 };
 
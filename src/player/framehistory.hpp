@@ -0,0 +1,120 @@
+#pragma once
+
+#include <QDebug>
+#include <QSettings>
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include "frame.hpp"
+#include "ponyplayer.h"
+
+/**
+ * @brief 最近呈现过的画面, 用于逐帧步进.
+ *
+ * 按呈现的顺序保存最近交给 VsyncScheduler 的画面, 游标指向正在显示的画面. 向前步进只移动游标, 不需要重新解码;
+ * 游标已经在最后时由调用者从解码队列中取出下一帧并记录. 保存的画面受内存预算和画面数的限制, 超出时丢弃最早的画面.
+ * 只在 Playback 线程上使用.
+ */
+class FrameHistory {
+public:
+    /**
+     * 默认的内存预算(单位: MB), 1080p 大约可以保存 3 秒
+     */
+    constexpr static int DEFAULT_BUDGET_MB = 256;
+    /**
+     * 最多保存的画面数, 避免很小的画面占用过多的 VideoFrame
+     */
+    constexpr static size_t MAX_FRAMES = 300;
+
+private:
+    std::deque<VideoFrameRef> m_frames;
+    size_t m_cursor = 0; // 正在显示的画面在 m_frames 中的下标, m_frames 为空时没有意义
+    size_t m_bytes = 0;
+    size_t m_budgetBytes;
+
+    /**
+     * 超出预算时丢弃最早的画面, 正在显示的画面总是保留
+     */
+    void evict() {
+        while (m_frames.size() > 1 && (m_bytes > m_budgetBytes || m_frames.size() > MAX_FRAMES) && m_cursor > 0) {
+            m_bytes -= frameBytes(m_frames.front());
+            m_frames.pop_front();
+            --m_cursor;
+        }
+    }
+
+public:
+    explicit FrameHistory(size_t budgetBytes = static_cast<size_t>(DEFAULT_BUDGET_MB) << 20)
+            : m_budgetBytes(budgetBytes) {}
+
+    /**
+     * 读取设置 Video/frameHistoryMB, 0 表示不保存历史, 只能从解码队列向后步进
+     */
+    static FrameHistory load() {
+        QSettings settings(AnytMusic::getConfigFile(), QSettings::IniFormat);
+        int mb = std::clamp(settings.value("Video/frameHistoryMB", DEFAULT_BUDGET_MB).toInt(), 0, 4096);
+        return FrameHistory(static_cast<size_t>(mb) << 20);
+    }
+
+    /**
+     * 画面占用的内存, 按 YUV420P 估计
+     */
+    static size_t frameBytes(const VideoFrameRef &frame) {
+        if (!frame.isValid()) { return 0; }
+        return static_cast<size_t>(frame.getLineSize()) * static_cast<size_t>(frame.getHeight()) * 3 / 2;
+    }
+
+    /**
+     * 记录新呈现的画面, 游标移到这个画面
+     */
+    void record(const VideoFrameRef &frame) {
+        if (!frame.isValid()) { return; }
+        m_frames.push_back(frame);
+        m_bytes += frameBytes(frame);
+        m_cursor = m_frames.size() - 1;
+        evict();
+    }
+
+    /**
+     * 把游标移到 PTS 为 pts 的画面, 暂停时调用: 已经交给 VsyncScheduler 但还没有显示的画面留在游标之后
+     * @return 是否找到, 找不到时游标不变
+     */
+    bool locate(double pts) {
+        if (std::isnan(pts)) { return false; }
+        for (size_t i = m_frames.size(); i-- > 0;) {
+            if (m_frames[i].getPTS() == pts) {
+                m_cursor = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * 向前步进一帧
+     * @return 上一个画面, 已经是最早的画面时返回无效的画面, 游标不变
+     */
+    VideoFrameRef previous() {
+        if (m_frames.empty() || m_cursor == 0) { return {}; }
+        return m_frames[--m_cursor];
+    }
+
+    /**
+     * 向后步进一帧
+     * @return 下一个画面, 游标已经在最后时返回无效的画面, 需要从解码队列中取出
+     */
+    VideoFrameRef next() {
+        if (m_cursor + 1 >= m_frames.size()) { return {}; }
+        return m_frames[++m_cursor];
+    }
+
+    void clear() {
+        m_frames.clear();
+        m_cursor = 0;
+        m_bytes = 0;
+    }
+
+    [[nodiscard]] size_t size() const { return m_frames.size(); }
+
+    [[nodiscard]] size_t bytes() const { return m_bytes; }
+};
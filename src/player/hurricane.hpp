@@ -10,6 +10,7 @@
 #include <utility>
 #include "framecontroller.hpp"
 #include "fireworks.hpp"
+#include "playbackstats.hpp"
 
 /**
  * @brief
@@ -56,6 +57,15 @@ public:
     Q_PROPERTY(
             QString currentOutputDevice READ getCurrentOutputDevice WRITE setCurrentOutputDevice NOTIFY currentOutputDeviceChanged)
     Q_PROPERTY(double speed READ getSpeed WRITE setSpeed NOTIFY speedChanged)
+    Q_PROPERTY(
+            qreal audioLatencyOffset READ getAudioLatencyOffset WRITE setAudioLatencyOffset NOTIFY audioLatencyOffsetChanged)
+    Q_PROPERTY(
+            int audioLatencyProfile READ getAudioLatencyProfile WRITE setAudioLatencyProfile NOTIFY audioLatencyProfileChanged)
+    Q_PROPERTY(bool equalizerEnabled READ isEqualizerEnabled WRITE setEqualizerEnabled NOTIFY equalizerChanged)
+    Q_PROPERTY(qreal crossfade READ getCrossfade WRITE setCrossfade NOTIFY crossfadeChanged)
+    Q_PROPERTY(PlaybackStats *stats READ getStats CONSTANT)
+    Q_PROPERTY(qreal loopStart READ getLoopStart NOTIFY loopChanged)
+    Q_PROPERTY(qreal loopEnd READ getLoopEnd NOTIFY loopChanged)
 
 
 private:
@@ -64,11 +74,20 @@ private:
     HurricaneState state = HurricaneState::INVALID;
 private:
     FrameController *frameController;
+    PlaybackStats *playbackStats;
     int track = -1;
     double speed = 1.0;
+    bool scrubbing = false;
+    bool scrubResume = false; // 拖动前正在播放, 松开后继续播放
+    qreal loopStart = -1.0;   // A-B 循环区间, 没有循环时为 -1
+    qreal loopEnd = -1.0;
+    QString nextUrl;
 public:
     explicit Hurricane(QQuickItem *parent = nullptr) : Fireworks(parent) {
-        frameController = new FrameController(this);
+        auto presenter = std::make_shared<VsyncScheduler>();
+        setScheduler(presenter);
+        frameController = new FrameController(presenter, this);
+        playbackStats = new PlaybackStats([this] { return frameController->getPlaybackMetrics(); }, this);
 
         connect(this, &Hurricane::signalStart, frameController, &FrameController::start);
         connect(this, &Hurricane::signalPause, frameController, &FrameController::pause);
@@ -79,7 +98,6 @@ public:
         connect(this, &Hurricane::signalClose, frameController, &FrameController::close);
         connect(frameController, &FrameController::setPicture, this, &Hurricane::setVideoFrame);
 
-        connect(this, &Hurricane::signalSeek, frameController, &FrameController::seek);
         connect(frameController, &FrameController::signalPositionChangedBySeek, this,
                 &Hurricane::slotPositionChangedBySeek);
 
@@ -92,7 +110,11 @@ public:
         connect(frameController, &FrameController::signalAudioOutputDevicesChanged, this,
                 &Hurricane::audioOutputDeviceChanged);
         connect(frameController, &FrameController::signalDeviceSwitched, this, &Hurricane::currentOutputDeviceChanged);
+        // 延迟校正是按设备保存的, 切换设备后需要刷新
+        connect(frameController, &FrameController::signalDeviceSwitched, this, &Hurricane::audioLatencyOffsetChanged);
         connect(frameController, &FrameController::resourcesEnd, this, &Hurricane::resourcesEnd);
+        connect(frameController, &FrameController::trackAdvanced, this, &Hurricane::slotTrackAdvanced);
+        connect(frameController, &FrameController::frameStepped, this, &Hurricane::frameStepped);
         emit signalPlayerInitializing(QPrivateSignal());
 #ifdef DEBUG_FLAG_AUTO_OPEN
         openFile(QUrl::fromLocalFile(QDir::homePath().append(u"/581518754-1-208.mp4"_qs)).url());
@@ -119,6 +141,15 @@ public:
 
     QStringList getAudioDeviceList() { return frameController->getAudioDeviceList(); }
 
+    /**
+     * 播放统计, 用于调试界面
+     */
+    PlaybackStats *getStats() { return playbackStats; }
+
+    qreal getLoopStart() { return loopStart; }
+
+    qreal getLoopEnd() { return loopEnd; }
+
 
 signals:
 
@@ -152,8 +183,30 @@ signals:
 
     void speedChanged();
 
+    void audioLatencyOffsetChanged();
+
+    void audioLatencyProfileChanged();
+
+    void equalizerChanged();
+
     void resourcesEnd();
 
+    /**
+     * 交叉淡化到中点, 已经开始播放 setNextFile 设置的文件, 不会发出 resourcesEnd 和 openFileResult
+     * @param url 新文件的 URL
+     */
+    void trackAdvanced(const QString &url);
+
+    void crossfadeChanged();
+
+    void loopChanged();
+
+    /**
+     * 逐帧步进完成
+     * @param pos 当前画面的位置(单位: 秒)
+     */
+    void frameStepped(qreal pos);
+
 Q_SIGNALS:
 
     // 下面这些方法用于与 VideoPlayWorker 通信
@@ -169,7 +222,6 @@ Q_SIGNALS:
 
     void signalOpenFile(const QString &path, QPrivateSignal);
 
-    void signalSeek(qreal pos, QPrivateSignal);
 
 
 public slots:
@@ -240,6 +292,11 @@ public slots:
     Q_INVOKABLE void close() {
         if (state == HurricaneState::PRE_PAUSE || state == HurricaneState::PAUSED) {
             state = HurricaneState::CLOSING;
+            scrubbing = false;
+            if (loopStart >= 0) {
+                loopStart = loopEnd = -1.0;
+                emit loopChanged();
+            }
             emit stateChanged();
             this->setVideoFrame(VideoFrameRef());
             emit signalClose(QPrivateSignal());
@@ -272,6 +329,257 @@ public slots:
         emit speedChanged();
     }
 
+    /**
+     * 设置当前音频输出设备的延迟校正, 用于修正蓝牙耳机等设备的音画不同步. 校正值按设备保存.
+     * @param offset 设备实际输出比报告晚的时间(单位: 秒), 画面比声音早时增大这个值
+     */
+    Q_INVOKABLE void setAudioLatencyOffset(qreal offset) {
+        frameController->setLatencyOffset(offset);
+        emit audioLatencyOffsetChanged();
+    }
+
+    /**
+     * 获取当前音频输出设备的延迟校正
+     * @return 单位: 秒
+     */
+    Q_INVOKABLE qreal getAudioLatencyOffset() {
+        return frameController ? frameController->getLatencyOffset() : 0.0;
+    }
+
+    /**
+     * 设置音频延迟档位: 0 低延迟, 1 均衡, 2 省电. 档位会被保存, 各档位的参数可以在配置文件中调整.
+     * @param profile 档位
+     */
+    Q_INVOKABLE void setAudioLatencyProfile(int profile) {
+        frameController->setLatencyProfile(profile);
+        emit audioLatencyProfileChanged();
+    }
+
+    /**
+     * 获取音频延迟档位
+     */
+    Q_INVOKABLE int getAudioLatencyProfile() {
+        return frameController ? frameController->getLatencyProfile() : 1;
+    }
+
+    /**
+     * 设置变速引擎和质量档位. 引擎: 0 sonic, 1 WSOLA; 质量: 0 快速, 1 均衡, 2 高质量. 设置会被保存.
+     * sonic 的 CPU 占用最低, 适合人声; WSOLA 在音乐和高倍速下更自然.
+     */
+    Q_INVOKABLE void setAudioTimeStretch(int engine, int quality) {
+        frameController->setTimeStretch(engine, quality);
+    }
+
+    Q_INVOKABLE int getAudioTimeStretchEngine() {
+        return frameController ? frameController->getTimeStretchEngine() : 0;
+    }
+
+    Q_INVOKABLE int getAudioTimeStretchQuality() {
+        return frameController ? frameController->getTimeStretchQuality() : 1;
+    }
+
+    /**
+     * 打开或关闭均衡器, 设置会被保存
+     */
+    Q_INVOKABLE void setEqualizerEnabled(bool enabled) {
+        EqualizerSettings settings = frameController->getEqualizer();
+        settings.enabled = enabled;
+        frameController->setEqualizer(settings);
+        emit equalizerChanged();
+    }
+
+    Q_INVOKABLE bool isEqualizerEnabled() {
+        return frameController && frameController->getEqualizer().enabled;
+    }
+
+    /**
+     * 获取内置预设的名称
+     */
+    Q_INVOKABLE QStringList getEqualizerPresets() {
+        QStringList presets;
+        for (const auto &preset: EqualizerPresets::PRESETS) { presets.append(preset.name); }
+        return presets;
+    }
+
+    /**
+     * 应用内置预设, 频段恢复为十段图示均衡, 前级增益自动调整以避免削波
+     * @param name 预设名称
+     */
+    Q_INVOKABLE void setEqualizerPreset(const QString &name) {
+        EqualizerSettings settings = frameController->getEqualizer();
+        if (!EqualizerPresets::apply(name.toStdString(), settings)) {
+            qWarning() << "Unknown equalizer preset" << name;
+            return;
+        }
+        frameController->setEqualizer(settings);
+        emit equalizerChanged();
+    }
+
+    /**
+     * 获取各频段的中心频率(单位: Hz)
+     */
+    Q_INVOKABLE QList<qreal> getEqualizerFrequencies() {
+        QList<qreal> freqs;
+        for (const auto &band: frameController->getEqualizer().bands) { freqs.append(band.freq); }
+        return freqs;
+    }
+
+    /**
+     * 获取各频段的增益(单位: dB)
+     */
+    Q_INVOKABLE QList<qreal> getEqualizerGains() {
+        QList<qreal> gains;
+        for (const auto &band: frameController->getEqualizer().bands) { gains.append(band.gainDb); }
+        return gains;
+    }
+
+    /**
+     * 设置一个频段的增益
+     * @param band 频段的下标
+     * @param gainDb 增益(单位: dB), 限制在 ±24dB 内
+     */
+    Q_INVOKABLE void setEqualizerGain(int band, qreal gainDb) {
+        EqualizerSettings settings = frameController->getEqualizer();
+        if (band < 0 || band >= static_cast<int>(settings.bands.size())) { return; }
+        settings.bands[static_cast<size_t>(band)].gainDb = std::clamp(gainDb, -24.0, 24.0);
+        frameController->setEqualizer(settings);
+        emit equalizerChanged();
+    }
+
+    /**
+     * 设置前级增益(单位: dB), 提升频段后出现削波时降低这个值
+     */
+    Q_INVOKABLE void setEqualizerPreamp(qreal preampDb) {
+        EqualizerSettings settings = frameController->getEqualizer();
+        settings.preampDb = std::clamp(preampDb, -24.0, 24.0);
+        frameController->setEqualizer(settings);
+        emit equalizerChanged();
+    }
+
+    Q_INVOKABLE qreal getEqualizerPreamp() {
+        return frameController ? frameController->getEqualizer().preampDb : 0.0;
+    }
+
+    /**
+     * 设置当前文件的 ReplayGain 信息
+     * @param info mediaLibController.getReplayGain 的返回值, 包括 scanned, trackGain, trackPeak, albumGain, albumPeak
+     */
+    Q_INVOKABLE void setReplayGain(const QVariantMap &info) {
+        ReplayGainInfo rg;
+        rg.scanned = info.value("scanned", false).toBool();
+        rg.trackGain = info.value("trackGain", 0.0).toDouble();
+        rg.trackPeak = info.value("trackPeak", 0.0).toDouble();
+        rg.albumGain = info.value("albumGain", 0.0).toDouble();
+        rg.albumPeak = info.value("albumPeak", 0.0).toDouble();
+        frameController->setReplayGainInfo(rg);
+    }
+
+    /**
+     * 设置 ReplayGain 模式
+     * @param mode 0 关闭, 1 音轨增益, 2 专辑增益
+     */
+    Q_INVOKABLE void setReplayGainMode(int mode) {
+        ReplayGainSettings settings = frameController->getReplayGain();
+        settings.mode = static_cast<ReplayGainMode>(std::clamp(mode, 0, 2));
+        frameController->setReplayGain(settings);
+    }
+
+    Q_INVOKABLE int getReplayGainMode() {
+        return static_cast<int>(frameController->getReplayGain().mode);
+    }
+
+    /**
+     * 设置 ReplayGain 的前级增益(单位: dB), 范围 [-15, 15]
+     */
+    Q_INVOKABLE void setReplayGainPreamp(qreal preampDb) {
+        ReplayGainSettings settings = frameController->getReplayGain();
+        settings.preampDb = std::clamp(preampDb, -15.0, 15.0);
+        frameController->setReplayGain(settings);
+    }
+
+    Q_INVOKABLE qreal getReplayGainPreamp() {
+        return frameController->getReplayGain().preampDb;
+    }
+
+    /**
+     * 设置声道混合. 设备支持源的声道数时直接输出, 否则按这里的增益缩混为 5.1, 立体声或单声道
+     * @param mix 包括 maxChannels(0 表示由设备决定), centerDb, surroundDb, lfeDb, mixLfe, normalize, 缺少的项保持不变
+     */
+    Q_INVOKABLE void setChannelMix(const QVariantMap &mix) {
+        ChannelMixSettings settings = frameController->getChannelMix();
+        settings.maxChannels = std::clamp(mix.value("maxChannels", settings.maxChannels).toInt(), 0,
+                                          PcmKernels::MAX_CHANNELS);
+        settings.centerDb = std::clamp(mix.value("centerDb", settings.centerDb).toDouble(), -30.0, 0.0);
+        settings.surroundDb = std::clamp(mix.value("surroundDb", settings.surroundDb).toDouble(), -30.0, 0.0);
+        settings.lfeDb = std::clamp(mix.value("lfeDb", settings.lfeDb).toDouble(), -30.0, 10.0);
+        settings.mixLfe = mix.value("mixLfe", settings.mixLfe).toBool();
+        settings.normalize = mix.value("normalize", settings.normalize).toBool();
+        frameController->setChannelMix(settings);
+    }
+
+    Q_INVOKABLE QVariantMap getChannelMix() {
+        ChannelMixSettings settings = frameController->getChannelMix();
+        return {{"maxChannels", settings.maxChannels},
+                {"centerDb",    settings.centerDb},
+                {"surroundDb",  settings.surroundDb},
+                {"lfeDb",       settings.lfeDb},
+                {"mixLfe",      settings.mixLfe},
+                {"normalize",   settings.normalize}};
+    }
+
+    /**
+     * 画面呈现的统计
+     * @return 包括 refreshRate(Hz), presented, dropped, repeated, judderMs, lateMs 和 driftP95Ms
+     */
+    Q_INVOKABLE QVariantMap getPresentationStats() {
+        PresentationStats stats = m_scheduler->stats();
+        return {{"refreshRate", stats.refreshRate},
+                {"presented",   static_cast<qulonglong>(stats.presented)},
+                {"dropped",     static_cast<qulonglong>(stats.dropped)},
+                {"repeated",    static_cast<qulonglong>(stats.repeated)},
+                {"judderMs",    stats.judderMs},
+                {"lateMs",      stats.lateMs},
+                {"driftP95Ms",  stats.driftP95Ms}};
+    }
+
+    /**
+     * 设置交叉淡化的时长, 只对连续播放的纯音频文件生效
+     * @param secs 单位: 秒, 范围 [0, 12], 0 表示关闭
+     */
+    Q_INVOKABLE void setCrossfade(qreal secs) {
+        frameController->setCrossfade(secs);
+        emit crossfadeChanged();
+    }
+
+    Q_INVOKABLE qreal getCrossfade() {
+        return frameController->getCrossfade();
+    }
+
+    /**
+     * 设置播放列表中的下一个文件, 当前文件即将结束时在后台打开并交叉淡化
+     * @param url 文件的 URL, 为空时不淡化
+     */
+    Q_INVOKABLE void setNextFile(const QString &url) {
+        nextUrl = url;
+        frameController->setNextFile(url.isEmpty() ? QString() : QUrl(url).toLocalFile());
+    }
+
+    /**
+     * 设置卷积的脉冲响应, 用于房间校正或耳机模拟. 启用后声音约有 10ms 的额外延迟, 音画同步会自动补偿.
+     * @param url WAV 文件的 URL 或本地路径, 为空时关闭卷积
+     */
+    Q_INVOKABLE void setAudioImpulseResponse(const QString &url) {
+        QString path = url.startsWith("file:") ? QUrl(url).toLocalFile() : url;
+        frameController->setImpulseResponse(path);
+    }
+
+    /**
+     * 获取已保存的脉冲响应路径, 没有启用卷积时返回空字符串
+     */
+    Q_INVOKABLE QString getAudioImpulseResponse() {
+        return frameController->getImpulseResponse();
+    }
+
     /**
      * 设置音频输出设备名称
      * @param deviceName 设备名称
@@ -312,7 +620,8 @@ public slots:
     }
 
     /**
-     * 改变视频播放的进度, 不保证马上生效, 请关注信号
+     * 改变视频播放的进度, 不保证马上生效, 请关注信号. 拖动进度条时可以连续调用, 还没有完成的跳转会被新的
+     * 请求取代, 只保证停在最后一次请求的位置.
      * 需要保证当前状态为 PAUSE, PRE_PAUSE, PLAYING 或 PRE_PLAY
      * @param pos 播放进度(单位: 秒)
      * @see HurricanePlayer::positionChangedBySeek
@@ -336,13 +645,126 @@ public slots:
         state = PRE_PAUSE;
         emit stateChanged();
 //    emit signalPause(QPrivateSignal());
-        emit signalSeek(pos, QPrivateSignal());
+        frameController->requestSeek(pos);
         if (playing) {
             emit signalStart(QPrivateSignal());
         }
         qDebug() << "HurricanePlayer: Seek" << pos;
     }
 
+    /**
+     * 拖动进度条时连续调用, 只解码 pos 之前最近的关键帧并立即显示, 不播放声音. 第一次调用时暂停播放,
+     * 拖动结束时需要调用 endScrub.
+     * 需要保证当前状态为 PAUSE, PRE_PAUSE, PLAYING 或 PRE_PLAY
+     * @param pos 播放进度(单位: 秒)
+     * @see HurricanePlayer::endScrub
+     */
+    Q_INVOKABLE void scrub(qreal pos) {
+        if (!scrubbing) {
+            switch (state) {
+                case HurricaneState::PLAYING:
+                case HurricaneState::PRE_PLAY:
+                case HurricaneState::PAUSED:
+                case HurricaneState::PRE_PAUSE:
+                    break;
+                default:
+                    return;
+            }
+            scrubbing = true;
+            scrubResume = state == HurricaneState::PLAYING || state == HurricaneState::PRE_PLAY;
+            state = PRE_PAUSE;
+            emit stateChanged();
+        }
+        if (pos < 0 || pos > getVideoDuration())
+            return;
+        frameController->requestScrub(pos);
+    }
+
+    /**
+     * 结束拖动, 精确地跳转到 pos, 拖动前正在播放时继续播放. 没有调用过 scrub 时等同于 seek.
+     * @param pos 播放进度(单位: 秒)
+     * @see HurricanePlayer::positionChangedBySeek
+     */
+    Q_INVOKABLE void endScrub(qreal pos) {
+        if (!scrubbing) {
+            seek(pos);
+            return;
+        }
+        scrubbing = false;
+        pos = std::clamp(pos, 0.0, getVideoDuration());
+        frameController->requestEndScrub(pos);
+        if (scrubResume) {
+            emit signalStart(QPrivateSignal());
+        }
+        qDebug() << "HurricanePlayer: End scrub at" << pos;
+    }
+
+    /**
+     * 逐帧步进, 正在播放时先暂停. 最近显示过的画面直接从历史中取出, 向后步进超出历史时从解码队列中取出.
+     * 倒放和纯音频文件不支持. 继续播放时从当前画面开始.
+     * 需要保证当前状态为 PAUSE, PRE_PAUSE, PLAYING 或 PRE_PLAY
+     * @param frames 步进的帧数, 负数表示向前
+     * @see HurricanePlayer::frameStepped
+     */
+    Q_INVOKABLE void stepFrame(int frames) {
+        switch (state) {
+            case HurricaneState::PLAYING:
+            case HurricaneState::PRE_PLAY:
+                pause();
+                /* fall through */
+            case HurricaneState::PAUSED:
+            case HurricaneState::PRE_PAUSE:
+                break;
+            default:
+                return;
+        }
+        if (scrubbing || frames == 0) { return; }
+        frameController->requestStep(frames);
+    }
+
+    /**
+     * 在 a 和 b 之间循环播放, 从 a 开始. 第一次播放区间时记录解码的音频和画面(画面受内存预算限制), 之后每次循环
+     * 都从内存中播放, 不需要跳转, 拼接处的声音交叉淡化. 倒放时不支持.
+     * 需要保证当前状态为 PAUSE, PRE_PAUSE, PLAYING 或 PRE_PLAY
+     * @param a 区间的开始(单位: 秒)
+     * @param b 区间的结束(单位: 秒)
+     */
+    Q_INVOKABLE void setLoop(qreal a, qreal b) {
+        switch (state) {
+            case HurricaneState::PLAYING:
+            case HurricaneState::PRE_PLAY:
+            case HurricaneState::PAUSED:
+            case HurricaneState::PRE_PAUSE:
+                break;
+            default:
+                return;
+        }
+        if (backwardStatus) { return; }
+        if (a > b) { std::swap(a, b); }
+        // 区间需要在文件结束之前, 否则解码器在到达 B 之前就结束了
+        a = std::max(a, 0.0);
+        b = std::min(b, getAudioDuration() - LoopAudioCache::EDGE_SECS);
+        if (b - a < LoopAudioCache::MIN_SECS || b - a > LoopAudioCache::MAX_SECS) {
+            qWarning() << "Invalid loop region" << a << b;
+            return;
+        }
+        loopStart = a;
+        loopEnd = b;
+        emit loopChanged();
+        frameController->setLoop(a, b);
+        qDebug() << "HurricanePlayer: Loop" << a << b;
+    }
+
+    /**
+     * 取消 A-B 循环, 从当前位置继续播放
+     */
+    Q_INVOKABLE void clearLoop() {
+        if (loopStart < 0) { return; }
+        loopStart = loopEnd = -1.0;
+        emit loopChanged();
+        frameController->setLoop(std::numeric_limits<qreal>::quiet_NaN(), std::numeric_limits<qreal>::quiet_NaN());
+    }
+
     Q_INVOKABLE QStringList getTracks() {
         if (state == LOADING || state == INVALID) {
             qWarning() << "Get tracks when" << state;
@@ -413,6 +835,8 @@ public slots:
             default:
                 return;
         }
+        // 倒放不支持 A-B 循环
+        clearLoop();
         state = PRE_PAUSE;
         emit stateChanged();
         backwardStatus = true;
@@ -454,6 +878,15 @@ private slots:
         emit stateChanged();
     };
 
+    void slotTrackAdvanced() {
+        QString url = std::exchange(nextUrl, QString());
+        qDebug() << "Track advanced to" << url;
+        track = 0;
+        playbackStats->reset();
+        emit trackChanged();
+        emit trackAdvanced(url);
+    }
+
     void slotOpenFileResult(AnytMusic::OpenFileResultType result) {
         if (result != AnytMusic::OpenFileResultType::FAILED) {
             state = PAUSED;
@@ -462,6 +895,7 @@ private slots:
             state = INVALID;
             track = -1;
         }
+        playbackStats->reset();
         emit openFileResult(result, QPrivateSignal());
         emit trackChanged();
         emit stateChanged();
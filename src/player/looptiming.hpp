@@ -0,0 +1,82 @@
+#pragma once
+
+#include <QDebug>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+/**
+ * @brief Playback 循环每次迭代自身的耗时.
+ *
+ * 只统计循环自己的工作(处理命令, 切换音频等), 不包括等待解码和等待显示, 这部分耗时的波动直接推迟画面送达
+ * VsyncScheduler 的时刻. 耗时按 2 的幂分桶, 第 i 个桶表示 [2^(i-1), 2^i) 微秒. 只在 Playback 线程上使用.
+ */
+class PlaybackLoopTiming {
+public:
+    using Clock = std::chrono::steady_clock;
+    constexpr static size_t BUCKETS = 20;
+
+private:
+    std::array<uint64_t, BUCKETS> m_histogram{};
+    uint64_t m_iterations = 0;
+    uint64_t m_maxNanos = 0;
+    uint64_t m_commands = 0;
+
+public:
+    void reset() {
+        m_histogram.fill(0);
+        m_iterations = 0;
+        m_maxNanos = 0;
+        m_commands = 0;
+    }
+
+    /**
+     * 记录一次迭代
+     * @param begin 循环开始工作的时刻
+     * @param end 循环开始等待的时刻
+     * @param commands 这次迭代处理的命令数
+     */
+    void record(Clock::time_point begin, Clock::time_point end, size_t commands) {
+        auto nanos = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+        uint64_t micros = nanos / 1000;
+        size_t bucket = 0;
+        while (micros) {
+            micros >>= 1;
+            ++bucket;
+        }
+        ++m_histogram[bucket < BUCKETS ? bucket : BUCKETS - 1];
+        ++m_iterations;
+        m_maxNanos = std::max(m_maxNanos, nanos);
+        m_commands += commands;
+    }
+
+    /**
+     * @param quantile 分位, 范围 [0, 1]
+     * @return 对应桶的上界(单位: 微秒), 没有数据时返回 0
+     */
+    [[nodiscard]] uint64_t quantileMicros(double quantile) const {
+        if (m_iterations == 0) { return 0; }
+        auto target = static_cast<uint64_t>(quantile * static_cast<double>(m_iterations));
+        uint64_t accumulated = 0;
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            accumulated += m_histogram[i];
+            if (accumulated > target) { return uint64_t{1} << i; }
+        }
+        return uint64_t{1} << (BUCKETS - 1);
+    }
+
+    [[nodiscard]] uint64_t iterations() const { return m_iterations; }
+
+    [[nodiscard]] double maxMicros() const { return static_cast<double>(m_maxNanos) / 1000; }
+
+    /**
+     * 输出统计, 每次停止播放时调用
+     */
+    void report() const {
+        if (m_iterations == 0) { return; }
+        qDebug().nospace() << "Playback loop: " << m_iterations << " iterations, " << m_commands << " commands, p50 "
+                           << quantileMicros(0.5) << "us, p99 " << quantileMicros(0.99) << "us, max "
+                           << maxMicros() << "us";
+    }
+};
@@ -8,11 +8,18 @@
 #include <QObject>
 #include <QThread>
 #include <QDebug>
-#include <QCoreApplication>
+#include <limits>
+#include <memory>
 #include <utility>
 #include "demuxer.hpp"
 #include "audiosink.hpp"
+#include "dspstage.hpp"
 #include "frame.hpp"
+#include "vsyncscheduler.hpp"
+#include "looptiming.hpp"
+#include "framehistory.hpp"
+#include "playbackstats.hpp"
+#include "concurrentqueue.h"
 
 /**
  * @brief 负责输出视频和音频(不含视频预览).
@@ -21,6 +28,25 @@
  */
 class Playback : public QObject {
 Q_OBJECT
+public:
+    /**
+     * 修改播放参数的命令
+     */
+    struct Command {
+        enum Type {
+            Volume, Pitch, Speed, LatencyOffset, LatencyProfile, TimeStretch, ImpulseResponse, OutputDevice
+        } type;
+        qreal value = 0.0;
+        int first = 0;  // LatencyProfile 的档位, TimeStretch 的引擎
+        int second = 0; // TimeStretch 的质量
+        QString text{}; // 脉冲响应的路径, 设备名称
+    };
+
+    /**
+     * 播放时每一帧最多处理的命令数, 剩下的留到下一帧
+     */
+    constexpr static size_t MAX_COMMANDS_PER_FRAME = 4;
+
 private:
     QThread *m_affinityThread;
     Demuxer *m_demuxer;
@@ -28,6 +54,9 @@ private:
 
 
     PonyAudioSink *m_audioSink = nullptr;
+    AudioDspStage *m_audioDsp = nullptr;
+    CrossfadeDeck *m_crossfade = nullptr;
+    std::shared_ptr<VsyncScheduler> m_presenter;
     std::atomic<bool> m_isInterrupt;
     std::atomic<bool> m_isPlaying;
     std::mutex m_interruptMutex;
@@ -39,62 +68,296 @@ private:
 
     std::atomic<qreal> m_preferablePos = 0.0;
 
+    // 从禁用音频的倍速恢复时, 需要在 Playback 循环中重新对齐音频
+    bool m_audioResumePending = false;
+
+    /**
+     * 任意线程提交, 只在 Playback 线程上取出: 播放时由循环在固定的位置取出, 空闲时由 commandsPosted 触发.
+     * 循环中不再运行事件循环, 其他排队的槽函数不会插入到两帧之间.
+     */
+    moodycamel::ConcurrentQueue<Command> m_commands;
+    std::atomic<bool> m_drainPosted = false;
+    PlaybackLoopTiming m_loopTiming;
+    std::atomic<uint64_t> m_skippedPictures = 0;
+    FrameHistory m_history = FrameHistory::load();
+    std::atomic<bool> m_frameStepped = false; // 暂停后逐帧步进过, 画面与音频不再对齐
+
+    // A-B 循环区间, 没有循环时为 NaN, 在下一次 stop 时生效
+    std::atomic<qreal> m_loopA = std::numeric_limits<qreal>::quiet_NaN();
+    std::atomic<qreal> m_loopB = std::numeric_limits<qreal>::quiet_NaN();
+    LoopVideoCache m_loopVideo = LoopVideoCache::load();
+    uint64_t m_loopWraps = 0;     // 画面回到 A 的次数, 与 AudioDspStage::loopSplices 对应
+    bool m_loopWrapped = false;   // 下一个画面回到了 A
+    bool m_loopRestart = false;   // 没有缓存, 播放到了 B, 需要跳转
+
+    PONY_THREAD_SAFE void post(Command command) {
+        m_commands.enqueue(std::move(command));
+        // 空闲时需要事件循环取出命令, 已经通知过时不重复通知
+        if (!m_drainPosted.exchange(true)) { emit commandsPosted(QPrivateSignal()); }
+    }
+
+    PONY_GUARD_BY(PLAYBACK)
+
+    void applyCommand(const Command &command) {
+        switch (command.type) {
+            case Command::Volume:
+                m_audioDsp->post({AudioDspStage::Command::Volume, command.value});
+                break;
+            case Command::Pitch:
+                m_audioDsp->post({AudioDspStage::Command::Pitch, command.value});
+                break;
+            case Command::Speed:
+                applySpeed(command.value);
+                break;
+            case Command::LatencyOffset:
+                // 校正值按设备保存, 没有 PonyAudioSink 时不知道是哪个设备, 丢弃
+                if (m_audioSink) { m_audioSink->setLatencyOffset(command.value); }
+                break;
+            case Command::LatencyProfile:
+                if (m_audioSink) {
+                    m_audioSink->setLatencyProfile(static_cast<AudioLatencyProfile>(command.first));
+                } else {
+                    AudioLatencyConfig::saveProfile(static_cast<AudioLatencyProfile>(command.first));
+                }
+                break;
+            case Command::TimeStretch:
+                m_audioDsp->post({AudioDspStage::Command::TimeStretch, 0.0, command.first, command.second});
+                break;
+            case Command::ImpulseResponse:
+                if (m_audioSink) {
+                    m_audioSink->loadImpulseResponse(command.text);
+                } else {
+                    PonyAudioSink::saveImpulseResponse(command.text);
+                }
+                break;
+            case Command::OutputDevice:
+                if (m_audioSink) { m_audioSink->requestDeviceSwitch(command.text); }
+                break;
+        }
+    }
+
+    /**
+     * 取出并执行命令
+     * @param limit 最多执行的命令数
+     * @return 执行的命令数
+     */
+    PONY_GUARD_BY(PLAYBACK)
+
+    size_t applyCommands(size_t limit) {
+        size_t applied = 0;
+        Command command{};
+        while (applied < limit && m_commands.try_dequeue(command)) {
+            applyCommand(command);
+            ++applied;
+        }
+        return applied;
+    }
+
+    PONY_GUARD_BY(PLAYBACK)
+
+    void applySpeed(qreal speed) {
+        m_speedFactor = speed;
+        m_audioDsp->post({AudioDspStage::Command::Speed, speed});
+        if (speed > PonyAudioSink::MAX_SPEED_FACTOR) {
+            m_audioResumePending = false;
+            if (m_audioSink->isBlock()) { return; }
+            // 需要禁用音频. 画面由视频时间驱动, 解码器继续输出音频, 不需要重新同步
+            m_audioSink->setBlockState(true);
+            if (!canToggleAudioInPlace()) {
+                emit requestResynchronization(false, false); // queue connection
+            }
+        } else if (speed <= PonyAudioSink::MAX_SPEED_FACTOR) {
+            if (!m_audioSink->isBlock()) { return; }
+            // 需要重新启动音频
+            if (canToggleAudioInPlace()) {
+                // 在 Playback 循环中恢复, 没有播放时在下一次开始播放时恢复
+                m_audioResumePending = true;
+            } else {
+                m_audioSink->setBlockState(false);
+                emit requestResynchronization(true, false); // queue connection
+            }
+        }
+    }
+
     inline void changeState(bool isPlaying) {
         m_isPlaying = isPlaying;
         emit stateChanged(isPlaying);
     }
 
-    inline void syncTo(qreal current) {
-        bool backward = m_demuxer->isBackward();
-        double duration;
-        if (!m_demuxer->hasVideo()) {
-            // 纯音频
-            duration = 1. / 30;
-            m_preferablePos = m_audioSink->getProcessSecs(backward);
+    /**
+     * 纯音频文件没有画面需要呈现, 只按固定的间隔更新位置
+     */
+    inline void syncTo() {
+        m_preferablePos = m_audioSink->getProcessSecs(m_demuxer->isBackward());
+        std::unique_lock lock(m_interruptMutex);
+        if (!m_isInterrupt) {
+            m_interruptCond.wait_for(lock, std::chrono::duration<double>(1. / 30));
+        }
+    }
+
+    /**
+     * 发布媒体时钟. 有音频时以音频时钟为准; 没有音频时由视频时钟驱动, 只在开始播放和速度改变时重新计时.
+     */
+    void publishClock(qreal videoPos, bool backward) {
+        qreal speed = m_audioSink->speed();
+        qreal rate = backward ? -speed : speed;
+        if (m_audioSink->isBlock()) {
+            m_presenter->retimeClock(videoPos, rate);
         } else {
-            qreal pos = m_demuxer->frontPicture();
-            if (isnan(pos)) { return; }
-            m_preferablePos = current;
-            if (m_audioSink->isBlock()) {
-                // 由于没有音频
-                duration = (current - pos) / m_audioSink->speed();
+            m_presenter->setClock(m_audioSink->getProcessSecs(backward), rate);
+        }
+    }
+
+    /**
+     * 把画面交给 VsyncScheduler, 由渲染线程在每次垂直同步时选择显示的画面. 队列已满时阻塞, 直到有画面被显示
+     * 或者丢弃; 被打断时画面留到下一次播放.
+     */
+    PONY_GUARD_BY(PLAYBACK)
+
+    void present(VideoFrameRef pic) {
+        bool backward = m_demuxer->isBackward();
+        if (!m_audioSink->isBlock() && m_audioSink->speed() > 2 - 1e-5) {
+            // 高倍速时解码可能跟不上, 直接跳过已经落后于音频的画面
+            int skipped;
+            if (!backward) {
+                skipped = m_demuxer->skipPicture([this, backward](qreal framePos) {
+                    return framePos < m_audioSink->getProcessSecs(backward);
+                });
             } else {
-                if (m_audioSink->speed() > 2 - 1e-5) {
-                    if (!backward) {
-                        m_demuxer->skipPicture([this, backward](qreal framePos) {
-                            return framePos < m_audioSink->getProcessSecs(backward);
-                        });
-                    } else {
-                        m_demuxer->skipPicture([this, backward](qreal framePos) {
-                            return framePos > m_audioSink->getProcessSecs(backward);
-                        });
-                    }
-                }
-                duration = m_demuxer->frontPicture() - m_audioSink->getProcessSecs(backward);
+                skipped = m_demuxer->skipPicture([this, backward](qreal framePos) {
+                    return framePos > m_audioSink->getProcessSecs(backward);
+                });
             }
-            if (backward) { duration = -duration; }
+            m_skippedPictures += static_cast<uint64_t>(skipped);
         }
-        if (duration > 0) {
-            if (duration > 1) {
-                qWarning() << "Sleep long duration" << duration << "s";
-            }
-            std::unique_lock lock(m_interruptMutex);
-            if (!m_isInterrupt) {
-                m_interruptCond.wait_for(lock, std::chrono::duration<double>(duration));
-            }
+        qreal pts = pic.getPTS();
+        publishClock(pts, backward);
+        // 倒放时不记录, 逐帧步进只支持正放
+        VideoFrameRef pushed = backward ? VideoFrameRef() : pic;
+        if (!m_presenter->push(pic, m_isInterrupt)) {
+            cacheVideoFrame = std::move(pic);
         } else {
-            qWarning() << "Sleep negative duration" << duration << "s";
+            m_history.record(pushed);
         }
+        qreal shown = m_presenter->currentPts();
+        m_preferablePos = isnan(shown) ? pts : shown;
     }
 
-    inline bool writeAudio(int batch) {
-        if (m_audioSink->isBlock()) { return true; }
-        for (int i = 0; i < batch && m_audioSink->freeByte() > MAX_AUDIO_FRAME_SIZE; ++i) {
-            AudioFrame sample = m_demuxer->getSample();
-            if (!sample.isValid()) { return false; }
-            m_audioSink->write(reinterpret_cast<const char *>(sample.getSampleData()), sample.getDataLen());
+    /**
+     * 是否可以不重新 seek 切换音频的禁用状态. 需要能够跳过音频帧, 目前只支持正放的视频. A-B 循环时解码器已经
+     * 越过 B, 需要重新 seek.
+     */
+    bool canToggleAudioInPlace() {
+        return m_demuxer->hasVideo() && !m_demuxer->isBackward() && std::isnan(m_loopA.load());
+    }
+
+    /**
+     * 播放时取出下一个画面. A-B 循环时记录区间中的画面, 之后从 LoopVideoCache 中循环取出.
+     */
+    PONY_GUARD_BY(PLAYBACK)
+
+    VideoFrameRef nextPicture() {
+        if (m_loopVideo.isLooping()) {
+            m_loopWrapped = m_loopVideo.atWrap();
+            return m_loopVideo.next();
+        }
+        VideoFrameRef pic = getVideoFrame();
+        if (!pic.isValid() || m_loopVideo.accept(pic)) {
+            if (m_loopVideo.state() == LoopVideoCache::State::Uncached) { m_audioDsp->disableLoopCache(); }
+            return pic;
+        }
+        if (m_loopVideo.isLooping()) {
+            m_loopWrapped = true;
+            return m_loopVideo.next();
         }
-        return true;
+        m_audioDsp->disableLoopCache();
+        m_loopRestart = true;
+        return pic;
+    }
+
+    /**
+     * 画面回到 A 之前等待声音播放到拼接处, 然后丢弃队列中 B 之前的画面. 禁用音频时画面由视频时钟驱动, 不需要等待.
+     */
+    PONY_GUARD_BY(PLAYBACK)
+
+    void waitLoopSplice() {
+        m_loopWrapped = false;
+        ++m_loopWraps;
+        if (!m_audioSink->isBlock()) {
+            // 上一次拼接播放之前不会写入下一次拼接, 因此拼接数超过回绕数时这一次已经播放
+            auto spliced = [this] {
+                uint64_t splices = m_audioDsp->loopSplices();
+                return splices > m_loopWraps || (splices == m_loopWraps && !m_audioSink->hasPendingRebase());
+            };
+            std::unique_lock lock(m_interruptMutex);
+            while (!m_isInterrupt && !spliced()) { m_interruptCond.wait_for(lock, std::chrono::milliseconds(2)); }
+        }
+        m_presenter->clear();
+    }
+
+    /**
+     * 请求 FrameController 跳转回 A, 等待跳转打断播放
+     */
+    PONY_GUARD_BY(PLAYBACK)
+
+    void restartLoop() {
+        m_loopRestart = false;
+        qDebug() << "Loop end reached without cache, seek to" << m_loopA.load();
+        emit requestLoopRestart();
+        std::unique_lock lock(m_interruptMutex);
+        m_interruptCond.wait(lock, [this] { return m_isInterrupt.load(); });
+    }
+
+    /**
+     * 恢复音频输出: 丢弃下一帧画面之前的音频帧, 从之后的第一个音频帧开始播放. 视频队列不受影响.
+     * 返回时 DSP 线程处于停止状态.
+     */
+    void resumeAudio() {
+        m_audioResumePending = false;
+        m_audioDsp->park();
+        // 之前可能通过重新同步禁用了音频解码
+        m_demuxer->setEnableAudio(true);
+        qreal pos = m_demuxer->frontPicture();
+        if (isnan(pos)) { pos = m_preferablePos; }
+        m_demuxer->skipSample([pos](qreal pts) { return pts < pos; });
+        qreal audioPos = m_demuxer->frontSample();
+        if (isnan(audioPos)) { audioPos = pos; }
+        bool playing = m_audioSink->state() == PlaybackState::PLAYING;
+        if (m_audioSink->state() != PlaybackState::STOPPED) { m_audioSink->stop(); }
+        m_audioSink->clear();
+        m_audioSink->setStartPoint(audioPos);
+        m_audioSink->setBlockState(false);
+        m_audioDsp->prime(5);
+        if (playing) { m_audioSink->start(); }
+        qDebug() << "Audio resumed at" << audioPos << "without seeking";
+    }
+
+    /**
+     * 逐帧步进, 显示步进后的画面. 历史中的画面直接显示, 向后超出历史时从解码队列中取出下一帧.
+     * @param frames 步进的帧数, 负数表示向前
+     */
+    PONY_GUARD_BY(PLAYBACK)
+
+    void stepFrames(int frames) {
+        VideoFrameRef pic;
+        for (; frames > 0; --frames) {
+            VideoFrameRef next = m_history.next();
+            if (!next.isValid()) {
+                next = getVideoFrame();
+                if (!next.isValid()) { break; }
+                m_history.record(next);
+            }
+            pic = std::move(next);
+        }
+        for (; frames < 0; ++frames) {
+            VideoFrameRef previous = m_history.previous();
+            if (!previous.isValid()) { break; }
+            pic = std::move(previous);
+        }
+        if (!pic.isValid()) { return; }
+        m_frameStepped = true;
+        m_preferablePos = pic.getPTS();
+        emit setPicture(pic);
     }
 
     PONY_GUARD_BY(PLAYBACK)
@@ -110,32 +373,31 @@ private:
     }
 
 public:
-    Playback(Demuxer *demuxer, QObject *parent) : QObject(nullptr), m_demuxer(demuxer) {
+    Playback(Demuxer *demuxer, std::shared_ptr<VsyncScheduler> presenter, QObject *parent)
+            : QObject(nullptr), m_demuxer(demuxer), m_presenter(std::move(presenter)) {
+        // 尽早开始枚举音频设备, 打开 PonyAudioSink 时通常已经完成
+        if (IAudioBackend::configuredKind() == IAudioBackend::Kind::PortAudio) { AudioDeviceCatalogue::instance(); }
         m_affinityThread = new QThread;
         m_affinityThread->setObjectName(AnytMusic::PLAYBACK);
         this->moveToThread(m_affinityThread);
         connect(this, &Playback::startWork, this, &Playback::onWork);
-        connect(this, &Playback::stopWork, this, [this] { this->m_audioSink->stop(); });
+        connect(this, &Playback::stopWork, this, [this] {
+            this->m_audioSink->stop();
+            m_history.clear();
+            m_loopVideo.arm(m_loopA, m_loopB);
+            m_loopWraps = 0;
+            m_loopWrapped = false;
+            m_loopRestart = false;
+        });
+        connect(this, &Playback::stepFramesRequested, this, &Playback::stepFrames, Qt::BlockingQueuedConnection);
         connect(this, &Playback::setAudioStartPoint, this, [this](qreal t) { this->m_audioSink->setStartPoint(t); });
-        connect(this, &Playback::setAudioVolume, this, [this](qreal volume) { this->m_audioSink->setVolume(volume); });
-        connect(this, &Playback::setAudioPitch, this, [this](qreal pitch) { this->m_audioSink->setPitch(pitch); });
-        connect(this, &Playback::setAudioSpeed, this, [this](qreal speed) {
-            m_speedFactor = speed;
-            this->m_audioSink->setSpeed(speed);
-            if (speed > PonyAudioSink::MAX_SPEED_FACTOR) {
-                if (this->m_audioSink->isBlock()) { return; }
-                // 需要禁用音频
-                this->m_audioSink->setBlockState(true);
-                emit requestResynchronization(false, false); // queue connection
-            } else if (speed <= PonyAudioSink::MAX_SPEED_FACTOR) {
-                if (!this->m_audioSink->isBlock()) { return; }
-                // 需要重新启动音频
-                this->m_audioSink->setBlockState(false);
-                emit requestResynchronization(true, false); // queue connection
-            }
+        connect(this, &Playback::commandsPosted, this, [this] {
+            m_drainPosted = false;
+            applyCommands(std::numeric_limits<size_t>::max());
         });
         connect(this, &Playback::showFirstVideoFrame, this, [this] {
             if (!cacheVideoFrame.isValid()) { cacheVideoFrame = m_demuxer->getPicture(); }
+            m_history.record(cacheVideoFrame);
             emit setPicture(cacheVideoFrame);
         });
         connect(this, &Playback::showFirstVideoFrame, this, [this] {
@@ -145,12 +407,21 @@ public:
         connect(m_affinityThread, &QThread::started, [this] {
             // 在 Playback 线程上初始化
             this->m_audioSink = new PonyAudioSink(AnytMusic::DEFAULT_AUDIO_FORMAT);
-            connect(m_audioSink, &PonyAudioSink::signalDeviceSwitched, this, [this] {
+            this->m_crossfade = new CrossfadeDeck;
+            this->m_audioDsp = new AudioDspStage(m_demuxer, m_audioSink, m_crossfade);
+            // 音频结束时唤醒等待下一帧画面的 Playback 线程
+            connect(m_audioDsp, &AudioDspStage::audioEnded, this, [this] {
+                std::lock_guard lock(m_interruptMutex);
+                m_interruptCond.notify_all();
+            }, Qt::DirectConnection);
+            // 设备切换在 Playback 线程上完成, 播放期间也需要立即通知
+            connect(m_audioSink, &PonyAudioSink::signalDeviceSwitched, this, [this](bool formatChanged) {
                 emit signalDeviceSwitched();
-                emit requestResynchronization(!this->m_audioSink->isBlock(), true);
-            }, Qt::QueuedConnection);
-            connect(this, &Playback::signalSetSelectedAudioOutputDevice, m_audioSink,
-                    &PonyAudioSink::requestDeviceSwitch);
+                // 格式不变时缓冲区中的音频可以继续播放, 不需要重新同步
+                if (formatChanged) {
+                    emit requestResynchronization(!this->m_audioSink->isBlock(), true);
+                }
+            }, Qt::DirectConnection);
             connect(m_audioSink, &PonyAudioSink::signalAudioOutputDeviceListChanged, this, [this] {
                 emit signalAudioOutputDevicesListChanged();
             });
@@ -163,6 +434,24 @@ public:
         return m_preferablePos;
     }
 
+    /**
+     * 采集当前的播放状况, 这个函数是线程安全的
+     */
+    PONY_THREAD_SAFE PlaybackMetrics getMetrics() {
+        PlaybackMetrics metrics;
+        metrics.presentation = m_presenter->stats();
+        metrics.skippedPictures = m_skippedPictures;
+        metrics.pictureQueue = m_demuxer->pictureQueueSize();
+        metrics.sampleQueue = m_demuxer->sampleQueueSize();
+        if (m_audioSink) {
+            metrics.audio = m_audioSink->telemetry();
+            metrics.ringFill = m_audioSink->ringFill();
+            metrics.ringSecs = m_audioSink->ringBufferSecs();
+        }
+        metrics.playing = m_isPlaying;
+        return metrics;
+    }
+
     PonyAudioFormat getDeviceFormat() {
         std::unique_lock lock(m_workMutex);
         return m_audioSink->getCurrentDeviceFormat();
@@ -190,20 +479,152 @@ public:
     }
 
     void setVolume(qreal volume) {
-        emit setAudioVolume(volume, QPrivateSignal());
+        post({Command::Volume, volume});
     }
 
 
     void setPitch(qreal pitch) {
-        emit setAudioPitch(pitch, QPrivateSignal());
+        post({Command::Pitch, pitch});
     }
 
     void setSpeed(qreal speed) {
-        emit setAudioSpeed(speed, QPrivateSignal());
+        post({Command::Speed, speed});
     }
 
     void setSelectedAudioOutputDevice(QString deviceName) {
-        emit signalSetSelectedAudioOutputDevice(std::move(deviceName));
+        post({Command::OutputDevice, 0.0, 0, 0, std::move(deviceName)});
+    }
+
+    /**
+     * 设置当前音频设备的延迟校正, 校正值会按设备保存
+     * @param offset 单位: 秒
+     */
+    void setLatencyOffset(qreal offset) {
+        post({Command::LatencyOffset, offset});
+    }
+
+    PONY_THREAD_SAFE qreal getLatencyOffset() {
+        return m_audioSink ? m_audioSink->latencyOffset() : 0.0;
+    }
+
+    /**
+     * 设置音频延迟档位, 档位会被保存
+     * @param profile AudioLatencyProfile 的值
+     */
+    void setLatencyProfile(int profile) {
+        post({Command::LatencyProfile, 0.0, profile});
+    }
+
+    PONY_THREAD_SAFE int getLatencyProfile() {
+        return static_cast<int>(m_audioSink ? m_audioSink->latencyProfile() : AudioLatencyConfig::loadProfile());
+    }
+
+    /**
+     * 设置变速引擎和质量档位, 设置会被保存
+     * @param engine TimeStretch::Engine 的值
+     * @param quality TimeStretch::Quality 的值
+     */
+    void setTimeStretch(int engine, int quality) {
+        // 在调用者的线程上保存, DSP 线程切换引擎时不写入配置文件
+        PonyAudioSink::saveTimeStretch(static_cast<TimeStretch::Engine>(engine),
+                                       static_cast<TimeStretch::Quality>(quality));
+        post({Command::TimeStretch, 0.0, engine, quality});
+    }
+
+    PONY_THREAD_SAFE int getTimeStretchEngine() {
+        return static_cast<int>(m_audioSink ? m_audioSink->timeStretchEngine() : TimeStretch::Engine::Sonic);
+    }
+
+    PONY_THREAD_SAFE int getTimeStretchQuality() {
+        return static_cast<int>(m_audioSink ? m_audioSink->timeStretchQuality() : TimeStretch::Quality::Balanced);
+    }
+
+    /**
+     * 修改均衡器设置, 设置会被保存. 还没有打开文件时只保存设置.
+     */
+    PONY_THREAD_SAFE void setEqualizer(const EqualizerSettings &settings) {
+        if (m_audioSink) {
+            m_audioSink->setEqualizer(settings);
+        } else {
+            PonyAudioSink::saveEqualizer(settings);
+        }
+    }
+
+    PONY_THREAD_SAFE EqualizerSettings getEqualizer() {
+        return m_audioSink ? m_audioSink->equalizer() : PonyAudioSink::loadEqualizer();
+    }
+
+    /**
+     * 修改声道混合设置, 设置会被保存. 输出的声道布局改变时重新同步.
+     */
+    PONY_THREAD_SAFE void setChannelMix(const ChannelMixSettings &settings) {
+        if (!m_audioSink) {
+            PonyAudioSink::saveChannelMix(settings);
+        } else if (m_audioSink->setChannelMix(settings)) {
+            emit requestResynchronization(!m_audioSink->isBlock(), true);
+        }
+    }
+
+    PONY_THREAD_SAFE ChannelMixSettings getChannelMix() {
+        return m_audioSink ? m_audioSink->channelMix() : PonyAudioSink::loadChannelMix();
+    }
+
+    /**
+     * 设置当前文件的 ReplayGain 信息, 切换文件时调用
+     */
+    PONY_THREAD_SAFE void setReplayGainInfo(const ReplayGainInfo &info) {
+        if (m_audioSink) { m_audioSink->setReplayGainInfo(info); }
+    }
+
+    /**
+     * 修改 ReplayGain 设置, 设置会被保存. 还没有打开文件时只保存设置.
+     */
+    PONY_THREAD_SAFE void setReplayGain(const ReplayGainSettings &settings) {
+        if (m_audioSink) {
+            m_audioSink->setReplayGain(settings);
+        } else {
+            PonyAudioSink::saveReplayGain(settings);
+        }
+    }
+
+    PONY_THREAD_SAFE ReplayGainSettings getReplayGain() {
+        return m_audioSink ? m_audioSink->replayGain() : PonyAudioSink::loadReplayGain();
+    }
+
+    /**
+     * 设置交叉淡化的时长, 设置会被保存
+     * @param secs 单位: 秒, 0 表示关闭
+     */
+    PONY_THREAD_SAFE void setCrossfade(qreal secs) {
+        if (m_crossfade) {
+            m_crossfade->setSecs(secs);
+        } else {
+            CrossfadeDeck::saveSecs(secs);
+        }
+    }
+
+    PONY_THREAD_SAFE qreal getCrossfade() {
+        return m_crossfade ? m_crossfade->secs() : CrossfadeDeck::loadSecs();
+    }
+
+    /**
+     * 设置播放列表中的下一个文件, 当前文件结束时与它交叉淡化
+     * @param path 本地文件路径, 为空时不淡化
+     */
+    PONY_THREAD_SAFE void setNextFile(const std::string &path) {
+        if (m_crossfade) { m_crossfade->setNextFile(path); }
+    }
+
+    /**
+     * 设置卷积的脉冲响应(WAV 文件), 在 Playback 线程上读取文件并计算频谱, 加载成功后保存路径
+     * @param path 文件路径, 为空时关闭卷积
+     */
+    void setImpulseResponse(const QString &path) {
+        post({Command::ImpulseResponse, 0.0, 0, 0, path});
+    }
+
+    PONY_THREAD_SAFE QString getImpulseResponse() {
+        return PonyAudioSink::savedImpulseResponse();
     }
 
     QString getSelectedAudioOutputDevice() {
@@ -218,6 +639,37 @@ public:
         emit clearCacheVideoFrame(QPrivateSignal());
     }
 
+    /**
+     * 逐帧步进并显示画面, 这个方法会阻塞直到画面被取出. 需要保证没有在播放.
+     * @param frames 步进的帧数, 负数表示向前
+     * @return 步进后画面的位置(单位: 秒)
+     */
+    qreal stepFrame(int frames) {
+        emit stepFramesRequested(frames, QPrivateSignal());
+        return m_preferablePos;
+    }
+
+    /**
+     * 设置 A-B 循环区间, 在下一次 stop(通常是随后的跳转)时生效. 这个函数是线程安全的.
+     * @param a 区间的开始(单位: 秒), 为 NaN 时取消循环
+     * @param b 区间的结束(单位: 秒)
+     */
+    PONY_THREAD_SAFE void setLoop(qreal a, qreal b) {
+        m_loopA = a;
+        m_loopB = b;
+    }
+
+    PONY_THREAD_SAFE qreal getLoopStart() { return m_loopA; }
+
+    PONY_THREAD_SAFE qreal getLoopEnd() { return m_loopB; }
+
+    /**
+     * 是否在上一次跳转之后逐帧步进过, 同时清除记录. 步进过时继续播放之前需要跳转到当前画面, 重新对齐音频.
+     */
+    PONY_THREAD_SAFE bool takeFrameStepped() {
+        return m_frameStepped.exchange(false);
+    }
+
     /**
      * 是否正在播放
      * @return 状态
@@ -261,6 +713,7 @@ public:
         m_isInterrupt = true;
         m_interruptCond.notify_all();
         cond_lock.unlock();
+        m_presenter->notify();
         std::unique_lock lock(m_workMutex);
     }
 
@@ -272,7 +725,18 @@ public:
         m_isInterrupt = true;
         m_interruptCond.notify_all();
         cond_lock.unlock();
+        m_presenter->notify();
         std::unique_lock lock(m_workMutex); // make sure stop
+        m_presenter->clear();
+        m_frameStepped = false;
+        if (m_audioDsp) {
+            // 淡化, 循环和时间基准的状态属于 DSP 线程, 确认它已经停下后才能在这里重置
+            m_audioDsp->park();
+            m_audioDsp->resetCrossfade();
+            m_audioDsp->resetLoop(m_loopA, m_loopB);
+            // 已经播放到淡化中点, 下一个文件已经接管
+            if (m_audioSink->takeClockRebased()) { emit trackAdvanced(); }
+        }
         emit stopWork(QPrivateSignal());
         emit setAudioStartPoint(0.0, QPrivateSignal());
         emit clearRingBuffer(QPrivateSignal());
@@ -292,25 +756,58 @@ private slots:
         std::unique_lock lock(m_workMutex, std::defer_lock);
         if (!lock.try_lock()) { return; } // not allow neat run
         changeState(true);
-        writeAudio(5);
+        applyCommands(std::numeric_limits<size_t>::max());
+        if (m_audioResumePending) { resumeAudio(); }
+        m_audioDsp->prime(5);
         m_audioSink->start();
+        m_audioDsp->start();
+        const bool hasVideo = m_demuxer->hasVideo();
+        if (hasVideo) { m_presenter->setActive(true); }
+        m_loopTiming.reset();
         while (!m_isInterrupt) {
-            VideoFrameRef pic = getVideoFrame();
-            if (!pic.isValid()) {
+            if (m_audioDsp->isAudioEnded()) {
                 m_audioSink->waitComplete();
                 emit resourcesEnd();
                 break;
             }
-//            m_videoPos = pic.getPTS();
-            emit setPicture(pic);
-            if (!writeAudio(static_cast<int>(10 * m_audioSink->speed()))) {
+            VideoFrameRef pic = nextPicture();
+            if (m_loopRestart || (m_audioDsp->isLoopEnded() && m_preferablePos >= m_loopB - LoopAudioCache::EDGE_SECS)) {
+                restartLoop();
+                break;
+            }
+            if (m_loopWrapped) { waitLoopSplice(); }
+            if (!pic.isValid()) {
+                // 只播放完已经写入的音频
+                m_audioDsp->park();
                 m_audioSink->waitComplete();
                 emit resourcesEnd();
                 break;
             }
-            QCoreApplication::processEvents(); // process setVolume setSpeed etc
-            syncTo(pic.getPTS());
+            auto workBegin = PlaybackLoopTiming::Clock::now();
+            if (!hasVideo) { emit setPicture(pic); }
+            m_audioDsp->setVideoPos(pic.getPTS());
+            // 两帧之间唯一处理外部请求的位置, 耗时有上限
+            size_t commands = applyCommands(MAX_COMMANDS_PER_FRAME);
+            m_audioSink->serviceEvents();
+            if (m_audioResumePending) {
+                resumeAudio();
+                m_audioDsp->start();
+            }
+            m_loopTiming.record(workBegin, PlaybackLoopTiming::Clock::now(), commands);
+            if (hasVideo) {
+                present(std::move(pic));
+            } else {
+                syncTo();
+            }
+            if (m_audioSink->takeClockRebased()) { emit trackAdvanced(); }
         }
+        if (hasVideo) {
+            m_presenter->setActive(false);
+            // 还没有显示的画面留在游标之后, 向后步进时先显示它们
+            m_history.locate(m_presenter->currentPts());
+        }
+        m_loopTiming.report();
+        m_audioDsp->park();
         m_audioSink->pause();
         changeState(false);
         lock.unlock();
@@ -328,13 +825,10 @@ signals:
 
     void setAudioStartPoint(qreal startPoint, QPrivateSignal);
 
-    void setAudioVolume(qreal volume, QPrivateSignal);
-
-    void setAudioPitch(qreal pitch, QPrivateSignal);
-
-    void setAudioSpeed(qreal speed, QPrivateSignal);
-
-    void signalSetSelectedAudioOutputDevice(QString);
+    /**
+     * 有新的命令, 空闲时在 Playback 线程上处理
+     */
+    void commandsPosted(QPrivateSignal);
 
     void signalDeviceSwitched();
 
@@ -342,12 +836,24 @@ signals:
 
     void clearCacheVideoFrame(QPrivateSignal);
 
+    void stepFramesRequested(int frames, QPrivateSignal);
+
+    /**
+     * 没有缓存的 A-B 循环播放到了 B, 需要跳转回 A
+     */
+    void requestLoopRestart();
+
     void setPicture(VideoFrameRef pic);
 
     void stateChanged(bool isPlaying);
 
     void resourcesEnd();
 
+    /**
+     * 交叉淡化已经播放到中点, 开始播放下一个文件. 时间已经切换到下一个文件.
+     */
+    void trackAdvanced();
+
     void signalAudioOutputDevicesListChanged();
 
     /**
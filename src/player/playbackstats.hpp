@@ -0,0 +1,163 @@
+#pragma once
+
+#include <QObject>
+#include <QDebug>
+#include <QString>
+#include <QTimer>
+#include <functional>
+#include <utility>
+#include "audiosink.hpp"
+#include "vsyncscheduler.hpp"
+
+/**
+ * @brief 某一时刻的播放状况, 计数都是累计值.
+ */
+struct PlaybackMetrics {
+    PresentationStats presentation;
+    uint64_t skippedPictures = 0; ///< 高倍速时没有送到 VsyncScheduler 就被跳过的画面数
+    size_t pictureQueue = 0;      ///< 解码队列中的画面数
+    size_t sampleQueue = 0;       ///< 解码队列中的音频帧数
+    AudioTelemetrySnapshot audio;
+    double ringFill = 0.0;        ///< DataBuffer 相对于允许写入长度的填充程度
+    double ringSecs = 0.0;        ///< DataBuffer 在 1x 速度下允许写入的长度(单位: 秒)
+    bool playing = false;
+};
+
+/**
+ * @brief 暴露给 QML 的播放统计.
+ *
+ * 在 GUI 线程上定时采集 PlaybackMetrics, 丢弃和重复的画面, 欠载等计数从上一次 reset (打开文件)开始累计.
+ * 播放期间定期把摘要写入日志, 音画偏差明显时输出警告, 用户的日志和截图都可以反映播放的情况.
+ */
+class PlaybackStats : public QObject {
+    Q_OBJECT
+    Q_PROPERTY(bool playing READ isPlaying NOTIFY updated)
+    Q_PROPERTY(qreal refreshRate READ getRefreshRate NOTIFY updated)
+    Q_PROPERTY(qreal driftP50 READ getDriftP50 NOTIFY updated)
+    Q_PROPERTY(qreal driftP95 READ getDriftP95 NOTIFY updated)
+    Q_PROPERTY(qreal driftP99 READ getDriftP99 NOTIFY updated)
+    Q_PROPERTY(qreal judder READ getJudder NOTIFY updated)
+    Q_PROPERTY(qulonglong presentedFrames READ getPresentedFrames NOTIFY updated)
+    Q_PROPERTY(qulonglong droppedFrames READ getDroppedFrames NOTIFY updated)
+    Q_PROPERTY(qulonglong repeatedFrames READ getRepeatedFrames NOTIFY updated)
+    Q_PROPERTY(int pictureQueue READ getPictureQueue NOTIFY updated)
+    Q_PROPERTY(int sampleQueue READ getSampleQueue NOTIFY updated)
+    Q_PROPERTY(qreal ringFill READ getRingFill NOTIFY updated)
+    Q_PROPERTY(qreal ringSecs READ getRingSecs NOTIFY updated)
+    Q_PROPERTY(qulonglong underruns READ getUnderruns NOTIFY updated)
+    Q_PROPERTY(qulonglong partialFills READ getPartialFills NOTIFY updated)
+    Q_PROPERTY(QString summary READ getSummary NOTIFY updated)
+public:
+    constexpr static int REFRESH_INTERVAL_MS = 500;
+    /**
+     * 播放期间每隔这么多次刷新输出一次摘要
+     */
+    constexpr static int LOG_EVERY_REFRESHES = 20;
+    /**
+     * 音画偏差的 p95 超过这个值(单位: 毫秒)时输出警告, 声音超前约 45 ms 开始可以察觉
+     */
+    constexpr static double DRIFT_WARNING_MS = 45.0;
+
+private:
+    std::function<PlaybackMetrics()> m_source;
+    QTimer *m_timer;
+    PlaybackMetrics m_baseline;
+    PlaybackMetrics m_current;
+    int m_refreshes = 0;
+
+    void refresh() {
+        m_current = m_source();
+        if (m_current.playing && ++m_refreshes % LOG_EVERY_REFRESHES == 0) {
+            if (getPresentedFrames() > 0 && getDriftP95() > DRIFT_WARNING_MS) {
+                qWarning() << "Playback out of sync:" << getSummary();
+            } else {
+                qDebug() << "Playback stats:" << getSummary();
+            }
+        }
+        emit updated();
+    }
+
+public:
+    /**
+     * @param source 采集播放状况, 在 GUI 线程上调用, 需要是线程安全的
+     */
+    explicit PlaybackStats(std::function<PlaybackMetrics()> source, QObject *parent = nullptr)
+            : QObject(parent), m_source(std::move(source)) {
+        m_timer = new QTimer(this);
+        m_timer->setInterval(REFRESH_INTERVAL_MS);
+        connect(m_timer, &QTimer::timeout, this, &PlaybackStats::refresh);
+        m_timer->start();
+    }
+
+    /**
+     * 从此刻开始重新累计计数, 打开新文件时调用
+     */
+    void reset() {
+        m_baseline = m_source();
+        m_current = m_baseline;
+        m_refreshes = 0;
+        emit updated();
+    }
+
+    [[nodiscard]] bool isPlaying() const { return m_current.playing; }
+
+    [[nodiscard]] qreal getRefreshRate() const { return m_current.presentation.refreshRate; }
+
+    [[nodiscard]] qreal getDriftP50() const { return m_current.presentation.driftP50Ms; }
+
+    [[nodiscard]] qreal getDriftP95() const { return m_current.presentation.driftP95Ms; }
+
+    [[nodiscard]] qreal getDriftP99() const { return m_current.presentation.driftP99Ms; }
+
+    [[nodiscard]] qreal getJudder() const { return m_current.presentation.judderMs; }
+
+    [[nodiscard]] qulonglong getPresentedFrames() const {
+        return m_current.presentation.presented - m_baseline.presentation.presented;
+    }
+
+    /**
+     * 包括 VsyncScheduler 丢弃的画面和高倍速时直接跳过的画面
+     */
+    [[nodiscard]] qulonglong getDroppedFrames() const {
+        return m_current.presentation.dropped - m_baseline.presentation.dropped
+               + m_current.skippedPictures - m_baseline.skippedPictures;
+    }
+
+    [[nodiscard]] qulonglong getRepeatedFrames() const {
+        return m_current.presentation.repeated - m_baseline.presentation.repeated;
+    }
+
+    [[nodiscard]] int getPictureQueue() const { return static_cast<int>(m_current.pictureQueue); }
+
+    [[nodiscard]] int getSampleQueue() const { return static_cast<int>(m_current.sampleQueue); }
+
+    [[nodiscard]] qreal getRingFill() const { return m_current.ringFill; }
+
+    [[nodiscard]] qreal getRingSecs() const { return m_current.ringSecs; }
+
+    [[nodiscard]] qulonglong getUnderruns() const {
+        return m_current.audio.underruns - m_baseline.audio.underruns;
+    }
+
+    [[nodiscard]] qulonglong getPartialFills() const {
+        return m_current.audio.partialFills - m_baseline.audio.partialFills;
+    }
+
+    /**
+     * 一行摘要, 用于日志
+     */
+    [[nodiscard]] QString getSummary() const {
+        return QStringLiteral("drift p50/p95/p99 %1/%2/%3 ms, judder %4 ms, %5 Hz, presented %6, dropped %7, "
+                              "repeated %8, queue video %9 audio %10, ring %11% of %12 s, underruns %13, partial %14")
+                .arg(getDriftP50(), 0, 'f', 1).arg(getDriftP95(), 0, 'f', 1).arg(getDriftP99(), 0, 'f', 1)
+                .arg(getJudder(), 0, 'f', 1).arg(getRefreshRate(), 0, 'f', 1)
+                .arg(getPresentedFrames()).arg(getDroppedFrames()).arg(getRepeatedFrames())
+                .arg(getPictureQueue()).arg(getSampleQueue())
+                .arg(getRingFill() * 100, 0, 'f', 0).arg(getRingSecs(), 0, 'f', 2)
+                .arg(getUnderruns()).arg(getPartialFills());
+    }
+
+signals:
+
+    void updated();
+};
@@ -7,5 +7,7 @@
 
 void registerPlayerQML() {
     qmlRegisterType<Hurricane>("HurricanePlayer", 1, 0, "HurricanePlayer");
+    qmlRegisterUncreatableType<PlaybackStats>("HurricanePlayer", 1, 0, "PlaybackStats",
+                                              "PlaybackStats is provided by HurricanePlayer.stats");
     qmlRegisterType<Thumbnail>("Thumbnail", 1, 0, "Thumbnail");
 }
\ No newline at end of file
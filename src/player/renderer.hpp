@@ -25,6 +25,7 @@
 #include <utility>
 #include "updatevalue.hpp"
 #include "frame.hpp"
+#include "vsyncscheduler.hpp"
 
 const static void* ZERO_OFFSET = nullptr;
 const static GLfloat VERTEX_POS[] = {
@@ -98,6 +99,7 @@ private:
 
     PONY_GUARD_BY(MAIN)   RenderSettings mainSettings;
     PONY_GUARD_BY(RENDER) RenderSettings renderSettings;
+    std::shared_ptr<VsyncScheduler> m_scheduler; // 在窗口创建之前设置, 之后只读
 
     void inline createTextureBuffer(GLuint *texture) {
         QOpenGLFunctions_3_3_Core::glGenTextures(1, texture);
@@ -171,6 +173,17 @@ public  slots:
     };
 
     void sync() {
+        // GUI 线程此时被阻塞, 可以修改 mainSettings
+        if (m_scheduler) {
+            if (auto frame = m_scheduler->present(VsyncClock::now())) {
+                const VideoFrameRef &previous = mainSettings.videoFrame;
+                if (frame->isValid() && !frame->isSameSize(previous)) {
+                    emit presentedSizeChanged(frame->getWidth(), frame->getHeight());
+                }
+                mainSettings.videoFrame = *frame;
+                markDirty(QSGNode::DirtyMaterial);
+            }
+        }
         renderSettings.updateBy(mainSettings);
     }
 public:
@@ -306,5 +319,10 @@ public:
         qDebug() << "Deconstruct Hurricane Renderer:" << static_cast<void *>(this) << ".";
     }
 
+signals:
+    /**
+     * VsyncScheduler 选择的画面尺寸发生改变, 在渲染线程上发出
+     */
+    void presentedSizeChanged(int width, int height);
 
 };
\ No newline at end of file
@@ -0,0 +1,361 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include "frame.hpp"
+
+/**
+ * @brief 根据窗口交换缓冲区的时刻预测垂直同步.
+ *
+ * 窗口每次交换缓冲区时调用 onVsync 记录时刻. 相邻两次交换可能跨过若干个刷新周期(场景没有变化或者渲染太慢),
+ * 按最接近的整数倍折算后平滑地更新周期, 相位向观测值收敛, 从而滤掉交换时刻的抖动. 时间单位与 steady_clock 相同.
+ * 这个类不是线程安全的.
+ */
+class VsyncClock {
+private:
+    constexpr static double PERIOD_GAIN = 0.05;
+    constexpr static double PHASE_GAIN = 0.2;
+    /**
+     * 超过这么多个周期没有交换时, 认为窗口曾经停止渲染, 重新确定相位
+     */
+    constexpr static double MAX_SKIP_PERIODS = 8.0;
+
+    double m_nominal = 1.0 / 60.0;
+    double m_interval = 1.0 / 60.0;
+    double m_phase = std::numeric_limits<double>::quiet_NaN();
+
+public:
+    static double now() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * 设置屏幕报告的刷新率, 作为周期的初始值和允许的范围
+     * @param hz 单位: Hz, 不合理的值会被忽略
+     */
+    void setNominalRate(double hz) {
+        if (!(hz >= 20.0 && hz <= 500.0)) { return; }
+        m_nominal = 1.0 / hz;
+        m_interval = m_nominal;
+    }
+
+    /**
+     * 记录一次交换缓冲区
+     * @param t 交换完成的时刻(单位: 秒)
+     */
+    void onVsync(double t) {
+        if (std::isnan(m_phase) || t - m_phase > MAX_SKIP_PERIODS * m_interval) {
+            m_phase = t;
+            return;
+        }
+        const double elapsed = t - m_phase;
+        const double periods = std::max(1.0, std::round(elapsed / m_interval));
+        const double measured = elapsed / periods;
+        if (std::abs(measured - m_interval) < 0.25 * m_interval) {
+            m_interval = std::clamp(m_interval + PERIOD_GAIN * (measured - m_interval), 0.5 * m_nominal, 2.0 * m_nominal);
+        }
+        const double predicted = m_phase + periods * m_interval;
+        m_phase = predicted + PHASE_GAIN * (t - predicted);
+    }
+
+    [[nodiscard]] double interval() const { return m_interval; }
+
+    /**
+     * 预测 now 之后的下一次垂直同步
+     */
+    [[nodiscard]] double next(double now) const {
+        if (std::isnan(m_phase)) { return now + m_interval; }
+        return m_phase + std::max(1.0, std::ceil((now - m_phase) / m_interval)) * m_interval;
+    }
+};
+
+/**
+ * @brief 画面呈现的统计.
+ */
+struct PresentationStats {
+    double refreshRate = 0.0; ///< 估计的刷新率(单位: Hz)
+    uint64_t presented = 0;   ///< 显示的画面数
+    uint64_t dropped = 0;     ///< 没有显示就被丢弃的画面数
+    uint64_t repeated = 0;    ///< 下一帧已经到期却还没有送达, 只能继续显示当前画面的垂直同步次数
+    double judderMs = 0.0;    ///< 每帧实际显示时长与 PTS 间隔之差的均方根(单位: 毫秒)
+    double lateMs = 0.0;      ///< 画面显示时刻晚于它的 PTS 的平均值(单位: 毫秒)
+    /**
+     * 最近显示的画面中, 显示时刻与 PTS 之差(音画偏差)绝对值的分位数(单位: 毫秒). 画面只能在垂直同步时显示,
+     * 正常播放时偏差也有半个刷新周期左右. 还没有显示画面时为 0.
+     */
+    double driftP50Ms = 0.0;
+    double driftP95Ms = 0.0;
+    double driftP99Ms = 0.0;
+};
+
+/**
+ * @brief 按垂直同步选择显示的画面.
+ *
+ * Playback 线程把解码的画面放入一个很短的队列, 并发布媒体时钟(音频时钟, 或者没有音频时的视频时钟). 渲染线程在
+ * 每次同步场景时预测这一帧显示的垂直同步, 换算出那一刻的媒体时间, 选择最后一个到期的画面: 更早的画面被丢弃,
+ * 没有新画面到期时继续显示当前画面. 因此画面的显示时刻总是对齐到最接近它 PTS 的垂直同步, 24 fps 在 60 Hz 屏幕上
+ * 呈现稳定的 3:2 节奏, 而不取决于信号何时跨越线程.
+ *
+ * 播放期间窗口在每次交换缓冲区后请求下一帧. 窗口不再渲染(例如被最小化)时, Playback 线程自己丢弃过期的画面,
+ * 解码不会因为队列已满而停止.
+ */
+class VsyncScheduler {
+public:
+    /**
+     * 队列中最多的画面数
+     */
+    constexpr static size_t QUEUE_CAPACITY = 4;
+    /**
+     * 超过这个时间(单位: 秒)没有交换缓冲区时, 认为窗口没有在渲染
+     */
+    constexpr static double STALL_SECS = 0.25;
+
+private:
+    constexpr static double STATS_GAIN = 0.05;
+    /**
+     * 相邻画面 PTS 之差超过这个值(单位: 秒)时不计入抖动, 通常是跳转或者文件的间断
+     */
+    constexpr static double MAX_FRAME_SECS = 0.5;
+    /**
+     * 计算音画偏差分位数时使用最近的画面数
+     */
+    constexpr static size_t DRIFT_WINDOW = 256;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_spaceCond;
+    VsyncClock m_vsync;
+    double m_lastSwap = -std::numeric_limits<double>::infinity();
+    std::deque<VideoFrameRef> m_queue;
+    bool m_active = false;
+    std::function<void()> m_wakeup;
+
+    // 媒体时钟: 时刻 t 的媒体时间为 m_clockPos + (t - m_clockTime) * m_clockRate, 倒放时 m_clockRate 为负
+    bool m_hasClock = false;
+    double m_clockPos = 0.0;
+    double m_clockTime = 0.0;
+    double m_clockRate = 1.0;
+
+    VideoFrameRef m_current;
+    double m_currentVsync = 0.0;
+    double m_frameSecs = 0.0; // 最近相邻两帧的 PTS 间隔
+    std::atomic<double> m_currentPts = std::numeric_limits<double>::quiet_NaN();
+
+    PresentationStats m_stats;
+    double m_judderSq = 0.0;
+    std::array<double, DRIFT_WINDOW> m_drift{};
+    size_t m_driftCount = 0; // 写入 m_drift 的总数
+
+    [[nodiscard]] double mediaTimeLocked(double t) const {
+        return m_clockPos + (t - m_clockTime) * m_clockRate;
+    }
+
+    [[nodiscard]] double direction() const { return m_clockRate < 0 ? -1.0 : 1.0; }
+
+    [[nodiscard]] bool stalledLocked(double now) const { return now - m_lastSwap > STALL_SECS; }
+
+    /**
+     * 丢弃之后的画面也已经到期的画面, 至少保留一个
+     */
+    void dropLateLocked(double now) {
+        if (!m_hasClock) { return; }
+        const double target = direction() * mediaTimeLocked(now);
+        size_t late = 0;
+        while (late + 1 < m_queue.size() && direction() * m_queue[late + 1].getPTS() <= target) { ++late; }
+        m_queue.erase(m_queue.begin(), m_queue.begin() + static_cast<std::ptrdiff_t>(late));
+        m_stats.dropped += late;
+    }
+
+public:
+    /**
+     * 设置屏幕的刷新率. 这个函数是线程安全的.
+     */
+    PONY_THREAD_SAFE void setNominalRate(double hz) {
+        std::lock_guard lock(m_mutex);
+        m_vsync.setNominalRate(hz);
+    }
+
+    /**
+     * 设置唤醒窗口渲染的回调, 开始播放时在 Playback 线程上调用. 这个函数是线程安全的.
+     */
+    PONY_THREAD_SAFE void setWakeup(std::function<void()> wakeup) {
+        std::lock_guard lock(m_mutex);
+        m_wakeup = std::move(wakeup);
+    }
+
+    /**
+     * 窗口交换缓冲区后调用
+     * @param now 当前时刻(单位: 秒)
+     * @return 是否需要继续渲染下一帧
+     */
+    PONY_GUARD_BY(RENDER) bool onVsync(double now) {
+        std::lock_guard lock(m_mutex);
+        m_vsync.onVsync(now);
+        m_lastSwap = now;
+        return m_active;
+    }
+
+    /**
+     * 开始或者停止呈现. 停止后保留队列中的画面, 继续播放时先显示它们.
+     */
+    PONY_GUARD_BY(PLAYBACK) void setActive(bool active) {
+        std::function<void()> wakeup;
+        {
+            std::lock_guard lock(m_mutex);
+            m_active = active;
+            // 暂停期间时间继续流逝, 视频时钟需要重新计时
+            if (!active) { m_hasClock = false; }
+            if (active) { wakeup = m_wakeup; }
+        }
+        m_spaceCond.notify_all();
+        if (wakeup) { wakeup(); }
+    }
+
+    /**
+     * 以音频时钟作为媒体时钟
+     * @param pos 此刻的媒体时间(单位: 秒)
+     * @param rate 媒体时间流逝的速度, 倒放时为负
+     */
+    PONY_GUARD_BY(PLAYBACK) void setClock(double pos, double rate) {
+        std::lock_guard lock(m_mutex);
+        m_clockPos = pos;
+        m_clockTime = VsyncClock::now();
+        m_clockRate = rate;
+        m_hasClock = true;
+    }
+
+    /**
+     * 没有音频时以视频时钟作为媒体时钟: 还没有时钟时从队首的画面(没有时为 pos)开始计时, 之后只在速度改变时
+     * 从当前的媒体时间重新计时, 画面按照 PTS 的间隔显示.
+     */
+    PONY_GUARD_BY(PLAYBACK) void retimeClock(double pos, double rate) {
+        std::lock_guard lock(m_mutex);
+        const double now = VsyncClock::now();
+        if (m_hasClock && rate == m_clockRate) { return; }
+        m_clockPos = m_hasClock ? mediaTimeLocked(now) : m_queue.empty() ? pos : m_queue.front().getPTS();
+        m_clockTime = now;
+        m_clockRate = rate;
+        m_hasClock = true;
+    }
+
+    /**
+     * 把画面放入队列, 队列已满时阻塞直到有画面被显示或者丢弃
+     * @param frame 画面, 成功时被移动
+     * @param interrupt 为 true 时放弃等待
+     * @return 是否放入队列, 被打断时返回 false
+     */
+    PONY_GUARD_BY(PLAYBACK) bool push(VideoFrameRef &frame, const std::atomic<bool> &interrupt) {
+        std::unique_lock lock(m_mutex);
+        while (m_queue.size() >= QUEUE_CAPACITY) {
+            if (interrupt) { return false; }
+            const double now = VsyncClock::now();
+            if (stalledLocked(now)) {
+                dropLateLocked(now);
+                if (m_queue.size() < QUEUE_CAPACITY) { break; }
+            }
+            m_spaceCond.wait_for(lock, std::chrono::duration<double>(m_vsync.interval()));
+        }
+        m_queue.push_back(std::move(frame));
+        return true;
+    }
+
+    /**
+     * 唤醒在 push 中等待的线程, 用于尽快响应打断
+     */
+    PONY_THREAD_SAFE void notify() {
+        std::lock_guard lock(m_mutex);
+        m_spaceCond.notify_all();
+    }
+
+    /**
+     * 丢弃队列中的画面, 媒体时钟和音画偏差的记录, 跳转或者停止时调用
+     */
+    PONY_THREAD_SAFE void clear() {
+        std::lock_guard lock(m_mutex);
+        m_queue.clear();
+        m_hasClock = false;
+        m_current = {};
+        m_currentPts = std::numeric_limits<double>::quiet_NaN();
+        // 跳转后的偏差与之前无关
+        m_driftCount = 0;
+        m_spaceCond.notify_all();
+    }
+
+    /**
+     * 选择下一次垂直同步显示的画面, 在场景同步阶段调用
+     * @param now 当前时刻(单位: 秒)
+     * @return 需要显示的新画面, 继续显示当前画面时返回空
+     */
+    PONY_GUARD_BY(RENDER) std::optional<VideoFrameRef> present(double now) {
+        std::lock_guard lock(m_mutex);
+        if (!m_active || !m_hasClock) { return std::nullopt; }
+        const double vsync = m_vsync.next(now);
+        const double speed = std::abs(m_clockRate);
+        // 画面到期的判断提前半个周期, 使画面显示在最接近它 PTS 的垂直同步
+        const double media = direction() * mediaTimeLocked(vsync);
+        const double target = media + 0.5 * m_vsync.interval() * speed;
+        size_t due = 0;
+        while (due < m_queue.size() && direction() * m_queue[due].getPTS() <= target) { ++due; }
+        if (due == 0) {
+            if (m_queue.empty() && m_current.isValid() && m_frameSecs > 0
+                && direction() * m_current.getPTS() + m_frameSecs <= target) {
+                ++m_stats.repeated;
+            }
+            return std::nullopt;
+        }
+        VideoFrameRef frame = m_queue[due - 1];
+        m_queue.erase(m_queue.begin(), m_queue.begin() + static_cast<std::ptrdiff_t>(due));
+        m_spaceCond.notify_all();
+        m_stats.dropped += due - 1;
+        if (m_current.isValid()) {
+            const double step = std::abs(frame.getPTS() - m_current.getPTS());
+            if (step > 0 && step < MAX_FRAME_SECS) {
+                m_frameSecs = step;
+                if (due == 1 && speed > 0) {
+                    const double error = (vsync - m_currentVsync) - step / speed;
+                    m_judderSq += STATS_GAIN * (error * error - m_judderSq);
+                }
+            }
+        }
+        if (speed > 0) {
+            const double late = (media - direction() * frame.getPTS()) / speed;
+            m_stats.lateMs += STATS_GAIN * (late * 1000.0 - m_stats.lateMs);
+            m_drift[m_driftCount++ % DRIFT_WINDOW] = std::abs(late) * 1000.0;
+        }
+        ++m_stats.presented;
+        m_current = frame;
+        m_currentVsync = vsync;
+        m_currentPts = frame.getPTS();
+        return frame;
+    }
+
+    /**
+     * 正在显示的画面的 PTS, 还没有显示时返回 NaN. 这个函数是线程安全的.
+     */
+    PONY_THREAD_SAFE double currentPts() const { return m_currentPts; }
+
+    PONY_THREAD_SAFE PresentationStats stats() const {
+        std::lock_guard lock(m_mutex);
+        PresentationStats stats = m_stats;
+        stats.refreshRate = 1.0 / m_vsync.interval();
+        stats.judderMs = std::sqrt(m_judderSq) * 1000.0;
+        const size_t n = std::min(m_driftCount, DRIFT_WINDOW);
+        if (n > 0) {
+            std::array<double, DRIFT_WINDOW> sorted = m_drift;
+            std::sort(sorted.begin(), sorted.begin() + static_cast<std::ptrdiff_t>(n));
+            auto quantile = [&sorted, n](double q) { return sorted[static_cast<size_t>(q * static_cast<double>(n - 1))]; };
+            stats.driftP50Ms = quantile(0.5);
+            stats.driftP95Ms = quantile(0.95);
+            stats.driftP99Ms = quantile(0.99);
+        }
+        return stats;
+    }
+};
@@ -18,6 +18,7 @@ Controller::Controller(QObject *parent) : QObject(parent)
     connect(this, SIGNAL(extractRequirement()), listOPer, SLOT(extractAndProcess()));
     connect(this, SIGNAL(removeRequirement(QString)), listOPer, SLOT(remove(QString)));
     connect(this, SIGNAL(getInfoRequirement(QString)), listOPer, SLOT(getInfo(QString)));
+    connect(this, SIGNAL(scanLoudnessRequirement()), listOPer, SLOT(scanLoudness()));
 
     // 该线程结束时销毁
     connect(&listOPThread, &QThread::finished, listOPer, &QObject::deleteLater);
@@ -28,8 +29,12 @@ Controller::Controller(QObject *parent) : QObject(parent)
     connect(listOPer, SIGNAL(searchDone(PlayListItem*)), this, SLOT(getSearchRst(PlayListItem*)));
     connect(listOPer, SIGNAL(extractDone(QList<simpleListItem*>)), this, SLOT(getExtractRst(QList<simpleListItem*>)));
     connect(listOPer, SIGNAL(getInfoDone(PlayListItem*)), this, SLOT(getInfoRst(PlayListItem*)));
+    connect(listOPer, SIGNAL(replayGainUpdated(QString,QVariantMap)), this, SLOT(getReplayGainRst(QString,QVariantMap)));
+    connect(listOPer, SIGNAL(scanProgress(int,int)), this, SLOT(getScanProgress(int,int)));
     //启动线程
     listOPThread.start();
+    // 读取已有的响度分析结果, 并继续上次没有完成的分析
+    emit scanLoudnessRequirement();
     //发射信号，开始执行
     qDebug()<<"-------------- MediaLib Thread Start! ID:"<<QThread::currentThreadId()<<"--------------\n";
 }
@@ -146,4 +151,16 @@ QVariantMap Controller::getListItemInfo() {
     res["音频采样率"] = QVariant::fromValue(QString::number(playListItemResult->getSampleRate()));
     res["音频流大小"] = QVariant::fromValue(QString::number(playListItemResult->getAudioSize()));
     return res;
-}
\ No newline at end of file
+}
+
+/*
+ * 获取文件的 ReplayGain 信息
+ */
+QVariantMap Controller::getReplayGain(QString filePath) {
+    auto it = replayGains.constFind(filePath);
+    if (it != replayGains.constEnd())
+        return it.value();
+    QVariantMap res;
+    res["scanned"] = false;
+    return res;
+}
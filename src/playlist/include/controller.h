@@ -14,11 +14,16 @@
 class Controller : public QObject {
 Q_OBJECT
     Q_PROPERTY(QVariantList recentFiles READ getRecentFiles NOTIFY recentFilesChanged)
+    Q_PROPERTY(int loudnessScanDone READ getLoudnessScanDone NOTIFY loudnessScanProgress)
+    Q_PROPERTY(int loudnessScanTotal READ getLoudnessScanTotal NOTIFY loudnessScanProgress)
     QThread listOPThread;
 
 private:
     QList<simpleListItem *> result;
     PlayListItem *playListItemResult;
+    QHash<QString, QVariantMap> replayGains;  // 文件路径 -> 响度分析结果
+    int loudnessScanDone = 0;
+    int loudnessScanTotal = 0;
 
 public:
     explicit Controller(QObject *parent = nullptr);
@@ -35,6 +40,13 @@ public:
 
     Q_INVOKABLE QVariantMap getListItemInfo();
 
+    // 获取文件的 ReplayGain 信息, 未分析完毕时 scanned 为 false
+    Q_INVOKABLE QVariantMap getReplayGain(QString filePath);
+
+    int getLoudnessScanDone() const { return loudnessScanDone; }
+
+    int getLoudnessScanTotal() const { return loudnessScanTotal; }
+
 public slots:
 
     void getInsertRst(int resultCode) {
@@ -94,6 +106,17 @@ public slots:
         return iconPath;
     }
 
+    void getReplayGainRst(QString path, QVariantMap info) {
+        replayGains[path] = info;
+        emit replayGainChanged(path);
+    }
+
+    void getScanProgress(int done, int total) {
+        loudnessScanDone = done;
+        loudnessScanTotal = total;
+        emit loudnessScanProgress();
+    }
+
     void sendExtractRequirement() { emit extractRequirement(); }
 
     void sendRemoveRequirement(QString filepath, QString iconPath) { emit removeRequirement(filepath); }
@@ -120,6 +143,12 @@ signals:
     void finishGetInfo();  // 向 qml 发送查找完毕的信号
 
     void recentFilesChanged();
+
+    void scanLoudnessRequirement();  // 向 PlayList 发送的响度分析请求
+
+    void replayGainChanged(QString path);  // 向 qml 发送某个文件的响度分析结果已更新的信号
+
+    void loudnessScanProgress();
 };
 
 #endif //PONYPLAYER_CONTROLLER_H
\ No newline at end of file
@@ -19,6 +19,8 @@ public:
 
     void createTableFrom(const QString &className, const QString &tableName);
 
+    void migrateTable(const QString &className, const QString &tableName);
+
     static QString qTypeToDDL(const QString &qType);
 
     void insert(const QString &tableName, const QObject *object);
@@ -27,6 +29,8 @@ public:
 
     void removeByKV(const QString &tableName, const QString &key, const QString &value);
 
+    void updateByKV(const QString &tableName, const QString &key, const QString &value, const QVariantMap &fields);
+
     template<typename T>
     T* search(const QString &tableName, const QString &className, const QString &key, const QString &value);
 
@@ -72,6 +76,8 @@ public:
 
     void remove(const QString& key,const QString& value);
 
+    void update(const QString& key, const QString& value, const QVariantMap& fields);
+
     T* extractInfo(QString key,QString value);
 
     QList<T*> extract();
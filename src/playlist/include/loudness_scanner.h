@@ -0,0 +1,69 @@
+#ifndef PONYPLAYER_LOUDNESS_SCANNER_H
+#define PONYPLAYER_LOUDNESS_SCANNER_H
+
+#include <QObject>
+#include <QThreadPool>
+#include <QSet>
+#include <atomic>
+
+/**
+ * 单个文件的响度分析结果
+ */
+struct LoudnessResult {
+    bool ok = false;
+    double loudness = 0.0;  ///< 积分响度(单位: LUFS)
+    double peak = 0.0;      ///< 真峰值(线性)
+    int blocks = 0;         ///< 400ms 块的数量, 计算专辑响度时按它加权
+};
+
+/**
+ * @brief 在后台线程池中解码音频并测量 EBU R128 响度.
+ *
+ * 每个文件作为一个任务提交到独立的线程池, 线程数比 CPU 核数少一个, 避免和播放抢占. 任务完成时在工作线程发出
+ * trackScanned 信号, 接收者应使用 QueuedConnection, 并在处理结果后调用 finish. scan 和 finish 只能在同一线程中调用,
+ * 进度的计数和 progress 信号都在这个线程上. 析构时取消未开始的任务, 并等待正在解码的任务退出.
+ */
+class LoudnessScanner : public QObject {
+    Q_OBJECT
+private:
+    QThreadPool m_pool;
+    QSet<QString> m_pending;
+    int m_done = 0;
+    int m_total = 0;
+    std::atomic<bool> m_cancelled = false;
+
+public:
+    explicit LoudnessScanner(QObject *parent = nullptr);
+
+    ~LoudnessScanner() override;
+
+    /**
+     * 解码整个文件并测量响度, 会阻塞直到文件解码完毕或被取消
+     * @param path 文件的 URL
+     * @param cancelled 置为 true 时提前返回失败
+     */
+    static LoudnessResult measure(const QString &path, const std::atomic<bool> &cancelled);
+
+    /**
+     * 提交一个文件, 已经在队列中的文件会被忽略
+     * @param path 文件的 URL
+     */
+    void scan(const QString &path);
+
+    /**
+     * 标记文件处理完毕并更新进度, 之后可以重新提交. 所有文件都处理完毕时进度归零
+     */
+    void finish(const QString &path);
+
+    [[nodiscard]] int done() const { return m_done; }
+
+    [[nodiscard]] int total() const { return m_total; }
+
+signals:
+
+    void trackScanned(QString path, bool ok, double loudness, double peak, int blocks);
+
+    void progress(int done, int total);
+};
+
+#endif //PONYPLAYER_LOUDNESS_SCANNER_H
@@ -3,6 +3,7 @@
 #include <QtCore>
 #include <utility>
 #include "kv_engine.h"
+#include "loudness_scanner.h"
 #include <QThread>
 #include <QMetaType>
 
@@ -26,6 +27,13 @@ class PlayListItem : public ListItem {
     Q_PROPERTY(QString format READ getFormat WRITE setFormat)  // 封装格式
     Q_PROPERTY(QString path READ getPath WRITE setPath)  // 路径
     Q_PROPERTY(QString iconPath READ getIconPath WRITE setIconPath) // icon 路径
+    // 以下为响度分析结果, 新的属性只能追加在末尾, 旧表通过 migrateTable 补齐列
+    Q_PROPERTY(int replayGainState READ getReplayGainState WRITE setReplayGainState) // 响度分析状态
+    Q_PROPERTY(float trackGain READ getTrackGain WRITE setTrackGain) // 音轨增益(dB)
+    Q_PROPERTY(float trackPeak READ getTrackPeak WRITE setTrackPeak) // 音轨真峰值(线性)
+    Q_PROPERTY(float albumGain READ getAlbumGain WRITE setAlbumGain) // 专辑增益(dB)
+    Q_PROPERTY(float albumPeak READ getAlbumPeak WRITE setAlbumPeak) // 专辑真峰值(线性)
+    Q_PROPERTY(int loudnessBlocks READ getLoudnessBlocks WRITE setLoudnessBlocks) // 400ms 块数量, 计算专辑增益时加权
 
 
 protected:
@@ -47,8 +55,20 @@ protected:
     int streamNumbers;
     QString format;
     QString iconPath;
+    int replayGainState = Unscanned;
+    float trackGain = 0;
+    float trackPeak = 0;
+    float albumGain = 0;
+    float albumPeak = 0;
+    int loudnessBlocks = 0;
 
 public:
+    enum ReplayGainState {
+        Unscanned = 0,
+        Scanned = 1,
+        ScanFailed = 2
+    };
+
     Q_INVOKABLE PlayListItem(QString _fileName, const QDir &_dir)
             : ListItem(), fileName(std::move(_fileName)), dir(_dir) {
     };
@@ -110,6 +130,29 @@ public:
     Q_INVOKABLE int getStreamNumbers() { return streamNumbers; }
     Q_INVOKABLE void setStreamNumbers(int _streamNumbers) { streamNumbers = _streamNumbers; }
 
+    Q_INVOKABLE int getReplayGainState() { return replayGainState; }
+    Q_INVOKABLE void setReplayGainState(int _replayGainState) { replayGainState = _replayGainState; }
+
+    Q_INVOKABLE float getTrackGain() { return trackGain; }
+    Q_INVOKABLE void setTrackGain(float _trackGain) { trackGain = _trackGain; }
+
+    Q_INVOKABLE float getTrackPeak() { return trackPeak; }
+    Q_INVOKABLE void setTrackPeak(float _trackPeak) { trackPeak = _trackPeak; }
+
+    Q_INVOKABLE float getAlbumGain() { return albumGain; }
+    Q_INVOKABLE void setAlbumGain(float _albumGain) { albumGain = _albumGain; }
+
+    Q_INVOKABLE float getAlbumPeak() { return albumPeak; }
+    Q_INVOKABLE void setAlbumPeak(float _albumPeak) { albumPeak = _albumPeak; }
+
+    Q_INVOKABLE int getLoudnessBlocks() { return loudnessBlocks; }
+    Q_INVOKABLE void setLoudnessBlocks(int _loudnessBlocks) { loudnessBlocks = _loudnessBlocks; }
+
+    /*
+     * 转换为 Controller::getReplayGain 返回的格式
+     */
+    QVariantMap replayGainInfo();
+
     Q_INVOKABLE ~PlayListItem() override = default;
 
 //    Q_INVOKABLE PlayListItem(const PlayListItem &listItem);
@@ -163,6 +206,11 @@ class PlayList : public QObject {
 private:
     QList<QObject *> data;
     PonyKVList<PlayListItem> pkvList;
+    LoudnessScanner *scanner;
+
+    static QString albumOf(const QString &path);
+
+    void updateAlbum(const QString &album);
 
 //    static void appendPlayList(QQmlListProperty<QObject*>* list,QObject *qobj);
 //    static int playListCount(QQmlListProperty<QObject*>*) const;
@@ -188,6 +236,8 @@ public slots:
     PlayListItem* search(QString key);
     void extractAndProcess();
     void getInfo(QString path);
+    void scanLoudness();
+    void onTrackScanned(QString path, bool ok, double loudness, double peak, int blocks);
 
 signals:
     void insertDone(int resultcode);
@@ -195,6 +245,8 @@ signals:
     void searchDone(PlayListItem *item);
     void extractDone(QList<simpleListItem*> res);
     void getInfoDone(PlayListItem *item);
+    void replayGainUpdated(QString path, QVariantMap info);
+    void scanProgress(int done, int total);
 };
 
 Q_DECLARE_METATYPE(PlayListItem*)
\ No newline at end of file
@@ -72,6 +72,28 @@ void PonyKVConnect::createTableFrom(const QString &className, const QString &tab
     db.exec(tableDDL);
 }
 
+/*
+ * 为旧版本创建的表补上新增的属性列，新列追加在末尾，保证列的顺序与属性顺序一致
+ * @className: 类名
+ * @tableName: 表名
+ */
+void PonyKVConnect::migrateTable(const QString &className, const QString &tableName) {
+    const QMetaObject *metaObj = QMetaType::fromName(className.toUtf8()).metaObject();
+
+    if (!metaObj) throw std::runtime_error("Can not migrateTable!");
+
+    QSqlRecord record = db.record(tableName);
+    for (int i = metaObj->propertyOffset(); i < metaObj->propertyCount(); ++i) {
+        QString name = metaObj->property(i).name();
+        if (record.contains(name)) continue;
+        QString type = qTypeToDDL(metaObj->property(i).typeName());
+        QString sql = "ALTER TABLE `" + tableName + "` ADD COLUMN " + name + " " + type;
+        sql += type == "text" ? " DEFAULT ''" : " DEFAULT 0";
+        qInfo() << "Migrating table" << tableName << ":" << sql;
+        db.exec(sql);
+    }
+}
+
 /*
  *
  */
@@ -176,6 +198,31 @@ void PonyKVConnect::removeByKV(const QString &tableName, const QString &key, con
     query.exec();
 }
 
+/*
+ * 更新满足 key = value 的记录
+ * @tableName: 表名
+ * @key: 键
+ * @value: 值
+ * @fields: 需要更新的列及其新值
+ */
+void PonyKVConnect::updateByKV(const QString &tableName, const QString &key, const QString &value,
+                               const QVariantMap &fields) {
+    if (fields.isEmpty()) return;
+    QStringList assignments;
+    for (auto it = fields.cbegin(); it != fields.cend(); ++it) {
+        assignments.append(it.key() + " = :" + it.key());
+    }
+    QSqlQuery query(db);
+    query.prepare("UPDATE `" + tableName + "` SET " + assignments.join(", ") + " WHERE " + key + " = :__key__");
+    for (auto it = fields.cbegin(); it != fields.cend(); ++it) {
+        query.bindValue(":" + it.key(), it.value());
+    }
+    query.bindValue(":__key__", value);
+    if (!query.exec()) {
+        qWarning() << "Update" << tableName << "failed:" << query.lastError().text();
+    }
+}
+
 /*
  * 向数据库查询
  * @tableName: 表名
@@ -209,6 +256,8 @@ PonyKVList<T>::PonyKVList(QString _dbName, QString _tableName, QString _classNam
                                                                                     className(std::move(_className)) {
     if (!engine.hasTable(tableName)) {
         engine.createTableFrom(className, tableName);
+    } else {
+        engine.migrateTable(className, tableName);
     }
     data = engine.retrieveDataByClass<T>(tableName, className);
 }
@@ -222,6 +271,22 @@ void PonyKVList<T>::insert(T *item) {
 template<typename T>
 void PonyKVList<T>::remove(const QString& key, const QString& value) {
     engine.removeByKV(tableName, key, value);
+    // 已经载入的对象也要移除, 否则计算专辑增益时仍会统计被删除的文件
+    data.removeIf([&](T *item) { return item->property(key.toUtf8()).toString() == value; });
+}
+
+/*
+ * 同时更新数据库和已经载入的对象
+ */
+template<typename T>
+void PonyKVList<T>::update(const QString& key, const QString& value, const QVariantMap& fields) {
+    engine.updateByKV(tableName, key, value, fields);
+    for (T *item : data) {
+        if (item->property(key.toUtf8()).toString() != value) continue;
+        for (auto it = fields.cbegin(); it != fields.cend(); ++it) {
+            item->setProperty(it.key().toUtf8(), it.value());
+        }
+    }
 }
 
 template<typename T>
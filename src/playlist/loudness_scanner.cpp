@@ -0,0 +1,132 @@
+#include "loudness_scanner.h"
+#include <QDebug>
+#include <QThread>
+#include <QUrl>
+#include <vector>
+#include "ponyplayer.h"
+#include "dsp/loudness.hpp"
+INCLUDE_FFMPEG_BEGIN
+#include "libavcodec/avcodec.h"
+#include "libavformat/avformat.h"
+#include "libswresample/swresample.h"
+INCLUDE_FFMPEG_END
+
+LoudnessScanner::LoudnessScanner(QObject *parent) : QObject(parent) {
+    m_pool.setMaxThreadCount(std::max(1, QThread::idealThreadCount() - 1));
+}
+
+LoudnessScanner::~LoudnessScanner() {
+    m_cancelled = true;
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+/*
+ * 解码第一条音频流, 转换为交错 float 后送入 LoudnessMeter
+ */
+LoudnessResult LoudnessScanner::measure(const QString &path, const std::atomic<bool> &cancelled) {
+    LoudnessResult result;
+    std::string filename = QUrl(path).toLocalFile().toStdString();
+    AVFormatContext *fmtCtx = nullptr;
+    AVCodecContext *codecCtx = nullptr;
+    SwrContext *swrCtx = nullptr;
+    AVPacket *pkt = av_packet_alloc();
+    AVFrame *frame = av_frame_alloc();
+    std::vector<float> buffer;
+    int streamIndex = -1;
+    int channels = 0;
+
+    auto feed = [&](LoudnessMeter &meter, const AVFrame *input) {
+        int capacity = swr_get_out_samples(swrCtx, input ? input->nb_samples : 0);
+        if (capacity <= 0) { return; }
+        buffer.resize(static_cast<std::size_t>(capacity * channels));
+        auto *out = reinterpret_cast<uint8_t *>(buffer.data());
+        int got = swr_convert(swrCtx, &out, capacity,
+                              input ? const_cast<const uint8_t **>(input->extended_data) : nullptr,
+                              input ? input->nb_samples : 0);
+        if (got > 0) { meter.process(buffer.data(), static_cast<std::size_t>(got)); }
+    };
+
+    do {
+        if (avformat_open_input(&fmtCtx, filename.c_str(), nullptr, nullptr) < 0 ||
+            avformat_find_stream_info(fmtCtx, nullptr) < 0) {
+            qWarning() << "LoudnessScanner: cannot open" << path;
+            break;
+        }
+        AVCodec *codec = nullptr;
+        streamIndex = av_find_best_stream(fmtCtx, AVMEDIA_TYPE_AUDIO, -1, -1, &codec, 0);
+        if (streamIndex < 0 || !codec) {
+            qWarning() << "LoudnessScanner: no audio stream in" << path;
+            break;
+        }
+        codecCtx = avcodec_alloc_context3(codec);
+        if (avcodec_parameters_to_context(codecCtx, fmtCtx->streams[streamIndex]->codecpar) < 0 ||
+            avcodec_open2(codecCtx, codec, nullptr) < 0) {
+            qWarning() << "LoudnessScanner: cannot open decoder for" << path;
+            break;
+        }
+        channels = codecCtx->channels;
+        auto inputLayout = codecCtx->channel_layout ? static_cast<int64_t>(codecCtx->channel_layout)
+                                                    : av_get_default_channel_layout(channels);
+        swrCtx = swr_alloc_set_opts(nullptr, av_get_default_channel_layout(channels), AV_SAMPLE_FMT_FLT,
+                                    codecCtx->sample_rate, inputLayout, codecCtx->sample_fmt,
+                                    codecCtx->sample_rate, 0, nullptr);
+        if (!swrCtx || swr_init(swrCtx) < 0 || channels <= 0) {
+            qWarning() << "LoudnessScanner: cannot initialize swrCtx for" << path;
+            break;
+        }
+
+        LoudnessMeter meter(codecCtx->sample_rate, channels);
+        bool failed = false;
+        auto drain = [&] {
+            int ret;
+            while ((ret = avcodec_receive_frame(codecCtx, frame)) >= 0) {
+                feed(meter, frame);
+                av_frame_unref(frame);
+            }
+            if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) { failed = true; }
+        };
+        while (!cancelled && !failed && av_read_frame(fmtCtx, pkt) >= 0) {
+            if (pkt->stream_index == streamIndex && avcodec_send_packet(codecCtx, pkt) >= 0) { drain(); }
+            av_packet_unref(pkt);
+        }
+        if (cancelled || failed) { break; }
+        avcodec_send_packet(codecCtx, nullptr);
+        drain();
+        feed(meter, nullptr);
+
+        result.ok = true;
+        result.loudness = meter.integratedLoudness();
+        result.peak = meter.truePeak();
+        result.blocks = static_cast<int>(meter.blockPowers().size());
+    } while (false);
+
+    av_frame_free(&frame);
+    av_packet_free(&pkt);
+    if (swrCtx) { swr_free(&swrCtx); }
+    if (codecCtx) { avcodec_free_context(&codecCtx); }
+    if (fmtCtx) { avformat_close_input(&fmtCtx); }
+    return result;
+}
+
+void LoudnessScanner::scan(const QString &path) {
+    if (m_pending.contains(path)) { return; }
+    m_pending.insert(path);
+    ++m_total;
+    emit progress(m_done, m_total);
+    m_pool.start([this, path] {
+        if (m_cancelled) { return; }
+        LoudnessResult result = measure(path, m_cancelled);
+        if (m_cancelled) { return; }
+        emit trackScanned(path, result.ok, result.loudness, result.peak, result.blocks);
+    });
+}
+
+void LoudnessScanner::finish(const QString &path) {
+    if (!m_pending.remove(path)) { return; }
+    emit progress(++m_done, m_total);
+    if (m_pending.isEmpty()) {
+        m_done = 0;
+        m_total = 0;
+    }
+}
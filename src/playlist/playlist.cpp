@@ -1,4 +1,6 @@
 #include "playlist.h"
+#include <cmath>
+#include "dsp/loudness.hpp"
 
 QString PlayListItem::getFileName() {
     return fileName;
@@ -8,12 +10,26 @@ QString PlayListItem::getDirectory() {
     return dir.path();
 }
 
+QVariantMap PlayListItem::replayGainInfo() {
+    QVariantMap res;
+    res["scanned"] = replayGainState == Scanned;
+    res["trackGain"] = trackGain;
+    res["trackPeak"] = trackPeak;
+    res["albumGain"] = albumGain;
+    res["albumPeak"] = albumPeak;
+    return res;
+}
+
 //PlayListItem::PlayListItem(const PlayListItem &item) : ListItem(item) {
 //    fileName = item.fileName;
 //    dir = item.dir;
 //}
 
 PlayList::PlayList(QString _dbName, QString _tableName, QString _className):pkvList(_dbName, _tableName, _className) {
+    // scanner 作为子对象随 PlayList 一起移动到 listOPThread, 分析结果排队回到该线程写入数据库
+    scanner = new LoudnessScanner(this);
+    connect(scanner, &LoudnessScanner::trackScanned, this, &PlayList::onTrackScanned, Qt::QueuedConnection);
+    connect(scanner, &LoudnessScanner::progress, this, &PlayList::scanProgress);
     qDebug()<<"PlayList init!\n";
 }
 
@@ -72,6 +88,8 @@ void PlayList::insert(PlayListItem *item){
         qDebug()<<"And this item was received correctly.";
     pkvList.insert(item);
     qDebug()<<"insert to db done!";
+    if (item && item->getReplayGainState() == PlayListItem::Unscanned)
+        scanner->scan(item->getPath());
 }
 
 void PlayList::remove(QString filepath){
@@ -104,4 +122,81 @@ void PlayList::extractAndProcess() {
         res.append(slItem);
     }
     emit extractDone(res);
-}
\ No newline at end of file
+}
+
+/*
+ * 专辑以文件所在目录区分
+ */
+QString PlayList::albumOf(const QString &path) {
+    return QFileInfo(QUrl(path).toLocalFile()).absolutePath();
+}
+
+/*
+ * 发布已有的响度分析结果，并继续分析上次没有完成的文件
+ */
+void PlayList::scanLoudness() {
+    foreach(PlayListItem* item, pkvList.extract()) {
+        if (item->getReplayGainState() == PlayListItem::Unscanned)
+            scanner->scan(item->getPath());
+        else
+            emit replayGainUpdated(item->getPath(), item->replayGainInfo());
+    }
+}
+
+/*
+ * 保存单个文件的分析结果，同一目录下的文件都分析完毕后计算专辑增益
+ */
+void PlayList::onTrackScanned(QString path, bool ok, double loudness, double peak, int blocks) {
+    scanner->finish(path);
+    QVariantMap fields;
+    if (ok) {
+        fields["replayGainState"] = static_cast<int>(PlayListItem::Scanned);
+        fields["trackGain"] = static_cast<float>(LoudnessMeter::replayGain(loudness));
+        fields["trackPeak"] = static_cast<float>(peak);
+        // 静音的文件不参与专辑响度的计算
+        fields["loudnessBlocks"] = std::isfinite(loudness) ? blocks : 0;
+    } else {
+        fields["replayGainState"] = static_cast<int>(PlayListItem::ScanFailed);
+    }
+    pkvList.update("path", path, fields);
+    qDebug() << "Loudness of" << path << ":" << loudness << "LUFS, peak" << peak;
+    foreach(PlayListItem* item, pkvList.extract()) {
+        if (item->getPath() == path) {
+            emit replayGainUpdated(path, item->replayGainInfo());
+            break;
+        }
+    }
+    updateAlbum(albumOf(path));
+}
+
+/*
+ * 专辑响度按各音轨时长对平均功率加权, 与把整张专辑作为一条音轨测量的结果近似
+ */
+void PlayList::updateAlbum(const QString &album) {
+    QList<PlayListItem*> tracks;
+    foreach(PlayListItem* item, pkvList.extract()) {
+        if (albumOf(item->getPath()) != album) continue;
+        if (item->getReplayGainState() == PlayListItem::Unscanned) return;
+        tracks.append(item);
+    }
+    double power = 0;
+    double weight = 0;
+    float albumPeak = 0;
+    foreach(PlayListItem* item, tracks) {
+        if (item->getReplayGainState() != PlayListItem::Scanned) continue;
+        double loudness = LoudnessMeter::REFERENCE_LUFS - item->getTrackGain();
+        power += item->getLoudnessBlocks() * std::pow(10.0, loudness / 10.0);
+        weight += item->getLoudnessBlocks();
+        albumPeak = std::max(albumPeak, item->getTrackPeak());
+    }
+    QVariantMap fields;
+    fields["albumGain"] = static_cast<float>(weight > 0 ? LoudnessMeter::REFERENCE_LUFS - 10.0 * std::log10(power / weight) : 0.0);
+    fields["albumPeak"] = albumPeak;
+    QSet<QString> updated;
+    foreach(PlayListItem* item, tracks) {
+        if (updated.contains(item->getPath())) continue;
+        updated.insert(item->getPath());
+        pkvList.update("path", item->getPath(), fields);
+        emit replayGainUpdated(item->getPath(), item->replayGainInfo());
+    }
+}
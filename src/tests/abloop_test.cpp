@@ -0,0 +1,189 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include "abloop.hpp"
+
+namespace {
+    constexpr int SAMPLE_RATE = 48000;
+    constexpr int CHANNELS = 2;
+    constexpr size_t FRAME_BYTES = CHANNELS * sizeof(int16_t);
+    constexpr size_t FADE_BYTES = 960 * FRAME_BYTES; // 20 ms
+    constexpr size_t FRAMES_PER_SAMPLE = 1024;
+
+    /**
+     * 从 pts 开始的正弦波, 按 FRAMES_PER_SAMPLE 帧切成音频帧依次交给 LoopAudioCache, 拼接处没有交叉淡化时会产生跳变
+     */
+    struct LoopFeeder {
+        LoopAudioCache loop;
+        qreal pts;
+        std::vector<int16_t> source;  // 从 pts 开始交给 accept 的所有样本
+        std::vector<int16_t> written; // accept 要求写入的部分
+        std::vector<size_t> writes;   // 每次 accept 的返回值
+
+        LoopFeeder(qreal a, qreal b, qreal start) : pts(start) {
+            loop.arm(a, b, PonyAudioFormat(AnytMusic::Int16, SAMPLE_RATE, CHANNELS));
+        }
+
+        static int16_t sampleAt(size_t frame, int channel) {
+            double phase = 2.0 * PcmKernels::PI * 437.5 * static_cast<double>(frame) / SAMPLE_RATE;
+            return static_cast<int16_t>(std::lround(8000.0 * std::sin(phase + channel)));
+        }
+
+        size_t feed() {
+            const size_t first = source.size() / CHANNELS;
+            std::vector<int16_t> data(FRAMES_PER_SAMPLE * CHANNELS);
+            for (size_t f = 0; f < FRAMES_PER_SAMPLE; ++f) {
+                for (int c = 0; c < CHANNELS; ++c) { data[f * CHANNELS + c] = sampleAt(first + f, c); }
+            }
+            source.insert(source.end(), data.begin(), data.end());
+            AudioFrame sample(reinterpret_cast<std::byte *>(data.data()),
+                              static_cast<int>(data.size() * sizeof(int16_t)), pts);
+            size_t n = loop.accept(sample);
+            written.insert(written.end(), data.begin(), data.begin() + static_cast<ptrdiff_t>(n / sizeof(int16_t)));
+            writes.push_back(n);
+            pts += static_cast<double>(FRAMES_PER_SAMPLE) / SAMPLE_RATE;
+            return n;
+        }
+
+        void feedUntilLooping() {
+            for (int i = 0; i < 10000 && !loop.isLooping(); ++i) { feed(); }
+            ASSERT_TRUE(loop.isLooping());
+        }
+    };
+
+    std::vector<int16_t> expectedFade(const std::vector<int16_t> &recorded) {
+        const size_t fadeSamples = FADE_BYTES / sizeof(int16_t);
+        std::vector<int16_t> fade(fadeSamples);
+        PcmKernels::crossfade(recorded.data() + recorded.size() - fadeSamples, recorded.data(), fade.data(),
+                              fadeSamples / CHANNELS, CHANNELS, 0.0F, 1.0F);
+        return fade;
+    }
+
+    int maxStep(const std::vector<int16_t> &pcm) {
+        int step = 0;
+        for (size_t i = CHANNELS; i < pcm.size(); ++i) { step = std::max(step, std::abs(pcm[i] - pcm[i - CHANNELS])); }
+        return step;
+    }
+}
+
+TEST(abloop_test, record_from_a_and_loop) {
+    LoopFeeder feeder(1.0, 1.5, 1.0);
+    feeder.feedUntilLooping();
+    // [A, B) 为 96000 字节, 只写入到 B - FADE_SECS, 记录到 B 为止
+    const size_t target = 96000;
+    const size_t limit = target - FADE_BYTES;
+    ASSERT_EQ(feeder.writes.size(), 24u);
+    EXPECT_EQ(feeder.writes[21], FRAMES_PER_SAMPLE * FRAME_BYTES);
+    EXPECT_EQ(feeder.writes[22], limit - 22 * FRAMES_PER_SAMPLE * FRAME_BYTES);
+    EXPECT_EQ(feeder.writes[23], 0u);
+    ASSERT_EQ(feeder.written.size() * sizeof(int16_t), limit);
+    EXPECT_TRUE(std::equal(feeder.written.begin(), feeder.written.end(), feeder.source.begin()));
+
+    const std::vector<int16_t> recorded(feeder.source.begin(),
+                                        feeder.source.begin() + static_cast<ptrdiff_t>(target / sizeof(int16_t)));
+    const std::vector<int16_t> fade = expectedFade(recorded);
+    // 淡化从 B - FADE_SECS 的样本开始, 淡化之后从 A + FADE_SECS 继续
+    EXPECT_TRUE(std::equal(fade.begin(), fade.begin() + CHANNELS,
+                           recorded.begin() + static_cast<ptrdiff_t>(limit / sizeof(int16_t))));
+    std::vector<int16_t> pass(fade);
+    pass.insert(pass.end(), recorded.begin() + static_cast<ptrdiff_t>(FADE_BYTES / sizeof(int16_t)),
+                recorded.begin() + static_cast<ptrdiff_t>(limit / sizeof(int16_t)));
+
+    std::vector<int16_t> pcm = feeder.written;
+    for (int i = 0; i < 2; ++i) {
+        EXPECT_FALSE(feeder.loop.atSplice());
+        size_t fadeRead = 0;
+        while (!feeder.loop.atSplice()) {
+            auto [data, len] = feeder.loop.read();
+            auto samples = reinterpret_cast<const int16_t *>(data);
+            pcm.insert(pcm.end(), samples, samples + len / sizeof(int16_t));
+            fadeRead += len;
+        }
+        EXPECT_EQ(fadeRead, FADE_BYTES);
+        EXPECT_DOUBLE_EQ(feeder.loop.splicePts(), 1.0 + LoopAudioCache::FADE_SECS);
+        size_t bodyRead = 0;
+        do {
+            auto [data, len] = feeder.loop.read();
+            auto samples = reinterpret_cast<const int16_t *>(data);
+            pcm.insert(pcm.end(), samples, samples + len / sizeof(int16_t));
+            bodyRead += len;
+        } while (bodyRead < limit - FADE_BYTES);
+        EXPECT_EQ(bodyRead, limit - FADE_BYTES);
+        EXPECT_TRUE(std::equal(pass.begin(), pass.end(), pcm.end() - static_cast<ptrdiff_t>(pass.size())));
+    }
+    // 437.5 Hz 的正弦波相邻样本最多相差约 460, 直接从 B 接到 A 时会相差数千
+    EXPECT_LT(maxStep(pcm), 1000);
+    EXPECT_GT(std::abs(recorded[recorded.size() - CHANNELS] - recorded[0]), 4000);
+}
+
+TEST(abloop_test, minimum_region) {
+    // 区间只有 10 ms, 按 2 * FADE_SECS 记录, 整个循环都是淡化部分
+    LoopFeeder feeder(1.0, 1.01, 1.0);
+    feeder.feedUntilLooping();
+    ASSERT_EQ(feeder.writes.size(), 2u);
+    EXPECT_EQ(feeder.writes[0], FADE_BYTES);
+    EXPECT_EQ(feeder.writes[1], 0u);
+
+    const std::vector<int16_t> recorded(feeder.source.begin(),
+                                        feeder.source.begin() + static_cast<ptrdiff_t>(2 * FADE_BYTES / sizeof(int16_t)));
+    const std::vector<int16_t> fade = expectedFade(recorded);
+    for (int i = 0; i < 2; ++i) {
+        auto [fadeData, fadeLen] = feeder.loop.read();
+        ASSERT_EQ(fadeLen, FADE_BYTES);
+        EXPECT_TRUE(std::equal(fade.begin(), fade.end(), reinterpret_cast<const int16_t *>(fadeData)));
+        EXPECT_TRUE(feeder.loop.atSplice());
+        auto [bodyData, bodyLen] = feeder.loop.read();
+        EXPECT_EQ(bodyLen, 0u);
+        EXPECT_FALSE(feeder.loop.atSplice());
+    }
+}
+
+TEST(abloop_test, record_after_a) {
+    // 跳转落在 A 之后 EDGE_SECS 以内时从第一个音频帧开始记录, 拼接后的时间基准也从那里计算
+    LoopFeeder feeder(1.0, 1.5, 1.0625);
+    feeder.feedUntilLooping();
+    const size_t target = 84000; // 0.4375 秒
+    size_t total = 0;
+    for (size_t n: feeder.writes) { total += n; }
+    EXPECT_EQ(total, target - FADE_BYTES);
+    EXPECT_DOUBLE_EQ(feeder.loop.splicePts(), 1.0625 + LoopAudioCache::FADE_SECS);
+}
+
+TEST(abloop_test, skip_before_a) {
+    LoopFeeder feeder(1.0, 1.5, 0.9);
+    // [0.9, 0.9213) 完全在 A 之前, 原样写入并且不记录
+    EXPECT_EQ(feeder.feed(), FRAMES_PER_SAMPLE * FRAME_BYTES);
+    EXPECT_FALSE(feeder.loop.isLooping());
+    EXPECT_FALSE(feeder.loop.isEnded());
+}
+
+TEST(abloop_test, uncached_cut_at_b) {
+    // 第一个音频帧超过 A + EDGE_SECS, 不记录, 写入到 B 为止
+    LoopFeeder feeder(1.0, 1.5, 1.2);
+    while (!feeder.loop.isEnded()) {
+        ASSERT_LT(feeder.writes.size(), 100u);
+        feeder.feed();
+    }
+    EXPECT_FALSE(feeder.loop.isLooping());
+    size_t total = 0;
+    for (size_t n: feeder.writes) { total += n; }
+    EXPECT_EQ(total % FRAME_BYTES, 0u);
+    EXPECT_NEAR(static_cast<double>(total), 0.3 * SAMPLE_RATE * FRAME_BYTES, FRAME_BYTES);
+    EXPECT_LT(feeder.writes.back(), FRAMES_PER_SAMPLE * FRAME_BYTES);
+    EXPECT_EQ(feeder.feed(), 0u);
+}
+
+TEST(abloop_test, disable_while_recording) {
+    LoopFeeder feeder(1.0, 1.5, 1.0);
+    feeder.feed();
+    feeder.loop.disable();
+    while (!feeder.loop.isEnded()) {
+        ASSERT_LT(feeder.writes.size(), 100u);
+        feeder.feed();
+    }
+    // 已经写入的部分加上之后写入到 B 的部分
+    EXPECT_NEAR(static_cast<double>(feeder.written.size() * sizeof(int16_t)), 96000.0, FRAME_BYTES);
+    EXPECT_FALSE(feeder.loop.isLooping());
+}
@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include <vector>
+#include "private/audiobackend.hpp"
+
+namespace {
+    constexpr int SAMPLE_RATE = 48000;
+    constexpr int CHANNELS = 2;
+    constexpr unsigned long FRAMES_PER_BUFFER = 480;
+    constexpr int BUFFERS = 100;
+
+    /**
+     * 每个样本依次写入递增的值, 写满 BUFFERS 个缓冲区后结束
+     */
+    struct RampSource {
+        int16_t next = 0;
+        int callbacks = 0;
+        std::vector<PaTime> times;
+        std::atomic<bool> finished = false;
+
+        static int callback(const void *, void *output, unsigned long frames, const PaStreamCallbackTimeInfo *timeInfo,
+                            PaStreamCallbackFlags, void *userData) {
+            auto *self = static_cast<RampSource *>(userData);
+            self->times.push_back(timeInfo->currentTime);
+            auto *out = static_cast<int16_t *>(output);
+            if (self->callbacks++ == BUFFERS) {
+                std::fill(out, out + frames * CHANNELS, 0);
+                return paComplete;
+            }
+            for (unsigned long i = 0; i < frames * CHANNELS; ++i) { out[i] = self->next++; }
+            return paContinue;
+        }
+
+        static void onFinished(void *userData) {
+            static_cast<RampSource *>(userData)->finished = true;
+        }
+
+        bool wait(std::chrono::milliseconds timeout) const {
+            auto deadline = std::chrono::steady_clock::now() + timeout;
+            while (!finished && std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            return finished;
+        }
+    };
+
+    PaStreamParameters stereoInt16() {
+        PaStreamParameters param{};
+        param.channelCount = CHANNELS;
+        param.sampleFormat = paInt16;
+        return param;
+    }
+}
+
+TEST(audiobackend_test, wav_output_as_fast_as_possible) {
+    auto path = (std::filesystem::temp_directory_path() / "pony_audiobackend_test.wav").string();
+    RampSource source;
+    {
+        HeadlessAudioBackend backend(IAudioBackend::Kind::Wav, path, 0.0);
+        PaStream *stream = nullptr;
+        ASSERT_EQ(backend.openStream(&stream, stereoInt16(), SAMPLE_RATE, FRAMES_PER_BUFFER,
+                                     &RampSource::callback, &source), paNoError);
+        backend.setStreamFinishedCallback(stream, &RampSource::onFinished);
+        ASSERT_EQ(backend.startStream(stream), paNoError);
+        ASSERT_TRUE(source.wait(std::chrono::seconds(10)));
+        EXPECT_NEAR(backend.streamInfo(stream)->outputLatency, 0.01, 1e-12);
+        backend.closeStream(stream);
+    }
+    // 流时间每次回调严格前进一个缓冲区
+    ASSERT_EQ(source.times.size(), static_cast<size_t>(BUFFERS + 1));
+    for (size_t i = 1; i < source.times.size(); ++i) {
+        EXPECT_NEAR(source.times[i] - source.times[i - 1], 0.01, 1e-9);
+    }
+    // 结束时的静音不写入文件
+    std::ifstream file(path, std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    WavData wav = WavFile::parse(bytes.data(), bytes.size());
+    EXPECT_EQ(wav.sampleRate, SAMPLE_RATE);
+    EXPECT_EQ(wav.channels, CHANNELS);
+    ASSERT_EQ(wav.frames(), FRAMES_PER_BUFFER * BUFFERS);
+    for (size_t i = 0; i < wav.samples.size(); i += 997) {
+        EXPECT_FLOAT_EQ(wav.samples[i], static_cast<float>(static_cast<int16_t>(i)) / 32768.0f) << i;
+    }
+    std::filesystem::remove(path);
+}
+
+TEST(audiobackend_test, null_output_paced_by_rate) {
+    RampSource source;
+    HeadlessAudioBackend backend(IAudioBackend::Kind::Null, {}, 10.0);
+    PaStream *stream = nullptr;
+    ASSERT_EQ(backend.openStream(&stream, stereoInt16(), SAMPLE_RATE, FRAMES_PER_BUFFER,
+                                 &RampSource::callback, &source), paNoError);
+    backend.setStreamFinishedCallback(stream, &RampSource::onFinished);
+    auto begin = std::chrono::steady_clock::now();
+    ASSERT_EQ(backend.startStream(stream), paNoError);
+    ASSERT_TRUE(source.wait(std::chrono::seconds(10)));
+    // 1 秒的音频按 10 倍速消耗, 不会少于 0.1 秒
+    EXPECT_GE(std::chrono::steady_clock::now() - begin, std::chrono::milliseconds(99));
+    backend.closeStream(stream);
+}
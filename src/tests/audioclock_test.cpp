@@ -0,0 +1,47 @@
+#include <gtest/gtest.h>
+#include "private/audioclock.hpp"
+
+TEST(audioclock_test, empty) {
+    AudioClock clock;
+    double bytes = -1;
+    EXPECT_FALSE(clock.bytesAt(1.0, bytes));
+    EXPECT_EQ(bytes, -1);
+}
+
+TEST(audioclock_test, interpolate_with_latency) {
+    AudioClock clock;
+    // 每次回调 10ms, 对应 1000 byte, 输出延迟 100ms
+    for (int i = 0; i < 50; ++i) {
+        clock.publish(0.1 + 0.01 * i, 1000 * i, 1000, 0.01);
+    }
+    double bytes = 0;
+    ASSERT_TRUE(clock.bytesAt(0.3, bytes));
+    EXPECT_NEAR(bytes, 20000, 1e-6);
+    ASSERT_TRUE(clock.bytesAt(0.305, bytes));
+    EXPECT_NEAR(bytes, 20500, 1e-6);
+    // 还没有开始播放
+    ASSERT_TRUE(clock.bytesAt(0.05, bytes));
+    EXPECT_NEAR(bytes, 0, 1e-6);
+    // 回调停止后时钟不再前进
+    ASSERT_TRUE(clock.bytesAt(10.0, bytes));
+    EXPECT_NEAR(bytes, 50000, 1e-6);
+}
+
+TEST(audioclock_test, silence_and_reset) {
+    AudioClock clock;
+    clock.publish(1.0, 0, 1000, 0.01);
+    clock.publish(1.01, 1000, 0, 0.0);
+    double bytes = 0;
+    ASSERT_TRUE(clock.bytesAt(1.015, bytes));
+    EXPECT_NEAR(bytes, 1000, 1e-6);
+    clock.reset();
+    EXPECT_FALSE(clock.bytesAt(1.015, bytes));
+}
+
+TEST(audioclock_test, stream_time) {
+    AudioClock clock;
+    clock.syncStreamTime(100.0);
+    double now = clock.streamNow();
+    EXPECT_GE(now, 100.0);
+    EXPECT_LT(now, 101.0);
+}
@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <vector>
+#include "dsp/channelmixer.hpp"
+#include "dsp/pcmkernels.hpp"
+
+TEST(channelmixer_test, negotiate) {
+    using namespace ChannelLayout;
+    auto stereoOnly = [](int channels) { return channels == 2; };
+    auto upTo8 = [](int channels) { return channels <= 8; };
+    auto upTo6 = [](int channels) { return channels <= 6; };
+    auto monoOnly = [](int channels) { return channels == 1; };
+    // 设备支持时直接输出
+    EXPECT_EQ(ChannelMixer::negotiate(SURROUND_7_1, upTo8), SURROUND_7_1);
+    EXPECT_EQ(ChannelMixer::negotiate(SURROUND_5_1, upTo8), SURROUND_5_1);
+    // 7.1 先尝试 5.1, 5.1 不会升到 7.1
+    EXPECT_EQ(ChannelMixer::negotiate(SURROUND_7_1, upTo6), SURROUND_5_1);
+    EXPECT_EQ(ChannelMixer::negotiate(SURROUND_5_1, stereoOnly), STEREO);
+    EXPECT_EQ(ChannelMixer::negotiate(SURROUND_5_1, monoOnly), MONO);
+    EXPECT_EQ(ChannelMixer::negotiate(MONO, stereoOnly), STEREO);
+    // 设置限制声道数
+    EXPECT_EQ(ChannelMixer::negotiate(SURROUND_7_1, upTo8, 2), STEREO);
+}
+
+TEST(channelmixer_test, surround_to_stereo) {
+    using namespace ChannelLayout;
+    ChannelMixSettings settings;
+    settings.normalize = false;
+    auto m = ChannelMixer::matrix(SURROUND_5_1, STEREO, settings);
+    ASSERT_EQ(m.size(), 12u);
+    const float c = std::pow(10.0F, -3.0F / 20.0F);
+    // 5.1 的顺序: FL FR FC LFE BL BR
+    const std::vector<float> expect = {1, 0, c, 0, c, 0,
+                                       0, 1, c, 0, 0, c};
+    for (std::size_t i = 0; i < expect.size(); ++i) { EXPECT_NEAR(m[i], expect[i], 1e-6) << i; }
+    EXPECT_TRUE(ChannelMixer::matrix(STEREO, STEREO, settings).empty());
+
+    // 归一化后任何输出都不会超过满幅
+    settings.normalize = true;
+    settings.mixLfe = true;
+    m = ChannelMixer::matrix(SURROUND_5_1, STEREO, settings);
+    std::vector<float> in = {1, 1, 1, 1, 1, 1}, out(2);
+    PcmKernels::downmix(in.data(), 6, out.data(), 2, m.data(), 1);
+    EXPECT_NEAR(out[0], 1.0F, 1e-6);
+    EXPECT_NEAR(out[1], 1.0F, 1e-6);
+}
+
+TEST(channelmixer_test, surround_7_1_to_5_1) {
+    using namespace ChannelLayout;
+    ChannelMixSettings settings;
+    settings.normalize = false;
+    auto m = ChannelMixer::matrix(SURROUND_7_1, SURROUND_5_1, settings);
+    ASSERT_EQ(m.size(), 48u);
+    const float s = std::pow(10.0F, -3.0F / 20.0F);
+    // 7.1 的顺序: FL FR FC LFE BL BR SL SR, 侧环绕并入同侧的后环绕
+    for (int d = 0; d < 6; ++d) {
+        for (int i = 0; i < 8; ++i) {
+            float expect = d == i ? 1.0F : 0.0F;
+            if (d == 4 && i == 6) { expect = s; }
+            if (d == 5 && i == 7) { expect = s; }
+            EXPECT_NEAR(m[static_cast<std::size_t>(d * 8 + i)], expect, 1e-6) << d << "," << i;
+        }
+    }
+}
@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <random>
+#include <vector>
+#include "dsp/convolver.hpp"
+
+namespace {
+    std::vector<float> noise(std::size_t count, unsigned seed) {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> dist(-0.5f, 0.5f);
+        std::vector<float> out(count);
+        for (auto &v: out) { v = dist(rng); }
+        return out;
+    }
+}
+
+TEST(convolver_test, fft_matches_dft) {
+    for (std::size_t n: {4, 8, 64, 1024}) {
+        Fft::RealFft fft(n);
+        auto in = noise(n, 1);
+        std::vector<float> re(fft.bins()), im(fft.bins()), back(n);
+        fft.forward(in.data(), re.data(), im.data());
+        for (std::size_t k = 0; k < fft.bins(); ++k) {
+            double sr = 0, si = 0;
+            for (std::size_t t = 0; t < n; ++t) {
+                double angle = -2 * PcmKernels::PI * static_cast<double>(k * t) / static_cast<double>(n);
+                sr += in[t] * std::cos(angle);
+                si += in[t] * std::sin(angle);
+            }
+            ASSERT_NEAR(re[k], sr, 1e-3) << n << " " << k;
+            ASSERT_NEAR(im[k], si, 1e-3) << n << " " << k;
+        }
+        fft.inverse(re.data(), im.data(), back.data());
+        for (std::size_t t = 0; t < n; ++t) { ASSERT_NEAR(back[t] / static_cast<float>(n), in[t], 1e-5); }
+    }
+}
+
+TEST(convolver_test, matches_direct_convolution) {
+    constexpr int CHANNELS = 2;
+    constexpr std::size_t BLOCK = 64;
+    WavData ir;
+    ir.sampleRate = 48000;
+    ir.channels = CHANNELS;
+    ir.samples = noise(3001 * CHANNELS, 2);
+    const std::size_t taps = ir.frames();
+    auto input = noise(20000 * CHANNELS, 3);
+    const std::size_t frames = input.size() / CHANNELS;
+
+    PartitionedConvolver convolver(ir, 48000, CHANNELS, BLOCK);
+    auto output = input;
+    std::mt19937 rng(4);
+    std::uniform_int_distribution<std::size_t> chunk(1, 300);
+    for (std::size_t f = 0; f < frames;) {
+        std::size_t n = std::min(chunk(rng), frames - f);
+        convolver.process(output.data() + f * CHANNELS, n);
+        f += n;
+    }
+    // 输出比直接卷积晚 BLOCK 帧
+    for (std::size_t t = BLOCK; t < frames; t += 97) {
+        for (std::size_t c = 0; c < CHANNELS; ++c) {
+            double expected = 0;
+            std::size_t n = t - BLOCK;
+            for (std::size_t k = 0; k < taps && k <= n; ++k) {
+                expected += ir.samples[k * CHANNELS + c] * input[(n - k) * CHANNELS + c];
+            }
+            ASSERT_NEAR(output[t * CHANNELS + c], expected, 2e-3) << t;
+        }
+    }
+    for (std::size_t t = 0; t < BLOCK * CHANNELS; ++t) { ASSERT_EQ(output[t], 0.0f); }
+}
+
+TEST(convolver_test, effect_reports_latency) {
+    ConvolutionEffect effect(256);
+    EXPECT_TRUE(effect.bypassed());
+    EXPECT_EQ(effect.latencyFrames(), 0U);
+    effect.prepare(44100, 2);
+    auto ir = std::make_shared<WavData>();
+    ir->sampleRate = 44100;
+    ir->channels = 1;
+    ir->samples = {1.0f};
+    effect.setImpulseResponse(ir);
+    EXPECT_FALSE(effect.bypassed());
+    std::vector<float> data(1024 * 2, 0.25f);
+    effect.process(data.data(), 1024);
+    EXPECT_EQ(effect.latencyFrames(), 256U);
+    EXPECT_EQ(data[0], 0.0f);
+    EXPECT_NEAR(data[300 * 2], 0.25f, 1e-5);
+    effect.setImpulseResponse(nullptr);
+    EXPECT_TRUE(effect.bypassed());
+    EXPECT_EQ(effect.latencyFrames(), 0U);
+}
+
+TEST(convolver_test, wav_roundtrip) {
+    WavData wav;
+    wav.sampleRate = 44100;
+    wav.channels = 2;
+    wav.samples = noise(100 * 2, 5);
+    auto bytes = WavFile::encode(wav);
+    WavData parsed = WavFile::parse(bytes.data(), bytes.size());
+    EXPECT_EQ(parsed.sampleRate, 44100);
+    EXPECT_EQ(parsed.channels, 2);
+    EXPECT_EQ(parsed.samples, wav.samples);
+
+    // 16 位整数, 数据块前有一个未知的块
+    const unsigned char pcm16[] = {'R', 'I', 'F', 'F', 46, 0, 0, 0, 'W', 'A', 'V', 'E',
+                                   'f', 'm', 't', ' ', 16, 0, 0, 0, 1, 0, 1, 0, 0x80, 0xBB, 0, 0,
+                                   0, 0x77, 1, 0, 2, 0, 16, 0,
+                                   'L', 'I', 'S', 'T', 1, 0, 0, 0, 0, 0,
+                                   'd', 'a', 't', 'a', 4, 0, 0, 0, 0x00, 0x40, 0x00, 0x80};
+    parsed = WavFile::parse(pcm16, sizeof(pcm16));
+    EXPECT_EQ(parsed.sampleRate, 48000);
+    ASSERT_EQ(parsed.samples.size(), 2U);
+    EXPECT_FLOAT_EQ(parsed.samples[0], 0.5f);
+    EXPECT_FLOAT_EQ(parsed.samples[1], -1.0f);
+
+    EXPECT_THROW(WavFile::parse(pcm16, 20), std::runtime_error);
+}
+
+TEST(convolver_test, resample_preserves_gain) {
+    WavData ir;
+    ir.sampleRate = 44100;
+    ir.channels = 1;
+    ir.samples.assign(200, 0.0f);
+    ir.samples[100] = 1.0f;
+    WavData out = Convolution::resample(ir, 96000);
+    EXPECT_EQ(out.sampleRate, 96000);
+    EXPECT_NEAR(static_cast<double>(out.frames()), 200 * 96000.0 / 44100, 1.0);
+    double sum = 0;
+    for (float v: out.samples) { sum += v; }
+    // 滤波器的直流增益不变
+    EXPECT_NEAR(sum, 1.0, 0.02);
+}
@@ -0,0 +1,113 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <vector>
+#include "dsp/equalizer.hpp"
+
+namespace {
+    constexpr int RATE = 48000;
+    constexpr int CHANNELS = 2;
+
+    std::vector<float> sine(std::size_t frames, double freq, int channels = CHANNELS) {
+        std::vector<float> out(frames * static_cast<std::size_t>(channels));
+        for (std::size_t i = 0; i < frames; ++i) {
+            for (int c = 0; c < channels; ++c) {
+                out[i * static_cast<std::size_t>(channels) + static_cast<std::size_t>(c)] =
+                        static_cast<float>(0.25 * std::sin(2 * PcmKernels::PI * freq * static_cast<double>(i) / RATE + c));
+            }
+        }
+        return out;
+    }
+
+    double rms(const std::vector<float> &data, std::size_t skipFrames) {
+        double sum = 0.0;
+        std::size_t n = 0;
+        for (std::size_t i = skipFrames * CHANNELS; i < data.size(); ++i, ++n) { sum += data[i] * data[i]; }
+        return std::sqrt(sum / static_cast<double>(n));
+    }
+
+    /**
+     * 以 480 帧为一块处理, 模拟 DSP 线程
+     */
+    void run(ParametricEqualizer &eq, std::vector<float> &data) {
+        const std::size_t block = 480;
+        std::size_t frames = data.size() / CHANNELS;
+        for (std::size_t f = 0; f < frames; f += block) {
+            eq.process(data.data() + f * CHANNELS, std::min(block, frames - f));
+        }
+    }
+
+    EqualizerSettings singleBand(double freq, double gainDb) {
+        EqualizerSettings settings;
+        settings.enabled = true;
+        settings.bands.push_back({Biquad::Type::Peaking, freq, gainDb, 1.41});
+        return settings;
+    }
+}
+
+TEST(equalizer_test, disabled_is_bypassed) {
+    EqualizerSettings settings;
+    settings.bands = EqualizerPresets::graphicBands();
+    ParametricEqualizer eq(settings);
+    eq.prepare(RATE, CHANNELS);
+    EXPECT_TRUE(eq.bypassed());
+    ASSERT_TRUE(EqualizerPresets::apply("Flat", settings));
+    settings.enabled = true;
+    eq.setSettings(settings);
+    EXPECT_FALSE(eq.bypassed());
+    auto data = sine(RATE / 10, 440);
+    auto origin = data;
+    run(eq, data);
+    for (std::size_t i = 0; i < data.size(); ++i) { ASSERT_NEAR(data[i], origin[i], 1e-5); }
+}
+
+TEST(equalizer_test, peaking_band) {
+    ParametricEqualizer eq(singleBand(1000, 6));
+    eq.prepare(RATE, CHANNELS);
+    auto boosted = sine(RATE / 2, 1000);
+    double before = rms(boosted, RATE / 4);
+    run(eq, boosted);
+    // 平滑结束后中心频率提升 6dB
+    EXPECT_NEAR(rms(boosted, RATE / 4) / before, std::pow(10.0, 6.0 / 20), 0.02);
+
+    eq.reset();
+    auto far = sine(RATE / 2, 100);
+    before = rms(far, RATE / 4);
+    run(eq, far);
+    EXPECT_NEAR(rms(far, RATE / 4) / before, 1.0, 0.05);
+}
+
+TEST(equalizer_test, disable_returns_to_bypass) {
+    ParametricEqualizer eq(singleBand(1000, 6));
+    eq.prepare(RATE, CHANNELS);
+    auto data = sine(RATE / 4, 1000);
+    run(eq, data);
+    auto settings = eq.settings();
+    settings.enabled = false;
+    eq.setSettings(settings);
+    // 平滑回到 0dB 之前仍然需要处理
+    EXPECT_FALSE(eq.bypassed());
+    data = sine(RATE / 4, 1000);
+    run(eq, data);
+    EXPECT_TRUE(eq.bypassed());
+}
+
+TEST(equalizer_test, vectorized_matches_scalar) {
+    for (int channels: {1, 2, 3, 6}) {
+        Biquad::Cascade simd, scalar;
+        simd.resize(EqualizerPresets::GRAPHIC_BANDS, channels);
+        scalar.resize(EqualizerPresets::GRAPHIC_BANDS, channels);
+        const auto *preset = EqualizerPresets::find("Rock");
+        ASSERT_NE(preset, nullptr);
+        for (std::size_t i = 0; i < EqualizerPresets::GRAPHIC_BANDS; ++i) {
+            auto k = Biquad::design(Biquad::Type::Peaking, RATE, EqualizerPresets::GRAPHIC_FREQS[i],
+                                    preset->gains[i], 1.41);
+            simd.setCoefficients(i, k);
+            scalar.setCoefficients(i, k);
+        }
+        auto a = sine(4096, 440, channels);
+        auto b = a;
+        simd.process(a.data(), 4096, true);
+        scalar.process(b.data(), 4096, false);
+        for (std::size_t i = 0; i < a.size(); ++i) { ASSERT_NEAR(a[i], b[i], 1e-5) << channels; }
+    }
+}
@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <vector>
+#include "dsp/loudness.hpp"
+#include "dsp/replaygain.hpp"
+
+namespace {
+    std::vector<float> sine(int sampleRate, int channels, double freq, double dbfs, double secs, double phase = 0) {
+        auto frames = static_cast<std::size_t>(sampleRate * secs);
+        const double amplitude = std::pow(10.0, dbfs / 20.0);
+        std::vector<float> out(frames * static_cast<std::size_t>(channels));
+        for (std::size_t f = 0; f < frames; ++f) {
+            auto v = static_cast<float>(amplitude * std::sin(2 * PcmKernels::PI * freq * static_cast<double>(f) / sampleRate + phase));
+            for (int c = 0; c < channels; ++c) { out[f * static_cast<std::size_t>(channels) + static_cast<std::size_t>(c)] = v; }
+        }
+        return out;
+    }
+}
+
+TEST(loudness_test, reference_sine) {
+    // EBU Tech 3341: 1kHz 正弦波, -23dBFS, 双声道, 应为 -23 LUFS
+    for (int rate: {44100, 48000}) {
+        auto data = sine(rate, 2, 1000, -23, 20);
+        LoudnessMeter meter(rate, 2);
+        // 任意分块输入, 结果不变
+        for (std::size_t f = 0, n = 777; f < data.size() / 2; f += n) {
+            meter.process(data.data() + f * 2, std::min(n, data.size() / 2 - f));
+        }
+        EXPECT_NEAR(meter.integratedLoudness(), -23.0, 0.1) << rate;
+        EXPECT_NEAR(LoudnessMeter::replayGain(meter.integratedLoudness()), 5.0, 0.1);
+    }
+}
+
+TEST(loudness_test, gating) {
+    // 前 10 秒 -23dBFS, 后 10 秒 -53dBFS, 安静部分低于相对门限, 被丢弃
+    auto loud = sine(48000, 2, 1000, -23, 10);
+    auto quiet = sine(48000, 2, 1000, -53, 10);
+    LoudnessMeter meter(48000, 2);
+    meter.process(loud.data(), loud.size() / 2);
+    meter.process(quiet.data(), quiet.size() / 2);
+    EXPECT_NEAR(meter.integratedLoudness(), -23.0, 0.2);
+
+    LoudnessMeter silent(48000, 2);
+    std::vector<float> zeros(48000 * 2);
+    silent.process(zeros.data(), 48000);
+    EXPECT_TRUE(std::isinf(silent.integratedLoudness()));
+    EXPECT_EQ(LoudnessMeter::replayGain(silent.integratedLoudness()), 0.0);
+}
+
+TEST(loudness_test, true_peak) {
+    // fs/4 的正弦波, 相位 45°, 采样点都落在 ±0.707 上, 真峰值是 1.0
+    auto data = sine(48000, 1, 12000, 0, 1, PcmKernels::PI / 4);
+    LoudnessMeter meter(48000, 1);
+    meter.process(data.data(), data.size());
+    float samplePeak = 0;
+    for (float v: data) { samplePeak = std::max(samplePeak, std::abs(v)); }
+    EXPECT_NEAR(samplePeak, 0.7071, 1e-3);
+    EXPECT_NEAR(meter.truePeak(), 1.0, 0.05);
+}
+
+TEST(loudness_test, replay_gain_effect) {
+    ReplayGainInfo info;
+    info.scanned = true;
+    info.trackGain = -6.0;
+    info.trackPeak = 0.5;
+    info.albumGain = 12.0;
+    info.albumPeak = 0.5;
+    ReplayGainSettings settings;
+    EXPECT_NEAR(ReplayGainEffect::linearGain(info, settings), 0.501, 1e-3);
+    // 专辑增益 +12dB 受真峰值限制
+    settings.mode = ReplayGainMode::Album;
+    EXPECT_NEAR(ReplayGainEffect::linearGain(info, settings), 2.0, 1e-6);
+    settings.preventClipping = false;
+    EXPECT_NEAR(ReplayGainEffect::linearGain(info, settings), 3.981, 1e-3);
+    settings.mode = ReplayGainMode::Off;
+    EXPECT_EQ(ReplayGainEffect::linearGain(info, settings), 1.0);
+
+    ReplayGainEffect effect;
+    effect.prepare(48000, 2);
+    EXPECT_TRUE(effect.bypassed());
+    effect.setInfo(info);
+    EXPECT_FALSE(effect.bypassed());
+    // 增益在 RAMP_SECS 内从 1 过渡到目标值
+    std::vector<float> data(4800 * 2, 1.0f);
+    effect.process(data.data(), 4800);
+    EXPECT_FLOAT_EQ(data[0], 1.0f);
+    EXPECT_GT(data[1200 * 2], 0.501f);
+    EXPECT_LT(data[1200 * 2], 1.0f);
+    EXPECT_NEAR(data[4000 * 2], 0.501f, 1e-3);
+    EXPECT_NEAR(data[4000 * 2 + 1], 0.501f, 1e-3);
+}
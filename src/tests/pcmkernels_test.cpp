@@ -0,0 +1,205 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+#include "dsp/pcmkernels.hpp"
+
+template<typename T>
+static std::vector<T> randomSamples(std::size_t count, unsigned seed = 42) {
+    std::mt19937 rng(seed);
+    std::vector<T> out(count);
+    for (auto &x: out) {
+        if constexpr (std::is_same_v<T, float>) {
+            x = std::uniform_real_distribution<float>(-1.5F, 1.5F)(rng);
+        } else {
+            x = static_cast<T>(std::uniform_int_distribution<int64_t>(std::numeric_limits<T>::min(),
+                                                                      std::numeric_limits<T>::max())(rng));
+        }
+    }
+    return out;
+}
+
+template<typename T>
+static void checkRoundTrip() {
+    // 奇数长度保证同时覆盖向量和标量尾部
+    const std::size_t n = 1001;
+    auto src = randomSamples<T>(n);
+    std::vector<float> simd(n), scalar(n);
+    PcmKernels::toFloat(src.data(), simd.data(), n);
+    PcmKernels::Scalar::toFloat(src.data(), scalar.data(), n);
+    for (std::size_t i = 0; i < n; ++i) { ASSERT_FLOAT_EQ(simd[i], scalar[i]) << i; }
+
+    std::vector<T> back(n), backScalar(n);
+    PcmKernels::fromFloat(simd.data(), back.data(), n);
+    PcmKernels::Scalar::fromFloat(scalar.data(), backScalar.data(), n);
+    for (std::size_t i = 0; i < n; ++i) {
+        ASSERT_EQ(back[i], backScalar[i]) << i;
+        if constexpr (!std::is_same_v<T, float> && !std::is_same_v<T, int32_t>) { ASSERT_EQ(back[i], src[i]) << i; }
+    }
+}
+
+TEST(pcmkernels_test, convert_round_trip) {
+    checkRoundTrip<uint8_t>();
+    checkRoundTrip<int16_t>();
+    checkRoundTrip<int32_t>();
+    checkRoundTrip<float>();
+}
+
+template<typename T>
+static void checkRoundHalf(double scale, int bias) {
+    // 每个值都恰好在两个整数中间, SIMD 和标量都应该远离零舍入
+    std::vector<float> src;
+    std::vector<int64_t> expect;
+    for (int k = -40; k < 40; ++k) {
+        src.push_back(static_cast<float>((k + 0.5) / scale));
+        expect.push_back((k < 0 ? k : k + 1) + bias);
+    }
+    for (double v: {4194303.5, -4194303.5, 8388607.5, -8388607.5}) {
+        if (std::abs(v) >= scale) { continue; }
+        src.push_back(static_cast<float>(v / scale));
+        expect.push_back(static_cast<int64_t>(v < 0 ? v - 0.5 : v + 0.5) + bias);
+    }
+    // 最接近 0.5 的小一点的值不能进位
+    src.push_back(std::nextafter(0.5F, 0.0F) / static_cast<float>(scale));
+    expect.push_back(bias);
+    std::vector<T> simd(src.size()), scalar(src.size());
+    PcmKernels::fromFloat(src.data(), simd.data(), src.size());
+    PcmKernels::Scalar::fromFloat(src.data(), scalar.data(), src.size());
+    for (std::size_t i = 0; i < src.size(); ++i) {
+        ASSERT_EQ(static_cast<int64_t>(simd[i]), expect[i]) << i;
+        ASSERT_EQ(static_cast<int64_t>(scalar[i]), expect[i]) << i;
+    }
+}
+
+TEST(pcmkernels_test, from_float_round_half) {
+    checkRoundHalf<uint8_t>(128.0, 128);
+    checkRoundHalf<int16_t>(32768.0, 0);
+    checkRoundHalf<int32_t>(2147483648.0, 0);
+}
+
+TEST(pcmkernels_test, from_float_saturate) {
+    std::vector<float> src = {2.0F, -2.0F, 1.0F, -1.0F, 0.0F, 0.5F, -0.5F, 100.0F, -100.0F};
+    src.resize(32, 3.0F);
+    std::vector<int16_t> s16(src.size());
+    std::vector<uint8_t> u8(src.size());
+    PcmKernels::fromFloat(src.data(), s16.data(), src.size());
+    PcmKernels::fromFloat(src.data(), u8.data(), src.size());
+    EXPECT_EQ(s16[0], 32767);
+    EXPECT_EQ(s16[1], -32768);
+    EXPECT_EQ(s16[2], 32767);
+    EXPECT_EQ(s16[3], -32768);
+    EXPECT_EQ(s16[4], 0);
+    EXPECT_EQ(s16[5], 16384);
+    EXPECT_EQ(s16[31], 32767);
+    EXPECT_EQ(u8[0], 255);
+    EXPECT_EQ(u8[1], 0);
+    EXPECT_EQ(u8[4], 128);
+}
+
+TEST(pcmkernels_test, gain_ramp) {
+    const std::size_t frames = 777;
+    auto src = randomSamples<int16_t>(frames * 2);
+    auto simd = src;
+    PcmKernels::gainRamp(simd.data(), frames, 2, 0.0F, 2.0F);
+    const float step = 2.0F / frames;
+    for (std::size_t f = 0; f < frames; ++f) {
+        for (std::size_t c = 0; c < 2; ++c) {
+            float expect = std::clamp(static_cast<float>(src[f * 2 + c]) * (step * static_cast<float>(f)),
+                                      -32768.0F, 32767.0F);
+            ASSERT_NEAR(simd[f * 2 + c], expect, 1.0) << f;
+        }
+    }
+}
+
+TEST(pcmkernels_test, reverse_frames) {
+    for (std::size_t frameBytes: {1, 2, 3, 4, 6, 8, 16}) {
+        for (std::size_t frames: {0, 1, 2, 7, 64, 1023}) {
+            std::vector<std::byte> data(frames * frameBytes);
+            for (std::size_t i = 0; i < data.size(); ++i) { data[i] = static_cast<std::byte>(i * 31 + 7); }
+            auto expect = data;
+            PcmKernels::Scalar::reverseFrames(expect.data(), frames, frameBytes);
+            PcmKernels::reverseFrames(data.data(), frames, frameBytes);
+            ASSERT_EQ(data, expect) << frameBytes << " " << frames;
+        }
+    }
+}
+
+TEST(pcmkernels_test, interleave) {
+    const std::size_t frames = 133;
+    auto l = randomSamples<int16_t>(frames, 1), r = randomSamples<int16_t>(frames, 2);
+    const int16_t *planes[2] = {l.data(), r.data()};
+    std::vector<int16_t> inter(frames * 2);
+    PcmKernels::interleave(planes, inter.data(), frames, 2);
+    for (std::size_t f = 0; f < frames; ++f) {
+        ASSERT_EQ(inter[2 * f], l[f]);
+        ASSERT_EQ(inter[2 * f + 1], r[f]);
+    }
+    std::vector<int16_t> l2(frames), r2(frames);
+    int16_t *out[2] = {l2.data(), r2.data()};
+    PcmKernels::deinterleave(inter.data(), out, frames, 2);
+    EXPECT_EQ(l, l2);
+    EXPECT_EQ(r, r2);
+}
+
+TEST(pcmkernels_test, interleave_many_channels) {
+    // 超过 MAX_CHANNELS 时所有声道都需要处理
+    const int channels = PcmKernels::MAX_CHANNELS + 4;
+    const std::size_t frames = 37;
+    std::vector<std::vector<float>> src;
+    std::vector<const float *> planes;
+    for (int c = 0; c < channels; ++c) {
+        src.push_back(randomSamples<float>(frames, static_cast<unsigned>(c)));
+        planes.push_back(src.back().data());
+    }
+    std::vector<float> inter(frames * channels);
+    PcmKernels::interleave(planes.data(), inter.data(), frames, channels);
+    for (std::size_t f = 0; f < frames; ++f) {
+        for (int c = 0; c < channels; ++c) { ASSERT_EQ(inter[f * channels + c], src[c][f]) << f << " " << c; }
+    }
+    std::vector<std::vector<float>> back(channels, std::vector<float>(frames));
+    std::vector<float *> out;
+    for (auto &plane: back) { out.push_back(plane.data()); }
+    PcmKernels::deinterleave(inter.data(), out.data(), frames, channels);
+    EXPECT_EQ(back, src);
+}
+
+TEST(pcmkernels_test, downmix) {
+    const std::size_t frames = 301;
+    const int src = 6, dst = 2;
+    auto in = randomSamples<float>(frames * src);
+    const float matrix[dst * src] = {
+            1.0F, 0.0F, 0.707F, 0.0F, 0.707F, 0.0F,
+            0.0F, 1.0F, 0.707F, 0.0F, 0.0F, 0.707F,
+    };
+    std::vector<float> out(frames * dst), expect(frames * dst);
+    PcmKernels::downmix(in.data(), src, out.data(), dst, matrix, frames);
+    PcmKernels::Scalar::downmix(in.data(), src, expect.data(), dst, matrix, frames);
+    for (std::size_t i = 0; i < out.size(); ++i) { ASSERT_NEAR(out[i], expect[i], 1e-5) << i; }
+}
+
+TEST(pcmkernels_test, crossfade_equal_power) {
+    // 0.5 秒 44100Hz
+    const std::size_t frames = 22050;
+    auto out = randomSamples<int16_t>(frames * 2, 3), in = randomSamples<int16_t>(frames * 2, 4);
+    for (auto &x: out) { x = static_cast<int16_t>(x / 2); }
+    for (auto &x: in) { x = static_cast<int16_t>(x / 2); }
+    std::vector<int16_t> mixed(frames * 2);
+    // 分两段处理, 检查段之间的进度是连续的
+    const std::size_t split = 8269;
+    PcmKernels::crossfade(out.data(), in.data(), mixed.data(), split, 2, 0.0F, static_cast<float>(split) / frames);
+    PcmKernels::crossfade(out.data() + split * 2, in.data() + split * 2, mixed.data() + split * 2,
+                          frames - split, 2, static_cast<float>(split) / frames, 1.0F);
+    for (std::size_t f = 0; f < frames; ++f) {
+        double t = static_cast<double>(f) / frames * PcmKernels::PI / 2;
+        for (std::size_t c = 0; c < 2; ++c) {
+            double expect = out[f * 2 + c] * std::cos(t) + in[f * 2 + c] * std::sin(t);
+            ASSERT_NEAR(mixed[f * 2 + c], expect, 1.5) << f;
+        }
+    }
+    EXPECT_EQ(mixed[0], out[0]);
+    // 原地输出
+    PcmKernels::crossfade(out.data(), in.data(), out.data(), frames, 2, 1.0F, 1.0F);
+    EXPECT_EQ(out, in);
+}
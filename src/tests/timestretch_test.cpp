@@ -0,0 +1,57 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <vector>
+#include "dsp/timestretch.hpp"
+
+namespace {
+    constexpr int RATE = 44100;
+    constexpr int CHANNELS = 2;
+
+    std::vector<int16_t> sine(int frames, double freq) {
+        std::vector<int16_t> out(static_cast<size_t>(frames * CHANNELS));
+        for (int i = 0; i < frames; ++i) {
+            auto v = static_cast<int16_t>(8000 * std::sin(2 * PcmKernels::PI * freq * i / RATE));
+            out[static_cast<size_t>(i * CHANNELS)] = v;
+            out[static_cast<size_t>(i * CHANNELS + 1)] = v;
+        }
+        return out;
+    }
+
+    std::vector<int16_t> process(ITimeStretcher &stretcher, const std::vector<int16_t> &input) {
+        std::vector<int16_t> output;
+        std::vector<int16_t> buf(4096 * CHANNELS);
+        const int chunk = 1024;
+        int frames = static_cast<int>(input.size()) / CHANNELS;
+        for (int i = 0; i < frames; i += chunk) {
+            stretcher.write(input.data() + i * CHANNELS, std::min(chunk, frames - i));
+            int n;
+            while ((n = stretcher.read(buf.data(), 4096)) > 0) {
+                output.insert(output.end(), buf.begin(), buf.begin() + n * CHANNELS);
+            }
+        }
+        return output;
+    }
+}
+
+TEST(timestretch_test, wsola_identity) {
+    WsolaStretcher stretcher(RATE, CHANNELS, TimeStretch::Quality::Balanced);
+    auto input = sine(RATE, 440);
+    auto output = process(stretcher, input);
+    ASSERT_GT(output.size(), input.size() / 2);
+    for (size_t i = 0; i < output.size(); ++i) { ASSERT_EQ(output[i], input[i]) << i; }
+}
+
+TEST(timestretch_test, duration) {
+    auto input = sine(4 * RATE, 440);
+    for (auto engine: {TimeStretch::Engine::Sonic, TimeStretch::Engine::Wsola}) {
+        for (float speed: {0.5f, 1.5f, 2.0f, 4.0f}) {
+            auto stretcher = TimeStretch::create(engine, TimeStretch::Quality::Balanced, RATE, CHANNELS);
+            stretcher->setSpeed(speed);
+            auto output = process(*stretcher, input);
+            double expected = 4.0 * RATE / speed;
+            // 引擎内部最多缓存约 0.1 秒的输入
+            EXPECT_NEAR(static_cast<double>(output.size() / CHANNELS), expected, 0.1 * RATE / speed + 0.02 * RATE)
+                                << static_cast<int>(engine) << " " << speed;
+        }
+    }
+}
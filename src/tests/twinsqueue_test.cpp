@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "private/decoders.hpp"
+
+/**
+ * 与 DecodeDispatcher 相同的过期条件: 帧的代数不是最新的代数时过期, 跳转还没有在解码线程上执行时文件结束标记也过期
+ */
+struct GenerationQueue {
+    std::atomic<uint64_t> generation = 0;
+    std::atomic<uint64_t> decodingGeneration = 0;
+    TwinsBlockQueue<AVFrame *> queue{"AudioQueue", 4};
+
+    GenerationQueue() {
+        queue.setDiscard([this](AVFrame *frame) {
+            return frame ? frameGeneration(frame) != generation : decodingGeneration != generation;
+        }, [](AVFrame *frame) { av_frame_free(&frame); });
+    }
+
+    ~GenerationQueue() {
+        queue.clear([](AVFrame *frame) { av_frame_free(&frame); });
+    }
+
+    static AVFrame *frameOf(uint64_t g) {
+        AVFrame *frame = av_frame_alloc();
+        setFrameGeneration(frame, g);
+        return frame;
+    }
+
+    void seek() {
+        ++generation;
+        decodingGeneration = generation.load();
+    }
+};
+
+TEST(twinsqueue_test, remove_drops_stale) {
+    GenerationQueue q;
+    q.queue.push(GenerationQueue::frameOf(0));
+    q.queue.push(GenerationQueue::frameOf(0));
+    q.seek();
+    q.queue.push(GenerationQueue::frameOf(1));
+    AVFrame *frame = q.queue.remove(true);
+    ASSERT_NE(frame, nullptr);
+    EXPECT_EQ(frameGeneration(frame), 1u);
+    EXPECT_EQ(q.queue.size(), 0u);
+    av_frame_free(&frame);
+}
+
+TEST(twinsqueue_test, stale_eof_dropped) {
+    GenerationQueue q;
+    q.queue.push(nullptr);
+    ++q.generation;
+    std::thread decoder([&q] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        q.decodingGeneration = q.generation.load();
+        q.queue.push(GenerationQueue::frameOf(1));
+    });
+    AVFrame *frame = q.queue.remove(true);
+    decoder.join();
+    ASSERT_NE(frame, nullptr);
+    EXPECT_EQ(frameGeneration(frame), 1u);
+    av_frame_free(&frame);
+}
+
+TEST(twinsqueue_test, current_eof_kept) {
+    GenerationQueue q;
+    q.seek();
+    q.queue.push(nullptr);
+    EXPECT_EQ(q.queue.remove(true), nullptr);
+    EXPECT_EQ(q.queue.size(), 1u);
+}
+
+TEST(twinsqueue_test, discard_wakes_producer) {
+    GenerationQueue q;
+    for (int i = 0; i < 4; ++i) { q.queue.push(GenerationQueue::frameOf(0)); }
+    std::atomic<bool> pushed = false;
+    std::thread decoder([&q, &pushed] {
+        q.queue.push(GenerationQueue::frameOf(1));
+        pushed = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_FALSE(pushed);
+    ++q.generation;
+    q.queue.discardStale();
+    decoder.join();
+    EXPECT_TRUE(pushed);
+    EXPECT_EQ(q.queue.size(), 1u);
+}
+
+TEST(twinsqueue_test, skip_ignores_stale) {
+    GenerationQueue q;
+    q.queue.push(GenerationQueue::frameOf(0));
+    q.seek();
+    q.queue.push(GenerationQueue::frameOf(1));
+    q.queue.push(GenerationQueue::frameOf(1));
+    q.queue.push(nullptr);
+    int skipped = q.queue.skip([](AVFrame *) { return true; }, [](AVFrame *frame) { av_frame_free(&frame); });
+    EXPECT_EQ(skipped, 2);
+    EXPECT_EQ(q.queue.size(), 1u);
+}
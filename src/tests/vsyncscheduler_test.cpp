@@ -0,0 +1,163 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "vsyncscheduler.hpp"
+
+namespace {
+    constexpr double REFRESH = 1.0 / 60.0;
+
+    /**
+     * 在 60 Hz 的虚拟屏幕上播放 fps 的视频: 每次垂直同步先交换缓冲区, 再为下一次垂直同步选择画面.
+     * setClock 使用真实的时刻计时, 因此虚拟时间从此刻开始.
+     */
+    struct VirtualScreen {
+        VsyncScheduler scheduler;
+        const double t0 = VsyncClock::now();
+        const double fps;
+        std::atomic<bool> interrupt = false;
+        int nextFrame = 0;
+        int vsync = 0;            // 下一次垂直同步的序号
+        std::vector<int> shownAt; // 每个画面开始显示的垂直同步序号
+
+        explicit VirtualScreen(double fps, double offset) : fps(fps) {
+            scheduler.setNominalRate(60.0);
+            scheduler.setActive(true);
+            // 媒体时间比垂直同步超前 offset, 避免 PTS 恰好落在到期判断的边界上
+            scheduler.setClock(offset, 1.0);
+        }
+
+        [[nodiscard]] double vsyncAt(int i) const { return t0 + i * REFRESH; }
+
+        void pushUntil(double media) {
+            while (nextFrame / fps <= media) {
+                VideoFrameRef frame(nullptr, true, nextFrame / fps);
+                ASSERT_TRUE(scheduler.push(frame, interrupt));
+                ++nextFrame;
+            }
+        }
+
+        /**
+         * @param feed 是否继续送入画面
+         */
+        void run(int vsyncs, bool feed = true) {
+            for (const int end = vsync + vsyncs; vsync < end; ++vsync) {
+                scheduler.onVsync(vsyncAt(vsync));
+                if (feed) { pushUntil((vsync + 2) * REFRESH); }
+                // 在两次垂直同步之间同步场景, 画面在下一次垂直同步显示
+                if (scheduler.present(vsyncAt(vsync) + 0.3 * REFRESH)) { shownAt.push_back(vsync + 1); }
+            }
+        }
+    };
+}
+
+TEST(vsyncscheduler_test, clock_tracks_period) {
+    VsyncClock clock;
+    clock.setNominalRate(60.0);
+    const double period = 1.0 / 59.94;
+    for (int i = 0; i < 2000; ++i) { clock.onVsync(i * period); }
+    EXPECT_NEAR(clock.interval(), period, 1e-7);
+    const double last = 1999 * period;
+    EXPECT_NEAR(clock.next(last + 0.3 * period), last + period, 1e-6);
+}
+
+TEST(vsyncscheduler_test, clock_filters_jitter) {
+    VsyncClock clock;
+    clock.setNominalRate(60.0);
+    // 交换时刻有 +-1 ms 的抖动, 预测的垂直同步仍然接近真实的时刻
+    for (int i = 0; i < 2000; ++i) { clock.onVsync(i * REFRESH + 0.001 * ((i * 7919) % 3 - 1)); }
+    EXPECT_NEAR(clock.interval(), REFRESH, 1e-4);
+    for (int i = 2000; i < 2010; ++i) {
+        clock.onVsync(i * REFRESH + 0.001 * ((i * 7919) % 3 - 1));
+        EXPECT_NEAR(clock.next((i + 0.3) * REFRESH), (i + 1) * REFRESH, 0.001);
+    }
+}
+
+TEST(vsyncscheduler_test, clock_skipped_swaps) {
+    VsyncClock clock;
+    clock.setNominalRate(60.0);
+    // 每两个刷新周期交换一次, 周期不会被当作 30 Hz
+    for (int i = 0; i < 200; ++i) { clock.onVsync(i * 2 * REFRESH); }
+    EXPECT_NEAR(clock.interval(), REFRESH, 1e-6);
+    // 长时间没有交换后从新的交换时刻重新确定相位
+    const double resume = 1000.0 + 0.37 * REFRESH;
+    clock.onVsync(resume);
+    EXPECT_NEAR(clock.next(resume + 0.1 * REFRESH), resume + REFRESH, 1e-6);
+}
+
+TEST(vsyncscheduler_test, clock_ignores_bad_rate) {
+    VsyncClock clock;
+    clock.setNominalRate(0.0);
+    clock.setNominalRate(std::numeric_limits<double>::quiet_NaN());
+    clock.setNominalRate(1000.0);
+    EXPECT_DOUBLE_EQ(clock.interval(), REFRESH);
+    clock.setNominalRate(144.0);
+    EXPECT_DOUBLE_EQ(clock.interval(), 1.0 / 144.0);
+}
+
+TEST(vsyncscheduler_test, pulldown_24_on_60) {
+    VirtualScreen screen(24.0, 0.001);
+    screen.run(600);
+    // 24 fps 在 60 Hz 上交替显示 3 个和 2 个刷新周期
+    // 第一次交换之前还不知道垂直同步的相位, 跳过开头的画面
+    ASSERT_GT(screen.shownAt.size(), 200u);
+    for (size_t i = 4; i < screen.shownAt.size(); ++i) {
+        EXPECT_EQ(screen.shownAt[i] - screen.shownAt[i - 2], 5);
+        EXPECT_NE(screen.shownAt[i] - screen.shownAt[i - 1], screen.shownAt[i - 1] - screen.shownAt[i - 2]);
+    }
+    PresentationStats stats = screen.scheduler.stats();
+    EXPECT_EQ(stats.dropped, 0u);
+    EXPECT_EQ(stats.repeated, 0u);
+    EXPECT_EQ(stats.presented, screen.shownAt.size());
+    EXPECT_NEAR(stats.refreshRate, 60.0, 1e-6);
+    // 每帧比 PTS 间隔多或者少半个刷新周期
+    EXPECT_NEAR(stats.judderMs, 0.5 * REFRESH * 1000.0, 0.5);
+    // 画面显示在最接近 PTS 的垂直同步, 偏差不超过半个刷新周期
+    EXPECT_LE(stats.driftP99Ms, 0.5 * REFRESH * 1000.0 + 1.0);
+    EXPECT_GT(stats.driftP99Ms, stats.driftP50Ms - 1e-9);
+}
+
+TEST(vsyncscheduler_test, even_cadence_30_on_60) {
+    VirtualScreen screen(30.0, 0.001);
+    screen.run(600);
+    ASSERT_GT(screen.shownAt.size(), 200u);
+    for (size_t i = 2; i < screen.shownAt.size(); ++i) { EXPECT_EQ(screen.shownAt[i] - screen.shownAt[i - 1], 2); }
+    PresentationStats stats = screen.scheduler.stats();
+    EXPECT_EQ(stats.dropped, 0u);
+    EXPECT_EQ(stats.repeated, 0u);
+    EXPECT_NEAR(stats.judderMs, 0.0, 0.01);
+    // 画面在 PTS 之后 offset 显示
+    EXPECT_NEAR(stats.driftP50Ms, 1.0, 0.1);
+    EXPECT_NEAR(stats.driftP99Ms, 1.0, 0.1);
+    EXPECT_NEAR(stats.lateMs, 1.0, 0.1);
+}
+
+TEST(vsyncscheduler_test, late_frames_dropped_and_repeated) {
+    VirtualScreen screen(30.0, 0.001);
+    screen.run(60);
+    const uint64_t presented = screen.scheduler.stats().presented;
+    // 解码停顿: 画面到期后没有新画面, 每次垂直同步都重复显示
+    screen.run(10, false);
+    PresentationStats stalled = screen.scheduler.stats();
+    EXPECT_EQ(stalled.presented, presented);
+    EXPECT_GE(stalled.repeated, 7u);
+    // 恢复后积压的画面中只显示最后一个到期的画面
+    const int v = screen.vsync;
+    screen.nextFrame = (v - 6) / 2;
+    screen.pushUntil((v - 1) * REFRESH);
+    screen.scheduler.onVsync(screen.vsyncAt(v));
+    ASSERT_TRUE(screen.scheduler.present(screen.vsyncAt(v) + 0.3 * REFRESH).has_value());
+    EXPECT_GT(screen.scheduler.stats().dropped, stalled.dropped);
+}
+
+TEST(vsyncscheduler_test, clear_resets_drift) {
+    VirtualScreen screen(30.0, 0.001);
+    screen.run(60);
+    EXPECT_GT(screen.scheduler.stats().driftP50Ms, 0.0);
+    screen.scheduler.clear();
+    PresentationStats stats = screen.scheduler.stats();
+    EXPECT_EQ(stats.driftP50Ms, 0.0);
+    EXPECT_EQ(stats.driftP99Ms, 0.0);
+    EXPECT_TRUE(std::isnan(screen.scheduler.currentPts()));
+}
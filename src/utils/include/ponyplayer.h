@@ -48,6 +48,9 @@ namespace AnytMusic {
     constexpr PonyThread RENDER   = "RenderThread";
     constexpr PonyThread PREVIEW  = "PreviewThread";
     constexpr PonyThread FRAME    = "FrameControllerThread";
+    constexpr PonyThread AUDIO_DEVICE = "AudioDeviceThread";
+    constexpr PonyThread AUDIO_DSP = "AudioDspThread";
+    constexpr PonyThread CROSSFADE = "CrossfadeThread";
 
     constexpr PonyThread ANY  = "__AnyThread";
     constexpr PonyThread SELF = "__SelfThread";
@@ -77,6 +80,14 @@ namespace AnytMusic {
 #endif
         return home;
     }
+
+    /**
+     * 获取配置文件路径, 配置文件为 ini 格式, 使用 QSettings 读写
+     * @return 配置文件路径
+     */
+    inline QString getConfigFile() {
+        return getHome() + "/config.ini";
+    }
 }
 
 
@@ -6,6 +6,7 @@
 #include <string>
 #include <mutex>
 #include <condition_variable>
+#include <functional>
 #include <utility>
 
 //#define DEBUG_PRINT_FUNCTION_CALL
@@ -24,6 +25,9 @@ class TwinsBlockQueue {
     std::mutex *m_mutex = nullptr;
     std::condition_variable *m_cond = nullptr;
     bool *m_open  = nullptr;
+
+    std::function<bool(T)> m_stale;
+    std::function<void(T)> m_free;
 private:
     TwinsBlockQueue(
             std::string name,
@@ -38,6 +42,30 @@ private:
 
     inline bool isOpen() { return *m_open && m_enable; }
 
+    /**
+     * 移除并释放队首的过期元素, 需要持有锁
+     */
+    void dropStaleLocked() {
+        if (!m_stale) { return; }
+        bool dropped = false;
+        while (!m_data.empty() && m_stale(m_data.front())) {
+            m_free(m_data.front());
+            m_data.pop();
+            dropped = true;
+        }
+        if (dropped) { m_cond->notify_all(); }
+    }
+
+    /**
+     * 等待直到队首有未过期的元素或者队列关闭, 需要持有锁
+     */
+    void waitFrontLocked(std::unique_lock<std::mutex> &lock) {
+        m_cond->wait(lock, [this] {
+            dropStaleLocked();
+            return !this->m_data.empty() || !isOpen();
+        });
+    }
+
 public:
     TwinsBlockQueue(std::string name, size_t prefer) : m_name(std::move(name)), m_prefer(prefer) {
         if (prefer < 2) { throw std::runtime_error("PreferSize must not less than 2."); }
@@ -65,11 +93,37 @@ public:
             m_cond->notify_all();
     }
 
+    /**
+     * 设置过期元素的条件. remove, viewFront 和 skip 遇到队首的过期元素时直接移除并用 freeFunc 释放, 生产者
+     * 不需要停下来清空队列. stale 在持有队列的锁时调用, 不能阻塞.
+     */
+    void setDiscard(std::function<bool(T)> stale, std::function<void(T)> freeFunc) {
+        std::unique_lock lock(*m_mutex);
+        m_stale = std::move(stale);
+        m_free = std::move(freeFunc);
+    }
+
+    /**
+     * 立即移除并释放队首的过期元素, 唤醒等待空位的生产者
+     */
+    void discardStale() {
+        std::unique_lock lock(*m_mutex);
+        dropStaleLocked();
+    }
+
     [[nodiscard]] bool isEnable() const {
         std::unique_lock lock(*m_mutex);
         return m_enable;
     }
 
+    /**
+     * 队列中的元素个数, 用于统计
+     */
+    [[nodiscard]] size_t size() const {
+        std::unique_lock lock(*m_mutex);
+        return m_data.size();
+    }
+
 
     void close() {
         std::unique_lock lock(*m_mutex);
@@ -119,7 +173,7 @@ public:
     R viewFront(const std::function<R(T)> &func) {
         const static T defaultValue = {};
         std::unique_lock lock(*m_mutex);
-        m_cond->wait(lock, [this]{ return !this->m_data.empty() || !isOpen();});
+        waitFrontLocked(lock);
         if (m_data.empty()) {
             return func(defaultValue);
         } else {
@@ -129,7 +183,7 @@ public:
 
     T remove(bool protectNull) {
         std::unique_lock lock(*m_mutex);
-        m_cond->wait(lock, [this]{ return !this->m_data.empty() || !isOpen();});
+        waitFrontLocked(lock);
         if (m_data.empty()) {
             return {};
         } else {
@@ -145,7 +199,7 @@ public:
         int ret = 0;
         while(true) {
             std::unique_lock lock(*m_mutex);
-            m_cond->wait(lock, [this]{ return !this->m_data.empty() || !isOpen();});
+            waitFrontLocked(lock);
             if (m_data.empty()) { return ret;}
             T element = m_data.front();
             if (element && predicate(element)) {
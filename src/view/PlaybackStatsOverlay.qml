@@ -0,0 +1,56 @@
+import QtQuick
+import HurricanePlayer
+
+//播放统计的调试浮层, 截图即可反映播放的情况
+Rectangle {
+    id: overlay
+    property PlaybackStats stats
+    readonly property bool outOfSync: stats && stats.presentedFrames > 0 && stats.driftP95 > 45
+    width: column.implicitWidth + 20
+    height: column.implicitHeight + 16
+    radius: 4
+    color: "#B0000000"
+    Column {
+        id: column
+        anchors.centerIn: parent
+        spacing: 2
+        Text {
+            color: "white"
+            font.family: "monospace"
+            font.pixelSize: 12
+            text: overlay.stats ? (overlay.stats.playing ? "正在播放" : "未播放")
+                                  + "  " + overlay.stats.refreshRate.toFixed(1) + " Hz" : ""
+        }
+        Text {
+            color: overlay.outOfSync ? "#FF6060" : "white"
+            font.family: "monospace"
+            font.pixelSize: 12
+            text: overlay.stats ? "音画偏差 p50/p95/p99: " + overlay.stats.driftP50.toFixed(1) + " / "
+                                  + overlay.stats.driftP95.toFixed(1) + " / "
+                                  + overlay.stats.driftP99.toFixed(1) + " ms" : ""
+        }
+        Text {
+            color: "white"
+            font.family: "monospace"
+            font.pixelSize: 12
+            text: overlay.stats ? "画面 显示/丢弃/重复: " + overlay.stats.presentedFrames + " / "
+                                  + overlay.stats.droppedFrames + " / " + overlay.stats.repeatedFrames
+                                  + "  抖动 " + overlay.stats.judder.toFixed(1) + " ms" : ""
+        }
+        Text {
+            color: "white"
+            font.family: "monospace"
+            font.pixelSize: 12
+            text: overlay.stats ? "解码队列 视频/音频: " + overlay.stats.pictureQueue + " / "
+                                  + overlay.stats.sampleQueue : ""
+        }
+        Text {
+            color: overlay.stats && overlay.stats.underruns > 0 ? "#FFC060" : "white"
+            font.family: "monospace"
+            font.pixelSize: 12
+            text: overlay.stats ? "音频缓冲: " + Math.round(overlay.stats.ringFill * 100) + "% / "
+                                  + overlay.stats.ringSecs.toFixed(2) + " s  欠载 " + overlay.stats.underruns
+                                  + "  不足 " + overlay.stats.partialFills : ""
+        }
+    }
+}
@@ -60,6 +60,10 @@ Rectangle {
         onValueChanged: {
             mainWindow.currentTime=videoSlide.value
         }
+        //拖动时只预览关键帧, 松开后再精确跳转
+        onMoved: {
+            videoArea.scrub(videoSlide.value)
+        }
         onPressedChanged: {
             if(videoSlide.pressed){
                 if(mainWindow.isPlay){
@@ -74,7 +78,7 @@ Rectangle {
                 if(footer.flagForMoved){
                     timer.start()
                 }
-                videoArea.seek(mainWindow.currentTime)
+                videoArea.endScrub(mainWindow.currentTime)
             }
         }
         Shortcut{
@@ -93,6 +97,18 @@ Rectangle {
             sequence: "Right"
             onActivated: IF.forwardFiveSeconds()
         }
+        Shortcut{
+            sequence: "."
+            onActivated: IF.stepFrame(1)
+        }
+        Shortcut{
+            sequence: ","
+            onActivated: IF.stepFrame(-1)
+        }
+        Shortcut{
+            sequence: "L"
+            onActivated: IF.toggleAbLoop()
+        }
     }
     Timer{
         id:timerForThumbnail
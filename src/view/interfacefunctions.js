@@ -54,6 +54,38 @@ function forwardFiveSeconds() {
   videoArea.seek(mainWindow.currentTime);
 }
 
+//逐帧步进, 正在播放时先暂停
+function stepFrame(frames) {
+  if (mainWindow.endTime == 0.0 || !videoArea.hasVideo()) {
+    return;
+  }
+  if (mainWindow.isPlay) {
+    mainWindow.isPlay = false;
+    mainWindow.stop();
+  }
+  videoArea.stepFrame(frames);
+}
+
+function solveFrameStepped(pos) {
+  mainWindow.currentTime = pos;
+  videoSlide.value = mainWindow.currentTime;
+}
+
+//A-B 循环: 第一次标记 A, 第二次标记 B 并开始循环, 循环时取消
+function toggleAbLoop() {
+  if (mainWindow.endTime == 0.0) {
+    return;
+  }
+  if (videoArea.loopStart >= 0) {
+    videoArea.clearLoop();
+  } else if (mainWindow.loopMark < 0) {
+    mainWindow.loopMark = videoArea.getPTS();
+  } else {
+    videoArea.setLoop(mainWindow.loopMark, videoArea.getPTS());
+    mainWindow.loopMark = -1;
+  }
+}
+
 function backOneSecond() {
   if (mainWindow.currentTime == 0.0) {
     return;
@@ -137,6 +169,7 @@ function playModeOnClicked() {
     mainWindow.playState = "ordered";
   }
   mainWindow.playModeChange(playState);
+  prepareNextTrack();
 }
 
 function invertedOnClicked() {
@@ -201,10 +234,16 @@ function videoAreaOnClicked() {
 function mainAreaInit() {
   mainWindow.start.connect(videoArea.start);
   mainWindow.stop.connect(videoArea.pause);
+  // 先设置响度归一化的增益再打开文件
+  mainWindow.openFile.connect(applyReplayGain);
   mainWindow.openFile.connect(videoArea.openFile);
   mainWindow.setSpeed.connect(videoArea.setSpeed);
 }
 
+function applyReplayGain(path) {
+  videoArea.setReplayGain(mediaLibController.getReplayGain(path));
+}
+
 function isBoundary() {
   //左边界
   if (mainWindow.isInverted && mainWindow.currentTime <= 0) {
@@ -279,15 +318,46 @@ function solveStateChanged() {
   }
 }
 
-function nextOnClicked() {
-  console.log("playState:", mainWindow.playState);
+function nextIndex() {
   if (mainWindow.playState === "ordered")
-    listview.currentIndex = (listview.currentIndex + 1) % listview.count;
+    return (listview.currentIndex + 1) % listview.count;
   else if (mainWindow.playState === "random")
-    listview.currentIndex =
+    return (
       (listview.currentIndex + Math.floor(Math.random() * listview.count)) %
-      listview.count;
-  else;
+      listview.count
+    );
+  return listview.currentIndex;
+}
+
+//把下一首告诉播放器, 用于交叉淡化
+function prepareNextTrack() {
+  if (!mainWindow.serialize || listview.count === 0) {
+    mainWindow.nextIndex = -1;
+    videoArea.setNextFile("");
+    return;
+  }
+  mainWindow.nextIndex = nextIndex();
+  videoArea.setNextFile(listModel.get(mainWindow.nextIndex).filePath);
+}
+
+//交叉淡化到中点, 播放器已经开始播放下一首
+function solveTrackAdvanced(url) {
+  if (mainWindow.nextIndex >= 0 && mainWindow.nextIndex < listview.count)
+    listview.currentIndex = mainWindow.nextIndex;
+  console.log("advanced to index:", listview.currentIndex);
+  applyReplayGain(url);
+  mainWindow.endTime = Math.floor(videoArea.getAudioDuration());
+  makeTrackMenu();
+  prepareNextTrack();
+}
+
+function nextOnClicked() {
+  console.log("playState:", mainWindow.playState);
+  //随机播放时使用已经告诉播放器的下一首
+  if (mainWindow.nextIndex >= 0 && mainWindow.nextIndex < listview.count)
+    listview.currentIndex = mainWindow.nextIndex;
+  else listview.currentIndex = nextIndex();
+  mainWindow.nextIndex = -1;
   console.log("index:", listview.currentIndex);
   mainWindow.openFile(listModel.get(listview.currentIndex).filePath);
   mainWindow.endTime = Math.floor(videoArea.getVideoDuration());
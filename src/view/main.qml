@@ -64,6 +64,8 @@ Window {
     property bool isPlay: false
     //音视频的当前时间
     property real currentTime: 0.0
+    //A-B 循环已经标记的 A, 没有标记时为 -1
+    property real loopMark: -1
     //音视频的时间长度
     property real endTime: 0.0
     //播放倍速
@@ -80,6 +82,8 @@ Window {
     property int userHeight: 600
     //播放模式
     property string playState: "ordered"
+    //已经告诉播放器的下一首在列表中的位置, 用于交叉淡化
+    property int nextIndex: -1
     //亮度
     property real brightness: 0.0
     //饱和度
@@ -313,6 +317,7 @@ Window {
                     checked: mainWindow.serialize
                     onTriggered: {
                         mainWindow.serialize = !mainWindow.serialize
+                        IF.prepareNextTrack()
                     }
                 }
 //                Menu {
@@ -673,9 +678,12 @@ SwipeView{
                     IF.nextOnClicked();
                 }
             }
+            onTrackAdvanced: (url)=> IF.solveTrackAdvanced(url)
+            onFrameStepped: (pos)=> IF.solveFrameStepped(pos)
             onStateChanged: IF.solveStateChanged()
             Component.onCompleted: IF.mainAreaInit()
             onOpenFileResult: (result)=> {
+            mainWindow.loopMark = -1
             if(result == PonyPlayerNS.FAILED)
             {
                 operationFailedDialogText.text="文件不存在或文件格式不支持"
@@ -697,6 +705,7 @@ SwipeView{
                     mainWindow.speed=1.0
                     videoArea.setSpeed(mainWindow.speed)
                 }
+                IF.prepareNextTrack()
                 IF.judgeSerialize()
             }
             else if(result == PonyPlayerNS.AUDIO){
@@ -709,6 +718,7 @@ SwipeView{
                 mainWindow.isInverted = false
                 videoArea.forward();
             }
+            IF.prepareNextTrack()
             IF.judgeSerialize()
         }
     }
@@ -773,6 +783,19 @@ Wave{
     }
 }
 }
+//播放统计, 用于诊断播放问题
+PlaybackStatsOverlay{
+    id: statsOverlay
+    stats: videoArea.stats
+    anchors.left: mainArea.left
+    anchors.top: mainArea.top
+    anchors.margins: 10
+    visible: false
+}
+Shortcut{
+    sequence: "Ctrl+Shift+D"
+    onActivated: statsOverlay.visible = !statsOverlay.visible
+}
 }
 
 PonyFooter{